@@ -30,7 +30,8 @@ namespace RayTrace
         const Transform* ObjectToWorld,
         const Transform* WorldToObject,
         bool reverseOrientation,
-        const ParamSet& paramSet);
+        const ParamSet& paramSet,
+        TriangleMeshPtr* compactMesh = nullptr);
 
     // API Macros
 #define VERIFY_INITIALIZED(func)                           \
@@ -81,7 +82,9 @@ namespace RayTrace
         const Transform* object2world,
         const Transform* world2object,
         bool reverseOrientation,
-        const ParamSet& paramSet) {
+        const ParamSet& paramSet,
+        TriangleMeshPtr* compactMesh) {
+        // _compactMesh_ receives triangle and ply meshes instead of their per face shapes
         std::vector<std::shared_ptr<Shape>> shapes;
         TriangleMeshPtr meshPtr;
         std::shared_ptr<Shape> s;
@@ -108,13 +111,13 @@ namespace RayTrace
             shapes.push_back(s);
         else if (name == "plymesh")
             shapes = CreatePLYMesh(object2world, world2object, 
-                reverseOrientation, paramSet, &*graphicsState.floatTextures, &meshPtr );
+                reverseOrientation, paramSet, &*graphicsState.floatTextures, &meshPtr, !compactMesh );
         // Create multiple-_Shape_ types
         else if (name == "curve")
             shapes = CreateCurveShape(object2world, world2object, reverseOrientation, paramSet);
         else if (name == "trianglemesh") {            
                 shapes = CreateTriangleMeshShape(object2world, world2object,
-                    reverseOrientation, paramSet, &*graphicsState.floatTextures, &meshPtr);
+                    reverseOrientation, paramSet, &*graphicsState.floatTextures, &meshPtr, !compactMesh);
         }       
         else if (name == "loopsubdiv")
             shapes = CreateLoopSubdiv(object2world, world2object, reverseOrientation, paramSet);
@@ -124,6 +127,8 @@ namespace RayTrace
             Warning("Shape \"%s\" unknown.", name.c_str());
         if (meshPtr)
             renderOptions->m_meshes.push_back(meshPtr);
+        if (compactMesh && (name == "plymesh" || name == "trianglemesh"))
+            *compactMesh = meshPtr;
         return shapes;
     }
 
@@ -492,6 +497,9 @@ namespace RayTrace
 
         // General \pbrt Initialization
         SampledSpectrum::Init();
+        ParallelInit(PbrtOptions.nThreads);
+        SetSceneCacheDirectory(PbrtOptions.cacheDirectory);
+        SetTextureCacheSize(size_t(PbrtOptions.textureCacheMB) << 20);
     }
 
     void pbrtCleanup() {
@@ -500,7 +508,8 @@ namespace RayTrace
             Error("pbrtCleanup() called without pbrtInit().");
         else if (currentApiState == APIState::WorldBlock)
             Error("pbrtCleanup() called while inside world block.");
-        currentApiState = APIState::Uninitialized;      
+        currentApiState = APIState::Uninitialized;
+        ParallelCleanup();
     }
 
     void pbrtIdentity() {
@@ -852,13 +861,21 @@ namespace RayTrace
             // Create shapes for shape _name_
             Transform* ObjToWorld = transformCache.Lookup(curTransform[0]);
             Transform* WorldToObj = transformCache.Lookup((curTransform[0]).inverted());
+            // Area lights need one shape per face
+            TriangleMeshPtr mesh;
+            const bool compact = PbrtOptions.compactMeshes && graphicsState.areaLight == "";
             std::vector<std::shared_ptr<Shape>> shapes =
                 MakeShapes(name, ObjToWorld, WorldToObj,
-                    graphicsState.reverseOrientation, params);
-            if (shapes.empty()) return;
+                    graphicsState.reverseOrientation, params, compact ? &mesh : nullptr);
+            if (mesh && shapes.empty() && !TriangleMeshPrimitive::CanRepresent(*mesh))
+                shapes = CreateTriangleShapes(ObjToWorld, WorldToObj, graphicsState.reverseOrientation, mesh);
+            if (shapes.empty() && (!mesh || mesh->m_nTriangles == 0)) return;
             std::shared_ptr<Material> mtl = graphicsState.GetMaterialForShape(params);
             params.ReportUnused();
             MediumInterface mi = graphicsState.CreateMediumInterface();
+            if (shapes.empty())
+                prims.push_back(std::make_shared<TriangleMeshPrimitive>(mesh, ObjToWorld, WorldToObj,
+                    graphicsState.reverseOrientation, mtl, mi));
             prims.reserve(shapes.size());
             for (auto s : shapes) {
                 // Possibly create area light for shape
@@ -1046,6 +1063,8 @@ namespace RayTrace
         if (renderOptions->currentInstance)
             Error("ObjectBegin called inside of instance definition");
         renderOptions->instances[name] = std::vector<std::shared_ptr<Primitive>>();
+        // A redefinition gets its own BLAS, instances placed earlier keep the old one
+        renderOptions->instanceBLAS.erase(name);
         renderOptions->currentInstance = &renderOptions->instances[name];
     }
 
@@ -1094,9 +1113,13 @@ namespace RayTrace
         AnimatedTransform animatedInstanceToWorld(
             InstanceToWorld[0], renderOptions->transformStartTime,
             InstanceToWorld[1], renderOptions->transformEndTime);
-        std::shared_ptr<Primitive> prim(
-            std::make_shared<TransformedPrimitive>(in[0], animatedInstanceToWorld));
-        renderOptions->primitives.push_back(prim);
+        // Instances share the BLAS of their definition and are gathered in one TLAS
+        if (!renderOptions->instanceAccel)
+            renderOptions->instanceAccel = std::make_shared<InstanceAccel>();
+        auto blas = renderOptions->instanceBLAS.find(name);
+        if (blas == renderOptions->instanceBLAS.end())
+            blas = renderOptions->instanceBLAS.emplace(name, renderOptions->instanceAccel->AddBLAS(in[0])).first;
+        renderOptions->instanceAccel->AddInstance(blas->second, animatedInstanceToWorld);
     }
 
     void pbrtWorldEnd() {
@@ -1168,9 +1191,21 @@ namespace RayTrace
     }
 
     Scene* RenderOptions::MakeScene() {
-        std::shared_ptr<Primitive> accelerator =
-            MakeAccelerator(AcceleratorName, std::move(primitives), AcceleratorParams);
-        if (!accelerator) accelerator = std::make_shared<BVHAccel>(primitives);
+        std::shared_ptr<Primitive> accelerator;
+        if (!primitives.empty() || !instanceAccel || instanceAccel->GetInstanceCount() == 0) {
+            accelerator = MakeAccelerator(AcceleratorName, std::move(primitives), AcceleratorParams);
+            if (!accelerator) accelerator = std::make_shared<BVHAccel>(primitives);
+        }
+        if (instanceAccel && instanceAccel->GetInstanceCount() > 0) {
+            // Non instanced geometry becomes one more BLAS under an identity instance
+            if (accelerator) {
+                Transform* identity = transformCache.Lookup(Transform());
+                instanceAccel->AddInstance(instanceAccel->AddBLAS(accelerator),
+                    AnimatedTransform(identity, transformStartTime, identity, transformEndTime));
+            }
+            instanceAccel->Commit();
+            accelerator = instanceAccel;
+        }
         Scene* scene = new Scene(accelerator, lights);
         // Erase primitives and lights from _RenderOptions_
         primitives.clear();
@@ -1203,6 +1238,9 @@ namespace RayTrace
         else if (IntegratorName == "path") {
             integrator = CreatePathIntegrator(IntegratorParams, camera, sampler);
         }
+        else if (IntegratorName == "wavefrontpath") {
+            integrator = CreateWavefrontPathIntegrator(IntegratorParams, camera, sampler);
+        }
         else if (IntegratorName == "volpath") {
             integrator = CreateVolPathIntegrator(IntegratorParams, sampler, camera);
         }
@@ -1231,6 +1269,19 @@ namespace RayTrace
                 "\"mlt\".", IntegratorName.c_str());
         }
 
+        if (SamplerIntegrator* samplerIntegrator = dynamic_cast<SamplerIntegrator*>(integrator)) {
+            SamplerIntegrator::ProgressiveSettings progressive;
+            progressive.samplesPerPass = IntegratorParams.FindOneInt("progressivespp", 0);
+            progressive.maxSamplesPerPixel = IntegratorParams.FindOneInt("maxspp", 0);
+            progressive.timeBudgetSeconds = IntegratorParams.FindOneFloat("timebudget", 0.f);
+            samplerIntegrator->SetProgressiveSettings(progressive);
+            SamplerIntegrator::AdaptiveSettings adaptive;
+            adaptive.targetError = IntegratorParams.FindOneFloat("targeterror", 0.f);
+            adaptive.minSamplesPerPixel = IntegratorParams.FindOneInt("adaptiveminspp", 16);
+            adaptive.averageSamplesPerPixel = IntegratorParams.FindOneInt("adaptivebudgetspp", 0);
+            samplerIntegrator->SetAdaptiveSettings(adaptive);
+        }
+
         IntegratorParams.ReportUnused();
         // Warn if no light sources are defined
         if (lights.empty())
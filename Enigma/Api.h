@@ -19,6 +19,15 @@ namespace RayTrace
         bool quickRender = false;
         bool quiet = false;
         bool cat = false, toPly = false;
+        // Trace static triangle meshes through TriangleMeshPrimitive instead of per face primitives
+        bool compactMeshes = true;
+        // Directory for cached BVHs and parsed PLY meshes, empty disables the cache
+        std::string cacheDirectory;
+        // Memory ceiling of paged image texture tiles in MB, 0 keeps every MIP level resident
+        int textureCacheMB = 0;
+        // Limits of the cache shared by all Ptex textures
+        int ptexMaxFiles = 100;
+        int ptexCacheMB = 4096;
         std::string imageFile;
         void* film = nullptr;
         // x0, x1, y0, y1
@@ -92,6 +101,9 @@ namespace RayTrace
         std::vector<std::shared_ptr<Light>> lights;
         std::vector<std::shared_ptr<Primitive>> primitives;
         std::map<std::string, std::vector<std::shared_ptr<Primitive>>> instances;
+        // TLAS over all ObjectInstance uses, with one BLAS per instance name
+        std::shared_ptr<InstanceAccel> instanceAccel;
+        std::map<std::string, int> instanceBLAS;
         
         std::vector<TriangleMeshPtr> m_meshes;
 
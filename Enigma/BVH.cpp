@@ -1,8 +1,14 @@
 #include <assert.h>
+#include <chrono>
+#include <unordered_map>
+#include <immintrin.h>
 #include "BBox.h"
 #include "Memory.h"
 #include "Error.h"
 #include "ParameterSet.h"
+#include "Misc.h"
+#include "Concurrency.h"
+#include "SceneCache.h"
 #include "BVH.h"
 
 
@@ -71,6 +77,188 @@ namespace RayTrace
         uint8_t pad[1];        // ensure 32 byte total size
     };
 
+    // Node with up to N children, child bounds are stored per axis so all slabs are tested at once
+    template <int N>
+    struct alignas(64) WideBVHNode {
+        float    boundsMin[3][N];
+        float    boundsMax[3][N];
+        int32_t  offset[N];        // child node index, or first primitive of a leaf child
+        uint16_t nPrimitives[N];   // > 0 marks a leaf child
+    };
+
+    // Ray data splatted across SIMD lanes once per traversal
+    struct WideRay {
+        explicit WideRay(const Ray& ray) {
+            Vector3f invDir = Inverted(ray.m_dir);
+            for (int a = 0; a < 3; ++a) {
+                dirIsNeg[a] = invDir[a] < 0;
+                org4[a] = _mm_set1_ps(ray.m_origin[a]);
+                invDir4[a] = _mm_set1_ps(invDir[a]);
+#if defined(__AVX__)
+                org8[a] = _mm256_set1_ps(ray.m_origin[a]);
+                invDir8[a] = _mm256_set1_ps(invDir[a]);
+#endif
+            }
+        }
+        __m128 org4[3], invDir4[3];
+#if defined(__AVX__)
+        __m256 org8[3], invDir8[3];
+#endif
+        int    dirIsNeg[3];
+    };
+
+    // Slab test against 4 boxes starting at _lane_, returns the hit lanes as a bit mask.
+    // A NaN from a zero direction component leaves the running interval untouched.
+    template <int N>
+    inline int IntersectBoxes4(const WideBVHNode<N>& node, int lane, const WideRay& r,
+        float tMax, float* tEntry) {
+        const __m128 robust = _mm_set1_ps(1 + 2 * gamma(3));
+        __m128 tNear = _mm_setzero_ps();
+        __m128 tFar = _mm_set1_ps(tMax);
+        for (int a = 0; a < 3; ++a) {
+            const float* nearPlane = r.dirIsNeg[a] ? node.boundsMax[a] : node.boundsMin[a];
+            const float* farPlane = r.dirIsNeg[a] ? node.boundsMin[a] : node.boundsMax[a];
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearPlane + lane), r.org4[a]), r.invDir4[a]);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farPlane + lane), r.org4[a]), r.invDir4[a]);
+            tNear = _mm_max_ps(t0, tNear);
+            tFar = _mm_min_ps(_mm_mul_ps(t1, robust), tFar);
+        }
+        _mm_storeu_ps(tEntry + lane, tNear);
+        return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+    }
+
+    inline int IntersectChildren(const WideBVHNode<4>& node, const WideRay& r, float tMax, float* tEntry) {
+        return IntersectBoxes4(node, 0, r, tMax, tEntry);
+    }
+
+    inline int IntersectChildren(const WideBVHNode<8>& node, const WideRay& r, float tMax, float* tEntry) {
+#if defined(__AVX__)
+        const __m256 robust = _mm256_set1_ps(1 + 2 * gamma(3));
+        __m256 tNear = _mm256_setzero_ps();
+        __m256 tFar = _mm256_set1_ps(tMax);
+        for (int a = 0; a < 3; ++a) {
+            const float* nearPlane = r.dirIsNeg[a] ? node.boundsMax[a] : node.boundsMin[a];
+            const float* farPlane = r.dirIsNeg[a] ? node.boundsMin[a] : node.boundsMax[a];
+            __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearPlane), r.org8[a]), r.invDir8[a]);
+            __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farPlane), r.org8[a]), r.invDir8[a]);
+            tNear = _mm256_max_ps(t0, tNear);
+            tFar = _mm256_min_ps(_mm256_mul_ps(t1, robust), tFar);
+        }
+        _mm256_storeu_ps(tEntry, tNear);
+        return _mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+#else
+        return IntersectBoxes4(node, 0, r, tMax, tEntry) |
+            (IntersectBoxes4(node, 4, r, tMax, tEntry) << 4);
+#endif
+    }
+
+    // Eight rays in SoA layout, inactive lanes get a negative tMax so they never hit a box
+    struct alignas(32) RayPacket8 {
+        RayPacket8(const Ray* rays, uint32_t activeMask) {
+            for (int a = 0; a < 3; ++a)
+                negMask[a] = 0;
+            for (int i = 0; i < RayPacketSize; ++i) {
+                const Ray& ray = rays[i];
+                Vector3f invDir = Inverted(ray.m_dir);
+                for (int a = 0; a < 3; ++a) {
+                    org[a][i] = ray.m_origin[a];
+                    inv[a][i] = invDir[a];
+                    if (invDir[a] < 0) negMask[a] |= 1u << i;
+                }
+                tMax[i] = (activeMask & (1u << i)) ? ray.m_maxT : -InfinityF32;
+            }
+        }
+        float    org[3][RayPacketSize];
+        float    inv[3][RayPacketSize];
+        float    tMax[RayPacketSize];
+        uint32_t negMask[3];    // lanes with a negative direction component per axis
+    };
+
+    // Slab test of one box against 4 packet lanes starting at _lane_
+    inline int IntersectPacket4(const BBox3f& b, const RayPacket8& p, int lane) {
+        const __m128 robust = _mm_set1_ps(1 + 2 * gamma(3));
+        __m128 tNear = _mm_setzero_ps();
+        __m128 tFar = _mm_load_ps(p.tMax + lane);
+        for (int a = 0; a < 3; ++a) {
+            __m128 org = _mm_load_ps(p.org[a] + lane);
+            __m128 inv = _mm_load_ps(p.inv[a] + lane);
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(b.m_min[a]), org), inv);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(b.m_max[a]), org), inv);
+            tNear = _mm_max_ps(_mm_min_ps(t0, t1), tNear);
+            tFar = _mm_min_ps(_mm_mul_ps(_mm_max_ps(t0, t1), robust), tFar);
+        }
+        return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+    }
+
+    inline uint32_t IntersectPacket(const BBox3f& b, const RayPacket8& p) {
+#if defined(__AVX__)
+        const __m256 robust = _mm256_set1_ps(1 + 2 * gamma(3));
+        __m256 tNear = _mm256_setzero_ps();
+        __m256 tFar = _mm256_load_ps(p.tMax);
+        for (int a = 0; a < 3; ++a) {
+            __m256 org = _mm256_load_ps(p.org[a]);
+            __m256 inv = _mm256_load_ps(p.inv[a]);
+            __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(b.m_min[a]), org), inv);
+            __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(b.m_max[a]), org), inv);
+            tNear = _mm256_max_ps(_mm256_min_ps(t0, t1), tNear);
+            tFar = _mm256_min_ps(_mm256_mul_ps(_mm256_max_ps(t0, t1), robust), tFar);
+        }
+        return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+#else
+        return static_cast<uint32_t>(IntersectPacket4(b, p, 0) | (IntersectPacket4(b, p, 4) << 4));
+#endif
+    }
+
+    // Slab test of child _c_ of a wide node against 4 packet lanes starting at _lane_. The near
+    // plane is picked per lane from the direction sign so the inverted bounds of empty slots miss.
+    template <int N>
+    inline int IntersectPacketChild4(const WideBVHNode<N>& node, int c, const RayPacket8& p, int lane,
+        float* tEntry) {
+        const __m128 robust = _mm_set1_ps(1 + 2 * gamma(3));
+        const __m128 zero = _mm_setzero_ps();
+        __m128 tNear = zero;
+        __m128 tFar = _mm_load_ps(p.tMax + lane);
+        for (int a = 0; a < 3; ++a) {
+            __m128 org = _mm_load_ps(p.org[a] + lane);
+            __m128 inv = _mm_load_ps(p.inv[a] + lane);
+            __m128 neg = _mm_cmplt_ps(inv, zero);
+            __m128 bMin = _mm_set1_ps(node.boundsMin[a][c]);
+            __m128 bMax = _mm_set1_ps(node.boundsMax[a][c]);
+            __m128 nearPlane = _mm_or_ps(_mm_and_ps(neg, bMax), _mm_andnot_ps(neg, bMin));
+            __m128 farPlane = _mm_or_ps(_mm_and_ps(neg, bMin), _mm_andnot_ps(neg, bMax));
+            tNear = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(nearPlane, org), inv), tNear);
+            tFar = _mm_min_ps(_mm_mul_ps(_mm_mul_ps(_mm_sub_ps(farPlane, org), inv), robust), tFar);
+        }
+        _mm_storeu_ps(tEntry + lane, tNear);
+        return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+    }
+
+    template <int N>
+    inline uint32_t IntersectPacketChild(const WideBVHNode<N>& node, int c, const RayPacket8& p, float* tEntry) {
+#if defined(__AVX__)
+        const __m256 robust = _mm256_set1_ps(1 + 2 * gamma(3));
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 tNear = zero;
+        __m256 tFar = _mm256_load_ps(p.tMax);
+        for (int a = 0; a < 3; ++a) {
+            __m256 org = _mm256_load_ps(p.org[a]);
+            __m256 inv = _mm256_load_ps(p.inv[a]);
+            __m256 neg = _mm256_cmp_ps(inv, zero, _CMP_LT_OQ);
+            __m256 bMin = _mm256_set1_ps(node.boundsMin[a][c]);
+            __m256 bMax = _mm256_set1_ps(node.boundsMax[a][c]);
+            __m256 nearPlane = _mm256_blendv_ps(bMin, bMax, neg);
+            __m256 farPlane = _mm256_blendv_ps(bMax, bMin, neg);
+            tNear = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(nearPlane, org), inv), tNear);
+            tFar = _mm256_min_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(farPlane, org), inv), robust), tFar);
+        }
+        _mm256_storeu_ps(tEntry, tNear);
+        return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+#else
+        return static_cast<uint32_t>(IntersectPacketChild4(node, c, p, 0, tEntry) |
+            (IntersectPacketChild4(node, c, p, 4, tEntry) << 4));
+#endif
+    }
+
     // BVHAccel Utility Functions
     inline uint32_t LeftShift3(uint32_t x) {
         assert(x <= (1 << 10));
@@ -108,6 +296,13 @@ namespace RayTrace
         static_assert((nBits % bitsPerPass) == 0,
             "Radix sort bitsPerPass must evenly divide nBits");
         constexpr int nPasses = nBits / bitsPerPass;
+        constexpr int nBuckets = 1 << bitsPerPass;
+        constexpr int bitMask = (1 << bitsPerPass) - 1;
+
+        // Every block is counted and scattered by one task, block order keeps the sort stable
+        constexpr int blockSize = 64 * 1024;
+        const int nBlocks = std::max<int>(1, ((int)v->size() + blockSize - 1) / blockSize);
+        std::vector<int> blockOffsets(nBlocks * nBuckets);
 
         for (int pass = 0; pass < nPasses; ++pass) {
             // Perform one pass of radix sort, sorting _bitsPerPass_ bits
@@ -116,76 +311,210 @@ namespace RayTrace
             // Set in and out vector pointers for radix sort pass
             std::vector<MortonPrimitive>& in = (pass & 1) ? tempVector : *v;
             std::vector<MortonPrimitive>& out = (pass & 1) ? *v : tempVector;
+            const int nItems = (int)in.size();
 
-            // Count number of zero bits in array for current radix sort bit
-            constexpr int nBuckets = 1 << bitsPerPass;
-            int bucketCount[nBuckets] = { 0 };
-            constexpr int bitMask = (1 << bitsPerPass) - 1;
-            for (const MortonPrimitive& mp : in) {
-                int bucket = (mp.mortonCode >> lowBit) & bitMask;
-                // CHECK_GE(bucket, 0);
-                 //CHECK_LT(bucket, nBuckets);
-                ++bucketCount[bucket];
-            }
+            // Count number of items per bucket in every block
+            ParallelFor([&](int64_t block) {
+                int* bucketCount = &blockOffsets[block * nBuckets];
+                std::fill(bucketCount, bucketCount + nBuckets, 0);
+                const int end = std::min(nItems, (int)(block + 1) * blockSize);
+                for (int i = (int)block * blockSize; i < end; ++i)
+                    ++bucketCount[(in[i].mortonCode >> lowBit) & bitMask];
+            }, nBlocks);
 
-            // Compute starting index in output array for each bucket
-            int outIndex[nBuckets];
-            outIndex[0] = 0;
-            for (int i = 1; i < nBuckets; ++i)
-                outIndex[i] = outIndex[i - 1] + bucketCount[i - 1];
+            // Compute starting index in output array for each bucket of each block
+            int outIndex = 0;
+            for (int bucket = 0; bucket < nBuckets; ++bucket) {
+                for (int block = 0; block < nBlocks; ++block) {
+                    int count = blockOffsets[block * nBuckets + bucket];
+                    blockOffsets[block * nBuckets + bucket] = outIndex;
+                    outIndex += count;
+                }
+            }
 
             // Store sorted values in output array
-            for (const MortonPrimitive& mp : in) {
-                int bucket = (mp.mortonCode >> lowBit) & bitMask;
-                out[outIndex[bucket]++] = mp;
-            }
+            ParallelFor([&](int64_t block) {
+                int* outOffset = &blockOffsets[block * nBuckets];
+                const int end = std::min(nItems, (int)(block + 1) * blockSize);
+                for (int i = (int)block * blockSize; i < end; ++i) {
+                    int bucket = (in[i].mortonCode >> lowBit) & bitMask;
+                    out[outOffset[bucket]++] = in[i];
+                }
+            }, nBlocks);
         }
         // Copy final result from _tempVector_, if needed
         if ((nPasses & 1) != 0) std::swap(*v, tempVector);
     }
 
+    using BuildClock = std::chrono::high_resolution_clock;
+
+    // Returns the milliseconds since _phaseStart_ and restarts it
+    static double ElapsedMs(BuildClock::time_point& phaseStart) {
+        BuildClock::time_point now = BuildClock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - phaseStart).count();
+        phaseStart = now;
+        return ms;
+    }
+
+    // Smaller BVHs build faster than their cache file is hashed and read
+    static constexpr size_t MinCachedPrimitives = 16 * 1024;
+
     // BVHAccel Method Definitions
     BVHAccel::BVHAccel(PrimitiveVector p,
-        int maxPrimsInNode, SplitMethod splitMethod)
+        int maxPrimsInNode, SplitMethod splitMethod, int width)
         : maxPrimsInNode(std::min(255, maxPrimsInNode)),
         splitMethod(splitMethod),
-        primitives(std::move(p)) {
+        primitives(std::move(p)),
+        width(width) {
         //ProfilePhase _(Prof::AccelConstruction);
+        build();
+    }
+
+    void BVHAccel::build() {
+        FreeAligned(nodes);
+        nodes = nullptr;
+        buildStats = BVHBuildStats();
         if (primitives.empty()) return;
         // Build BVH from _primitives_
+        BuildClock::time_point buildStart = BuildClock::now(),
+                               phaseStart = buildStart;
 
         // Initialize _primitiveInfo_ array for primitives
         std::vector<BVHPrimitiveInfo> primitiveInfo(primitives.size());
-        for (size_t i = 0; i < primitives.size(); ++i)
-            primitiveInfo[i] = { i, primitives[i]->worldBound() };
+        ParallelFor([&](int64_t i) {
+            primitiveInfo[i] = { (size_t)i, primitives[i]->worldBound() };
+        }, primitives.size(), 1024);
+        buildStats.primitiveInfoMs = ElapsedMs(phaseStart);
+
+        // The tree only depends on the primitive bounds and build settings, reuse a cached one
+        uint64_t cacheKey = 0;
+        const bool useCache = !GetSceneCacheDirectory().empty() && primitives.size() >= MinCachedPrimitives;
+        if (useCache) {
+            cacheKey = HashBytes(&maxPrimsInNode, sizeof(maxPrimsInNode), (uint64_t)splitMethod);
+            for (const BVHPrimitiveInfo& info : primitiveInfo)
+                cacheKey = HashBytes(&info.bounds, sizeof(BBox3f), cacheKey);
+            const bool loaded = loadCachedBVH(cacheKey);
+            buildStats.cacheMs = ElapsedMs(phaseStart);
+            if (loaded) {
+                buildWide();
+                buildStats.wideCollapseMs = ElapsedMs(phaseStart);
+                buildStats.loadedFromCache = true;
+                buildStats.totalMs    = std::chrono::duration<double, std::milli>(BuildClock::now() - buildStart).count();
+                buildStats.totalNodes = (int)sahCost.size();
+                return;
+            }
+        }
 
         // Build BVH tree for primitives using _primitiveInfo_
-        MemoryArena arena(1024 * 1024);
-        int totalNodes = 0;
+        // Subtrees are built by whichever thread picks them up, give each its own arena
+        std::vector<std::unique_ptr<MemoryArena>> arenas(MaxThreadIndex());
+        for (auto& threadArena : arenas)
+            threadArena = std::make_unique<MemoryArena>(1024 * 1024);
+        std::atomic<int> atomicTotal(0);
         std::vector<std::shared_ptr<Primitive>> orderedPrims;
-        orderedPrims.reserve(primitives.size());
         BVHBuildNode* root;
-        if (splitMethod == SplitMethod::HLBVH)
-            root = HLBVHBuild(arena, primitiveInfo, &totalNodes, orderedPrims);
-        else
-            root = recursiveBuild(arena, primitiveInfo, 0, primitives.size(), &totalNodes, orderedPrims);
+        {
+            // The top of the tree is built on this thread, it needs an arena slot of its own
+            ThreadSlotScope threadSlot;
+            if (splitMethod == SplitMethod::HLBVH)
+                root = HLBVHBuild(arenas, primitiveInfo, &atomicTotal, orderedPrims, &buildStats);
+            else {
+                orderedPrims.resize(primitives.size());
+                root = recursiveBuild(arenas, primitiveInfo, 0, primitives.size(), &atomicTotal, orderedPrims);
+                buildStats.recursiveBuildMs = ElapsedMs(phaseStart);
+            }
+        }
+        int totalNodes = atomicTotal;
         primitives.swap(orderedPrims);
         primitiveInfo.resize(0);
-        /*  LOG(INFO) << StringPrintf("BVH created with %d nodes for %d "
-              "primitives (%.2f MB), arena allocated %.2f MB",*/
-              /*totalNodes, (int)primitives.size(),
-              float(totalNodes * sizeof(LinearBVHNode)) /
-              (1024.f * 1024.f),
-              float(arena.TotalAllocated()) /
-              (1024.f * 1024.f));*/
-
-              // Compute representation of depth-first traversal of BVH tree
-             // treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
-              //    primitives.size() * sizeof(primitives[0]);
+
+        // Compute representation of depth-first traversal of BVH tree
+        phaseStart = BuildClock::now();
         nodes = AllocAligned<LinearBVHNode>(totalNodes);
         int offset = 0;
         flattenBVHTree(root, &offset);
         //   CHECK_EQ(totalNodes, offset);
+        sahCost.resize(totalNodes);
+        computeSAHCost(0);
+        buildStats.flattenMs  = ElapsedMs(phaseStart);
+        if (useCache) {
+            // _orderedPrims_ holds the input order after the swap above
+            storeCachedBVH(cacheKey, orderedPrims, totalNodes);
+            buildStats.cacheMs += ElapsedMs(phaseStart);
+        }
+
+        buildWide();
+        buildStats.wideCollapseMs = ElapsedMs(phaseStart);
+        buildStats.totalMs    = std::chrono::duration<double, std::milli>(BuildClock::now() - buildStart).count();
+        buildStats.totalNodes = totalNodes;
+    }
+
+    // Cache chunks: header, flattened nodes, input index of each ordered primitive, per node SAH cost
+    struct BVHCacheHeader {
+        uint32_t nNodes;
+        uint32_t nPrimitives;
+    };
+
+    bool BVHAccel::loadCachedBVH(uint64_t key) {
+        std::vector<SceneCacheChunk> chunks;
+        std::unique_ptr<MappedFile> file = ReadSceneCache("bvh", key, &chunks);
+        if (!file || chunks.size() != 4 || chunks[0].size != sizeof(BVHCacheHeader))
+            return false;
+        BVHCacheHeader header;
+        memcpy(&header, chunks[0].data, sizeof(header));
+        const size_t nNodes = header.nNodes;
+        if (nNodes == 0 || header.nPrimitives != primitives.size() ||
+            chunks[1].size != nNodes * sizeof(LinearBVHNode) ||
+            chunks[2].size != primitives.size() * sizeof(uint32_t) ||
+            chunks[3].size != nNodes * sizeof(float))
+            return false;
+        const uint32_t* primIndices = (const uint32_t*)chunks[2].data;
+        for (size_t i = 0; i < primitives.size(); ++i)
+            if (primIndices[i] >= primitives.size())
+                return false;
+
+        nodes = AllocAligned<LinearBVHNode>(nNodes);
+        memcpy(nodes, chunks[1].data, chunks[1].size);
+        PrimitiveVector orderedPrims(primitives.size());
+        for (size_t i = 0; i < primitives.size(); ++i)
+            orderedPrims[i] = primitives[primIndices[i]];
+        primitives.swap(orderedPrims);
+        sahCost.assign((const float*)chunks[3].data, (const float*)chunks[3].data + nNodes);
+        return true;
+    }
+
+    void BVHAccel::storeCachedBVH(uint64_t key, const PrimitiveVector& inputPrims, int totalNodes) const {
+        std::unordered_map<const Primitive*, uint32_t> inputIndex(inputPrims.size());
+        for (size_t i = 0; i < inputPrims.size(); ++i)
+            inputIndex.emplace(inputPrims[i].get(), (uint32_t)i);
+        std::vector<uint32_t> primIndices(primitives.size());
+        for (size_t i = 0; i < primitives.size(); ++i)
+            primIndices[i] = inputIndex[primitives[i].get()];
+        const BVHCacheHeader header = { (uint32_t)totalNodes, (uint32_t)primitives.size() };
+        WriteSceneCache("bvh", key, {
+            { &header, sizeof(header) },
+            { nodes, size_t(totalNodes) * sizeof(LinearBVHNode) },
+            { primIndices.data(), primIndices.size() * sizeof(uint32_t) },
+            { sahCost.data(), size_t(totalNodes) * sizeof(float) } });
+    }
+
+    void BVHAccel::buildWide() {
+        FreeAligned(wideNodes4);
+        FreeAligned(wideNodes8);
+        wideNodes4 = nullptr;
+        wideNodes8 = nullptr;
+        if (width == 4) {
+            std::vector<WideBVHNode<4>> wide;
+            collapseWideBVH(wide, 0);
+            wideNodes4 = AllocAligned<WideBVHNode<4>>(wide.size());
+            std::copy(wide.begin(), wide.end(), wideNodes4);
+        }
+        else if (width == 8) {
+            std::vector<WideBVHNode<8>> wide;
+            collapseWideBVH(wide, 0);
+            wideNodes8 = AllocAligned<WideBVHNode<8>>(wide.size());
+            std::copy(wide.begin(), wide.end(), wideNodes8);
+        }
     }
 
     BBox3f BVHAccel::worldBound() const {
@@ -197,201 +526,253 @@ namespace RayTrace
         BBox3f bounds;
     };
 
+    // Ranges with at least this many primitives build their two children as parallel tasks
+    static constexpr int ParallelBuildThreshold = 4 * 1024;
+    // Ranges with at least this many primitives compute bounds and SAH buckets in parallel
+    static constexpr int ParallelBinningThreshold = 64 * 1024;
+    static constexpr int BinningBlockSize = 16 * 1024;
+    static constexpr int nSAHBuckets = 12;
+
+    // Ranges with at least this many treelets build the two halves of the HLBVH upper tree in parallel
+    static constexpr int ParallelUpperSAHThreshold = 64;
+
+    // Cost of splitting after each bucket, sweeping once from either side
+    static void ComputeSAHCosts(const BucketInfo buckets[nSAHBuckets], const BBox3f& bounds,
+        float traversalCost, float cost[nSAHBuckets - 1]) {
+        int   countBelow[nSAHBuckets - 1];
+        float areaBelow[nSAHBuckets - 1];
+        BBox3f b0, b1;
+        int count0 = 0, count1 = 0;
+        for (int i = 0; i < nSAHBuckets - 1; ++i) {
+            b0 = Union(b0, buckets[i].bounds);
+            count0 += buckets[i].count;
+            countBelow[i] = count0;
+            areaBelow[i] = b0.surfaceArea();
+        }
+        for (int i = nSAHBuckets - 1; i > 0; --i) {
+            b1 = Union(b1, buckets[i].bounds);
+            count1 += buckets[i].count;
+            cost[i - 1] = traversalCost +
+                (countBelow[i - 1] * areaBelow[i - 1] +
+                    count1 * b1.surfaceArea()) /
+                bounds.surfaceArea();
+        }
+    }
+
+    static void ComputeRangeBounds(const PrimInfoVector& primitiveInfo,
+        int start, int end, BBox3f* bounds, BBox3f* centroidBounds) {
+        auto accumulate = [&](int first, int last, BBox3f* b, BBox3f* cb) {
+            for (int i = first; i < last; ++i) {
+                *b = Union(*b, primitiveInfo[i].bounds);
+                *cb = Union(*cb, primitiveInfo[i].centroid);
+            }
+        };
+        if (end - start < ParallelBinningThreshold) {
+            accumulate(start, end, bounds, centroidBounds);
+            return;
+        }
+
+        const int nBlocks = (end - start + BinningBlockSize - 1) / BinningBlockSize;
+        std::vector<BBox3f> blockBounds(nBlocks), blockCentroidBounds(nBlocks);
+        ParallelFor([&](int64_t block) {
+            int first = start + (int)block * BinningBlockSize;
+            accumulate(first, std::min(end, first + BinningBlockSize),
+                &blockBounds[block], &blockCentroidBounds[block]);
+        }, nBlocks);
+        for (int block = 0; block < nBlocks; ++block) {
+            *bounds = Union(*bounds, blockBounds[block]);
+            *centroidBounds = Union(*centroidBounds, blockCentroidBounds[block]);
+        }
+    }
+
+    static void ComputeSAHBuckets(const PrimInfoVector& primitiveInfo,
+        int start, int end, const BBox3f& centroidBounds, int dim,
+        BucketInfo buckets[nSAHBuckets]) {
+        auto fill = [&](int first, int last, BucketInfo* b) {
+            for (int i = first; i < last; ++i) {
+                int bucket = nSAHBuckets * centroidBounds.offset(primitiveInfo[i].centroid)[dim];
+                if (bucket == nSAHBuckets) bucket = nSAHBuckets - 1;
+                b[bucket].count++;
+                b[bucket].bounds = Union(b[bucket].bounds, primitiveInfo[i].bounds);
+            }
+        };
+        if (end - start < ParallelBinningThreshold) {
+            fill(start, end, buckets);
+            return;
+        }
+
+        const int nBlocks = (end - start + BinningBlockSize - 1) / BinningBlockSize;
+        std::vector<std::array<BucketInfo, nSAHBuckets>> blockBuckets(nBlocks);
+        ParallelFor([&](int64_t block) {
+            int first = start + (int)block * BinningBlockSize;
+            fill(first, std::min(end, first + BinningBlockSize), blockBuckets[block].data());
+        }, nBlocks);
+        for (int block = 0; block < nBlocks; ++block) {
+            for (int b = 0; b < nSAHBuckets; ++b) {
+                buckets[b].count += blockBuckets[block][b].count;
+                buckets[b].bounds = Union(buckets[b].bounds, blockBuckets[block][b].bounds);
+            }
+        }
+    }
+
     BVHBuildNode* BVHAccel::recursiveBuild(
-        MemoryArena& arena,
+        std::vector<std::unique_ptr<MemoryArena>>& arenas,
         PrimInfoVector& primitiveInfo,
-        int start, int end, int* totalNodes, PrimitiveVector& orderedPrims) {
+        int start, int end, std::atomic<int>* totalNodes, PrimitiveVector& orderedPrims) {
         //  CHECK_NE(start, end);
-        BVHBuildNode* node = arena.Alloc<BVHBuildNode>();
+        BVHBuildNode* node = arenas[ThreadIndex()]->Alloc<BVHBuildNode>();
         (*totalNodes)++;
-        // Compute bounds of all primitives in BVH node
-        BBox3f bounds;
-        for (int i = start; i < end; ++i)
-            bounds = Union(bounds, primitiveInfo[i].bounds);
+        // Compute bounds of all primitives and their centroids in BVH node
+        BBox3f bounds, centroidBounds;
+        ComputeRangeBounds(primitiveInfo, start, end, &bounds, &centroidBounds);
         int nPrimitives = end - start;
-        if (nPrimitives == 1) {
-            // Create leaf _BVHBuildNode_
-            int firstPrimOffset = orderedPrims.size();
-            for (int i = start; i < end; ++i) {
-                int primNum = primitiveInfo[i].primitiveNumber;
-                orderedPrims.push_back(primitives[primNum]);
-            }
-            node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
+
+        // Leaves keep the primitives at their _primitiveInfo_ position, ranges never overlap
+        auto createLeaf = [&]() {
+            for (int i = start; i < end; ++i)
+                orderedPrims[i] = primitives[primitiveInfo[i].primitiveNumber];
+            node->InitLeaf(start, nPrimitives, bounds);
             return node;
+        };
+
+        if (nPrimitives == 1)
+            return createLeaf();
+
+        // Choose split dimension _dim_
+        int dim = centroidBounds.maximumExtent();
+
+        // Partition primitives into two sets and build children
+        int mid = (start + end) / 2;
+        if (centroidBounds.m_max[dim] == centroidBounds.m_min[dim])
+            return createLeaf();
+
+        // Partition primitives based on _splitMethod_
+        switch (splitMethod) {
+        case SplitMethod::Middle: {
+            // Partition primitives through node's midpoint
+            float pmid =
+                (centroidBounds.m_min[dim] + centroidBounds.m_max[dim]) / 2;
+            BVHPrimitiveInfo* midPtr = std::partition(
+                &primitiveInfo[start], &primitiveInfo[end - 1] + 1,
+                [dim, pmid](const BVHPrimitiveInfo& pi) {
+                    return pi.centroid[dim] < pmid;
+                });
+            mid = midPtr - &primitiveInfo[0];
+            // For lots of prims with large overlapping bounding boxes, this
+            // may fail to partition; in that case don't break and fall
+            // through
+            // to EqualCounts.
+            if (mid != start && mid != end) break;
         }
-        else {
-            // Compute bound of primitive centroids, choose split dimension _dim_
-            BBox3f centroidBounds;
-            for (int i = start; i < end; ++i)
-                centroidBounds = Union(centroidBounds, primitiveInfo[i].centroid);
-            int dim = centroidBounds.maximumExtent();
-
-            // Partition primitives into two sets and build children
-            int mid = (start + end) / 2;
-            if (centroidBounds.m_max[dim] == centroidBounds.m_min[dim]) {
-                // Create leaf _BVHBuildNode_
-                int firstPrimOffset = orderedPrims.size();
-                for (int i = start; i < end; ++i) {
-                    int primNum = primitiveInfo[i].primitiveNumber;
-                    orderedPrims.push_back(primitives[primNum]);
-                }
-                node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
-                return node;
+        case SplitMethod::EqualCounts: {
+            // Partition primitives into equally-sized subsets
+            mid = (start + end) / 2;
+            std::nth_element(&primitiveInfo[start], &primitiveInfo[mid],
+                &primitiveInfo[end - 1] + 1,
+                [dim](const BVHPrimitiveInfo& a,
+                    const BVHPrimitiveInfo& b) {
+                        return a.centroid[dim] < b.centroid[dim];
+                });
+            break;
+        }
+        case SplitMethod::SAH:
+        default: {
+            // Partition primitives using approximate SAH
+            if (nPrimitives <= 2) {
+                // Partition primitives into equally-sized subsets
+                mid = (start + end) / 2;
+                std::nth_element(&primitiveInfo[start], &primitiveInfo[mid],
+                    &primitiveInfo[end - 1] + 1,
+                    [dim](const BVHPrimitiveInfo& a,
+                        const BVHPrimitiveInfo& b) {
+                            return a.centroid[dim] <
+                                b.centroid[dim];
+                    });
             }
             else {
-                // Partition primitives based on _splitMethod_
-                switch (splitMethod) {
-                case SplitMethod::Middle: {
-                    // Partition primitives through node's midpoint
-                    float pmid =
-                        (centroidBounds.m_min[dim] + centroidBounds.m_max[dim]) / 2;
-                    BVHPrimitiveInfo* midPtr = std::partition(
-                        &primitiveInfo[start], &primitiveInfo[end - 1] + 1,
-                        [dim, pmid](const BVHPrimitiveInfo& pi) {
-                            return pi.centroid[dim] < pmid;
-                        });
-                    mid = midPtr - &primitiveInfo[0];
-                    // For lots of prims with large overlapping bounding boxes, this
-                    // may fail to partition; in that case don't break and fall
-                    // through
-                    // to EqualCounts.
-                    if (mid != start && mid != end) break;
-                }
-                case SplitMethod::EqualCounts: {
-                    // Partition primitives into equally-sized subsets
-                    mid = (start + end) / 2;
-                    std::nth_element(&primitiveInfo[start], &primitiveInfo[mid],
-                        &primitiveInfo[end - 1] + 1,
-                        [dim](const BVHPrimitiveInfo& a,
-                            const BVHPrimitiveInfo& b) {
-                                return a.centroid[dim] < b.centroid[dim];
-                        });
-                    break;
-                }
-                case SplitMethod::SAH:
-                default: {
-                    // Partition primitives using approximate SAH
-                    if (nPrimitives <= 2) {
-                        // Partition primitives into equally-sized subsets
-                        mid = (start + end) / 2;
-                        std::nth_element(&primitiveInfo[start], &primitiveInfo[mid],
-                            &primitiveInfo[end - 1] + 1,
-                            [dim](const BVHPrimitiveInfo& a,
-                                const BVHPrimitiveInfo& b) {
-                                    return a.centroid[dim] <
-                                        b.centroid[dim];
-                            });
-                    }
-                    else {
-                        // Allocate _BucketInfo_ for SAH partition buckets
-                        constexpr int nBuckets = 12;
-                        BucketInfo buckets[nBuckets];
-
-                        // Initialize _BucketInfo_ for SAH partition buckets
-                        for (int i = start; i < end; ++i) {
-                            int b = nBuckets *
-                                centroidBounds.offset(
-                                    primitiveInfo[i].centroid)[dim];
-                            if (b == nBuckets) b = nBuckets - 1;
-                            // CHECK_GE(b, 0);
-                             //CHECK_LT(b, nBuckets);
-                            buckets[b].count++;
-                            buckets[b].bounds =
-                                Union(buckets[b].bounds, primitiveInfo[i].bounds);
-                        }
-
-                        // Compute costs for splitting after each bucket
-                        float cost[nBuckets - 1];
-                        for (int i = 0; i < nBuckets - 1; ++i) {
-                            BBox3f b0, b1;
-                            int count0 = 0, count1 = 0;
-                            for (int j = 0; j <= i; ++j) {
-                                b0 = Union(b0, buckets[j].bounds);
-                                count0 += buckets[j].count;
-                            }
-                            for (int j = i + 1; j < nBuckets; ++j) {
-                                b1 = Union(b1, buckets[j].bounds);
-                                count1 += buckets[j].count;
-                            }
-                            cost[i] = 1 +
-                                (count0 * b0.surfaceArea() +
-                                    count1 * b1.surfaceArea()) /
-                                bounds.surfaceArea();
-                        }
+                // Initialize _BucketInfo_ for SAH partition buckets
+                BucketInfo buckets[nSAHBuckets];
+                ComputeSAHBuckets(primitiveInfo, start, end, centroidBounds, dim, buckets);
 
-                        // Find bucket to split at that minimizes SAH metric
-                        float minCost = cost[0];
-                        int minCostSplitBucket = 0;
-                        for (int i = 1; i < nBuckets - 1; ++i) {
-                            if (cost[i] < minCost) {
-                                minCost = cost[i];
-                                minCostSplitBucket = i;
-                            }
-                        }
+                // Compute costs for splitting after each bucket
+                float cost[nSAHBuckets - 1];
+                ComputeSAHCosts(buckets, bounds, 1, cost);
 
-                        // Either create leaf or split primitives at selected SAH
-                        // bucket
-                        float leafCost = nPrimitives;
-                        if (nPrimitives > maxPrimsInNode || minCost < leafCost) {
-                            BVHPrimitiveInfo* pmid = std::partition(
-                                &primitiveInfo[start], &primitiveInfo[end - 1] + 1,
-                                [=](const BVHPrimitiveInfo& pi) {
-                                    int b = nBuckets *
-                                        centroidBounds.offset(pi.centroid)[dim];
-                                    if (b == nBuckets) b = nBuckets - 1;
-                                    //CHECK_GE(b, 0);
-                                    //CHECK_LT(b, nBuckets);
-                                    return b <= minCostSplitBucket;
-                                });
-                            mid = pmid - &primitiveInfo[0];
-                        }
-                        else {
-                            // Create leaf _BVHBuildNode_
-                            int firstPrimOffset = orderedPrims.size();
-                            for (int i = start; i < end; ++i) {
-                                int primNum = primitiveInfo[i].primitiveNumber;
-                                orderedPrims.push_back(primitives[primNum]);
-                            }
-                            node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
-                            return node;
-                        }
+                // Find bucket to split at that minimizes SAH metric
+                float minCost = cost[0];
+                int minCostSplitBucket = 0;
+                for (int i = 1; i < nSAHBuckets - 1; ++i) {
+                    if (cost[i] < minCost) {
+                        minCost = cost[i];
+                        minCostSplitBucket = i;
                     }
-                    break;
                 }
+
+                // Either create leaf or split primitives at selected SAH
+                // bucket
+                float leafCost = nPrimitives;
+                if (nPrimitives > maxPrimsInNode || minCost < leafCost) {
+                    BVHPrimitiveInfo* pmid = std::partition(
+                        &primitiveInfo[start], &primitiveInfo[end - 1] + 1,
+                        [=](const BVHPrimitiveInfo& pi) {
+                            int b = nSAHBuckets *
+                                centroidBounds.offset(pi.centroid)[dim];
+                            if (b == nSAHBuckets) b = nSAHBuckets - 1;
+                            //CHECK_GE(b, 0);
+                            //CHECK_LT(b, nBuckets);
+                            return b <= minCostSplitBucket;
+                        });
+                    mid = pmid - &primitiveInfo[0];
                 }
-                node->InitInterior(dim,
-                    recursiveBuild(arena, primitiveInfo, start, mid,
-                        totalNodes, orderedPrims),
-                    recursiveBuild(arena, primitiveInfo, mid, end,
-                        totalNodes, orderedPrims));
+                else
+                    return createLeaf();
             }
+            break;
+        }
+        }
+
+        // Large subtrees are built as two tasks, the pool steals whichever half is idle
+        BVHBuildNode* children[2];
+        if (nPrimitives >= ParallelBuildThreshold) {
+            ParallelFor([&](int64_t child) {
+                children[child] = child == 0
+                    ? recursiveBuild(arenas, primitiveInfo, start, mid, totalNodes, orderedPrims)
+                    : recursiveBuild(arenas, primitiveInfo, mid, end, totalNodes, orderedPrims);
+            }, 2);
+        }
+        else {
+            children[0] = recursiveBuild(arenas, primitiveInfo, start, mid, totalNodes, orderedPrims);
+            children[1] = recursiveBuild(arenas, primitiveInfo, mid, end, totalNodes, orderedPrims);
         }
+        node->InitInterior(dim, children[0], children[1]);
         return node;
     }
 
     BVHBuildNode* BVHAccel::HLBVHBuild(
-        MemoryArena& arena, const PrimInfoVector& primitiveInfo,
-        int* totalNodes,
-        PrimitiveVector& orderedPrims) const {
+        std::vector<std::unique_ptr<MemoryArena>>& arenas, const PrimInfoVector& primitiveInfo,
+        std::atomic<int>* totalNodes,
+        PrimitiveVector& orderedPrims,
+        BVHBuildStats* stats) const {
+        BuildClock::time_point phaseStart = BuildClock::now();
         // Compute bounding box of all primitive centroids
-        BBox3f bounds;
-        for (const BVHPrimitiveInfo& pi : primitiveInfo)
-            bounds = Union(bounds, pi.centroid);
+        BBox3f primBounds, bounds;
+        ComputeRangeBounds(primitiveInfo, 0, primitiveInfo.size(), &primBounds, &bounds);
 
         // Compute Morton indices of primitives
         std::vector<MortonPrimitive> mortonPrims(primitiveInfo.size());
-        // ParallelFor([&](int i)
-        for (int i = 0; i < primitiveInfo.size(); ++i)
-        {
+        ParallelFor([&](int64_t i) {
             // Initialize _mortonPrims[i]_ for _i_th primitive
             constexpr int mortonBits = 10;
             constexpr int mortonScale = 1 << mortonBits;
             mortonPrims[i].primitiveIndex = primitiveInfo[i].primitiveNumber;
             Vector3f centroidOffset = bounds.offset(primitiveInfo[i].centroid);
             mortonPrims[i].mortonCode = EncodeMorton3(centroidOffset * (float)mortonScale);
-        }
+        }, primitiveInfo.size(), 512);
+        stats->mortonMs = ElapsedMs(phaseStart);
+
         // Radix sort primitive Morton indices
         RadixSort(&mortonPrims);
+        stats->radixSortMs = ElapsedMs(phaseStart);
 
         // Create LBVH treelets at bottom of BVH
 
@@ -409,22 +790,18 @@ namespace RayTrace
                 // Add entry to _treeletsToBuild_ for this treelet
                 int nPrimitives = end - start;
                 int maxBVHNodes = 2 * nPrimitives;
-                BVHBuildNode* pnodes = arena.Alloc<BVHBuildNode>(maxBVHNodes, false);
+                BVHBuildNode* pnodes = arenas[ThreadIndex()]->Alloc<BVHBuildNode>(maxBVHNodes, false);
                 treeletsToBuild.push_back({ start, nPrimitives, pnodes });
                 start = end;
             }
         }
 
         // Create LBVHs for treelets in parallel
-        std::atomic<int> atomicTotal(0),
-            orderedPrimsOffset(0);
+        std::atomic<int> orderedPrimsOffset(0);
         orderedPrims.resize(primitives.size());
 
-        for (int i = 0; i < treeletsToBuild.size(); ++i)
-        {
-
-            //ParallelFor([&](int i) {
-                // Generate _i_th LBVH treelet
+        ParallelFor([&](int64_t i) {
+            // Generate _i_th LBVH treelet
             int nodesCreated = 0;
             const int firstBitIndex = 29 - 12;
             LBVHTreelet& tr = treeletsToBuild[i];
@@ -432,17 +809,19 @@ namespace RayTrace
                 emitLBVH(tr.buildNodes, primitiveInfo, &mortonPrims[tr.startIndex],
                     tr.nPrimitives, &nodesCreated, orderedPrims,
                     &orderedPrimsOffset, firstBitIndex);
-            atomicTotal += nodesCreated;
-        }//, treeletsToBuild.size());
+            *totalNodes += nodesCreated;
+        }, treeletsToBuild.size());
 
-        *totalNodes = atomicTotal;
+        stats->treeletMs = ElapsedMs(phaseStart);
 
         // Create and return SAH BVH from LBVH treelets
         std::vector<BVHBuildNode*> finishedTreelets;
         finishedTreelets.reserve(treeletsToBuild.size());
         for (LBVHTreelet& treelet : treeletsToBuild)
             finishedTreelets.push_back(treelet.buildNodes);
-        return buildUpperSAH(arena, finishedTreelets, 0, finishedTreelets.size(), totalNodes);
+        BVHBuildNode* root = buildUpperSAH(arenas, finishedTreelets, 0, finishedTreelets.size(), totalNodes);
+        stats->upperSAHMs = ElapsedMs(phaseStart);
+        return root;
     }
 
     BVHBuildNode* BVHAccel::emitLBVH(
@@ -511,15 +890,15 @@ namespace RayTrace
         }
     }
 
-    BVHBuildNode* BVHAccel::buildUpperSAH(MemoryArena& arena,
+    BVHBuildNode* BVHAccel::buildUpperSAH(std::vector<std::unique_ptr<MemoryArena>>& arenas,
         std::vector<BVHBuildNode*>& treeletRoots,
         int start, int end,
-        int* totalNodes) const {
+        std::atomic<int>* totalNodes) const {
         //CHECK_LT(start, end);
         int nNodes = end - start;
         if (nNodes == 1) return treeletRoots[start];
         (*totalNodes)++;
-        BVHBuildNode* node = arena.Alloc<BVHBuildNode>();
+        BVHBuildNode* node = arenas[ThreadIndex()]->Alloc<BVHBuildNode>();
 
         // Compute bounds of all nodes under this HLBVH node
         BBox3f bounds;
@@ -539,23 +918,16 @@ namespace RayTrace
         // Make sure the SAH split below does something... ?
         //CHECK_NE(centroidBounds.m_max[dim], centroidBounds.m_min[dim]);
 
-        // Allocate _BucketInfo_ for SAH partition buckets
-        constexpr int nBuckets = 12;
-        struct BucketInfo {
-            int count = 0;
-            BBox3f bounds;
-        };
-        BucketInfo buckets[nBuckets];
-
         // Initialize _BucketInfo_ for HLBVH SAH partition buckets
+        BucketInfo buckets[nSAHBuckets];
         for (int i = start; i < end; ++i) {
             float centroid = (treeletRoots[i]->bounds.m_min[dim] +
                 treeletRoots[i]->bounds.m_max[dim]) *
                 0.5f;
             int b =
-                nBuckets * ((centroid - centroidBounds.m_min[dim]) /
+                nSAHBuckets * ((centroid - centroidBounds.m_min[dim]) /
                     (centroidBounds.m_max[dim] - centroidBounds.m_min[dim]));
-            if (b == nBuckets) b = nBuckets - 1;
+            if (b == nSAHBuckets) b = nSAHBuckets - 1;
             //CHECK_GE(b, 0);
            // CHECK_LT(b, nBuckets);
             buckets[b].count++;
@@ -563,27 +935,13 @@ namespace RayTrace
         }
 
         // Compute costs for splitting after each bucket
-        float cost[nBuckets - 1];
-        for (int i = 0; i < nBuckets - 1; ++i) {
-            BBox3f b0, b1;
-            int count0 = 0, count1 = 0;
-            for (int j = 0; j <= i; ++j) {
-                b0 = Union(b0, buckets[j].bounds);
-                count0 += buckets[j].count;
-            }
-            for (int j = i + 1; j < nBuckets; ++j) {
-                b1 = Union(b1, buckets[j].bounds);
-                count1 += buckets[j].count;
-            }
-            cost[i] = .125f +
-                (count0 * b0.surfaceArea() + count1 * b1.surfaceArea()) /
-                bounds.surfaceArea();
-        }
+        float cost[nSAHBuckets - 1];
+        ComputeSAHCosts(buckets, bounds, .125f, cost);
 
         // Find bucket to split at that minimizes SAH metric
         float minCost = cost[0];
         int minCostSplitBucket = 0;
-        for (int i = 1; i < nBuckets - 1; ++i) {
+        for (int i = 1; i < nSAHBuckets - 1; ++i) {
             if (cost[i] < minCost) {
                 minCost = cost[i];
                 minCostSplitBucket = i;
@@ -596,10 +954,10 @@ namespace RayTrace
             [=](const BVHBuildNode* node) {
                 float centroid =
                     (node->bounds.m_min[dim] + node->bounds.m_max[dim]) * 0.5f;
-                int b = nBuckets *
+                int b = nSAHBuckets *
                     ((centroid - centroidBounds.m_min[dim]) /
                         (centroidBounds.m_max[dim] - centroidBounds.m_min[dim]));
-                if (b == nBuckets) b = nBuckets - 1;
+                if (b == nSAHBuckets) b = nSAHBuckets - 1;
                 // CHECK_GE(b, 0);
                //  CHECK_LT(b, nBuckets);
                 return b <= minCostSplitBucket;
@@ -607,9 +965,21 @@ namespace RayTrace
         int mid = pmid - &treeletRoots[0];
         // CHECK_GT(mid, start);
        //  CHECK_LT(mid, end);
-        node->InitInterior(
-            dim, this->buildUpperSAH(arena, treeletRoots, start, mid, totalNodes),
-            this->buildUpperSAH(arena, treeletRoots, mid, end, totalNodes));
+
+        // Treelet ranges large enough to amortize a task build their halves in parallel
+        BVHBuildNode* children[2];
+        if (nNodes >= ParallelUpperSAHThreshold) {
+            ParallelFor([&](int64_t child) {
+                children[child] = child == 0
+                    ? buildUpperSAH(arenas, treeletRoots, start, mid, totalNodes)
+                    : buildUpperSAH(arenas, treeletRoots, mid, end, totalNodes);
+            }, 2);
+        }
+        else {
+            children[0] = buildUpperSAH(arenas, treeletRoots, start, mid, totalNodes);
+            children[1] = buildUpperSAH(arenas, treeletRoots, mid, end, totalNodes);
+        }
+        node->InitInterior(dim, children[0], children[1]);
         return node;
     }
 
@@ -634,10 +1004,284 @@ namespace RayTrace
         return myOffset;
     }
 
-    BVHAccel::~BVHAccel() { FreeAligned(nodes); }
+    // Unnormalized SAH cost of the subtree, leaves cost their primitive count times their area
+    float BVHAccel::computeSAHCost(int nodeIndex) {
+        const LinearBVHNode& node = nodes[nodeIndex];
+        float cost = node.nPrimitives > 0
+            ? node.nPrimitives * node.bounds.surfaceArea()
+            : node.bounds.surfaceArea() + computeSAHCost(nodeIndex + 1) +
+                computeSAHCost(node.secondChildOffset);
+        sahCost[nodeIndex] = cost;
+        return cost;
+    }
+
+    void BVHAccel::Refit(const std::vector<const Primitive*>& changedPrimitives, float rebuildThreshold) {
+        if (!nodes || changedPrimitives.empty()) return;
+        BuildClock::time_point refitStart = BuildClock::now(),
+                               phaseStart = refitStart;
+        std::unordered_set<const Primitive*> changed(changedPrimitives.begin(), changedPrimitives.end());
+        std::vector<int> degraded;
+        float cost;
+        if (!refitRecursive(0, changed, rebuildThreshold, &cost, &degraded))
+            return;
+        double refitMs = ElapsedMs(phaseStart);
+
+        for (int nodeIndex : degraded) {
+            if (!rebuildSubtree(nodeIndex)) {
+                // The subtree no longer fits its slots, start over
+                build();
+                return;
+            }
+        }
+        double rebuildMs = ElapsedMs(phaseStart);
+        buildWide();
+
+        buildStats.refitMs         = refitMs;
+        buildStats.refitRebuildMs  = rebuildMs;
+        buildStats.refitWideMs     = ElapsedMs(phaseStart);
+        buildStats.refitTotalMs    = std::chrono::duration<double, std::milli>(BuildClock::now() - refitStart).count();
+        buildStats.subtreesRebuilt = (int)degraded.size();
+        ++buildStats.refits;
+    }
+
+    // Returns whether the subtree held a changed primitive. _degraded_ collects the topmost
+    // interior nodes whose refit cost exceeds their build cost by _rebuildThreshold_
+    bool BVHAccel::refitRecursive(int nodeIndex, const std::unordered_set<const Primitive*>& changed,
+        float rebuildThreshold, float* cost, std::vector<int>* degraded) {
+        LinearBVHNode& node = nodes[nodeIndex];
+        bool dirty = false;
+        if (node.nPrimitives > 0) {
+            for (int i = 0; i < node.nPrimitives && !dirty; ++i)
+                dirty = changed.count(primitives[node.primitivesOffset + i].get()) > 0;
+            if (dirty) {
+                BBox3f bounds;
+                for (int i = 0; i < node.nPrimitives; ++i)
+                    bounds = Union(bounds, primitives[node.primitivesOffset + i]->worldBound());
+                node.bounds = bounds;
+            }
+            *cost = node.nPrimitives * node.bounds.surfaceArea();
+            return dirty;
+        }
+
+        size_t firstDegraded = degraded->size();
+        float cost0, cost1;
+        bool dirty0 = refitRecursive(nodeIndex + 1, changed, rebuildThreshold, &cost0, degraded);
+        bool dirty1 = refitRecursive(node.secondChildOffset, changed, rebuildThreshold, &cost1, degraded);
+        dirty = dirty0 || dirty1;
+        if (dirty)
+            node.bounds = Union(nodes[nodeIndex + 1].bounds, nodes[node.secondChildOffset].bounds);
+        *cost = node.bounds.surfaceArea() + cost0 + cost1;
+        if (dirty && *cost > rebuildThreshold * sahCost[nodeIndex]) {
+            // Descendants are rebuilt along with this node
+            degraded->resize(firstDegraded);
+            degraded->push_back(nodeIndex);
+        }
+        return dirty;
+    }
+
+    // Rebuilds the subtree at _nodeIndex_ with SAH into the slots it already occupies.
+    // Returns false if its primitives aren't contiguous (HLBVH upper levels) or the new
+    // subtree needs more nodes than the old one.
+    bool BVHAccel::rebuildSubtree(int nodeIndex) {
+        // Depth first layout, the subtree ends after its rightmost leaf
+        int endIndex = nodeIndex;
+        while (nodes[endIndex].nPrimitives == 0)
+            endIndex = nodes[endIndex].secondChildOffset;
+        const int nodeSlots = endIndex + 1 - nodeIndex;
+
+        // Gather the primitive range from the reachable leaves, earlier rebuilds may leave unused slots
+        int firstPrim = (int)primitives.size(), endPrim = 0, nPrimitives = 0;
+        std::vector<int> toVisit = { nodeIndex };
+        while (!toVisit.empty()) {
+            int current = toVisit.back();
+            toVisit.pop_back();
+            const LinearBVHNode& node = nodes[current];
+            if (node.nPrimitives > 0) {
+                firstPrim = std::min(firstPrim, node.primitivesOffset);
+                endPrim = std::max(endPrim, node.primitivesOffset + (int)node.nPrimitives);
+                nPrimitives += node.nPrimitives;
+            }
+            else {
+                toVisit.push_back(current + 1);
+                toVisit.push_back(node.secondChildOffset);
+            }
+        }
+        if (endPrim - firstPrim != nPrimitives)
+            return false;
+
+        std::vector<BVHPrimitiveInfo> primitiveInfo(nPrimitives);
+        ParallelFor([&](int64_t i) {
+            primitiveInfo[i] = { (size_t)(firstPrim + i), primitives[firstPrim + i]->worldBound() };
+        }, nPrimitives, 1024);
+        std::vector<std::unique_ptr<MemoryArena>> arenas(MaxThreadIndex());
+        for (auto& threadArena : arenas)
+            threadArena = std::make_unique<MemoryArena>(64 * 1024);
+        std::atomic<int> totalNodes(0);
+        PrimitiveVector orderedPrims(nPrimitives);
+        ThreadSlotScope threadSlot;
+        BVHBuildNode* root = recursiveBuild(arenas, primitiveInfo, 0, nPrimitives, &totalNodes, orderedPrims);
+        if (totalNodes > nodeSlots)
+            return false;
+
+        std::move(orderedPrims.begin(), orderedPrims.end(), primitives.begin() + firstPrim);
+        int offset = nodeIndex;
+        flattenBVHTree(root, &offset);
+        // Leaves were built relative to the subtree's first primitive
+        for (int i = nodeIndex; i < offset; ++i)
+            if (nodes[i].nPrimitives > 0)
+                nodes[i].primitivesOffset += firstPrim;
+        computeSAHCost(nodeIndex);
+        return true;
+    }
+
+    template <int N>
+    int BVHAccel::collapseWideBVH(std::vector<WideBVHNode<N>>& wide, int binaryIndex) const {
+        int wideIndex = (int)wide.size();
+        wide.emplace_back();
+
+        // Open the interior child with the largest surface area until all N slots are used
+        int children[N];
+        int numChildren = 0;
+        if (nodes[binaryIndex].nPrimitives > 0)
+            children[numChildren++] = binaryIndex;
+        else {
+            children[numChildren++] = binaryIndex + 1;
+            children[numChildren++] = nodes[binaryIndex].secondChildOffset;
+        }
+        while (numChildren < N) {
+            int best = -1;
+            float bestArea = -1.f;
+            for (int i = 0; i < numChildren; ++i) {
+                const LinearBVHNode& child = nodes[children[i]];
+                if (child.nPrimitives == 0 && child.bounds.surfaceArea() > bestArea) {
+                    best = i;
+                    bestArea = child.bounds.surfaceArea();
+                }
+            }
+            if (best < 0) break;
+            int opened = children[best];
+            children[best] = opened + 1;
+            children[numChildren++] = nodes[opened].secondChildOffset;
+        }
+
+        // Empty slots get inverted bounds so the slab test never reports them
+        int32_t  offsets[N];
+        uint16_t counts[N];
+        for (int i = 0; i < N; ++i) {
+            WideBVHNode<N>& node = wide[wideIndex];
+            if (i >= numChildren) {
+                for (int a = 0; a < 3; ++a) {
+                    node.boundsMin[a][i] = InfinityF32;
+                    node.boundsMax[a][i] = -InfinityF32;
+                }
+                offsets[i] = -1;
+                counts[i] = 0;
+                continue;
+            }
+            const LinearBVHNode& child = nodes[children[i]];
+            for (int a = 0; a < 3; ++a) {
+                node.boundsMin[a][i] = child.bounds.m_min[a];
+                node.boundsMax[a][i] = child.bounds.m_max[a];
+            }
+            if (child.nPrimitives > 0) {
+                offsets[i] = child.primitivesOffset;
+                counts[i] = child.nPrimitives;
+            }
+            else {
+                // recursion may reallocate _wide_, write the node back by index afterwards
+                offsets[i] = collapseWideBVH(wide, children[i]);
+                counts[i] = 0;
+            }
+        }
+        for (int i = 0; i < N; ++i) {
+            wide[wideIndex].offset[i] = offsets[i];
+            wide[wideIndex].nPrimitives[i] = counts[i];
+        }
+        return wideIndex;
+    }
+
+    struct WideStackEntry {
+        int32_t  offset;
+        uint16_t nPrimitives;
+        float    tEntry;
+    };
+
+    template <int N>
+    bool BVHAccel::intersectWide(const WideBVHNode<N>* wide, const Ray& ray, SurfaceInteraction* isect) const {
+        WideRay r(ray);
+        bool hit = false;
+        WideStackEntry stack[512];
+        int stackSize = 0;
+        stack[stackSize++] = { 0, 0, 0.f };
+        while (stackSize > 0) {
+            const WideStackEntry entry = stack[--stackSize];
+            // Skip subtrees that start behind the closest hit found so far
+            if (entry.tEntry > ray.m_maxT) continue;
+            if (entry.nPrimitives > 0) {
+                for (int i = 0; i < entry.nPrimitives; ++i)
+                    if (primitives[entry.offset + i]->intersect(ray, isect))
+                        hit = true;
+                continue;
+            }
+
+            const WideBVHNode<N>& node = wide[entry.offset];
+            alignas(32) float tEntry[N];
+            int mask = IntersectChildren(node, r, ray.m_maxT, tEntry);
+
+            // Push hit children far to near so the nearest one is visited first
+            int order[N];
+            int numHits = 0;
+            while (mask) {
+                int child = CountTrailingZeros(mask);
+                mask &= mask - 1;
+                int j = numHits++;
+                while (j > 0 && tEntry[order[j - 1]] < tEntry[child]) {
+                    order[j] = order[j - 1];
+                    --j;
+                }
+                order[j] = child;
+            }
+            for (int i = 0; i < numHits; ++i)
+                stack[stackSize++] = { node.offset[order[i]], node.nPrimitives[order[i]], tEntry[order[i]] };
+        }
+        return hit;
+    }
+
+    template <int N>
+    bool BVHAccel::intersectPWide(const WideBVHNode<N>* wide, const Ray& ray) const {
+        WideRay r(ray);
+        int stack[512];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0) {
+            const WideBVHNode<N>& node = wide[stack[--stackSize]];
+            alignas(32) float tEntry[N];
+            int mask = IntersectChildren(node, r, ray.m_maxT, tEntry);
+            while (mask) {
+                int child = CountTrailingZeros(mask);
+                mask &= mask - 1;
+                if (node.nPrimitives[child] > 0) {
+                    for (int i = 0; i < node.nPrimitives[child]; ++i)
+                        if (primitives[node.offset[child] + i]->intersectP(ray))
+                            return true;
+                }
+                else
+                    stack[stackSize++] = node.offset[child];
+            }
+        }
+        return false;
+    }
+
+    BVHAccel::~BVHAccel() {
+        FreeAligned(nodes);
+        FreeAligned(wideNodes4);
+        FreeAligned(wideNodes8);
+    }
 
     bool BVHAccel::intersect(const Ray& ray, SurfaceInteraction* isect) const {
         if (!nodes) return false;
+        if (wideNodes8) return intersectWide(wideNodes8, ray, isect);
+        if (wideNodes4) return intersectWide(wideNodes4, ray, isect);
         //ProfilePhase p(Prof::AccelIntersect);
         bool hit = false;
         Vector3f invDir =   Inverted( ray.m_dir) ;
@@ -681,6 +1325,8 @@ namespace RayTrace
 
     bool BVHAccel::intersectP(const Ray& ray) const {
         if (!nodes) return false;
+        if (wideNodes8) return intersectPWide(wideNodes8, ray);
+        if (wideNodes4) return intersectPWide(wideNodes4, ray);
         //ProfilePhase p(Prof::AccelIntersectP);
         Vector3f invDir = Inverted(ray.m_dir);
         int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
@@ -721,6 +1367,183 @@ namespace RayTrace
         return false;
     }
 
+    struct PacketStackEntry {
+        int      nodeIndex;
+        uint32_t mask;
+    };
+
+    struct WidePacketStackEntry {
+        int32_t  offset;
+        uint16_t nPrimitives;
+        uint32_t mask;
+    };
+
+    // Masked packet traversal of the wide nodes, each child box is tested against all lanes
+    // still in the packet and the children are visited nearest first by their closest lane
+    template <int N>
+    uint32_t BVHAccel::intersectWide8(const WideBVHNode<N>* wide, const Ray* rays, SurfaceInteraction* isects,
+        uint32_t activeMask) const {
+        RayPacket8 packet(rays, activeMask);
+        uint32_t hitMask = 0;
+        WidePacketStackEntry stack[512];
+        int stackSize = 0;
+        stack[stackSize++] = { 0, 0, activeMask };
+        while (stackSize > 0) {
+            const WidePacketStackEntry entry = stack[--stackSize];
+            if (entry.nPrimitives > 0) {
+                for (uint32_t mask = entry.mask; mask; mask &= mask - 1) {
+                    int lane = CountTrailingZeros(mask);
+                    for (int i = 0; i < entry.nPrimitives; ++i)
+                        if (primitives[entry.offset + i]->intersect(rays[lane], &isects[lane]))
+                            hitMask |= 1u << lane;
+                    packet.tMax[lane] = rays[lane].m_maxT;
+                }
+                continue;
+            }
+
+            const WideBVHNode<N>& node = wide[entry.offset];
+            uint32_t childMask[N];
+            float childEntry[N];
+            int order[N];
+            int numHits = 0;
+            for (int c = 0; c < N; ++c) {
+                alignas(32) float tEntry[RayPacketSize];
+                childMask[c] = entry.mask & IntersectPacketChild(node, c, packet, tEntry);
+                if (!childMask[c]) continue;
+                childEntry[c] = InfinityF32;
+                for (uint32_t m = childMask[c]; m; m &= m - 1)
+                    childEntry[c] = std::min(childEntry[c], tEntry[CountTrailingZeros(m)]);
+                // Push hit children far to near so the nearest one is visited first
+                int j = numHits++;
+                while (j > 0 && childEntry[order[j - 1]] < childEntry[c]) {
+                    order[j] = order[j - 1];
+                    --j;
+                }
+                order[j] = c;
+            }
+            for (int i = 0; i < numHits; ++i)
+                stack[stackSize++] = { node.offset[order[i]], node.nPrimitives[order[i]], childMask[order[i]] };
+        }
+        return hitMask;
+    }
+
+    template <int N>
+    uint32_t BVHAccel::intersectPWide8(const WideBVHNode<N>* wide, const Ray* rays, uint32_t activeMask) const {
+        RayPacket8 packet(rays, activeMask);
+        uint32_t hitMask = 0;
+        WidePacketStackEntry stack[512];
+        int stackSize = 0;
+        stack[stackSize++] = { 0, 0, activeMask };
+        while (stackSize > 0) {
+            const WidePacketStackEntry entry = stack[--stackSize];
+            // Occluded lanes are done, drop them from everything still on the stack
+            uint32_t mask = entry.mask & ~hitMask;
+            if (!mask) continue;
+            if (entry.nPrimitives > 0) {
+                for (; mask; mask &= mask - 1) {
+                    int lane = CountTrailingZeros(mask);
+                    for (int i = 0; i < entry.nPrimitives; ++i) {
+                        if (primitives[entry.offset + i]->intersectP(rays[lane])) {
+                            hitMask |= 1u << lane;
+                            packet.tMax[lane] = -InfinityF32;
+                            break;
+                        }
+                    }
+                }
+                if (hitMask == activeMask) break;
+                continue;
+            }
+
+            const WideBVHNode<N>& node = wide[entry.offset];
+            for (int c = 0; c < N; ++c) {
+                alignas(32) float tEntry[RayPacketSize];
+                uint32_t childMask = mask & IntersectPacketChild(node, c, packet, tEntry);
+                if (childMask)
+                    stack[stackSize++] = { node.offset[c], node.nPrimitives[c], childMask };
+            }
+        }
+        return hitMask;
+    }
+
+    // Masked packet traversal of the binary nodes, the children are visited in the
+    // order preferred by the majority of the lanes that reached the node
+    uint32_t BVHAccel::intersect8(const Ray* rays, SurfaceInteraction* isects, uint32_t activeMask) const {
+        if (!nodes || !activeMask) return 0;
+        if (wideNodes8) return intersectWide8(wideNodes8, rays, isects, activeMask);
+        if (wideNodes4) return intersectWide8(wideNodes4, rays, isects, activeMask);
+        RayPacket8 packet(rays, activeMask);
+        uint32_t hitMask = 0;
+        PacketStackEntry nodesToVisit[64];
+        int toVisitOffset = 0;
+        nodesToVisit[toVisitOffset++] = { 0, activeMask };
+        while (toVisitOffset > 0) {
+            const PacketStackEntry entry = nodesToVisit[--toVisitOffset];
+            const LinearBVHNode* node = &nodes[entry.nodeIndex];
+            uint32_t mask = entry.mask & IntersectPacket(node->bounds, packet);
+            if (!mask) continue;
+            if (node->nPrimitives > 0) {
+                while (mask) {
+                    int lane = CountTrailingZeros(mask);
+                    mask &= mask - 1;
+                    for (int i = 0; i < node->nPrimitives; ++i)
+                        if (primitives[node->primitivesOffset + i]->intersect(rays[lane], &isects[lane]))
+                            hitMask |= 1u << lane;
+                    packet.tMax[lane] = rays[lane].m_maxT;
+                }
+            }
+            else if (2 * PopCount(mask & packet.negMask[node->axis]) > PopCount(mask)) {
+                nodesToVisit[toVisitOffset++] = { entry.nodeIndex + 1, mask };
+                nodesToVisit[toVisitOffset++] = { node->secondChildOffset, mask };
+            }
+            else {
+                nodesToVisit[toVisitOffset++] = { node->secondChildOffset, mask };
+                nodesToVisit[toVisitOffset++] = { entry.nodeIndex + 1, mask };
+            }
+        }
+        return hitMask;
+    }
+
+    uint32_t BVHAccel::intersectP8(const Ray* rays, uint32_t activeMask) const {
+        if (!nodes || !activeMask) return 0;
+        if (wideNodes8) return intersectPWide8(wideNodes8, rays, activeMask);
+        if (wideNodes4) return intersectPWide8(wideNodes4, rays, activeMask);
+        RayPacket8 packet(rays, activeMask);
+        uint32_t hitMask = 0;
+        PacketStackEntry nodesToVisit[64];
+        int toVisitOffset = 0;
+        nodesToVisit[toVisitOffset++] = { 0, activeMask };
+        while (toVisitOffset > 0) {
+            const PacketStackEntry entry = nodesToVisit[--toVisitOffset];
+            const LinearBVHNode* node = &nodes[entry.nodeIndex];
+            // Occluded lanes are done, drop them from everything still on the stack
+            uint32_t mask = entry.mask & ~hitMask & IntersectPacket(node->bounds, packet);
+            if (!mask) continue;
+            if (node->nPrimitives > 0) {
+                while (mask) {
+                    int lane = CountTrailingZeros(mask);
+                    mask &= mask - 1;
+                    for (int i = 0; i < node->nPrimitives; ++i) {
+                        if (primitives[node->primitivesOffset + i]->intersectP(rays[lane])) {
+                            hitMask |= 1u << lane;
+                            packet.tMax[lane] = -InfinityF32;
+                            break;
+                        }
+                    }
+                }
+                if (hitMask == activeMask) break;
+            }
+            else if (2 * PopCount(mask & packet.negMask[node->axis]) > PopCount(mask)) {
+                nodesToVisit[toVisitOffset++] = { entry.nodeIndex + 1, mask };
+                nodesToVisit[toVisitOffset++] = { node->secondChildOffset, mask };
+            }
+            else {
+                nodesToVisit[toVisitOffset++] = { node->secondChildOffset, mask };
+                nodesToVisit[toVisitOffset++] = { entry.nodeIndex + 1, mask };
+            }
+        }
+        return hitMask;
+    }
+
     std::shared_ptr<BVHAccel> CreateBVHAccelerator(
         std::vector<std::shared_ptr<Primitive>> prims, const ParamSet& ps) {
         std::string splitMethodName = ps.FindOneString("splitmethod", "hlbvh");
@@ -740,7 +1563,12 @@ namespace RayTrace
         }
 
         int maxPrimsInNode = ps.FindOneInt("maxnodeprims", 128);
-        return std::make_shared<BVHAccel>(std::move(prims), maxPrimsInNode, splitMethod);
+        int width = ps.FindOneInt("width", 2);
+        if (width != 2 && width != 4 && width != 8) {
+            Warning("BVH width %d unsupported.  Using 2.", width);
+            width = 2;
+        }
+        return std::make_shared<BVHAccel>(std::move(prims), maxPrimsInNode, splitMethod, width);
 
     }
 }
@@ -1,9 +1,37 @@
 #pragma once
+#include <unordered_set>
 #include "Defines.h"
 #include "Primitive.h"
 
 namespace RayTrace
 {
+    template <int N> struct WideBVHNode;
+
+    // Wall clock time spent in each phase of BVHAccel construction, in milliseconds
+    struct BVHBuildStats
+    {
+        double primitiveInfoMs  = 0.0;
+        double mortonMs         = 0.0;  // HLBVH only
+        double radixSortMs      = 0.0;  // HLBVH only
+        double treeletMs        = 0.0;  // HLBVH only
+        double upperSAHMs       = 0.0;  // HLBVH only
+        double recursiveBuildMs = 0.0;  // SAH, Middle, EqualCounts
+        double flattenMs        = 0.0;
+        double wideCollapseMs   = 0.0;  // width 4 or 8 only
+        double cacheMs          = 0.0;  // hashing the inputs and reading or writing the cache file
+        double totalMs          = 0.0;
+        int    totalNodes       = 0;
+        bool   loadedFromCache  = false;
+
+        // Last Refit() that changed the tree, a full rebuild from Refit() fills the fields above
+        double refitMs          = 0.0;
+        double refitRebuildMs   = 0.0;  // degraded subtrees rebuilt in place
+        double refitWideMs      = 0.0;
+        double refitTotalMs     = 0.0;
+        int    subtreesRebuilt  = 0;
+        int    refits           = 0;  // Refit() calls that changed the tree since the last full build
+    };
+
   // BVHAccel Declarations
     class BVHAccel : public Aggregate 
     {
@@ -14,23 +42,35 @@ namespace RayTrace
         // BVHAccel Public Methods
         BVHAccel(PrimitiveVector v,
             int maxPrimsInNode = 1,
-            SplitMethod splitMethod = SplitMethod::SAH);
+            SplitMethod splitMethod = SplitMethod::SAH,
+            int width = 2);
         BBox3f worldBound() const;
         ~BVHAccel();
         bool intersect(const Ray& ray, SurfaceInteraction* isect) const;
         bool intersectP(const Ray& ray) const;
+        uint32_t intersect8(const Ray* rays, SurfaceInteraction* isects, uint32_t activeMask) const override;
+        uint32_t intersectP8(const Ray* rays, uint32_t activeMask) const override;
+        const BVHBuildStats& GetBuildStats() const { return buildStats; }
+        // Updates the bounds of the leaves holding _changed_ primitives and their ancestors.
+        // Subtrees whose SAH cost grew past _rebuildThreshold_ times their build time cost
+        // are rebuilt in place. Must not run concurrently with intersection queries.
+        void Refit(const std::vector<const Primitive*>& changed, float rebuildThreshold = 1.5f);
 
     private:
         // BVHAccel Private Methods
+        void build();
+        void buildWide();
         BVHBuildNode* recursiveBuild(
-            MemoryArena& arena, PrimInfoVector& primitiveInfo,
-            int start, int end, int* totalNodes,
+            std::vector<std::unique_ptr<MemoryArena>>& arenas,
+            PrimInfoVector& primitiveInfo,
+            int start, int end, std::atomic<int>* totalNodes,
             PrimitiveVector& orderedPrims);
 
         BVHBuildNode* HLBVHBuild(
-            MemoryArena& arena, const PrimInfoVector& primitiveInfo,
-            int* totalNodes,
-            PrimitiveVector& orderedPrims) const;
+            std::vector<std::unique_ptr<MemoryArena>>& arenas, const PrimInfoVector& primitiveInfo,
+            std::atomic<int>* totalNodes,
+            PrimitiveVector& orderedPrims,
+            BVHBuildStats* stats) const;
 
         BVHBuildNode* emitLBVH(
             BVHBuildNode*& buildNodes,
@@ -40,17 +80,47 @@ namespace RayTrace
             PrimitiveVector& orderedPrims,
             std::atomic<int>* orderedPrimsOffset, int bitIndex) const;
 
-        BVHBuildNode* buildUpperSAH(MemoryArena& arena,
+        BVHBuildNode* buildUpperSAH(std::vector<std::unique_ptr<MemoryArena>>& arenas,
             std::vector<BVHBuildNode*>& treeletRoots,
-            int start, int end, int* totalNodes) const;
+            int start, int end, std::atomic<int>* totalNodes) const;
 
         int flattenBVHTree(BVHBuildNode* node, int* offset);
 
+        // Scene cache, see SceneCache.h
+        bool loadCachedBVH(uint64_t key);
+        void storeCachedBVH(uint64_t key, const PrimitiveVector& inputPrims, int totalNodes) const;
+
+        float computeSAHCost(int nodeIndex);
+        bool refitRecursive(int nodeIndex, const std::unordered_set<const Primitive*>& changed,
+            float rebuildThreshold, float* cost, std::vector<int>* degraded);
+        bool rebuildSubtree(int nodeIndex);
+
+        // Collapses the flattened binary tree into nodes with up to N children
+        template <int N>
+        int collapseWideBVH(std::vector<WideBVHNode<N>>& wide, int binaryIndex) const;
+
+        template <int N>
+        bool intersectWide(const WideBVHNode<N>* wide, const Ray& ray, SurfaceInteraction* isect) const;
+
+        template <int N>
+        bool intersectPWide(const WideBVHNode<N>* wide, const Ray& ray) const;
+
+        template <int N>
+        uint32_t intersectWide8(const WideBVHNode<N>* wide, const Ray* rays, SurfaceInteraction* isects, uint32_t activeMask) const;
+
+        template <int N>
+        uint32_t intersectPWide8(const WideBVHNode<N>* wide, const Ray* rays, uint32_t activeMask) const;
+
         // BVHAccel Private Data
         const int         maxPrimsInNode;
         const SplitMethod splitMethod;
         PrimitiveVector   primitives;
         LinearBVHNode*    nodes = nullptr;
+        const int         width;               // 2, or 4/8 for SIMD traversal of the wide nodes
+        WideBVHNode<4>*   wideNodes4 = nullptr;
+        WideBVHNode<8>*   wideNodes8 = nullptr;
+        BVHBuildStats     buildStats;
+        std::vector<float> sahCost;            // per node SAH cost when its subtree was built
     };
 
 
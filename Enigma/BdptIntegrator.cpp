@@ -66,7 +66,7 @@ namespace RayTrace
             int x0 = sampleBounds.m_min.x + m_curTile.x * TileSize;
             int x1 = std::min(x0 + TileSize, sampleBounds.m_max.x);
 
-            int y0 = sampleBounds.m_min.x + m_curTile.y * TileSize;
+            int y0 = sampleBounds.m_min.y + m_curTile.y * TileSize;
             int y1 = std::min(y0 + TileSize, sampleBounds.m_max.y);
             BBox2i tileBounds(Vector2i(x0, y0), Vector2i(x1, y1));
             // LOG(INFO) << "Starting image tile " << tileBounds;
@@ -622,9 +622,8 @@ namespace RayTrace
         Film* film = camera->m_film.get();
         const BBox2i sampleBounds = film->GetSampleBounds();
         const Vector2i sampleExtent = sampleBounds.diagonal();
-        const int tileSize = 16;
-        const int nXTiles = (sampleExtent.x + tileSize - 1) / tileSize;
-        const int nYTiles = (sampleExtent.y + tileSize - 1) / tileSize;
+        const int nXTiles = (sampleExtent.x + TileSize - 1) / TileSize;
+        const int nYTiles = (sampleExtent.y + TileSize - 1) / TileSize;
         //ProgressReporter reporter(nXTiles * nYTiles, "Rendering");
 
         // Allocate buffers for debug visualization
@@ -652,17 +651,10 @@ namespace RayTrace
         if (scene.m_lights.size() > 0) {
 
 
-            TaskQueue<TileTask> renderQueue(NumSystemCores());
-            for (int y = 0; y < nYTiles; ++y)
-            {
-                for (int x = 0; x < nXTiles; ++x)
-                {
-                    TileTask t = { Vector2i(nXTiles, nYTiles), Vector2i(x,y), this, lightDistribution.get(), &lightToIndex, &scene, &weightFilms };                   
-                    renderQueue.Enqueue(t);
-                }//for x tiles
-            }//for y tiles
-            // Save final image after rendering
-            renderQueue.Join();          
+            ParallelFor2D([&](Vector2i tile) {
+                TileTask t = { Vector2i(nXTiles, nYTiles), tile, this, lightDistribution.get(), &lightToIndex, &scene, &weightFilms };
+                t();
+            }, Vector2i(nXTiles, nYTiles));
         }
         const float invSampleCount = 1.0f / sampler->m_samplesPerPixel;
         film->WriteImage(1.0f / sampler->m_samplesPerPixel);
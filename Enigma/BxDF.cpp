@@ -10,6 +10,7 @@
 #include "Primitive.h"
 #include "Fourier.h"
 #include "Memory.h"
+#include "Concurrency.h"
 #include "BxDF.h"
 
 
@@ -131,32 +132,29 @@ namespace RayTrace
 
         // Choose albedo values of the diffusion profile discretization
         for (int i = 0; i < t->m_nRhoSamples; ++i)
-        {
             t->m_rhoSamples[i] =
                 (1 - std::exp(-8 * i / (float)(t->m_nRhoSamples - 1))) /
                 (1 - std::exp(-8));
-            // ParallelFor([&](int i) 
-            {
-                // Compute the diffusion profile for the _i_th albedo sample
-
-                // Compute scattering profile for chosen albedo $\rho$
-                for (int j = 0; j < t->m_nRadiusSamples; ++j) {
-                    float rho = t->m_rhoSamples[i],
-                        r = t->m_radiusSamples[j];
-                    t->m_profile[i * t->m_nRadiusSamples + j] =
-                        2 * PI * r * (BeamDiffusionSS(rho, 1 - rho, g, eta, r) +
-                            BeamDiffusionMS(rho, 1 - rho, g, eta, r));
-                }
 
-                // Compute effective albedo $\rho_{\roman{eff}}$ and CDF for importance
-                // sampling
-                t->m_rhoEff[i] =
-                    IntegrateCatmullRom(t->m_nRadiusSamples, t->m_radiusSamples.get(),
-                        &t->m_profile[i * t->m_nRadiusSamples],
-                        &t->m_profileCDF[i * t->m_nRadiusSamples]);
+        ParallelFor([&](int64_t i) {
+            // Compute the diffusion profile for the _i_th albedo sample
+
+            // Compute scattering profile for chosen albedo $\rho$
+            for (int j = 0; j < t->m_nRadiusSamples; ++j) {
+                float rho = t->m_rhoSamples[i],
+                    r = t->m_radiusSamples[j];
+                t->m_profile[i * t->m_nRadiusSamples + j] =
+                    2 * PI * r * (BeamDiffusionSS(rho, 1 - rho, g, eta, r) +
+                        BeamDiffusionMS(rho, 1 - rho, g, eta, r));
             }
-            //, t->m_nRhoSamples);
-        }//for i
+
+            // Compute effective albedo $\rho_{\roman{eff}}$ and CDF for importance
+            // sampling
+            t->m_rhoEff[i] =
+                IntegrateCatmullRom(t->m_nRadiusSamples, t->m_radiusSamples.get(),
+                    &t->m_profile[i * t->m_nRadiusSamples],
+                    &t->m_profileCDF[i * t->m_nRadiusSamples]);
+        }, t->m_nRhoSamples);
     }
 
     void SubsurfaceFromDiffuse(const BSSRDFTable& t, const Spectrum& rhoEff,
@@ -42,6 +42,7 @@ namespace RayTrace
         valid &= Register<EditorComponent>();
         valid &= Register<MeshComponent>();
         valid &= Register<IndexedMeshComponent>();
+        valid &= Register<RenderSceneComponent>();
         valid &= Register<TextureComponent>();
         valid &= Register<ShaderComponent>();
         valid &= Register<MaterialComponent>();
@@ -53,15 +54,16 @@ namespace RayTrace
 
     bool ComponentSystem::Clear()
     {
-        m_components.clear();
+        m_managers.clear();
+        m_typeIds.clear();
         return true;
     }
 
     bool ComponentSystem::Clone(Entity _srcEnt, Entity _dstEnt)
     {
         bool valid = true;
-        for (auto& [key, compMan] : m_components) {
-            if (compMan->ContainsEntity(_srcEnt))
+        for (auto& compMan : m_managers) {
+            if (compMan && compMan->ContainsEntity(_srcEnt))
                 valid &= compMan->Clone(_srcEnt, _dstEnt );            
         }
         return valid;
@@ -70,18 +72,33 @@ namespace RayTrace
     bool ComponentSystem::Remove(Entity _ent)
     {
         bool valid = true;
-        for (auto& [key, compMan] : m_components) {
-            if (compMan->ContainsEntity(_ent))
+        for (auto& compMan : m_managers) {
+            if (compMan && compMan->ContainsEntity(_ent))
                 valid &= compMan->Remove(_ent);
         }
         return valid;
     }
 
+    bool ComponentSystem::Register(uint32_t _typeId, const std::string& _name, std::unique_ptr<ComponentManagerBase> _comp)
+    {
+        if (Contains(_name)) {
+            AddLogMessage(&GetContext(), fmt::format("Duplicate Component<{}>", _name), eLogLevel::LOG_LEVEL_ERROR);
+            return false;
+        }
+        if (_typeId >= m_managers.size())
+            m_managers.resize(_typeId + 1);
+        m_managers[_typeId] = std::move(_comp);
+        m_typeIds[_name] = _typeId;
+        AddLogMessage(&GetContext(), fmt::format("Registered Component<{}>", _name));
+        return true;
+    }
+
     ComponentManagerBase* ComponentSystem::GetManager(const std::string& _name) const
     {
-        if (m_components.find(_name) == std::end(m_components))
+        const auto it = m_typeIds.find(_name);
+        if (it == std::end(m_typeIds))
             return nullptr;
-        return m_components.at(_name).get();
+        return m_managers[it->second].get();
     }
 
     bool ComponentSystem::Contains(const std::string& _name) const
@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+#include <tuple>
 #include <unordered_map>
 #include "SystemBase.h"
 #include "Components.h"
@@ -22,6 +24,24 @@ namespace RayTrace
     };
 
 
+    // Small sequential id per component type, assigned on first use. ComponentSystem indexes its
+    // managers with it instead of hashing type names
+    inline uint32_t NextComponentTypeId()
+    {
+        static std::atomic<uint32_t> nextId{ 0 };
+        return nextId++;
+    }
+
+    template<typename T>
+    uint32_t ComponentTypeId()
+    {
+        static const uint32_t id = NextComponentTypeId();
+        return id;
+    }
+
+
+    // Sparse set storage: components and their entities are packed in parallel arrays, the
+    // sparse pages map an entity id to its packed index without hashing
     template<typename T>
     class TypedComponentManager : public ComponentManagerBase
     {
@@ -36,7 +56,7 @@ namespace RayTrace
 
 		
         bool ContainsEntity(Entity _ent) const override {
-            return m_lookup.find(_ent) != std::end(m_lookup);
+            return GetIndex(_ent) != InvalidIndex;
         }
 
         bool Clone(Entity _srcEnt, Entity _dstEnt) override {
@@ -45,7 +65,7 @@ namespace RayTrace
                 return false;
             T cloned = *GetComponent(_srcEnt);
 
-            m_lookup[_dstEnt] = m_components.size();
+            SetIndex(_dstEnt, (uint32_t)m_components.size());
             m_components.push_back(cloned);
             m_entities.push_back(_dstEnt);
 
@@ -56,7 +76,7 @@ namespace RayTrace
         T* Create(Entity _ent, Targs... _args) {
             assert(ContainsEntity(_ent) == false);
 
-            m_lookup[_ent] = m_components.size();
+            SetIndex(_ent, (uint32_t)m_components.size());
             m_components.push_back(T(_args...));
             m_entities.push_back(_ent);
             return &m_components.back();
@@ -68,18 +88,14 @@ namespace RayTrace
 
         T* GetComponent(Entity _ent)         
         {
-            if (!ContainsEntity(_ent))
-                return nullptr;
-            const auto idx = m_lookup.at(_ent);
-            return &m_components.at(idx);
+            const uint32_t idx = GetIndex(_ent);
+            return idx != InvalidIndex ? &m_components[idx] : nullptr;
         }
 
         const T* GetComponent(Entity _ent) const
         {
-            if (!ContainsEntity(_ent))
-                return nullptr;
-            const auto idx = m_lookup.at(_ent);
-            return &m_components.at(idx);
+            const uint32_t idx = GetIndex(_ent);
+            return idx != InvalidIndex ? &m_components[idx] : nullptr;
         }
 
         T& operator[] (uint32_t _idx)
@@ -99,20 +115,18 @@ namespace RayTrace
 
         bool Remove(Entity _ent) override
         {
-            if (!ContainsEntity(_ent))
+            const uint32_t idx = GetIndex(_ent);
+            if (idx == InvalidIndex)
                 return false;
-            const auto idx = m_lookup[_ent];
             if (idx < m_components.size() - 1)
             {
                 m_components[idx] = std::move(m_components.back());
                 m_entities[idx] = std::move(m_entities.back());
-
-                const auto& entity = m_entities[idx];
-                m_lookup[entity] = idx;
+                SetIndex(m_entities[idx], idx);
             }
             m_components.pop_back();
             m_entities.pop_back();
-            m_lookup.erase(_ent);
+            SetIndex(_ent, InvalidIndex);
             return true;
         }
 
@@ -122,7 +136,82 @@ namespace RayTrace
 
         std::vector<T>                       m_components;
         std::vector<Entity>                  m_entities;
-        std::unordered_map<Entity, uint32_t, Entity::hash_fn> m_lookup;
+
+    private:
+        static constexpr uint32_t InvalidIndex = ~0u;
+        static constexpr uint32_t PageSize     = 4096;
+
+        uint32_t GetIndex(Entity _ent) const
+        {
+            const uint32_t page = _ent.m_id / PageSize;
+            if (page >= m_sparse.size() || !m_sparse[page])
+                return InvalidIndex;
+            return m_sparse[page][_ent.m_id % PageSize];
+        }
+
+        void SetIndex(Entity _ent, uint32_t _idx)
+        {
+            const uint32_t page = _ent.m_id / PageSize;
+            if (page >= m_sparse.size())
+                m_sparse.resize(page + 1);
+            if (!m_sparse[page]) {
+                if (_idx == InvalidIndex)
+                    return;
+                m_sparse[page].reset(new uint32_t[PageSize]);
+                std::fill_n(m_sparse[page].get(), PageSize, InvalidIndex);
+            }
+            m_sparse[page][_ent.m_id % PageSize] = _idx;
+        }
+
+        // Pages of packed indices, allocated once an entity of their id range gets the component
+        std::vector<std::unique_ptr<uint32_t[]>> m_sparse;
+    };
+
+
+    // Iterates the entities owning all of _Ts_. Walks the packed entities of the smallest
+    // manager and looks the others up, so the cost follows the rarest component rather than
+    // the entity count. Components must not be added or removed during Each()
+    template<typename... Ts>
+    class ComponentView
+    {
+    public:
+        ComponentView(TypedComponentManager<Ts>*... _managers)
+            : m_managers(_managers...) {
+        }
+
+        // Calls _func_(Entity, Ts&...) for every matching entity
+        template<typename Func>
+        void Each(Func _func) const
+        {
+            const std::vector<Entity>* driver = nullptr;
+            bool valid = true;
+            std::apply([&](auto*... _manager) {
+                ((valid = valid && _manager != nullptr), ...);
+                if (valid)
+                    ((driver = (!driver || _manager->m_entities.size() < driver->size()) ? &_manager->m_entities : driver), ...);
+            }, m_managers);
+            if (!valid)
+                return;
+
+            for (const Entity ent : *driver) {
+                auto comps = std::make_tuple(std::get<TypedComponentManager<Ts>*>(m_managers)->GetComponent(ent)...);
+                if ((std::get<Ts*>(comps) && ...))
+                    _func(ent, *std::get<Ts*>(comps)...);
+            }
+        }
+
+        // Number of entities Each() visits at most
+        uint32_t SizeHint() const
+        {
+            uint32_t count = ~0u;
+            std::apply([&](auto*... _manager) {
+                ((count = std::min(count, _manager ? _manager->GetCount() : 0u)), ...);
+            }, m_managers);
+            return count;
+        }
+
+    private:
+        std::tuple<TypedComponentManager<Ts>*...> m_managers;
     };
 
 
@@ -143,17 +232,6 @@ namespace RayTrace
 
         bool Remove(Entity _ent);
 
-        bool Register(const std::string& _name, std::unique_ptr<ComponentManagerBase> _comp) {
-            if (Contains(_name)) {
-                AddLogMessage(&GetContext(), fmt::format("Duplicate Component<{}>", _name), eLogLevel::LOG_LEVEL_ERROR);
-                return false;
-            }
-            m_components[_name] = std::move(_comp);
-            AddLogMessage(&GetContext(), fmt::format("Registered Component<{}>", _name));
-            return true;
-        }
-
-       
         template<typename T>
         bool Register(uint32_t _initialSize = 4096 )
         {
@@ -164,15 +242,13 @@ namespace RayTrace
             {
                 std::string newCompName = NewComp::GetTypeName();
                 auto newManager = std::make_unique<NewComp>(&GetContext(), _initialSize);
-                return Register(newCompName, std::move(newManager));              
+                return Register(ComponentTypeId<T>(), newCompName, std::move(newManager));
             }                 
             return false;
         }     
 
         template<typename T>
         T* GetComponent(Entity _ent) const{
-            using NewComp = TypedComponentManager<T>;
-            const std::string newCompName = NewComp::GetTypeName();          
             auto comp = GetTypedManager<T>();
             if (!comp)
                 return nullptr;
@@ -181,12 +257,10 @@ namespace RayTrace
 
         template<typename T>
         T* CreateComponent(Entity _ent, bool _createNew = true) {
-            using NewComp = TypedComponentManager<T>;
-            const std::string newCompName = NewComp::GetTypeName();
             auto comp = GetTypedManager<T>();
             if ( !comp && _createNew )
             {
-                 AddLogMessage(&GetContext(), fmt::format("Component: {} not found, registering...", newCompName));
+                 AddLogMessage(&GetContext(), fmt::format("Component: {} not found, registering...", TypedComponentManager<T>::GetTypeName()));
                  Register<T>(); //register new component type
                  comp = GetTypedManager<T>();    
             }
@@ -197,14 +271,14 @@ namespace RayTrace
     
         template<typename T>
         TypedComponentManager<T>* GetTypedManager() const{
-            using NewComp = TypedComponentManager<T>;
-            return static_cast<TypedComponentManager<T>*>(GetManager(NewComp::GetTypeName()));
+            const uint32_t typeId = ComponentTypeId<T>();
+            if (typeId >= m_managers.size())
+                return nullptr;
+            return static_cast<TypedComponentManager<T>*>(m_managers[typeId].get());
         }
 
         template<typename T>
         bool            RemoveComponent(Entity _ent) {
-            using NewComp = TypedComponentManager<T>;
-            const std::string newCompName = NewComp::GetTypeName();
             auto comp = GetTypedManager<T>();
             if (!comp)
             {
@@ -230,8 +304,19 @@ namespace RayTrace
             return std::make_tuple(this->GetComponent<Targs>(_ent) ...);
         }       
 
+        // Entities owning all of _Targs_, see ComponentView
+        template<typename... Targs>
+        ComponentView<Targs...>            View() const
+        {
+            return ComponentView<Targs...>(GetTypedManager<Targs>()...);
+        }
+
 
     private:
-        std::unordered_map<std::string, std::unique_ptr<ComponentManagerBase>> m_components;       
+        bool Register(uint32_t _typeId, const std::string& _name, std::unique_ptr<ComponentManagerBase> _comp);
+
+        // Indexed by ComponentTypeId, null for types not registered here
+        std::vector<std::unique_ptr<ComponentManagerBase>> m_managers;
+        std::unordered_map<std::string, uint32_t>          m_typeIds;
     };
 }
\ No newline at end of file
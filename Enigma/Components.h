@@ -199,6 +199,7 @@ namespace RayTrace
          uint32_t m_instanceIdd = { INVALID_ID };
          uint32_t m_numIndices = { 0 };
          ProcessObjectFun m_pDrawMeshFun = { nullptr };
+         TriangleBVHPtr m_pPickMesh = { nullptr }; //object space triangles for picking, shared by copies
      };
    
 
@@ -212,6 +213,18 @@ namespace RayTrace
     };
 
 
+    // Links an entity to the primitives it owns in the ray traced scene. Edits of its
+    // TransformComponent are written to m_objectToWorld and refit the scene
+    struct RenderSceneComponent
+    {
+        RT_COMPONENT(RenderSceneComponent)
+        int m_instance = { -1 };                     // InstanceAccel instance, -1 if not instanced
+        std::shared_ptr<Transform> m_objectToWorld;  // the instance transform, or the one the shapes of m_primitives reference
+        std::shared_ptr<Transform> m_worldToObject;
+        std::vector<const Primitive*> m_primitives;  // primitives to refit, in the BLASes for instances
+    };
+
+
     struct SkyBoxComponent
     {
         RT_COMPONENT(SkyBoxComponent)        
@@ -0,0 +1,311 @@
+#include "Misc.h"
+#include "Concurrency.h"
+
+namespace RayTrace
+{
+    static thread_local int         t_threadSlot = -1;
+    static std::atomic<ThreadPool*> s_threadPool = { nullptr };
+    static std::mutex               s_threadPoolMutex;
+
+    using AsyncQueue = TaskQueue<std::function<void()>>;
+    static std::unique_ptr<AsyncQueue> s_asyncQueue;
+    static std::mutex               s_asyncQueueMutex;
+
+    struct ParallelForLoop
+    {
+        ParallelForLoop(const std::function<void(int64_t)>& _func, int64_t _count, int _chunkSize)
+            : m_func(_func)
+            , m_chunkSize(std::max(1, _chunkSize))
+            , m_remaining(_count)
+        {
+            // every spawned task owns at least one chunk, so this is an upper bound
+            int64_t numChunks = (_count + m_chunkSize - 1) / m_chunkSize;
+            m_tasks.resize(static_cast<size_t>(numChunks));
+            m_tasks[0] = { this, 0, _count };
+        }
+
+        ParallelForTask* AllocTask(int64_t _begin, int64_t _end)
+        {
+            ParallelForTask* task = &m_tasks[m_nextTask.fetch_add(1, std::memory_order_relaxed)];
+            task->m_loop  = this;
+            task->m_begin = _begin;
+            task->m_end   = _end;
+            return task;
+        }
+
+        const std::function<void(int64_t)>& m_func;
+        const int64_t                       m_chunkSize;
+        std::atomic<int64_t>                m_remaining;
+        std::atomic<int>                    m_nextTask = { 1 };
+        std::vector<ParallelForTask>        m_tasks;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // ThreadPool Implementation
+    //////////////////////////////////////////////////////////////////////////
+    ThreadPool::ThreadPool(int _numThreads)
+    {
+        const int numWorkers = std::max(0, _numThreads - 1);
+        for (int i = 0; i < numWorkers + NumExternalSlots; ++i)
+            m_deques.push_back(std::make_unique<TaskDeque>());
+        for (int i = 0; i < numWorkers; ++i)
+            m_threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_shutdown.store(true);
+        }
+        m_sleepSignal.notify_all();
+        for (auto& thread : m_threads)
+            thread.join();
+    }
+
+    void ThreadPool::ParallelFor(const std::function<void(int64_t)>& _func, int64_t _count, int _chunkSize)
+    {
+        if (_count <= 0)
+            return;
+
+        // Nested loops keep the slot of the outer one, outside callers claim their own
+        const bool external = t_threadSlot < 0;
+        if (external)
+            t_threadSlot = ClaimExternalSlot();
+
+        if (m_threads.empty() || _count <= _chunkSize) {
+            for (int64_t i = 0; i < _count; ++i)
+                _func(i);
+        }
+        else {
+            ParallelForLoop loop(_func, _count, _chunkSize);
+            RunLoop(loop, t_threadSlot);
+        }
+
+        if (external) {
+            ReleaseExternalSlot(t_threadSlot);
+            t_threadSlot = -1;
+        }
+    }
+
+    int ThreadPool::GetThreadCount() const
+    {
+        return static_cast<int>(m_threads.size()) + NumExternalSlots;
+    }
+
+    int ThreadPool::ClaimExternalSlot()
+    {
+        uint32_t free = m_freeExternalSlots.load();
+        while (true) {
+            if (free == 0) {
+                std::unique_lock<std::mutex> lock(m_externalMutex);
+                m_externalSignal.wait(lock, [&]() { return (free = m_freeExternalSlots.load()) != 0; });
+            }
+            const uint32_t slotBit = free & (0u - free);
+            if (m_freeExternalSlots.compare_exchange_weak(free, free & ~slotBit))
+                return static_cast<int>(m_threads.size()) + CountTrailingZeros(slotBit);
+        }
+    }
+
+    void ThreadPool::ReleaseExternalSlot(int _slot)
+    {
+        m_freeExternalSlots.fetch_or(1u << (_slot - static_cast<int>(m_threads.size())));
+        {
+            // Pairs with the predicate check in ClaimExternalSlot so the wakeup can't be lost
+            std::lock_guard<std::mutex> lock(m_externalMutex);
+        }
+        m_externalSignal.notify_one();
+    }
+
+    void ThreadPool::WorkerLoop(int _index)
+    {
+        t_threadSlot = _index;
+        uint32_t rngState = 0x9E3779B9u * (_index + 1);
+        while (!m_shutdown.load(std::memory_order_relaxed))
+        {
+            const uint64_t epoch = m_workEpoch.load();
+            if (ParallelForTask* task = FindWork(_index, rngState)) {
+                Execute(task, _index);
+                continue;
+            }
+
+            // Nothing to steal, sleep until new work is pushed
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_numSleeping.fetch_add(1);
+            m_sleepSignal.wait(lock, [&]() {
+                return m_shutdown.load() || m_workEpoch.load() != epoch;
+            });
+            m_numSleeping.fetch_sub(1);
+        }
+        t_threadSlot = -1;
+    }
+
+    void ThreadPool::RunLoop(ParallelForLoop& _loop, int _slot)
+    {
+        uint32_t rngState = 0x85EBCA6Bu * (_slot + 1);
+        Execute(&_loop.m_tasks[0], _slot);
+
+        // Help out until every iteration of this loop has run
+        while (_loop.m_remaining.load(std::memory_order_acquire) > 0)
+        {
+            if (ParallelForTask* task = FindWork(_slot, rngState))
+                Execute(task, _slot);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    void ThreadPool::Execute(ParallelForTask* _task, int _slot)
+    {
+        ParallelForLoop& loop = *_task->m_loop;
+        int64_t begin = _task->m_begin,
+                end   = _task->m_end;
+
+        // Keep the first half, expose the second half to thieves
+        TaskDeque& deque = *m_deques[_slot];
+        int64_t numChunks = (end - begin + loop.m_chunkSize - 1) / loop.m_chunkSize;
+        bool    pushed = false;
+        while (numChunks > 1 && !deque.Full())
+        {
+            int64_t half = numChunks / 2;
+            int64_t mid  = begin + (numChunks - half) * loop.m_chunkSize;
+            deque.Push(loop.AllocTask(mid, end));
+            end       = mid;
+            numChunks -= half;
+            pushed    = true;
+        }
+        if (pushed)
+            SignalWork();
+
+        for (int64_t i = begin; i < end; ++i)
+            loop.m_func(i);
+        loop.m_remaining.fetch_sub(end - begin, std::memory_order_release);
+    }
+
+    ParallelForTask* ThreadPool::FindWork(int _slot, uint32_t& _rngState)
+    {
+        if (ParallelForTask* task = m_deques[_slot]->Pop())
+            return task;
+
+        // xorshift to pick the first victim
+        _rngState ^= _rngState << 13;
+        _rngState ^= _rngState >> 17;
+        _rngState ^= _rngState << 5;
+
+        const int numDeques = static_cast<int>(m_deques.size());
+        const int first = static_cast<int>(_rngState % numDeques);
+        for (int i = 0; i < numDeques; ++i)
+        {
+            int victim = (first + i) % numDeques;
+            if (victim == _slot)
+                continue;
+            if (ParallelForTask* task = m_deques[victim]->Steal())
+                return task;
+        }
+        return nullptr;
+    }
+
+    void ThreadPool::SignalWork()
+    {
+        m_workEpoch.fetch_add(1);
+        if (m_numSleeping.load() > 0) {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_sleepSignal.notify_all();
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // Global pool
+    //////////////////////////////////////////////////////////////////////////
+    void ParallelInit(int _numThreads)
+    {
+        std::lock_guard<std::mutex> lock(s_threadPoolMutex);
+        if (s_threadPool.load())
+            return;
+        if (_numThreads <= 0)
+            _numThreads = NumSystemCores();
+        s_threadPool.store(new ThreadPool(_numThreads));
+    }
+
+    void ParallelCleanup()
+    {
+        {
+            // Async jobs may still use the pool, drain them first
+            std::lock_guard<std::mutex> lock(s_asyncQueueMutex);
+            s_asyncQueue.reset();
+        }
+        std::lock_guard<std::mutex> lock(s_threadPoolMutex);
+        delete s_threadPool.exchange(nullptr);
+    }
+
+    static ThreadPool& GetThreadPool()
+    {
+        ThreadPool* pool = s_threadPool.load(std::memory_order_acquire);
+        if (!pool) {
+            ParallelInit();
+            pool = s_threadPool.load(std::memory_order_acquire);
+        }
+        return *pool;
+    }
+
+    int MaxThreadIndex()
+    {
+        return GetThreadPool().GetThreadCount();
+    }
+
+    int ThreadIndex()
+    {
+        assert(t_threadSlot >= 0 && "ThreadIndex() outside ParallelFor, hold a ThreadSlotScope");
+        return t_threadSlot;
+    }
+
+    int ExclusiveThreadIndex()
+    {
+        return t_threadSlot;
+    }
+
+    ThreadSlotScope::ThreadSlotScope()
+    {
+        if (t_threadSlot >= 0)
+            return;
+        m_pool = &GetThreadPool();
+        m_slot = m_pool->ClaimExternalSlot();
+        t_threadSlot = m_slot;
+    }
+
+    ThreadSlotScope::~ThreadSlotScope()
+    {
+        if (m_slot < 0)
+            return;
+        t_threadSlot = -1;
+        m_pool->ReleaseExternalSlot(m_slot);
+    }
+
+    void ParallelFor(const std::function<void(int64_t)>& _func, int64_t _count, int _chunkSize)
+    {
+        GetThreadPool().ParallelFor(_func, _count, _chunkSize);
+    }
+
+    void ParallelFor2D(const std::function<void(Vector2i)>& _func, const Vector2i& _count)
+    {
+        if (_count.x <= 0 || _count.y <= 0)
+            return;
+        const int64_t width = _count.x;
+        GetThreadPool().ParallelFor([&](int64_t i) {
+            _func(Vector2i(static_cast<int>(i % width), static_cast<int>(i / width)));
+        }, width * _count.y, 1);
+    }
+
+    void RunAsync(std::function<void()> _func)
+    {
+        {
+            std::lock_guard<std::mutex> lock(s_asyncQueueMutex);
+            if (!s_asyncQueue)
+                s_asyncQueue.reset(new AsyncQueue(NumSystemCores()));
+            if (s_asyncQueue->Enqueue(std::move(_func)) >= 0)
+                return;
+        }
+        // The queue is shutting down
+        _func();
+    }
+}
@@ -10,6 +10,8 @@
 #include <cassert>
 #include <algorithm>
 #include <optional>
+#include <cstdint>
+#include "Defines.h"
 #define USE_MT 1
 
 namespace RayTrace
@@ -26,7 +28,7 @@ namespace RayTrace
 		std::atomic<bool> CanEnqueue;
 
 		std::deque<std::pair<int, T>> Queue;
-		int CurrentWorkID;
+		int CurrentWorkID = 0;
 
 		std::vector<std::pair<std::thread, bool>> Workers;
 
@@ -342,4 +344,186 @@ namespace RayTrace
 
 		return std::nullopt;
 	}
+
+    //////////////////////////////////////////////////////////////////////////
+    // Work-stealing scheduler
+    //////////////////////////////////////////////////////////////////////////
+
+    /*
+        Fixed capacity Chase-Lev deque. The owning thread pushes and pops at the
+        bottom, other threads steal from the top. Only pointers are stored so every
+        slot can be read and written atomically.
+    */
+    template <typename T, int Capacity = 1024>
+    class WorkStealingDeque
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    public:
+        WorkStealingDeque()
+        {
+            for (auto& item : m_items)
+                item.store(nullptr, std::memory_order_relaxed);
+        }
+
+        // [Owner only] Returns false when the deque is full, the caller should run the item inline
+        bool Push(T* _item)
+        {
+            int64_t b = m_bottom.load(std::memory_order_relaxed);
+            int64_t t = m_top.load(std::memory_order_acquire);
+            if (b - t >= Capacity)
+                return false;
+            m_items[b & (Capacity - 1)].store(_item, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // [Owner only]
+        T* Pop()
+        {
+            int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+            m_bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = m_top.load(std::memory_order_relaxed);
+            if (t > b) {
+                // Deque was empty
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            T* item = m_items[b & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (t == b) {
+                // Last item, race against thieves
+                if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    item = nullptr;
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        // [Any thread]
+        T* Steal()
+        {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = m_bottom.load(std::memory_order_acquire);
+            if (t >= b)
+                return nullptr;
+            T* item = m_items[t & (Capacity - 1)].load(std::memory_order_acquire);
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+            return item;
+        }
+
+        // [Owner only] A full deque can not fail a Push from its owner
+        bool Full() const
+        {
+            return m_bottom.load(std::memory_order_relaxed) - m_top.load(std::memory_order_acquire) >= Capacity;
+        }
+
+        bool Empty() const
+        {
+            return m_top.load(std::memory_order_acquire) >= m_bottom.load(std::memory_order_acquire);
+        }
+
+    private:
+        alignas(64) std::atomic<int64_t> m_top    = { 0 };
+        alignas(64) std::atomic<int64_t> m_bottom = { 0 };
+        std::atomic<T*>                  m_items[Capacity];
+    };
+
+    struct ParallelForLoop;
+
+    // Range of loop iterations, split in half by whoever runs it until a single chunk remains
+    struct ParallelForTask
+    {
+        ParallelForLoop* m_loop  = nullptr;
+        int64_t          m_begin = 0,
+                         m_end   = 0;
+    };
+
+    /*
+        Pool of worker threads, each owning a WorkStealingDeque. Threads that are not part
+        of the pool claim one of NumExternalSlots extra deques for the duration of their
+        ParallelFor, so several outside callers run their loops side by side. m_externalMutex
+        is only taken to wait for a slot when all of them are in use.
+    */
+    class ThreadPool
+    {
+    public:
+        ThreadPool(int _numThreads);
+        ~ThreadPool();
+
+        // Runs _func_ for every index in [0, _count_), blocks until all iterations finished
+        void        ParallelFor(const std::function<void(int64_t)>& _func, int64_t _count, int _chunkSize = 1);
+
+        // Total number of slots that may execute tasks, workers plus external slots
+        int         GetThreadCount() const;
+
+        // Slot for a thread outside the pool, blocks while every external slot is taken
+        int         ClaimExternalSlot();
+        void        ReleaseExternalSlot(int _slot);
+
+        static constexpr int NumExternalSlots = 16;
+
+    private:
+        using TaskDeque = WorkStealingDeque<ParallelForTask>;
+
+        void        WorkerLoop(int _index);
+        void        RunLoop(ParallelForLoop& _loop, int _slot);
+        void        Execute(ParallelForTask* _task, int _slot);
+        ParallelForTask* FindWork(int _slot, uint32_t& _rngState);
+        void        SignalWork();
+
+        std::vector<std::thread>                m_threads;
+        std::vector<std::unique_ptr<TaskDeque>> m_deques;   // one per worker + NumExternalSlots
+        std::atomic<uint32_t>                   m_freeExternalSlots = { (1u << NumExternalSlots) - 1 };
+        std::mutex                              m_externalMutex;
+        std::condition_variable                 m_externalSignal;
+
+        std::mutex                              m_sleepMutex;
+        std::condition_variable                 m_sleepSignal;
+        std::atomic<int>                        m_numSleeping = { 0 };
+        std::atomic<uint64_t>                   m_workEpoch   = { 0 };
+        std::atomic<bool>                       m_shutdown    = { false };
+    };
+
+    // Creates the global pool, _numThreads_ <= 0 uses all cores
+    void ParallelInit(int _numThreads = 0);
+    void ParallelCleanup();
+
+    // Number of slots executing ParallelFor work, valid upper bound for ThreadIndex()
+    int  MaxThreadIndex();
+
+    // Index of the calling thread in [0, MaxThreadIndex()), no two threads hold the same index at
+    // once. Only valid inside ParallelFor or a ThreadSlotScope
+    int  ThreadIndex();
+
+    // ThreadIndex() of the calling thread, or -1 when it holds no slot
+    int  ExclusiveThreadIndex();
+
+    // Gives a thread outside the pool a ThreadIndex() of its own until the scope ends, for
+    // per-thread storage used outside ParallelFor. Does nothing if the thread already holds one
+    class ThreadSlotScope
+    {
+    public:
+        ThreadSlotScope();
+        ~ThreadSlotScope();
+
+        ThreadSlotScope(const ThreadSlotScope&) = delete;
+        ThreadSlotScope& operator=(const ThreadSlotScope&) = delete;
+
+    private:
+        ThreadPool* m_pool = nullptr;
+        int         m_slot = -1;
+    };
+
+    void ParallelFor(const std::function<void(int64_t)>& _func, int64_t _count, int _chunkSize = 1);
+
+    // Runs _func_ for every (x, y) in [0, _count.x) x [0, _count.y)
+    void ParallelFor2D(const std::function<void(Vector2i)>& _func, const Vector2i& _count);
+
+    // Queues _func_ on the background task queue and returns immediately. Meant for long,
+    // independent jobs such as image decoding that overlap the calling thread; they never
+    // occupy the ParallelFor workers. ParallelCleanup() waits for queued jobs.
+    void RunAsync(std::function<void()> _func);
 }
\ No newline at end of file
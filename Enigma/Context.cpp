@@ -268,14 +268,9 @@ namespace RayTrace
         
         const auto pLayer =dynamic_cast<EditorLayer*>(  GetLayerManager().GetLayer(eLayer::LAYER_EDITOR));
         assert(pLayer);       
-        const auto pos = pLayer->GetWorldPosition(_xy, pLayer->GetDepth(_xy));
-        if (HasInfinities(pos)) {
-            _valid = false;
-            return InvalidObjUnderMouse;
-        }
-        const auto objId = pLayer->GetObjectId(_xy);
-        _valid = true;
-        return ObjectUnderMouse(objId, pos);
+        const auto objUnderMouse = pLayer->GetObjectUnderCursor(_xy);
+        _valid = !HasInfinities(objUnderMouse.second);
+        return objUnderMouse;
 
     }
 
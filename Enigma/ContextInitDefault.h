@@ -115,10 +115,6 @@ namespace RayTrace
         params.m_depth      = 1;
         params.m_target     = eTarget::TARGET_TEXTURE_2D;
         
-        //Picking Framebuffer
-        valid &= GetResourceManager().AddFrameBuffer("__DefaultPickingFrameBuffer", std::unique_ptr<HWFrameBuffer>(
-            CreateFrameBuffer(this, { eInternalFormat::INTERNAL_R32UI, eInternalFormat::INTERNAL_DEPTH_COMPONENT32F }, params, false)));
-
         //Depth only framebuffer
         valid &= GetResourceManager().AddFrameBuffer("__DefaultDepthOnlyFrameBuffer", std::unique_ptr<HWFrameBuffer>(
             CreateFrameBuffer(this, { eInternalFormat::INTERNAL_DEPTH24_STENCIL8 }, params, false)));
@@ -595,25 +591,34 @@ namespace RayTrace
             };
 
 
+            //the filters only run on the objects owning the components they test for
+            const std::vector<SceneGather> GatherMeshes = {
+                GatherObjectsWith<MeshComponent>(), GatherObjectsWith<IndexedMeshComponent>() };
+            const std::vector<SceneGather> GatherEditorItems = {
+                GatherObjectsWith<MeshComponent>(), GatherObjectsWith<IndexedMeshComponent>(),
+                GatherObjectsWith<LightComponent>(), GatherObjectsWith<EditorSpriteComponent, Position3fComponent>() };
+
             auto depthOnlyPass = new DepthPrePass(this, 
                 "Depth Only Pass", 
-                std::make_unique<FilteredSceneItemCollector>(IsMeshFilter),
+                std::make_unique<FilteredSceneItemCollector>(IsMeshFilter, true, GatherMeshes),
                 depthOnlyState);
             auto meshPass = new HWPass(this, 
                 "World Pass", 
-                std::make_unique<FilteredSceneItemCollector>(IsMeshFilter),
+                std::make_unique<FilteredSceneItemCollector>(IsMeshFilter, true, GatherMeshes),
                 meshState);
             auto skyPass = new HWPass(this,
                     "Sky Pass", 
-                std::make_unique<FilteredSceneItemCollector>(IsSkyBoxFilter),
+                std::make_unique<FilteredSceneItemCollector>(IsSkyBoxFilter, true,
+                    std::vector<SceneGather>{ GatherObjectsWith<SkyBoxComponent>() }),
                 skyState);
             auto lightPass = new HWPass(this, 
                 "Light Pass", 
-                 std::make_unique<FilteredSceneItemCollector>(IsLightFilter)
+                 std::make_unique<FilteredSceneItemCollector>(IsLightFilter, true,
+                     std::vector<SceneGather>{ GatherObjectsWith<LightComponent>() })
             );
             auto editorPass = new EditorPass(this,
                 "Editor Pass", 
-                std::make_unique<FilteredSceneItemCollector>(EditorPassFilter),
+                std::make_unique<FilteredSceneItemCollector>(EditorPassFilter, true, GatherEditorItems),
                 editorState);
 
             lightPass->SetShader(GetResourceManager().GetShader("__LightCullingShader"));
@@ -101,6 +101,7 @@ namespace RayTrace
     using Matrix4x4 = glm::mat4;
 
     class Transform;
+    class AnimatedTransform;
    // class Matrix4x4;
  
     template <typename T> class BBox2;
@@ -154,6 +155,7 @@ namespace RayTrace
     template <int nSamples> class CoefficientSpectrum;
     class RGBSpectrum;
     class SampledSpectrum;
+    class SampledWavelengths;
     typedef RGBSpectrum Spectrum;
 
     using FilterUPtr = std::unique_ptr<Filter>;
@@ -246,10 +248,12 @@ namespace RayTrace
 namespace RayTrace
 {
     class Primitive;
+    class Aggregate;
     class Shape;
     class ShapeSet;
     class GeometricPrimitive;
     class BVHAccel;  
+    class InstanceAccel;
 
     struct TriangleMesh;
 
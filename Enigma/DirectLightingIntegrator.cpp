@@ -35,12 +35,19 @@ namespace RayTrace
     }
 
     Spectrum DirectLightingIntegrator::Li(const RayDifferential& ray,
-        const Scene& scene, Sampler& sampler, MemoryArena& arena, int depth) const
+        const Scene& scene, Sampler& sampler, MemoryArena& arena, int depth, const SurfaceInteraction* primaryHit) const
     {
         Spectrum L(0.f);
         // Find closest ray intersection or return background radiance
         SurfaceInteraction isect;
-        if (!scene.intersect(ray, &isect)) {
+        bool foundIntersection;
+        if (primaryHit) {
+            isect = *primaryHit;
+            foundIntersection = primaryHit->m_primitive != nullptr;
+        }
+        else
+            foundIntersection = scene.intersect(ray, &isect);
+        if (!foundIntersection) {
             for (const auto& light : scene.m_lights)
                 L += light->Le(ray);
             return L;
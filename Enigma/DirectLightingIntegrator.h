@@ -15,7 +15,8 @@ namespace RayTrace
             std::shared_ptr<Camera> camera,
             std::shared_ptr<Sampler> sampler,
             const BBox2i& pixelBounds);
-        Spectrum        Li(const RayDifferential& ray, const Scene& scene, Sampler& sampler, MemoryArena& arena, int depth) const override;
+        Spectrum        Li(const RayDifferential& ray, const Scene& scene, Sampler& sampler, MemoryArena& arena, int depth,
+                           const SurfaceInteraction* primaryHit = nullptr) const override;
         void            Preprocess(const Scene& scene, Sampler& sampler) override;
 
     private:
@@ -0,0 +1,254 @@
+#include <assert.h>
+#include <algorithm>
+#include "DynamicAABBTree.h"
+
+namespace RayTrace
+{
+    DynamicAABBTree::DynamicAABBTree(float _margin /*= 0.1f*/)
+        : m_margin(_margin)
+    {
+
+    }
+
+    int32_t DynamicAABBTree::Insert(const BBox3f& _bounds, void* _pUserData)
+    {
+        const int32_t proxy = allocateNode();
+        m_nodes[proxy].m_bounds    = fatten(_bounds);
+        m_nodes[proxy].m_pUserData = _pUserData;
+        m_nodes[proxy].m_height    = 0;
+        insertLeaf(proxy);
+        ++m_proxyCount;
+        return proxy;
+    }
+
+    void DynamicAABBTree::Remove(int32_t _proxy)
+    {
+        assert(_proxy >= 0 && _proxy < (int32_t)m_nodes.size() && m_nodes[_proxy].IsLeaf());
+        removeLeaf(_proxy);
+        freeNode(_proxy);
+        --m_proxyCount;
+    }
+
+    bool DynamicAABBTree::Move(int32_t _proxy, const BBox3f& _bounds)
+    {
+        assert(_proxy >= 0 && _proxy < (int32_t)m_nodes.size() && m_nodes[_proxy].IsLeaf());
+        const BBox3f& fatBounds = m_nodes[_proxy].m_bounds;
+        const BBox3f  newFatBounds = fatten(_bounds);
+        const bool contained = fatBounds.inside(_bounds.m_min) && fatBounds.inside(_bounds.m_max);
+        // Objects that shrank a lot are reinserted as well, their old bounds would stay in every query
+        if (contained && fatBounds.surfaceArea() <= 4.0f * newFatBounds.surfaceArea())
+            return false;
+
+        removeLeaf(_proxy);
+        m_nodes[_proxy].m_bounds = newFatBounds;
+        insertLeaf(_proxy);
+        return true;
+    }
+
+    void DynamicAABBTree::Clear()
+    {
+        m_nodes.clear();
+        m_root       = NullNode;
+        m_freeList   = NullNode;
+        m_proxyCount = 0;
+    }
+
+    void* DynamicAABBTree::GetUserData(int32_t _proxy) const
+    {
+        return m_nodes[_proxy].m_pUserData;
+    }
+
+    const BBox3f& DynamicAABBTree::GetFatBounds(int32_t _proxy) const
+    {
+        return m_nodes[_proxy].m_bounds;
+    }
+
+    int32_t DynamicAABBTree::GetHeight() const
+    {
+        return m_root != NullNode ? m_nodes[m_root].m_height : 0;
+    }
+
+    int32_t DynamicAABBTree::allocateNode()
+    {
+        if (m_freeList == NullNode) {
+            m_nodes.emplace_back();
+            return (int32_t)m_nodes.size() - 1;
+        }
+        const int32_t node = m_freeList;
+        m_freeList = m_nodes[node].m_parent;
+        m_nodes[node] = Node();
+        return node;
+    }
+
+    void DynamicAABBTree::freeNode(int32_t _node)
+    {
+        m_nodes[_node].m_parent    = m_freeList;
+        m_nodes[_node].m_height    = -1;
+        m_nodes[_node].m_pUserData = nullptr;
+        m_freeList = _node;
+    }
+
+    BBox3f DynamicAABBTree::fatten(const BBox3f& _bounds) const
+    {
+        BBox3f retVal = _bounds;
+        const Vector3f diag = _bounds.diagonal();
+        retVal.expand(m_margin * std::max(diag.x, std::max(diag.y, diag.z)));
+        return retVal;
+    }
+
+    void DynamicAABBTree::refit(int32_t _node)
+    {
+        Node& node = m_nodes[_node];
+        const Node& child0 = m_nodes[node.m_child[0]];
+        const Node& child1 = m_nodes[node.m_child[1]];
+        node.m_bounds = Union(child0.m_bounds, child1.m_bounds);
+        node.m_height = 1 + std::max(child0.m_height, child1.m_height);
+    }
+
+    void DynamicAABBTree::insertLeaf(int32_t _leaf)
+    {
+        if (m_root == NullNode) {
+            m_root = _leaf;
+            m_nodes[_leaf].m_parent = NullNode;
+            return;
+        }
+
+        // Descend towards the sibling with the lowest surface area cost
+        const BBox3f leafBounds = m_nodes[_leaf].m_bounds;
+        int32_t index = m_root;
+        while (!m_nodes[index].IsLeaf()) {
+            const Node& node   = m_nodes[index];
+            const float area   = node.m_bounds.surfaceArea();
+            const float combinedArea = Union(node.m_bounds, leafBounds).surfaceArea();
+
+            // Cost of pairing the leaf with this node, and of pushing it further down
+            const float cost            = 2.0f * combinedArea;
+            const float inheritanceCost = 2.0f * (combinedArea - area);
+
+            float childCost[2];
+            for (int i = 0; i < 2; ++i) {
+                const Node& child = m_nodes[node.m_child[i]];
+                const float unionArea = Union(child.m_bounds, leafBounds).surfaceArea();
+                childCost[i] = (child.IsLeaf() ? unionArea : unionArea - child.m_bounds.surfaceArea()) + inheritanceCost;
+            }
+
+            if (cost < childCost[0] && cost < childCost[1])
+                break;
+            index = childCost[0] < childCost[1] ? node.m_child[0] : node.m_child[1];
+        }
+
+        // Replace the sibling by a new parent of the sibling and the leaf
+        const int32_t sibling   = index;
+        const int32_t oldParent = m_nodes[sibling].m_parent;
+        const int32_t newParent = allocateNode();
+        Node& parent = m_nodes[newParent];
+        parent.m_parent   = oldParent;
+        parent.m_bounds   = Union(leafBounds, m_nodes[sibling].m_bounds);
+        parent.m_height   = m_nodes[sibling].m_height + 1;
+        parent.m_child[0] = sibling;
+        parent.m_child[1] = _leaf;
+        m_nodes[sibling].m_parent = newParent;
+        m_nodes[_leaf].m_parent   = newParent;
+
+        if (oldParent != NullNode) {
+            Node& grandParent = m_nodes[oldParent];
+            grandParent.m_child[grandParent.m_child[0] == sibling ? 0 : 1] = newParent;
+        }
+        else {
+            m_root = newParent;
+        }
+
+        for (index = m_nodes[_leaf].m_parent; index != NullNode; index = m_nodes[index].m_parent) {
+            index = balance(index);
+            refit(index);
+        }
+    }
+
+    void DynamicAABBTree::removeLeaf(int32_t _leaf)
+    {
+        if (_leaf == m_root) {
+            m_root = NullNode;
+            return;
+        }
+
+        const int32_t parent      = m_nodes[_leaf].m_parent;
+        const int32_t grandParent = m_nodes[parent].m_parent;
+        const int32_t sibling     = m_nodes[parent].m_child[m_nodes[parent].m_child[0] == _leaf ? 1 : 0];
+
+        if (grandParent == NullNode) {
+            m_root = sibling;
+            m_nodes[sibling].m_parent = NullNode;
+            freeNode(parent);
+            return;
+        }
+
+        // The sibling takes the parent's place
+        Node& grand = m_nodes[grandParent];
+        grand.m_child[grand.m_child[0] == parent ? 0 : 1] = sibling;
+        m_nodes[sibling].m_parent = grandParent;
+        freeNode(parent);
+
+        for (int32_t index = grandParent; index != NullNode; index = m_nodes[index].m_parent) {
+            index = balance(index);
+            refit(index);
+        }
+    }
+
+    // Rotates the taller grandchild up if the children of _iA_ differ more than one in height,
+    // returns the node now at _iA_'s position
+    int32_t DynamicAABBTree::balance(int32_t _iA)
+    {
+        Node& A = m_nodes[_iA];
+        if (A.IsLeaf() || A.m_height < 2)
+            return _iA;
+
+        const int32_t iB = A.m_child[0];
+        const int32_t iC = A.m_child[1];
+        Node& B = m_nodes[iB];
+        Node& C = m_nodes[iC];
+        const int32_t balanceFactor = C.m_height - B.m_height;
+
+        // Rotate _up_ (C or B) above A, _down_ is the sibling that stays below A
+        auto rotate = [&](int32_t _iUp, int32_t _upSlot, int32_t _iDown) {
+            Node& up = m_nodes[_iUp];
+            const int32_t iF = up.m_child[0];
+            const int32_t iG = up.m_child[1];
+            Node& F = m_nodes[iF];
+            Node& G = m_nodes[iG];
+
+            // Swap A and its child
+            up.m_child[0] = _iA;
+            up.m_parent   = A.m_parent;
+            A.m_parent    = _iUp;
+
+            if (up.m_parent != NullNode) {
+                Node& upParent = m_nodes[up.m_parent];
+                upParent.m_child[upParent.m_child[0] == _iA ? 0 : 1] = _iUp;
+            }
+            else {
+                m_root = _iUp;
+            }
+
+            // The taller grandchild stays with the rotated node, the other one moves to A
+            const Node& down = m_nodes[_iDown];
+            int32_t iKeep = iF, iMove = iG;
+            if (F.m_height <= G.m_height)
+                std::swap(iKeep, iMove);
+            up.m_child[1] = iKeep;
+            A.m_child[_upSlot] = iMove;
+            m_nodes[iMove].m_parent = _iA;
+
+            A.m_bounds  = Union(down.m_bounds, m_nodes[iMove].m_bounds);
+            A.m_height  = 1 + std::max(down.m_height, m_nodes[iMove].m_height);
+            up.m_bounds = Union(A.m_bounds, m_nodes[iKeep].m_bounds);
+            up.m_height = 1 + std::max(A.m_height, m_nodes[iKeep].m_height);
+            return _iUp;
+        };
+
+        if (balanceFactor > 1)
+            return rotate(iC, 1, iB);
+        if (balanceFactor < -1)
+            return rotate(iB, 0, iC);
+        return _iA;
+    }
+}
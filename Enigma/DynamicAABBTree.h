@@ -0,0 +1,132 @@
+#pragma once
+#include <vector>
+#include "BBox.h"
+#include "Frustum.h"
+#include "Ray.h"
+
+namespace RayTrace
+{
+    /*
+        @brief: Bounding volume hierarchy over moving objects. Leaves store enlarged bounds so that
+                small movements do not touch the tree, internal nodes are kept balanced with
+                rotations. Objects are identified by the proxy returned from Insert()
+    */
+    class DynamicAABBTree
+    {
+    public:
+        static constexpr int32_t NullNode = -1;
+
+        DynamicAABBTree(float _margin = 0.1f);
+
+        int32_t         Insert(const BBox3f& _bounds, void* _pUserData);
+        void            Remove(int32_t _proxy);
+        // Returns true if the proxy had to be reinserted
+        bool            Move(int32_t _proxy, const BBox3f& _bounds);
+        void            Clear();
+
+        void*           GetUserData(int32_t _proxy) const;
+        const BBox3f&   GetFatBounds(int32_t _proxy) const;
+        int32_t         GetHeight() const;
+        uint32_t        GetProxyCount() const { return m_proxyCount; }
+
+        // Calls _func_(void* userData) for every proxy whose bounds are not outside the frustum.
+        // Subtrees entirely inside are reported without testing them further
+        template<typename Func>
+        void            Query(const FrustumCuller& _culler, Func _func) const;
+        // Calls _func_(void* userData) for every proxy whose bounds _ray_ enters before _ray.m_maxT_.
+        // The callback may shorten m_maxT, farther subtrees are then skipped
+        template<typename Func>
+        void            Query(const Ray& _ray, Func _func) const;
+
+    private:
+        struct Node
+        {
+            bool IsLeaf() const { return m_child[0] == NullNode; }
+
+            BBox3f  m_bounds;
+            void*   m_pUserData = nullptr;
+            int32_t m_parent    = NullNode;    //next free node while on the free list
+            int32_t m_child[2]  = { NullNode, NullNode };
+            int32_t m_height    = -1;          //0 for leaves, -1 for free nodes
+        };
+
+        int32_t         allocateNode();
+        void            freeNode(int32_t _node);
+        void            insertLeaf(int32_t _leaf);
+        void            removeLeaf(int32_t _leaf);
+        void            refit(int32_t _node);
+        int32_t         balance(int32_t _node);
+        BBox3f          fatten(const BBox3f& _bounds) const;
+
+        std::vector<Node>   m_nodes;
+        int32_t             m_root       = NullNode;
+        int32_t             m_freeList   = NullNode;
+        uint32_t            m_proxyCount = 0;
+        float               m_margin;
+    };
+
+    template<typename Func>
+    void DynamicAABBTree::Query(const FrustumCuller& _culler, Func _func) const
+    {
+        if (m_root == NullNode)
+            return;
+
+        struct Entry {
+            int32_t m_node;
+            bool    m_inside;
+        };
+        // Rotations keep the height logarithmic, a path never holds more than height + 1 entries
+        Entry stack[128];
+        int   stackSize = 0;
+        stack[stackSize++] = { m_root, false };
+        while (stackSize > 0) {
+            const Entry entry = stack[--stackSize];
+            const Node& node  = m_nodes[entry.m_node];
+
+            bool inside = entry.m_inside;
+            if (!inside) {
+                const auto result = _culler.Classify(node.m_bounds);
+                if (result == eCullResult::CULL_RESULT_OUTSIDE)
+                    continue;
+                inside = result == eCullResult::CULL_RESULT_INSIDE;
+            }
+
+            if (node.IsLeaf()) {
+                _func(node.m_pUserData);
+            }
+            else {
+                assert(stackSize + 2 <= 128);
+                stack[stackSize++] = { node.m_child[0], inside };
+                stack[stackSize++] = { node.m_child[1], inside };
+            }
+        }
+    }
+
+    template<typename Func>
+    void DynamicAABBTree::Query(const Ray& _ray, Func _func) const
+    {
+        if (m_root == NullNode)
+            return;
+
+        const Vector3f invDir(1.0f / _ray.m_dir.x, 1.0f / _ray.m_dir.y, 1.0f / _ray.m_dir.z);
+        const int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+        int32_t stack[128];
+        int     stackSize = 0;
+        stack[stackSize++] = m_root;
+        while (stackSize > 0) {
+            const Node& node = m_nodes[stack[--stackSize]];
+            if (!node.m_bounds.intersectP(_ray, invDir, dirIsNeg))
+                continue;
+
+            if (node.IsLeaf()) {
+                _func(node.m_pUserData);
+            }
+            else {
+                assert(stackSize + 2 <= 128);
+                stack[stackSize++] = node.m_child[0];
+                stack[stackSize++] = node.m_child[1];
+            }
+        }
+    }
+}
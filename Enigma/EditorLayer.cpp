@@ -23,6 +23,7 @@
 #include "ModifierStack.h"
 #include "Modifiers.h"
 #include "Geometry.h"
+#include "Picking.h"
 #include "EditorLayer.h"
 
 namespace RayTrace
@@ -30,6 +31,7 @@ namespace RayTrace
     EditorLayer::EditorLayer(Context* _pContext)
         : LayerBase( _pContext )
         , m_pSelectionHelper( std::make_unique<SceneSelection>( _pContext, this ) )
+        , m_pPicker( std::make_unique<ScenePicker>( _pContext ) )
     {
         m_layerName = "Editor";
         m_layer = eLayer::LAYER_EDITOR;     
@@ -114,29 +116,24 @@ namespace RayTrace
 
     uint32_t EditorLayer::GetObjectId(const Vector2i& _xy) const
     {
-        const auto pixIndex = GetPixelIndex(_xy);
-        if (pixIndex == INVALID_ID)
-            return INVALID_ID;
-        
-        return m_pEditorPass->GetObjectIdPixels()[pixIndex];
+        return GetObjectUnderCursor(_xy).first;
     }
 
     float EditorLayer::GetDepth(const Vector2i& _xy) const
     {
-        const auto pixIndex = GetPixelIndex(_xy);
-        if (pixIndex == INVALID_ID)
+        const auto worldPos = GetObjectUnderCursor(_xy).second;
+        if (HasInfinities(worldPos))
             return InfinityF32;
         
-        return m_pEditorPass->GetDepthPixels()[pixIndex];
+        return m_pActiveCam->WorldToScreen(worldPos).z;
     }
 
     Vector3f EditorLayer::GetWorldPosition(const Vector2i& _xy, float _depth) const
     {
         assert(m_pActiveCam && "No Active Camera");
-        const float depth = GetDepth(_xy);
-        if (depth == InfinityF32)
+        if (_depth == InfinityF32)
             return Vector3f(InfinityF32);
-        return m_pActiveCam->ScreenToWorld( _xy.x, _xy.y, depth );
+        return m_pActiveCam->ScreenToWorld( _xy.x, _xy.y, _depth );
     }
 
     std::pair<uint32_t,Vector3f> EditorLayer::GetObjectUnderCursor() const
@@ -146,23 +143,20 @@ namespace RayTrace
 
     ObjectUnderMouse EditorLayer::GetObjectUnderCursor(const Vector2i& _xy) const
     {
-        const auto depth = GetDepth(_xy);
-        if (depth == InfinityF32) {          
-            return { INVALID_ID, Vector3f{ InfinityF32, InfinityF32, InfinityF32 } };
-        }
-        const auto objId = GetObjectId(_xy);
-        const auto worldPos = GetWorldPosition(_xy, depth);
-        return { objId, worldPos };
+        if (!m_pActiveCam)
+            return InvalidObjUnderMouse;
+
+        const auto pick = m_pPicker->Pick(m_pActiveCam, _xy);
+        if (!pick.m_pEntity)
+            return InvalidObjUnderMouse;
+        return { pick.m_pEntity->GetObjectId(), pick.m_worldPos };
     }
 
-    void EditorLayer::AddPass(HWPass* _pPass)
+    EntityVector EditorLayer::GetObjectsInRect(const Vector2i& _min, const Vector2i& _max) const
     {
-        auto pass = dynamic_cast<EditorPass*>(_pPass);
-        if (pass){
-            m_pEditorPass = pass;
-        }        
-       
-        LayerBase::AddPass(_pPass);
+        if (!m_pActiveCam)
+            return {};
+        return m_pPicker->PickRect(m_pActiveCam, _min, _max);
     }
 
 
@@ -193,17 +187,6 @@ namespace RayTrace
             CrossHairColor, CrossHairLineWidth);
     }
 
-    int EditorLayer::GetPixelIndex(const Vector2i& _xy) const
-    {
-        const auto& vpSize   = m_pEditorPass->GetViewport().GetFrameBufferSize();
-        const auto _xyCoord  = _xy / m_pEditorPass->GetViewportDownScale();
-        const auto idx = vpSize.x *( vpSize.y - _xyCoord.y ) + _xyCoord.x; //flip y
-        if (idx < 0 || idx >= vpSize.x * vpSize.y)
-            return INVALID_ID;
-
-        return idx;
-    }
-
     bool EditorLayer::KeyDown(const KeyInfo& _info)
     {
 		auto CtrlDown = GetContext().GetInputHandler().CtrlDown();
@@ -252,14 +235,9 @@ namespace RayTrace
         
         assert(GetWindowId() == _info.m_windowId && "Window Id Mismatch"); //TODO support for multiple windows
         const auto xy = Vector2i(_info.m_x, _info.m_y);
-        const auto depth = GetDepth(xy);
-        if (depth == InfinityF32) {
-            m_objUnderMouse = InvalidObjUnderMouse;
+        m_objUnderMouse = GetObjectUnderCursor(xy);
+        if (m_objUnderMouse.first == INVALID_ID)
             return {};
-        }
-        const auto objId = GetObjectId(xy);
-        const auto worldPos = GetWorldPosition(xy, depth);       
-        m_objUnderMouse = ObjectUnderMouse(objId, worldPos);
 
         if (m_pSelectionHelper->IsActive())
             return m_pSelectionHelper->MouseMove(_info);
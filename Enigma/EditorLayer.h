@@ -29,8 +29,7 @@ namespace RayTrace
 
         ObjectUnderMouse    GetObjectUnderCursor() const;
         ObjectUnderMouse    GetObjectUnderCursor(const Vector2i& _xy) const;
-
-        void                AddPass(HWPass* _pPass) override;
+        EntityVector        GetObjectsInRect(const Vector2i& _min, const Vector2i& _max) const;
 
         SceneSelection*     GetSelectionHelper() const;
 
@@ -43,8 +42,6 @@ namespace RayTrace
                                 
     private:      
         void         DrawCrossHair(const SceneView* _pView);
-        
-        int          GetPixelIndex(const Vector2i& _xy) const;
 
         bool         KeyDown(const KeyInfo& _info)override;
         bool         KeyUp(const KeyInfo& _info)override;
@@ -63,9 +60,9 @@ namespace RayTrace
         float        m_keyRepeatTreshold = 1.0f;
         float        m_lastKeyRepeatTime = 0;
        
-        EditorPass*  m_pEditorPass = nullptr;
         ObjectUnderMouse m_objUnderMouse = InvalidObjUnderMouse;
 
         std::unique_ptr<SceneSelection> m_pSelectionHelper;
+        std::unique_ptr<ScenePicker>    m_pPicker;
     };
 }
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include "ImageFilmSDL.h"
 #include "Integrator.h"
 #include "Scene.h"
+#include "Concurrency.h"
 #include "Film.h"
 
 
@@ -21,6 +22,11 @@ namespace RayTrace
 {
 
 
+    // Splats of one thread, pages of splatPageSize^2 XYZ triples are allocated on first use
+    struct Film::SplatBuffer {
+        std::vector<std::unique_ptr<float[]>> pages;
+    };
+
     static std::atomic<float>& operator+= (std::atomic<float>& atomicFloat, float increment)
     {
         float oldValue;
@@ -37,13 +43,15 @@ namespace RayTrace
     }
 
     Film::Film(const Vector2i& resolution, const BBox2f& cropWindow, std::unique_ptr<Filter> filter, 
-        float diagonal, const std::string& filename, float scale, float maxSampleLuminance /*= InfinityF32*/)
+        float diagonal, const std::string& filename, float scale, float maxSampleLuminance /*= InfinityF32*/,
+        bool lockFreeAccumulation /*= true*/)
         : m_fullResolution(resolution)
         , m_diagonal(diagonal * .001)
         , m_filter(std::move(filter))
         , m_filename(filename)
         , m_scale(scale)
         , m_maxSampleLuminance(maxSampleLuminance) 
+        , m_lockFree(lockFreeAccumulation)
     {
         // Compute film image bounds
         m_croppedPixelBounds =
@@ -57,6 +65,7 @@ namespace RayTrace
 
         // Allocate film image storage
         m_pixels = std::unique_ptr<Pixel[]>(new Pixel[m_croppedPixelBounds.area()]);      
+        m_pixelStats = std::unique_ptr<PixelStats[]>(new PixelStats[m_croppedPixelBounds.area()]);
 
         // Precompute filter weight table
         int offset = 0;
@@ -68,8 +77,22 @@ namespace RayTrace
                 m_filterTable[offset] = m_filter->Evaluate(p);
             }
         }
+
+        if (m_lockFree) {
+            Vector2i extent = m_croppedPixelBounds.m_max - m_croppedPixelBounds.m_min;
+            m_numMergeRegions = (extent + Vector2i(mergeRegionSize - 1)) / mergeRegionSize;
+            m_mergeLocks.reset(new std::mutex[std::max(1, m_numMergeRegions.x * m_numMergeRegions.y)]);
+            m_numSplatPages = (extent + Vector2i(splatPageSize - 1)) / splatPageSize;
+            m_splatBuffers.resize(MaxThreadIndex());
+            for (auto& buffer : m_splatBuffers) {
+                buffer = std::make_unique<SplatBuffer>();
+                buffer->pages.resize(std::max(0, m_numSplatPages.x * m_numSplatPages.y));
+            }
+        }
     }
 
+    Film::~Film() = default;
+
     BBox2i Film::GetSampleBounds() const
     {
 
@@ -101,29 +124,46 @@ namespace RayTrace
     void Film::MergeFilmTile(std::unique_ptr<FilmTile> tile)
     {
         const auto& bounds = tile->GetPixelBounds();
-        int xMin = bounds.m_min.x;
-        int xMax = bounds.m_max.x;
-        int yMin = bounds.m_min.y;
-        int yMax = bounds.m_max.y;
-        
-        {
+        if (!m_lockFree) {
             std::lock_guard<std::mutex> lock(m_mutex);
-            for (int y = yMin; y < yMax; ++y) {
-                for (int x = xMin; x < xMax; ++x) {
-                    const FilmTilePixel& tilePixel = tile->GetPixel(Vector2i(x, y));
-                    Pixel& mergePixel = GetPixel(Vector2i(x, y));
-                    float xyz[3];
-                    tilePixel.contribSum.ToXYZ(xyz);
-                    for (int i = 0; i < 3; ++i)
-                        mergePixel.xyz[i] += xyz[i];
-
-                    mergePixel.filterWeightSum += tilePixel.filterWeightSum;
+            mergeTilePixels(*tile, bounds);
+        }
+        else if (bounds.m_max.x > bounds.m_min.x && bounds.m_max.y > bounds.m_min.y) {
+            // Only tiles sharing a merge region wait for each other, regions are locked one at a time
+            Vector2i r0 = (bounds.m_min - m_croppedPixelBounds.m_min) / mergeRegionSize;
+            Vector2i r1 = (bounds.m_max - Vector2i(1) - m_croppedPixelBounds.m_min) / mergeRegionSize;
+            for (int ry = r0.y; ry <= r1.y; ++ry) {
+                for (int rx = r0.x; rx <= r1.x; ++rx) {
+                    Vector2i regionMin = m_croppedPixelBounds.m_min + Vector2i(rx, ry) * mergeRegionSize;
+                    BBox2i region = Intersection(BBox2i(regionMin, regionMin + Vector2i(mergeRegionSize)), bounds);
+                    std::lock_guard<std::mutex> lock(m_mergeLocks[ry * m_numMergeRegions.x + rx]);
+                    mergeTilePixels(*tile, region);
                 }
             }
         }
         OnTileMerged(tile.get()); 
     }
 
+    void Film::mergeTilePixels(const FilmTile& tile, const BBox2i& region)
+    {
+        for (int y = region.m_min.y; y < region.m_max.y; ++y) {
+            for (int x = region.m_min.x; x < region.m_max.x; ++x) {
+                const FilmTilePixel& tilePixel = tile.GetPixel(Vector2i(x, y));
+                Pixel& mergePixel = GetPixel(Vector2i(x, y));
+                float xyz[3];
+                tilePixel.contribSum.ToXYZ(xyz);
+                for (int i = 0; i < 3; ++i)
+                    mergePixel.xyz[i] += xyz[i];
+
+                mergePixel.filterWeightSum += tilePixel.filterWeightSum;
+                PixelStats& mergeStats = GetPixelStats(Vector2i(x, y));
+                mergeStats.nSamples += tilePixel.nSamples;
+                mergeStats.lumSum += tilePixel.lumSum;
+                mergeStats.lumSqSum += tilePixel.lumSqSum;
+            }
+        }
+    }
+
     void Film::SetImage(const Spectrum* img) const
     {
         int nPixels = m_croppedPixelBounds.area();
@@ -131,8 +171,10 @@ namespace RayTrace
             Pixel& p = m_pixels[i];
             img[i].ToXYZ(p.xyz);
             p.filterWeightSum = 1;
+            m_pixelStats[i] = PixelStats();
             p.splatXYZ[0] = p.splatXYZ[1] = p.splatXYZ[2] = 0;
         }
+        clearSplatBuffers();
     }
 
     void Film::AddSplat(const Vector2f& p, Spectrum v)
@@ -149,16 +191,72 @@ namespace RayTrace
             v *= m_maxSampleLuminance / v.y();
         float xyz[3];
         v.ToXYZ(xyz);
+        // Threads outside ParallelFor have no slot of their own and may splat concurrently, their
+        // splats and those past the page budget go straight to the atomic pixel sums
+        const int threadIndex = ExclusiveThreadIndex();
+        if (m_lockFree && threadIndex >= 0 && threadIndex < (int)m_splatBuffers.size()) {
+            Vector2i local = pi - m_croppedPixelBounds.m_min;
+            std::unique_ptr<float[]>& page = m_splatBuffers[threadIndex]->pages[
+                (local.y / splatPageSize) * m_numSplatPages.x + local.x / splatPageSize];
+            if (!page && m_numSplatPagesAllocated.load(std::memory_order_relaxed) < maxSplatPages &&
+                m_numSplatPagesAllocated.fetch_add(1, std::memory_order_relaxed) < maxSplatPages)
+                page.reset(new float[3 * splatPageSize * splatPageSize]());
+            if (page) {
+                float* splat = &page[3 * ((local.y % splatPageSize) * splatPageSize + local.x % splatPageSize)];
+                for (int i = 0; i < 3; ++i)
+                    splat[i] += xyz[i];
+                return;
+            }
+        }
         Pixel& pixel = GetPixel(pi);
         for (int i = 0; i < 3; ++i)
             pixel.splatXYZ[i] += xyz[i];
     }
 
+    void Film::MergeSplats()
+    {
+        if (!m_lockFree)
+            return;
+        // Each page is reduced over all threads by one task, so pixels are never shared
+        const Vector2i extent = m_croppedPixelBounds.m_max - m_croppedPixelBounds.m_min;
+        ParallelFor([&](int64_t pageIndex) {
+            const int px0 = int(pageIndex % m_numSplatPages.x) * splatPageSize;
+            const int py0 = int(pageIndex / m_numSplatPages.x) * splatPageSize;
+            const int px1 = std::min(px0 + splatPageSize, extent.x);
+            const int py1 = std::min(py0 + splatPageSize, extent.y);
+            for (auto& buffer : m_splatBuffers) {
+                std::unique_ptr<float[]>& page = buffer->pages[pageIndex];
+                if (!page)
+                    continue;
+                for (int y = py0; y < py1; ++y) {
+                    for (int x = px0; x < px1; ++x) {
+                        const float* splat = &page[3 * ((y - py0) * splatPageSize + (x - px0))];
+                        Pixel& pixel = m_pixels[y * extent.x + x];
+                        for (int i = 0; i < 3; ++i)
+                            pixel.splatXYZ[i].store(pixel.splatXYZ[i].load(std::memory_order_relaxed) + splat[i],
+                                std::memory_order_relaxed);
+                    }
+                }
+                page.reset();
+            }
+        }, m_numSplatPages.x * m_numSplatPages.y);
+        m_numSplatPagesAllocated = 0;
+    }
+
+    void Film::clearSplatBuffers() const
+    {
+        for (const auto& buffer : m_splatBuffers)
+            for (auto& page : buffer->pages)
+                page.reset();
+        m_numSplatPagesAllocated = 0;
+    }
+
     void Film::WriteImage(float splatScale /*= 1*/)
     {
         const auto& bounds = m_croppedPixelBounds;
 
         std::cout << "Splat Scale: " << splatScale << std::endl;
+        MergeSplats();
 
         std::unique_ptr<float[]> rgb(new float[3 * bounds.area()]);
 
@@ -169,32 +267,7 @@ namespace RayTrace
         int offset = 0;
         for (int y = yMin; y < yMax; ++y) {
             for (int x = xMin; x < xMax; ++x) {
-                // Convert pixel XYZ color to RGB
-                Pixel& pixel = GetPixel(Vector2i(x,y));
-                XYZToRGB(pixel.xyz, &rgb[3 * offset]);
-
-                // Normalize pixel with weight sum
-                float filterWeightSum = pixel.filterWeightSum;
-                if (filterWeightSum != 0) {
-                    float invWt = (float)1 / filterWeightSum;
-                    rgb[3 * offset + 0] = std::max((float)0, rgb[3 * offset + 0] * invWt);
-                    rgb[3 * offset + 1] = std::max((float)0, rgb[3 * offset + 1] * invWt);
-                    rgb[3 * offset + 2] = std::max((float)0, rgb[3 * offset + 2] * invWt);
-                }
-
-                // Add splat value at pixel
-                float splatRGB[3];
-                float splatXYZ[3] = { pixel.splatXYZ[0], pixel.splatXYZ[1], pixel.splatXYZ[2] };
-                XYZToRGB(splatXYZ, splatRGB);
-                rgb[3 * offset + 0] += splatScale * splatRGB[0];
-                rgb[3 * offset + 1] += splatScale * splatRGB[1];
-                rgb[3 * offset + 2] += splatScale * splatRGB[2];
-
-                // Scale pixel value by _scale_
-                rgb[3 * offset + 0] *= m_scale;
-                rgb[3 * offset + 1] *= m_scale;
-                rgb[3 * offset + 2] *= m_scale;
-               // std::cout << rgb[3 * offset + 0] << " " << rgb[3 * offset + 1] << " " << rgb[3 * offset + 2] << "\n";
+                getPixelRGB(GetPixel(Vector2i(x, y)), splatScale, &rgb[3 * offset]);
                 ++offset;
             }
         }
@@ -208,6 +281,63 @@ namespace RayTrace
       //  ::WriteImage( m_filename, &rgb[0], croppedPixelBounds, fullResolution);
     }
 
+    void Film::getPixelRGB(const Pixel& pixel, float splatScale, float rgb[3]) const
+    {
+        // Convert pixel XYZ color to RGB
+        XYZToRGB(pixel.xyz, rgb);
+
+        // Normalize pixel with weight sum
+        float filterWeightSum = pixel.filterWeightSum;
+        if (filterWeightSum != 0) {
+            float invWt = (float)1 / filterWeightSum;
+            rgb[0] = std::max((float)0, rgb[0] * invWt);
+            rgb[1] = std::max((float)0, rgb[1] * invWt);
+            rgb[2] = std::max((float)0, rgb[2] * invWt);
+        }
+
+        // Add splat value at pixel
+        float splatRGB[3];
+        float splatXYZ[3] = { pixel.splatXYZ[0], pixel.splatXYZ[1], pixel.splatXYZ[2] };
+        XYZToRGB(splatXYZ, splatRGB);
+        rgb[0] += splatScale * splatRGB[0];
+        rgb[1] += splatScale * splatRGB[1];
+        rgb[2] += splatScale * splatRGB[2];
+
+        // Scale pixel value by _scale_
+        rgb[0] *= m_scale;
+        rgb[1] *= m_scale;
+        rgb[2] *= m_scale;
+    }
+
+    void Film::PublishImage(float splatScale)
+    {
+        MergeSplats();
+        if (!m_callback)
+            return;
+        auto toU8 = [](float _val) {
+            return uint8_t(std::clamp(255.f * std::pow(_val, 1.f / 2.2f), 0.f, 255.f));
+        };
+        for (int y = m_croppedPixelBounds.m_min.y; y < m_croppedPixelBounds.m_max.y; ++y) {
+            for (int x = m_croppedPixelBounds.m_min.x; x < m_croppedPixelBounds.m_max.x; ++x) {
+                float rgb[3];
+                getPixelRGB(GetPixel(Vector2i(x, y)), splatScale, rgb);
+                m_callback(x, y, toU8(rgb[0]), toU8(rgb[1]), toU8(rgb[2]));
+            }
+        }
+    }
+
+    float Film::GetPixelError(const Vector2i& p) const
+    {
+        const PixelStats& stats = GetPixelStats(p);
+        if (stats.nSamples < 2)
+            return InfinityF32;
+        const double n = stats.nSamples;
+        const double mean = stats.lumSum / n;
+        const double variance = std::max(0.0, (stats.lumSqSum - n * mean * mean) / (n - 1));
+        // Near black pixels are measured against a floor so noise far below display precision converges
+        return float(std::sqrt(variance / n) / std::max(mean, 1e-2));
+    }
+
     void Film::Clear()
     {
         int xMin = m_croppedPixelBounds.m_min.x;
@@ -221,8 +351,10 @@ namespace RayTrace
                 for (int c = 0; c < 3; ++c)
                     pixel.splatXYZ[c] = pixel.xyz[c] = 0;
                 pixel.filterWeightSum = 0;
+                GetPixelStats(Vector2i(x, y)) = PixelStats();
             }
         }       
+        clearSplatBuffers();
     }
 
     
@@ -237,13 +369,32 @@ namespace RayTrace
         //nop
     }
 
-    Film::Pixel& Film::GetPixel(const Vector2i& p)
+    int Film::pixelOffset(const Vector2i& p) const
     {
         assert(m_croppedPixelBounds.insideExclusive(p));
         int width = m_croppedPixelBounds.m_max.x - m_croppedPixelBounds.m_min.x;
-        int offset = (p.x - m_croppedPixelBounds.m_min.x) +
+        return (p.x - m_croppedPixelBounds.m_min.x) +
             (p.y - m_croppedPixelBounds.m_min.y) * width;
-        return m_pixels[offset];
+    }
+
+    Film::Pixel& Film::GetPixel(const Vector2i& p)
+    {
+        return m_pixels[pixelOffset(p)];
+    }
+
+    const Film::Pixel& Film::GetPixel(const Vector2i& p) const
+    {
+        return m_pixels[pixelOffset(p)];
+    }
+
+    Film::PixelStats& Film::GetPixelStats(const Vector2i& p)
+    {
+        return m_pixelStats[pixelOffset(p)];
+    }
+
+    const Film::PixelStats& Film::GetPixelStats(const Vector2i& p) const
+    {
+        return m_pixelStats[pixelOffset(p)];
     }
     //////////////////////////////////////////////////////////////////////////
     //FilmTile
@@ -269,6 +420,16 @@ namespace RayTrace
         Vector2f pFilmDiscrete = pFilm - Vector2f(0.5f, 0.5f);
         Vector2i p0 = (Vector2i)Ceil2Int(pFilmDiscrete - m_filterRadius);
         Vector2i p1 = (Vector2i)Floor2Int(pFilmDiscrete + m_filterRadius) + Vector2i(1, 1);
+        // Record the luminance moments in the pixel the sample lies in
+        Vector2i pSample = Floor2Int(pFilm);
+        if (m_pixelBounds.insideExclusive(pSample)) {
+            FilmTilePixel& pixel = GetPixel(pSample);
+            float lum = L.y() * sampleWeight;
+            pixel.lumSum += lum;
+            pixel.lumSqSum += lum * lum;
+            ++pixel.nSamples;
+        }
+
         p0 = Max(p0, m_pixelBounds.m_min); //p0.maxVal(m_pixelBounds.m_min);
         p1 = Min(p1, m_pixelBounds.m_max);//p1.minVal(m_pixelBounds.m_max);
 
@@ -305,7 +466,7 @@ namespace RayTrace
         assert(m_pixelBounds.inside(p));
         int width = m_pixelBounds.m_max.x - m_pixelBounds.m_min.x;
         int offset =
-            (p.x - m_pixelBounds.m_max.x) + (p.y - m_pixelBounds.m_min.y) * width;
+            (p.x - m_pixelBounds.m_min.x) + (p.y - m_pixelBounds.m_min.y) * width;
         return m_pixels[offset];
     }
 
@@ -368,7 +529,9 @@ namespace RayTrace
         float scale    = params.FindOneFloat("scale", 1.);
         float diagonal = params.FindOneFloat("diagonal", 35.);
         float maxSampleLuminance = params.FindOneFloat("maxsampleluminance", InfinityF32);
-        return new Film( Vector2i(xres, yres), crop, std::move(filter), diagonal, filename, scale, maxSampleLuminance);
+        bool lockFreeAccumulation = params.FindOneBool("lockfreeaccumulation", true);
+        return new Film( Vector2i(xres, yres), crop, std::move(filter), diagonal, filename, scale, maxSampleLuminance,
+            lockFreeAccumulation);
     }
 
     Film* CreateFilmSDL(const ParamSet& params, std::unique_ptr<Filter> filter)
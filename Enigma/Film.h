@@ -24,6 +24,10 @@ namespace RayTrace
     struct FilmTilePixel {
         Spectrum contribSum   = 0.f;
         float filterWeightSum = 0.f;
+        // Luminance moments of the samples taken inside the pixel, for adaptive sampling
+        float    lumSum       = 0.f;
+        float    lumSqSum     = 0.f;
+        uint32_t nSamples     = 0;
     };
 
     using SetPixelCallBack = std::function<void(int _x, int _y, uint8_t _r, uint8_t _g, uint8_t _b)>;
@@ -33,10 +37,14 @@ namespace RayTrace
     class Film {
     public:
         // Film Public Methods
+        // With _lockFreeAccumulation_ tiles merge under locks of the film regions they overlap
+        // instead of one film wide mutex, and splats go to per thread buffers
         Film(const Vector2i& resolution, const BBox2f& cropWindow,
             std::unique_ptr<Filter> filter, float diagonal,
             const std::string& filename, float scale,
-            float maxSampleLuminance = InfinityF32);
+            float maxSampleLuminance = InfinityF32,
+            bool lockFreeAccumulation = true);
+        virtual ~Film();
 
         virtual void                WriteImage(float splatScale);
 
@@ -47,10 +55,18 @@ namespace RayTrace
         void                        MergeFilmTile(std::unique_ptr<FilmTile> tile);
         void                        SetImage(const Spectrum* img) const;
         void                        AddSplat(const Vector2f& p, Spectrum v);
+        // Adds the per thread splat buffers into the pixels. Must not run concurrently with
+        // AddSplat; WriteImage calls it, progressive renders call it at their checkpoints
+        void                        MergeSplats();
         
         void                        Clear();
         
         void                        InstallPixelCallback(SetPixelCallBack _cb);
+        // Sends the current image to the pixel callback, progressive renders call it after each pass
+        void                        PublishImage(float splatScale);
+        // Standard error of the mean luminance of pixel _p_ relative to that mean, from the samples
+        // merged so far. Pixels with fewer than two samples report infinity
+        float                       GetPixelError(const Vector2i& p) const;
 
         // Film Public Data
         const Vector2i    m_fullResolution;
@@ -67,22 +83,54 @@ namespace RayTrace
             std::atomic<float>  splatXYZ[3];
             float               pad;
         };
+        static_assert(sizeof(Pixel) == 32, "Pixel should stay 32 bytes, keep new per pixel data in its own array");
+
+        // Luminance moments for adaptive sampling, apart from Pixel so they don't grow it
+        struct PixelStats {
+            uint32_t nSamples = 0;
+            float    lumSum   = 0.f,
+                     lumSqSum = 0.f;
+        };
 
         // Film Private Methods
         Pixel& GetPixel(const Vector2i& p);
+        const Pixel& GetPixel(const Vector2i& p) const;
+        PixelStats& GetPixelStats(const Vector2i& p);
+        const PixelStats& GetPixelStats(const Vector2i& p) const;
 
     protected:
         mutable SetPixelCallBack    m_callback;
 
     private:
-       
+        struct SplatBuffer;
+
+        void  mergeTilePixels(const FilmTile& tile, const BBox2i& region);
+        // Normalized and scaled RGB of _pixel_ including its splats
+        void  getPixelRGB(const Pixel& pixel, float splatScale, float rgb[3]) const;
+        void  clearSplatBuffers() const;
+
+        // Offset of _p_ into m_pixels and m_pixelStats
+        int   pixelOffset(const Vector2i& p) const;
+
         std::unique_ptr<Pixel[]> m_pixels;
+        std::unique_ptr<PixelStats[]> m_pixelStats;
         static constexpr int filterTableWidth = 16;
         float       m_filterTable[filterTableWidth * filterTableWidth];
         std::mutex  m_mutex;
         const float m_scale;
         const float m_maxSampleLuminance;
 
+        static constexpr int mergeRegionSize = 32;     // pixels per side guarded by one merge lock
+        static constexpr int splatPageSize   = 64;     // pixels per side of a splat buffer page
+        // Each thread splatting everywhere would cost threads x pixels x 12 B, about 1.6 GB at
+        // 64 threads and 1080p. Pages past this budget are not allocated, their splats are atomic
+        static constexpr int maxSplatPages   = (256 << 20) / (3 * sizeof(float) * splatPageSize * splatPageSize);
+        const bool                                  m_lockFree;
+        Vector2i                                    m_numMergeRegions;
+        std::unique_ptr<std::mutex[]>               m_mergeLocks;
+        Vector2i                                    m_numSplatPages;
+        std::vector<std::unique_ptr<SplatBuffer>>   m_splatBuffers;    // indexed by ExclusiveThreadIndex()
+        mutable std::atomic<int>                    m_numSplatPagesAllocated = { 0 };
        
 
       
@@ -48,6 +48,8 @@ namespace RayTrace
     class SceneSelection;
     class CopyPasteBuffer;
     class UiAction;
+    class TriangleBVH;
+    class ScenePicker;
 
     struct EventBase;
     class  StateSystem;
@@ -60,6 +62,7 @@ namespace RayTrace
     struct DrawableObject;
   
     using MeshPtr = std::shared_ptr<MeshBase>;
+    using TriangleBVHPtr = std::shared_ptr<TriangleBVH>;
    
     template<typename T>
     class VertexBuffer;
@@ -1,6 +1,78 @@
 #pragma once
+#include <xmmintrin.h>
+#include <algorithm>
+#include "HWCamera.h"
 
 namespace RayTrace
 {
+    enum class eCullResult
+    {
+        CULL_RESULT_OUTSIDE,
+        CULL_RESULT_INTERSECTS,
+        CULL_RESULT_INSIDE
+    };
 
-}
\ No newline at end of file
+    /*
+        @brief: Frustum planes stored per component so that a box is tested against 4 planes at a
+                time. The 6 planes are padded to 8 by repeating the last one
+    */
+    class FrustumCuller
+    {
+    public:
+        explicit FrustumCuller(const Frustum& _frustum)
+        {
+            alignas(16) float nx[8], ny[8], nz[8], d[8];
+            for (int i = 0; i < 8; ++i) {
+                const Plane& plane = _frustum.m_planes[std::min(i, 5)];
+                nx[i] = plane.m_normal.x;
+                ny[i] = plane.m_normal.y;
+                nz[i] = plane.m_normal.z;
+                d[i]  = plane.m_distance;
+            }
+            const __m128 signMask = _mm_set1_ps(-0.0f);
+            for (int i = 0; i < 2; ++i) {
+                m_nx[i]    = _mm_load_ps(nx + 4 * i);
+                m_ny[i]    = _mm_load_ps(ny + 4 * i);
+                m_nz[i]    = _mm_load_ps(nz + 4 * i);
+                m_d[i]     = _mm_load_ps(d + 4 * i);
+                m_absNx[i] = _mm_andnot_ps(signMask, m_nx[i]);
+                m_absNy[i] = _mm_andnot_ps(signMask, m_ny[i]);
+                m_absNz[i] = _mm_andnot_ps(signMask, m_nz[i]);
+            }
+        }
+
+        eCullResult Classify(const BBox3f& _bounds) const
+        {
+            const Vector3f center = (_bounds.m_min + _bounds.m_max) * 0.5f;
+            const Vector3f extent = (_bounds.m_max - _bounds.m_min) * 0.5f;
+            const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+            const __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+            const __m128 zero = _mm_setzero_ps();
+
+            int outside = 0, intersects = 0;
+            for (int i = 0; i < 2; ++i) {
+                //signed distance of the center and the box' radius along each plane normal
+                const __m128 dist = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(m_nx[i], cx), _mm_mul_ps(m_ny[i], cy)),
+                    _mm_add_ps(_mm_mul_ps(m_nz[i], cz), m_d[i]));
+                const __m128 radius = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(m_absNx[i], ex), _mm_mul_ps(m_absNy[i], ey)),
+                    _mm_mul_ps(m_absNz[i], ez));
+                outside    |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+                intersects |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, radius), zero));
+            }
+            if (outside)
+                return eCullResult::CULL_RESULT_OUTSIDE;
+            return intersects ? eCullResult::CULL_RESULT_INTERSECTS : eCullResult::CULL_RESULT_INSIDE;
+        }
+
+        bool IsVisible(const BBox3f& _bounds) const
+        {
+            return Classify(_bounds) != eCullResult::CULL_RESULT_OUTSIDE;
+        }
+
+    private:
+        __m128 m_nx[2], m_ny[2], m_nz[2], m_d[2];
+        __m128 m_absNx[2], m_absNy[2], m_absNz[2];
+    };
+}
@@ -0,0 +1,137 @@
+#include <assert.h>
+#include <string.h>
+#include "Geometry.h"
+
+namespace RayTrace
+{
+    // Adding 0.0f turns -0.0f into 0.0f, the two compare equal and have to hash the same
+    inline uint32_t FloatBits(float _value)
+    {
+        _value += 0.0f;
+        uint32_t bits;
+        memcpy(&bits, &_value, sizeof(bits));
+        return bits;
+    }
+
+    inline uint32_t HashVertex(const Vector3f& _pos, const Vector3f& _normal, const Vector2f& _uv)
+    {
+        const float values[] = { _pos.x, _pos.y, _pos.z, _normal.x, _normal.y, _normal.z, _uv.x, _uv.y };
+
+        uint64_t hash = 0x9E3779B97F4A7C15ull;
+        for (float value : values) {
+            hash = (hash ^ FloatBits(value)) * 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 32;
+        }
+        return (uint32_t)hash;
+    }
+
+
+    GeometryBuilder::GeometryBuilder(GeometryBase* _pGeometry)
+        : m_pGeometry(_pGeometry)
+        , m_firstVertex(_pGeometry->GetVertexCount())
+    {
+        assert(m_pGeometry->m_normals.size() == m_pGeometry->m_verts.size() &&
+               m_pGeometry->m_uvs.size() == m_pGeometry->m_verts.size());
+    }
+
+    void GeometryBuilder::Reserve(uint32_t _numQuads)
+    {
+        auto& geometry = *m_pGeometry;
+        const size_t maxVerts = geometry.m_verts.size() + 4 * (size_t)_numQuads;
+
+        geometry.m_verts.reserve(maxVerts);
+        geometry.m_normals.reserve(maxVerts);
+        geometry.m_uvs.reserve(maxVerts);
+        geometry.m_indices.reserve(geometry.m_indices.size() + 6 * (size_t)_numQuads);
+
+        //keep the table at most half full
+        const uint32_t numBuilt = (uint32_t)maxVerts - m_firstVertex;
+        if (2 * numBuilt > m_slots.size()) {
+            uint32_t numSlots = 16;
+            while (numSlots < 2 * numBuilt)
+                numSlots *= 2;
+            rehash(numSlots);
+        }
+    }
+
+    uint32_t GeometryBuilder::AddVertex(const Vector3f& _pos, const Vector3f& _normal, const Vector2f& _uv)
+    {
+        auto& geometry = *m_pGeometry;
+        const uint32_t numBuilt = geometry.GetVertexCount() - m_firstVertex;
+        if (2 * (numBuilt + 1) > m_slots.size())
+            rehash(m_slots.empty() ? 16 : 2 * (uint32_t)m_slots.size());
+
+        const uint32_t slot = findSlot(_pos, _normal, _uv);
+        if (m_slots[slot] != EmptySlot)
+            return m_slots[slot];
+
+        const uint32_t index = geometry.GetVertexCount();
+        geometry.m_verts.push_back(_pos);
+        geometry.m_normals.push_back(_normal);
+        geometry.m_uvs.push_back(_uv);
+        m_slots[slot] = index;
+        return index;
+    }
+
+    void GeometryBuilder::AddTriangle(uint32_t _a, uint32_t _b, uint32_t _c)
+    {
+        auto& indices = m_pGeometry->m_indices;
+        indices.push_back(_a);
+        indices.push_back(_b);
+        indices.push_back(_c);
+    }
+
+    void GeometryBuilder::AddQuad(const Vector3f _verts[4], const Vector2f _uvs[4], bool _flip)
+    {
+        //reversed corner order, same as flipping the face before splitting it
+        const int order[2][4] = { { 0, 1, 2, 3 }, { 3, 2, 1, 0 } };
+        const int* pOrder = order[_flip ? 1 : 0];
+
+        const Vector3f& v0 = _verts[pOrder[0]];
+        const Vector3f& v1 = _verts[pOrder[1]];
+        const Vector3f& v2 = _verts[pOrder[2]];
+        const Vector3f& v3 = _verts[pOrder[3]];
+
+        //the diagonals still span the quad when two corners meet, like at the poles of a sphere
+        Vector3f normal = Cross(v2 - v0, v3 - v1);
+        const float lengthSqr = LengthSqr(normal);
+        if (lengthSqr > 0.0f)
+            normal = normal / sqrtf(lengthSqr);
+
+        const uint32_t a = AddVertex(v0, normal, _uvs[pOrder[0]]);
+        const uint32_t b = AddVertex(v1, normal, _uvs[pOrder[1]]);
+        const uint32_t c = AddVertex(v2, normal, _uvs[pOrder[2]]);
+        const uint32_t d = AddVertex(v3, normal, _uvs[pOrder[3]]);
+
+        AddTriangle(a, b, c);
+        AddTriangle(c, d, a);
+    }
+
+    void GeometryBuilder::rehash(uint32_t _numSlots)
+    {
+        assert((_numSlots & (_numSlots - 1)) == 0);
+        m_slots.assign(_numSlots, EmptySlot);
+
+        const auto& geometry = *m_pGeometry;
+        for (uint32_t i = m_firstVertex; i < geometry.GetVertexCount(); ++i) {
+            const uint32_t slot = findSlot(geometry.m_verts[i], geometry.m_normals[i], geometry.m_uvs[i]);
+            if (m_slots[slot] == EmptySlot)
+                m_slots[slot] = i;
+        }
+    }
+
+    uint32_t GeometryBuilder::findSlot(const Vector3f& _pos, const Vector3f& _normal, const Vector2f& _uv) const
+    {
+        const auto& geometry = *m_pGeometry;
+        const uint32_t mask = (uint32_t)m_slots.size() - 1;
+
+        //linear probing, the table is never full so an empty slot ends the search
+        for (uint32_t slot = HashVertex(_pos, _normal, _uv) & mask; ; slot = (slot + 1) & mask) {
+            const uint32_t index = m_slots[slot];
+            if (index == EmptySlot)
+                return slot;
+            if (geometry.m_verts[index] == _pos && geometry.m_normals[index] == _normal && geometry.m_uvs[index] == _uv)
+                return slot;
+        }
+    }
+}
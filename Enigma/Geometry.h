@@ -37,27 +37,6 @@ namespace RayTrace
     };
 
 
-    struct sUnprocessedFace
-    {
-        std::vector<Vector3f> m_verts;
-        std::vector<Vector3f> m_normals;
-        std::vector<Vector2f> m_uvs;
-
-        void Build()
-        {
-
-        }
-
-        void Flip() {
-            std::reverse(m_verts.begin(), m_verts.end());
-            std::reverse(m_uvs.begin(), m_uvs.end());
-            Build();
-        }
-    };
-
-
-
-
     class GeometryBase
     {
 
@@ -125,7 +104,35 @@ namespace RayTrace
         std::vector<sEdge>    m_edges;
         std::vector<sFace>    m_faces;
         std::vector<sVertex>  m_vertices;
+    };
+
+    /*
+        @brief: Writes the output of the primitive modifiers straight into the streams of a
+                GeometryBase. Corners that match in position, normal and uv are welded through an
+                open addressing table and referenced from m_indices, so once Reserve() is called
+                nothing is allocated per face
+    */
+    class GeometryBuilder
+    {
+    public:
+        explicit GeometryBuilder(GeometryBase* _pGeometry);
+
+        // Room for _numQuads_ more quads, triangles count as quads
+        void        Reserve(uint32_t _numQuads);
+        // Index of an already added vertex with the same attributes, or of a new one
+        uint32_t    AddVertex(const Vector3f& _pos, const Vector3f& _normal, const Vector2f& _uv);
+        void        AddTriangle(uint32_t _a, uint32_t _b, uint32_t _c);
+        // Flat shaded quad split into (0,1,2) and (2,3,0), _flip_ reverses the corners first
+        void        AddQuad(const Vector3f _verts[4], const Vector2f _uvs[4], bool _flip = false);
+
+    private:
+        static constexpr uint32_t EmptySlot = ~0u;
+
+        void        rehash(uint32_t _numSlots);
+        uint32_t    findSlot(const Vector3f& _pos, const Vector3f& _normal, const Vector2f& _uv) const;
 
-        std::vector<sUnprocessedFace> m_unprocessed;
+        GeometryBase*           m_pGeometry;
+        std::vector<uint32_t>   m_slots;        //vertex index or EmptySlot, size is a power of two
+        uint32_t                m_firstVertex;  //vertices before this one were not added by the builder
     };
-}
\ No newline at end of file
+}
@@ -250,7 +250,8 @@ namespace RayTrace
 
     Frustum::Frustum(const Matrix4x4& _view, const Matrix4x4& _proj)
     {
-        const auto viewProj = _view * _proj;
+        //planes are combinations of the rows of the clip matrix, glm stores columns
+        const auto viewProj = Transpose4x4(_proj * _view);
 
         m_planes[0] = Plane(viewProj[3] + viewProj[0]);       // left
         m_planes[1] = Plane(viewProj[3] - viewProj[0]);       // right
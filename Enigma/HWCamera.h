@@ -33,6 +33,7 @@ namespace RayTrace
         float    m_distance;
     };
 
+    //planes point inwards, _view_ maps world to view space
     struct Frustum
     {
         Frustum(const Matrix4x4& _view, const Matrix4x4& _proj);        
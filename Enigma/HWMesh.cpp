@@ -12,6 +12,7 @@
 #include "Context.h"
 #include "WrappedEntity.h"
 #include "Geometry.h"
+#include "Picking.h"
 
 #include "HWMesh.h"
 
@@ -240,6 +241,7 @@ namespace RayTrace
         pMeshComp->m_numIndices    = mesh->GetIndicesCount();
         pMeshComp->m_vaoId         = mesh->GetVaoId();
         pMeshComp->m_pDrawMeshFun  = DrawIndexedMesh;
+        pMeshComp->m_pPickMesh     = std::make_shared<TriangleBVH>(_verts, _numVerts, _indices, _numIndices);
 
         return pEnt;
     }
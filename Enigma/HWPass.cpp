@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "Context.h"
 #include "SceneManager.h"
 #include "HWVertexBuffer.h"
@@ -40,12 +41,14 @@ namespace RayTrace
         m_activeView   = _view;
         m_pActiveCamera = _pCamera;
         
-        assert(m_passSceneItems.empty());      
         if (m_clearFrameBuffer) {
         }       
      
         if (m_collector) {
-            m_passSceneItems = m_collector->GetItems( &m_pContext->GetSceneManager() );
+            m_pPassSceneItems = &m_collector->GetItems( &m_pContext->GetSceneManager() );
+            const auto revision = m_collector->GetRevision();
+            m_itemsChanged  = revision != m_itemsRevision;
+            m_itemsRevision = revision;
         }
     }
 
@@ -55,9 +58,9 @@ namespace RayTrace
             m_renderer.PushState(*m_activeState);
 
 
-        for (auto& item : m_passSceneItems)
+        for (const auto& item : GetPassItems())
         {
-            if (item.m_pEntity && item.m_material && item.m_activeShader)
+            if (item.m_pEntity && item.m_material && item.m_activeShader && !IsCulled(item))
             {
                 if (item.m_pProcessEntityFun) {                 
                     item.m_activeShader->Bind();
@@ -105,7 +108,18 @@ namespace RayTrace
 
     void HWPass::End()
     {
-        m_passSceneItems.clear();       
+        m_pPassSceneItems = nullptr;
+    }
+
+    const SceneItemVector& HWPass::GetPassItems() const
+    {
+        static const SceneItemVector noItems;
+        return m_pPassSceneItems ? *m_pPassSceneItems : noItems;
+    }
+
+    bool HWPass::IsCulled(const SceneItem& _item) const
+    {
+        return m_pContext->GetSceneManager().IsCulled(_item.m_pEntity);
     }
 
     void HWPass::SetEnabled(bool _enabled)
@@ -264,8 +278,6 @@ namespace RayTrace
     void DepthPrePass::End()
     {
         HWPass::End();
-        m_opaqueItems.clear();
-        m_maskedItems.clear();       
         m_activeShader = nullptr;
     }
        
@@ -279,7 +291,7 @@ namespace RayTrace
         writeDepthShader->Bind();
         for (const auto& item : m_opaqueItems)
         {
-            if (item.m_pProcessEntityFun)
+            if (item.m_pProcessEntityFun && !IsCulled(item))
                item.m_pProcessEntityFun(&m_renderer, item.m_pEntity, nullMaterial, writeDepthShader);            
         }
         writeDepthShader->UnBind();
@@ -293,7 +305,7 @@ namespace RayTrace
         writeDepthShader->Bind();
         for (auto& item : m_maskedItems)
         {
-            if (item.m_pProcessEntityFun)
+            if (item.m_pProcessEntityFun && !IsCulled(item))
             {
                 auto texUnit = 0;
                 item.m_material->m_textures[ALBEDO]->Bind(texUnit);
@@ -310,7 +322,11 @@ namespace RayTrace
 
     void DepthPrePass::BinItems()
     {
-        for (auto& curItem : m_passSceneItems)
+        if (!m_itemsChanged)
+            return;
+        m_opaqueItems.clear();
+        m_maskedItems.clear();
+        for (const auto& curItem : GetPassItems())
         {
             bool isOpaque = true;
             if (curItem.m_material)
@@ -332,39 +348,18 @@ namespace RayTrace
         Context* _pContext, const std::string& _name, SceneItemCollectorUPtr _pCollector, RenderState* _state)
         : HWPass(_pContext, _name, std::move(_pCollector), _state)
     {
-        m_activeShader          = m_pContext->GetResourceManager().GetShader("__DefaultWriteObjectIdsShader");    
-        m_objectIdsFrameBuffer  = m_pContext->GetResourceManager().GetFrameBuffer("__DefaultPickingFrameBuffer");
-        assert(m_activeShader && m_objectIdsFrameBuffer);
     }
 
     void EditorPass::Begin(eLayer _layer, const HWViewport& _view, const HWCamera* _pCamera)
     {
-       
-        auto viewport = _view;
-        //change framebuffer & resize
-        viewport.SetFrameBuffer(m_objectIdsFrameBuffer);    
-        viewport.Resize(max(_view.m_size / m_downScaleRatio, Vector2i(2, 2)));
-        viewport.m_clearData.m_rgba = Vector4f(1.f, 1.f, 1.f, 1.f);
-        HWPass::Begin(_layer, viewport, _pCamera );
+        //picking is answered on the CPU by ScenePicker, nothing is rendered into an object id buffer
+        HWPass::Begin(_layer, _view, _pCamera );
         BinItems();
 
     }
 
     void EditorPass::Process()
     {
-        auto nullMat = m_pContext->GetResourceManager().GetMaterial("__DefaultNullMaterial");
-       
-        if (m_activeState)
-            m_renderer.PushState(*m_activeState);
-        m_renderer.PushViewport(m_activeView); 
-        DrawToObjectIdBuffer();    
-        CopyPixelsFromGpu();
-
-        m_renderer.PopViewport();
-
-        if (m_activeState)
-            m_renderer.PopState();
-      
        // DrawGrid();
         DrawEditorSprites();//#todo assign proper render state etc draw selected objects
         DrawSelectedMeshes();
@@ -376,30 +371,42 @@ namespace RayTrace
         Clear();
     }
 
-    const uint32_t* EditorPass::GetObjectIdPixels() const
-    {
-        return m_objIdPixels.data();
-    }
-
-    const float* EditorPass::GetDepthPixels() const
-    {
-        return m_depthPixels.data();
-    }
-
-    int EditorPass::GetViewportDownScale() const
-    {
-       return m_downScaleRatio;
-    }
-
     void EditorPass::BinItems()
     {
-        for (const auto& item : m_passSceneItems)
+        if (m_itemsChanged) {
+            m_meshes.clear();
+            m_spriteItems.clear();
+            //index the pass items by entity, the views below only visit entities with a mesh or sprite
+            const auto& items = GetPassItems();
+            std::fill(m_itemByEntity.begin(), m_itemByEntity.end(), -1);
+            for (int32_t i = 0; i < (int32_t)items.size(); ++i) {
+                const auto id = items[i].m_pEntity->GetEntity().GetId();
+                if (id >= m_itemByEntity.size())
+                    m_itemByEntity.resize(id + 1, -1);
+                m_itemByEntity[id] = i;
+            }
+            //every item goes to one bin, meshes take precedence over sprites
+            auto binItem = [&](SceneItemVector& _bin, Entity _ent) {
+                if (_ent.GetId() >= m_itemByEntity.size())
+                    return;
+                int32_t& idx = m_itemByEntity[_ent.GetId()];
+                if (idx >= 0) {
+                    _bin.push_back(items[idx]);
+                    idx = -1;
+                }
+            };
+            auto& components = m_pContext->GetComponentSystem();
+            components.View<MeshComponent>().Each([&](Entity _ent, MeshComponent&) { binItem(m_meshes, _ent); });
+            components.View<IndexedMeshComponent>().Each([&](Entity _ent, IndexedMeshComponent&) { binItem(m_meshes, _ent); });
+            components.View<EditorSpriteComponent>().Each([&](Entity _ent, EditorSpriteComponent&) { binItem(m_spriteItems, _ent); });
+        }
+
+        //sprite quads follow the camera, rebuild them every frame
+        for (const auto& item : m_spriteItems)
         {
              auto* pEnt = item.m_pEntity;
             
-             if (pEnt->HasComponent<MeshComponent>() || pEnt->HasComponent<IndexedMeshComponent>() )
-                 m_meshes.push_back(item);    
-             else if (auto spriteComp = pEnt->GetComponent<EditorSpriteComponent>()) {
+             if (auto spriteComp = pEnt->GetComponent<EditorSpriteComponent>()) {
 
                  Vector3f worldPos  = pEnt->GetPosition();
                  Vector3f iconColor = pEnt->GetIconColor();                
@@ -414,42 +421,6 @@ namespace RayTrace
         }
     }
 
-    void EditorPass::DrawToObjectIdBuffer()
-    {
-        auto nullMat = m_pContext->GetResourceManager().GetMaterial("__DefaultNullMaterial");
-        auto shader  = m_pContext->GetResourceManager().GetShader("__DefaultWriteObjectIdsShader");
-      
-        shader->Bind();
-        for (const auto& mesh : m_meshes) {
-            auto objId = mesh.m_pEntity->GetObjectId();
-            shader->SetUint("objectId", &objId);
-            mesh.m_pProcessEntityFun(&m_renderer, mesh.m_pEntity, nullMat, shader);
-        }
-
-        shader->SetMatrix4x4("model", &Identity4x4);
-        for (const auto& sprite : m_sprites)
-        {
-            auto objId      = sprite.m_pEntity->GetObjectId();
-            auto spriteComp = sprite.m_pEntity->GetComponent<EditorSpriteComponent>();
-            shader->SetUint("objectId", &objId);
-            m_renderer.DrawQuad(spriteComp->m_coords, spriteComp->m_uvs, 4, shader);
-        }
-        shader->UnBind();
-
-    }
-
-    void EditorPass::CopyPixelsFromGpu()
-    {
-        auto hwTex    = m_activeView.GetFrameBuffer()->GetTexture(0);
-        auto depthTex = m_activeView.GetFrameBuffer()->GetDepthTexture().get();
-        const auto numPixels = m_activeView.m_size.x * m_activeView.m_size.y;
-        m_objIdPixels.resize(numPixels);
-        m_depthPixels.resize(numPixels);
-
-        memcpy(m_objIdPixels.data(), GetTextureData(hwTex).data(), numPixels * sizeof(uint32_t));
-        memcpy(m_depthPixels.data(), GetTextureData(depthTex).data(), numPixels * sizeof(float));
-    }
-
     void EditorPass::DrawGrid()
     {
         auto shader  = m_pContext->GetResourceManager().GetShader("__DefaultGridShader");
@@ -503,7 +474,7 @@ namespace RayTrace
         shader->SetInt("isSelected", &isSelected);
         for (auto mesh : m_meshes)
         {
-            if( !mesh.m_pEntity->GetObjectFlags().m_field.m_selected )
+            if( !mesh.m_pEntity->GetObjectFlags().m_field.m_selected || IsCulled(mesh) )
                 continue;            
             mesh.m_pProcessEntityFun(&m_renderer, mesh.m_pEntity, nullMat, shader);
         }
@@ -515,7 +486,6 @@ namespace RayTrace
 
     void EditorPass::Clear()
     {
-        m_meshes.clear();
         m_sprites.clear();
     }
 
@@ -48,6 +48,9 @@ namespace RayTrace
 
     protected:
 
+        const SceneItemVector&  GetPassItems() const;
+        bool                    IsCulled(const SceneItem& _item) const; //outside the camera of the active layer
+
         const HWCamera*         m_pActiveCamera  = nullptr;      
         SceneItemCollectorUPtr  m_collector      = nullptr;
         Context*                m_pContext       = nullptr;
@@ -60,7 +63,9 @@ namespace RayTrace
 
         std::string             m_name;
         FrameBufferClear        m_clear;
-        SceneItemVector         m_passSceneItems; //items that belong to this pass to be drawn
+        const SceneItemVector*  m_pPassSceneItems = nullptr; //items that belong to this pass to be drawn, owned by the collector
+        uint64_t                m_itemsRevision   = 0;       //collector revision the pass last saw
+        bool                    m_itemsChanged    = true;    //items differ from the previous frame, bins have to be rebuilt
         bool                    m_enabled          = true;  
         bool                    m_clearFrameBuffer = false;
 
@@ -80,28 +85,21 @@ namespace RayTrace
         void                    Begin(eLayer _layer, const HWViewport& _view, const HWCamera* _pCamera) override;
         void                    Process() override;
         void                    End() override;    
-        const uint32_t*         GetObjectIdPixels() const;
-        const float*            GetDepthPixels() const;
-        int                     GetViewportDownScale() const;
 
     private:
         void                    BinItems();
-        void                    DrawToObjectIdBuffer();
-        void                    CopyPixelsFromGpu();
         void                    DrawGrid();
         void                    DrawEditorSprites();
         void                    DrawSelectedMeshes();
         void                    Clear();
 
-        HWFrameBuffer*          m_objectIdsFrameBuffer = nullptr;
-        std::vector<uint32_t>   m_objIdPixels;
-        std::vector<float>      m_depthPixels;
         uint32_t                m_windowId = INVALID_ID;
-        int                     m_downScaleRatio = 4;    
         Vector2f                m_spritScale = { 64.0f, 64.0f };
 
         SceneItemVector         m_meshes, //meshes both indexed and non-indexed
-                                m_sprites;
+                                m_spriteItems, //items with a sprite, kept until the pass items change
+                                m_sprites;     //sprites facing the camera this frame
+        std::vector<int32_t>    m_itemByEntity;  //by EntityId, index into the pass items while binning
     };
 
     /*
@@ -122,7 +120,7 @@ namespace RayTrace
 
 
     private:
-        void                    BinItems(); //sort items in a opaqua and masked vector
+        void                    BinItems(); //sort items in a opaqua and masked vector, only when the items changed
 
         SceneItemVector         m_opaqueItems;
         SceneItemVector         m_maskedItems;
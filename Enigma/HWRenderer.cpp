@@ -210,7 +210,8 @@ namespace RayTrace
             shader->SetMatrix4x4("view", &matrices.m_views[i]);            
             fboPtr->AttachCubemapFace(i, 0, 0);
             renderer.Clear(viewport.m_clearData);          
-            renderer.DrawTriangles(eDrawMode::DRAWMODE_TRIANGLES, geometry->GetVertices(), geometry->GetVertexCount(),
+            renderer.DrawIndexedTriangles(eDrawMode::DRAWMODE_TRIANGLES, geometry->GetVertices(), geometry->GetVertexCount(),
+                geometry->GetIndices(), geometry->GetIndicesCount(),
                 shader, nullptr, nullptr,nullptr);
         }
 
@@ -271,7 +272,8 @@ namespace RayTrace
             shader->SetMatrix4x4("view", &matrices.m_views[i]);
             fboPtr->AttachCubemapFace(i, 0, 0);
             renderer.Clear(viewport.m_clearData);
-            renderer.DrawTriangles( eDrawMode::DRAWMODE_TRIANGLES,  geometry->GetVertices(), geometry->GetVertexCount(),
+            renderer.DrawIndexedTriangles( eDrawMode::DRAWMODE_TRIANGLES,  geometry->GetVertices(), geometry->GetVertexCount(),
+                geometry->GetIndices(), geometry->GetIndicesCount(),
                 shader, nullptr, nullptr, nullptr);
         }
 
@@ -349,7 +351,8 @@ namespace RayTrace
                 shader->SetMatrix4x4("view", &matrices.m_views[side]);
                 fboPtr->AttachCubemapFace(side, 0, mip);
                 renderer.Clear(viewport.m_clearData);
-                renderer.DrawTriangles( eDrawMode::DRAWMODE_TRIANGLES, geometry->GetVertices(), geometry->GetVertexCount(),
+                renderer.DrawIndexedTriangles( eDrawMode::DRAWMODE_TRIANGLES, geometry->GetVertices(), geometry->GetVertexCount(),
+                    geometry->GetIndices(), geometry->GetIndicesCount(),
                     shader, nullptr, nullptr, nullptr);
             }
         }       
@@ -720,6 +723,12 @@ namespace RayTrace
 
     void HWRenderer::DrawTriangles(eDrawMode _mode, const Vector3f* _pVerts, uint32_t _numVerts, ShaderProgram* _pShader,
         const Vector3f* _pNormals /*= nullptr*/, const Vector3f* _pTangents /*= nullptr*/, const Vector2f* _pUvs /*= nullptr*/)
+    {
+        DrawIndexedTriangles(_mode, _pVerts, _numVerts, nullptr, 0, _pShader, _pNormals, _pTangents, _pUvs);
+    }
+
+    void HWRenderer::DrawIndexedTriangles(eDrawMode _mode, const Vector3f* _pVerts, uint32_t _numVerts, const uint32_t* _pIndices, uint32_t _numIndices,
+        ShaderProgram* _pShader /*= nullptr*/, const Vector3f* _pNormals /*= nullptr*/, const Vector3f* _pTangents /*= nullptr*/, const Vector2f* _pUvs /*= nullptr*/)
     {
         assert(_pVerts);
         
@@ -745,8 +754,18 @@ namespace RayTrace
             unbind = true;
         }
         vao.Bind();
-        DrawArrays( _mode, 0, _numVerts );      
-        vao.UnBind();
+        if (_pIndices) {
+            //the index binding is vao state, the vao goes first
+            std::unique_ptr<IndexBuffer> indices(CreateIndexBuffer(_pIndices, _numIndices));
+            BindIndexBuffer(indices->GetBufferId());
+            DrawIndexed(_mode, _numIndices);
+            vao.UnBind();
+            BindIndexBuffer(0);
+        }
+        else {
+            DrawArrays( _mode, 0, _numVerts );
+            vao.UnBind();
+        }
         if( unbind )
             _pShader->UnBind();
 
@@ -62,6 +62,8 @@ namespace RayTrace
         void                    DrawCube(HWTexture* _pCubeTex, ShaderProgram* _pShader);
         void                    DrawTriangles(eDrawMode _mode,  const Vector3f* _pVerts, uint32_t _numVerts, ShaderProgram* _pShader = nullptr, const Vector3f* _pNormals = nullptr,
             const Vector3f* _pTangents = nullptr, const Vector2f* _pUvs = nullptr);
+        void                    DrawIndexedTriangles(eDrawMode _mode, const Vector3f* _pVerts, uint32_t _numVerts, const uint32_t* _pIndices, uint32_t _numIndices,
+            ShaderProgram* _pShader = nullptr, const Vector3f* _pNormals = nullptr, const Vector3f* _pTangents = nullptr, const Vector2f* _pUvs = nullptr);
 
         StateSystem&            GetStateSystem() { return m_states; }
         const StateSystem&      GetStateSystem() const { return m_states; }
@@ -70,6 +70,7 @@ namespace RayTrace
     bool TransformHistory::Apply(const std::vector<Transformable>& _objects)
     {
         UUIDVector transformed;
+        std::vector<WrappedEntity*> moved;
         
         for (const auto& obj : _objects)
         {
@@ -77,8 +78,11 @@ namespace RayTrace
             auto transComp = pEnt->GetComponent<TransformComponent>();
            
             transComp->m_transform = obj.m_startTransform;
+            GetContext().GetSceneManager().UpdateBounds(pEnt);
             transformed.push_back(obj.m_entityUuid);
+            moved.push_back(pEnt);
         }
+        GetContext().GetSceneManager().SyncRenderScene(moved);
 
         EventBase evt(eEvents::EVENT_OBJECT_TRANSFORM_CHANGED, m_pContext->GetElapsedTime());
         evt.m_data["changedObjects"] = transformed;
@@ -3,6 +3,7 @@
 #include "Integrator.h"
 #include "BdptIntegrator.h"
 #include "PathIntegrator.h"
+#include "WavefrontPathIntegrator.h"
 #include "DirectLightingIntegrator.h"
 #include "VolPathIntegrator.h"
 #include "Sample.h"
@@ -20,6 +21,7 @@
 #include "Lights.h"
 #include "Scene.h"
 #include "Memory.h"
+#include "Concurrency.h"
 #include "Medium.h"
 #include "Filter.h"
 #include "Error.h"
@@ -29,5 +31,9 @@
 #include "SubDiv.h"
 #include "Film.h"
 #include "TriangleMesh.h"
+#include "MeshPrimitive.h"
+#include "InstanceAccel.h"
+#include "SceneCache.h"
+#include "TextureCache.h"
 #include "Medium.h"
 #include "Camera.h"
@@ -0,0 +1,455 @@
+#include <algorithm>
+#include "BBox.h"
+#include "Ray.h"
+#include "Memory.h"
+#include "Misc.h"
+#include "Interaction.h"
+#include "BVH.h"
+#include "InstanceAccel.h"
+
+namespace RayTrace
+{
+    static constexpr int nInstanceSAHBuckets = 12;
+
+    struct InstanceBVHNode {
+        BBox3f   bounds;
+        int32_t  offset;        // leaf: first entry of m_instanceOrder; interior: second child
+        uint16_t nInstances;    // 0 -> interior node
+        uint8_t  axis;
+        uint8_t  pad[1];
+    };
+
+    struct InstancePacketStackEntry {
+        int      nodeIndex;
+        uint32_t mask;
+    };
+
+    // Lanes of _mask_ whose ray overlaps the node bounds
+    static uint32_t IntersectNode8(const InstanceBVHNode& node, const Ray* rays, const Vector3f* invDir,
+        const int (*dirIsNeg)[3], uint32_t mask)
+    {
+        uint32_t hitMask = 0;
+        for (; mask; mask &= mask - 1) {
+            int lane = CountTrailingZeros(mask);
+            if (node.bounds.intersectP(rays[lane], invDir[lane], dirIsNeg[lane]))
+                hitMask |= 1u << lane;
+        }
+        return hitMask;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // InstanceAccel Implementation
+    //////////////////////////////////////////////////////////////////////////
+    InstanceAccel::~InstanceAccel()
+    {
+        FreeAligned(m_nodes);
+    }
+
+    int InstanceAccel::AddBLAS(const PrimitivePtr& blas)
+    {
+        m_blas.push_back(blas);
+        m_blasBounds.push_back(blas->worldBound());
+        return static_cast<int>(m_blas.size()) - 1;
+    }
+
+    int InstanceAccel::AddInstance(int blas, const AnimatedTransform& instanceToWorld)
+    {
+        m_instances.emplace_back(blas, instanceToWorld);
+        updateInstance(m_instances.back());
+        m_needsBuild = true;
+        return static_cast<int>(m_instances.size()) - 1;
+    }
+
+    void InstanceAccel::SetInstanceTransform(int instance, const AnimatedTransform& instanceToWorld)
+    {
+        m_instances[instance].m_instanceToWorld = instanceToWorld;
+        updateInstance(m_instances[instance]);
+        m_needsRefit = true;
+    }
+
+    void InstanceAccel::Commit()
+    {
+        if (m_needsBuild)
+            build();
+        else if (m_needsRefit)
+            refit();
+        m_needsBuild = m_needsRefit = false;
+    }
+
+    void InstanceAccel::Refit(const std::vector<const Primitive*>& changed, float rebuildThreshold)
+    {
+        for (size_t i = 0; i < m_blas.size(); ++i) {
+            if (BVHAccel* bvh = dynamic_cast<BVHAccel*>(m_blas[i].get())) {
+                bvh->Refit(changed, rebuildThreshold);
+                m_blasBounds[i] = bvh->worldBound();
+            }
+        }
+        for (Instance& instance : m_instances)
+            updateInstance(instance);
+        m_needsRefit = true;
+        Commit();
+    }
+
+    void InstanceAccel::updateInstance(Instance& instance)
+    {
+        const AnimatedTransform& xf = instance.m_instanceToWorld;
+        if (!xf.m_isAnimated)
+            instance.m_worldToInstance = xf.m_start->inverted();
+        instance.m_bounds = xf.motionBounds(m_blasBounds[instance.m_blas]);
+    }
+
+    void InstanceAccel::build()
+    {
+        FreeAligned(m_nodes);
+        m_nodes = nullptr;
+        m_numNodes = 0;
+        if (m_instances.empty())
+            return;
+
+        m_instanceOrder.resize(m_instances.size());
+        for (int i = 0; i < (int)m_instances.size(); ++i)
+            m_instanceOrder[i] = i;
+        std::vector<InstanceBVHNode> nodes;
+        nodes.reserve(2 * m_instances.size());
+        buildRecursive(nodes, 0, (int)m_instances.size());
+
+        m_numNodes = (int)nodes.size();
+        m_nodes = AllocAligned<InstanceBVHNode>(nodes.size());
+        std::copy(nodes.begin(), nodes.end(), m_nodes);
+    }
+
+    int InstanceAccel::buildRecursive(std::vector<InstanceBVHNode>& nodes, int start, int end)
+    {
+        const int nodeIndex = (int)nodes.size();
+        nodes.emplace_back();
+
+        BBox3f bounds, centroidBounds;
+        for (int i = start; i < end; ++i) {
+            const BBox3f& b = m_instances[m_instanceOrder[i]].m_bounds;
+            bounds = Union(bounds, b);
+            centroidBounds = Union(centroidBounds, b.getCenter());
+        }
+        nodes[nodeIndex].bounds = bounds;
+
+        const int nInstances = end - start;
+        const int dim = centroidBounds.maximumExtent();
+        if (nInstances == 1 || centroidBounds.m_max[dim] == centroidBounds.m_min[dim]) {
+            nodes[nodeIndex].offset = start;
+            nodes[nodeIndex].nInstances = (uint16_t)nInstances;
+            // Coincident instances that don't fit one leaf are still split by count below
+            if (nInstances <= 0xffff)
+                return nodeIndex;
+        }
+
+        auto centroid = [&](int instance) { return m_instances[instance].m_bounds.getCenter()[dim]; };
+        auto bucketOf = [&](int instance) {
+            int b = (int)(nInstanceSAHBuckets * centroidBounds.offset(m_instances[instance].m_bounds.getCenter())[dim]);
+            return std::min(b, nInstanceSAHBuckets - 1);
+        };
+        int mid = start;
+        if (centroidBounds.m_max[dim] > centroidBounds.m_min[dim]) {
+            // Binned SAH, same cost sweep as BVHAccel
+            int    counts[nInstanceSAHBuckets] = {};
+            BBox3f bucketBounds[nInstanceSAHBuckets];
+            for (int i = start; i < end; ++i) {
+                int b = bucketOf(m_instanceOrder[i]);
+                counts[b]++;
+                bucketBounds[b] = Union(bucketBounds[b], m_instances[m_instanceOrder[i]].m_bounds);
+            }
+
+            float  areaBelow[nInstanceSAHBuckets - 1];
+            int    countBelow[nInstanceSAHBuckets - 1];
+            BBox3f b0, b1;
+            int    count0 = 0, count1 = 0;
+            for (int i = 0; i < nInstanceSAHBuckets - 1; ++i) {
+                b0 = Union(b0, bucketBounds[i]);
+                count0 += counts[i];
+                countBelow[i] = count0;
+                areaBelow[i] = b0.surfaceArea();
+            }
+            float minCost = InfinityF32;
+            int   minBucket = 0;
+            for (int i = nInstanceSAHBuckets - 1; i > 0; --i) {
+                b1 = Union(b1, bucketBounds[i]);
+                count1 += counts[i];
+                float cost = countBelow[i - 1] * areaBelow[i - 1] + count1 * b1.surfaceArea();
+                if (countBelow[i - 1] > 0 && count1 > 0 && cost < minCost) {
+                    minCost = cost;
+                    minBucket = i - 1;
+                }
+            }
+            mid = (int)(std::partition(m_instanceOrder.begin() + start, m_instanceOrder.begin() + end,
+                [&](int instance) { return bucketOf(instance) <= minBucket; }) - m_instanceOrder.begin());
+        }
+        if (mid == start || mid == end) {
+            mid = (start + end) / 2;
+            std::nth_element(m_instanceOrder.begin() + start, m_instanceOrder.begin() + mid,
+                m_instanceOrder.begin() + end,
+                [&](int a, int b) { return centroid(a) < centroid(b); });
+        }
+
+        buildRecursive(nodes, start, mid);
+        const int secondChild = buildRecursive(nodes, mid, end);
+        nodes[nodeIndex].offset = secondChild;
+        nodes[nodeIndex].nInstances = 0;
+        nodes[nodeIndex].axis = (uint8_t)dim;
+        return nodeIndex;
+    }
+
+    void InstanceAccel::refit()
+    {
+        // Children are always stored after their parent, so one reverse sweep updates every node
+        for (int i = m_numNodes - 1; i >= 0; --i) {
+            InstanceBVHNode& node = m_nodes[i];
+            if (node.nInstances > 0) {
+                BBox3f bounds;
+                for (int j = 0; j < node.nInstances; ++j)
+                    bounds = Union(bounds, m_instances[m_instanceOrder[node.offset + j]].m_bounds);
+                node.bounds = bounds;
+            }
+            else
+                node.bounds = Union(m_nodes[i + 1].bounds, m_nodes[node.offset].bounds);
+        }
+    }
+
+    BBox3f InstanceAccel::worldBound() const
+    {
+        return m_numNodes > 0 ? m_nodes[0].bounds : BBox3f();
+    }
+
+    bool InstanceAccel::intersectInstance(const Instance& instance, const Ray& r, SurfaceInteraction* isect) const
+    {
+        // Static instances use the inverse stored at build time instead of inverting per ray
+        const AnimatedTransform& xf = instance.m_instanceToWorld;
+        Transform interpolated;
+        const Transform* instanceToWorld = xf.m_start;
+        Ray ray;
+        if (xf.m_isAnimated) {
+            xf.interpolate(r.m_time, &interpolated);
+            instanceToWorld = &interpolated;
+            ray = interpolated.inverted().transformRay(r);
+        }
+        else
+            ray = instance.m_worldToInstance.transformRay(r);
+
+        if (!m_blas[instance.m_blas]->intersect(ray, isect))
+            return false;
+        r.m_maxT = ray.m_maxT;
+        if (!instanceToWorld->isIdentity())
+            *isect = instanceToWorld->transformSurfInteraction(*isect);
+        return true;
+    }
+
+    bool InstanceAccel::intersectPInstance(const Instance& instance, const Ray& r) const
+    {
+        const AnimatedTransform& xf = instance.m_instanceToWorld;
+        if (xf.m_isAnimated) {
+            Transform interpolated;
+            xf.interpolate(r.m_time, &interpolated);
+            return m_blas[instance.m_blas]->intersectP(interpolated.inverted().transformRay(r));
+        }
+        return m_blas[instance.m_blas]->intersectP(instance.m_worldToInstance.transformRay(r));
+    }
+
+    bool InstanceAccel::intersect(const Ray& r, SurfaceInteraction* isect) const
+    {
+        if (!m_nodes) return false;
+        bool hit = false;
+        Vector3f invDir = Inverted(r.m_dir);
+        int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+        int toVisitOffset = 0, currentNodeIndex = 0;
+        int nodesToVisit[64];
+        while (true) {
+            const InstanceBVHNode* node = &m_nodes[currentNodeIndex];
+            if (node->bounds.intersectP(r, invDir, dirIsNeg)) {
+                if (node->nInstances > 0) {
+                    for (int i = 0; i < node->nInstances; ++i)
+                        if (intersectInstance(m_instances[m_instanceOrder[node->offset + i]], r, isect))
+                            hit = true;
+                    if (toVisitOffset == 0) break;
+                    currentNodeIndex = nodesToVisit[--toVisitOffset];
+                }
+                else if (dirIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->offset;
+                }
+                else {
+                    nodesToVisit[toVisitOffset++] = node->offset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+            else {
+                if (toVisitOffset == 0) break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            }
+        }
+        return hit;
+    }
+
+    bool InstanceAccel::intersectP(const Ray& r) const
+    {
+        if (!m_nodes) return false;
+        Vector3f invDir = Inverted(r.m_dir);
+        int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+        int toVisitOffset = 0, currentNodeIndex = 0;
+        int nodesToVisit[64];
+        while (true) {
+            const InstanceBVHNode* node = &m_nodes[currentNodeIndex];
+            if (node->bounds.intersectP(r, invDir, dirIsNeg)) {
+                if (node->nInstances > 0) {
+                    for (int i = 0; i < node->nInstances; ++i)
+                        if (intersectPInstance(m_instances[m_instanceOrder[node->offset + i]], r))
+                            return true;
+                    if (toVisitOffset == 0) break;
+                    currentNodeIndex = nodesToVisit[--toVisitOffset];
+                }
+                else if (dirIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->offset;
+                }
+                else {
+                    nodesToVisit[toVisitOffset++] = node->offset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+            else {
+                if (toVisitOffset == 0) break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            }
+        }
+        return false;
+    }
+
+    uint32_t InstanceAccel::intersectInstance8(const Instance& instance, const Ray* rays, SurfaceInteraction* isects,
+        uint32_t mask) const
+    {
+        // Animated instances need a transform per ray time, those go one ray at a time
+        const Primitive* blas = m_blas[instance.m_blas].get();
+        uint32_t hitMask = 0;
+        if (instance.m_instanceToWorld.m_isAnimated) {
+            for (; mask; mask &= mask - 1) {
+                int lane = CountTrailingZeros(mask);
+                if (intersectInstance(instance, rays[lane], &isects[lane]))
+                    hitMask |= 1u << lane;
+            }
+            return hitMask;
+        }
+
+        Ray local[RayPacketSize];
+        for (uint32_t m = mask; m; m &= m - 1) {
+            int lane = CountTrailingZeros(m);
+            local[lane] = instance.m_worldToInstance.transformRay(rays[lane]);
+        }
+        hitMask = blas->intersect8(local, isects, mask);
+        const Transform* instanceToWorld = instance.m_instanceToWorld.m_start;
+        for (uint32_t m = hitMask; m; m &= m - 1) {
+            int lane = CountTrailingZeros(m);
+            rays[lane].m_maxT = local[lane].m_maxT;
+            if (!instanceToWorld->isIdentity())
+                isects[lane] = instanceToWorld->transformSurfInteraction(isects[lane]);
+        }
+        return hitMask;
+    }
+
+    uint32_t InstanceAccel::intersectPInstance8(const Instance& instance, const Ray* rays, uint32_t mask) const
+    {
+        const Primitive* blas = m_blas[instance.m_blas].get();
+        uint32_t hitMask = 0;
+        if (instance.m_instanceToWorld.m_isAnimated) {
+            for (; mask; mask &= mask - 1) {
+                int lane = CountTrailingZeros(mask);
+                if (intersectPInstance(instance, rays[lane]))
+                    hitMask |= 1u << lane;
+            }
+            return hitMask;
+        }
+
+        Ray local[RayPacketSize];
+        for (uint32_t m = mask; m; m &= m - 1) {
+            int lane = CountTrailingZeros(m);
+            local[lane] = instance.m_worldToInstance.transformRay(rays[lane]);
+        }
+        return blas->intersectP8(local, mask);
+    }
+
+    uint32_t InstanceAccel::intersect8(const Ray* rays, SurfaceInteraction* isects, uint32_t activeMask) const
+    {
+        if (!m_nodes || !activeMask) return 0;
+        Vector3f invDir[RayPacketSize];
+        int      dirIsNeg[RayPacketSize][3];
+        uint32_t negMask[3] = {};
+        for (int i = 0; i < RayPacketSize; ++i) {
+            invDir[i] = Inverted(rays[i].m_dir);
+            for (int a = 0; a < 3; ++a) {
+                dirIsNeg[i][a] = invDir[i][a] < 0;
+                if (dirIsNeg[i][a]) negMask[a] |= 1u << i;
+            }
+        }
+
+        uint32_t hitMask = 0;
+        InstancePacketStackEntry nodesToVisit[64];
+        int toVisitOffset = 0;
+        nodesToVisit[toVisitOffset++] = { 0, activeMask };
+        while (toVisitOffset > 0) {
+            const InstancePacketStackEntry entry = nodesToVisit[--toVisitOffset];
+            const InstanceBVHNode* node = &m_nodes[entry.nodeIndex];
+            const uint32_t mask = IntersectNode8(*node, rays, invDir, dirIsNeg, entry.mask);
+            if (!mask) continue;
+            if (node->nInstances > 0) {
+                for (int i = 0; i < node->nInstances; ++i)
+                    hitMask |= intersectInstance8(m_instances[m_instanceOrder[node->offset + i]], rays, isects, mask);
+            }
+            // Same child order as BVHAccel::intersect8, the one preferred by most lanes goes first
+            else if (2 * PopCount(mask & negMask[node->axis]) > PopCount(mask)) {
+                nodesToVisit[toVisitOffset++] = { entry.nodeIndex + 1, mask };
+                nodesToVisit[toVisitOffset++] = { node->offset, mask };
+            }
+            else {
+                nodesToVisit[toVisitOffset++] = { node->offset, mask };
+                nodesToVisit[toVisitOffset++] = { entry.nodeIndex + 1, mask };
+            }
+        }
+        return hitMask;
+    }
+
+    uint32_t InstanceAccel::intersectP8(const Ray* rays, uint32_t activeMask) const
+    {
+        if (!m_nodes || !activeMask) return 0;
+        Vector3f invDir[RayPacketSize];
+        int      dirIsNeg[RayPacketSize][3];
+        uint32_t negMask[3] = {};
+        for (int i = 0; i < RayPacketSize; ++i) {
+            invDir[i] = Inverted(rays[i].m_dir);
+            for (int a = 0; a < 3; ++a) {
+                dirIsNeg[i][a] = invDir[i][a] < 0;
+                if (dirIsNeg[i][a]) negMask[a] |= 1u << i;
+            }
+        }
+
+        uint32_t hitMask = 0;
+        InstancePacketStackEntry nodesToVisit[64];
+        int toVisitOffset = 0;
+        nodesToVisit[toVisitOffset++] = { 0, activeMask };
+        while (toVisitOffset > 0) {
+            const InstancePacketStackEntry entry = nodesToVisit[--toVisitOffset];
+            const InstanceBVHNode* node = &m_nodes[entry.nodeIndex];
+            // Occluded lanes are done, drop them from everything still on the stack
+            const uint32_t mask = IntersectNode8(*node, rays, invDir, dirIsNeg, entry.mask & ~hitMask);
+            if (!mask) continue;
+            if (node->nInstances > 0) {
+                for (int i = 0; i < node->nInstances; ++i)
+                    hitMask |= intersectPInstance8(m_instances[m_instanceOrder[node->offset + i]], rays, mask & ~hitMask);
+                if (hitMask == activeMask) break;
+            }
+            else if (2 * PopCount(mask & negMask[node->axis]) > PopCount(mask)) {
+                nodesToVisit[toVisitOffset++] = { entry.nodeIndex + 1, mask };
+                nodesToVisit[toVisitOffset++] = { node->offset, mask };
+            }
+            else {
+                nodesToVisit[toVisitOffset++] = { node->offset, mask };
+                nodesToVisit[toVisitOffset++] = { entry.nodeIndex + 1, mask };
+            }
+        }
+        return hitMask;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "Defines.h"
+#include "Primitive.h"
+#include "Transform.h"
+
+namespace RayTrace
+{
+    struct InstanceBVHNode;
+
+    // InstanceAccel Declarations
+    // Top level acceleration structure (TLAS) over instances of shared bottom level
+    // aggregates (BLAS). A BLAS is built once per unique object; an instance only stores
+    // its transform and BLAS index. Moving instances refits the TLAS nodes in place.
+    class InstanceAccel : public Aggregate
+    {
+    public:
+        InstanceAccel() = default;
+        ~InstanceAccel();
+
+        int                 AddBLAS(const PrimitivePtr& blas);
+        int                 AddInstance(int blas, const AnimatedTransform& instanceToWorld);
+        void                SetInstanceTransform(int instance, const AnimatedTransform& instanceToWorld);
+        int                 GetInstanceCount() const { return static_cast<int>(m_instances.size()); }
+        // Builds the TLAS after instances were added, or refits it after transforms changed.
+        // Must not run concurrently with intersection queries.
+        void                Commit();
+        // Refits the BVHAccel BLASes holding _changed_ primitives, then the TLAS above them
+        void                Refit(const std::vector<const Primitive*>& changed, float rebuildThreshold = 1.5f);
+
+        BBox3f              worldBound() const override;
+        bool                intersect(const Ray& r, SurfaceInteraction*) const override;
+        bool                intersectP(const Ray& r) const override;
+        // The TLAS is tested per lane, each static instance then hands its lanes to the BLAS
+        // packet traversal in one call
+        uint32_t            intersect8(const Ray* rays, SurfaceInteraction* isects, uint32_t activeMask) const override;
+        uint32_t            intersectP8(const Ray* rays, uint32_t activeMask) const override;
+
+    private:
+        struct Instance
+        {
+            Instance(int blas, const AnimatedTransform& instanceToWorld)
+                : m_blas(blas), m_instanceToWorld(instanceToWorld) {}
+
+            int               m_blas;
+            AnimatedTransform m_instanceToWorld;
+            Transform         m_worldToInstance;   // static instances only
+            BBox3f            m_bounds;
+        };
+
+        void                updateInstance(Instance& instance);
+        void                build();
+        void                refit();
+        int                 buildRecursive(std::vector<InstanceBVHNode>& nodes, int start, int end);
+        bool                intersectInstance(const Instance& instance, const Ray& r, SurfaceInteraction* isect) const;
+        bool                intersectPInstance(const Instance& instance, const Ray& r) const;
+        uint32_t            intersectInstance8(const Instance& instance, const Ray* rays, SurfaceInteraction* isects, uint32_t mask) const;
+        uint32_t            intersectPInstance8(const Instance& instance, const Ray* rays, uint32_t mask) const;
+
+        // InstanceAccel Private Data
+        PrimitiveVector         m_blas;
+        std::vector<BBox3f>     m_blasBounds;
+        std::vector<Instance>   m_instances;
+        std::vector<int>        m_instanceOrder;    // leaves reference ranges of this
+        InstanceBVHNode*        m_nodes = nullptr;
+        int                     m_numNodes = 0;
+        bool                    m_needsBuild = false;
+        bool                    m_needsRefit = false;
+    };
+}
@@ -58,17 +58,39 @@ namespace RayTrace
             else {
                 // Estimate direct lighting using sample arrays
                 Spectrum Ld(0.f);
-                for (int k = 0; k < nSamples; ++k)
-                    Ld += EstimateDirect(it, uScatteringArray[k], *light,
-                        uLightArray[k], scene, sampler, arena,
-                        handleMedia);
+                if (handleMedia) {
+                    for (int k = 0; k < nSamples; ++k)
+                        Ld += EstimateDirect(it, uScatteringArray[k], *light,
+                            uLightArray[k], scene, sampler, arena,
+                            handleMedia);
+                }
+                else {
+                    // Trace the shadow rays of the light samples in packets
+                    const eBxDFType bsdfFlags = eBxDFType(BSDF_ALL & ~BSDF_SPECULAR);
+                    for (int k0 = 0; k0 < nSamples; k0 += RayPacketSize) {
+                        VisibilityTester testers[RayPacketSize];
+                        Spectrum         unoccludedLd[RayPacketSize];
+                        int              nTests = 0;
+                        for (int k = k0; k < std::min(k0 + RayPacketSize, nSamples); ++k) {
+                            unoccludedLd[nTests] = SampleLightDirect(it, *light, uLightArray[k], bsdfFlags, &testers[nTests]);
+                            if (!unoccludedLd[nTests].IsBlack())
+                                ++nTests;
+                            if (!IsDeltaLight(light->m_flags))
+                                Ld += SampleBSDFDirect(it, uScatteringArray[k], *light, scene, sampler, false, bsdfFlags);
+                        }
+                        uint32_t visible = VisibilityTester::Unoccluded(testers, nTests, scene);
+                        for (int i = 0; i < nTests; ++i)
+                            if (visible & (1u << i))
+                                Ld += unoccludedLd[i];
+                    }
+                }
                 L += Ld / nSamples;
             }
         }
         return L;
     }
 
-    Spectrum UniformSampleOneLight(const Interaction& it, const Scene& scene, MemoryArena& arena, Sampler& sampler, bool handleMedia /*= false*/, const Distribution1D* lightDistrib /*= nullptr*/)
+    Spectrum UniformSampleOneLight(const Interaction& it, const Scene& scene, MemoryArena& arena, Sampler& sampler, bool handleMedia /*= false*/, const LightDistribution* lightDistrib /*= nullptr*/)
     {
         // Randomly choose a single light to sample, _light_
         int nLights = scene.getNumLights();
@@ -77,8 +99,8 @@ namespace RayTrace
         int lightNum;
         float lightPdf;
         if (lightDistrib) {
-            lightNum = lightDistrib->SampleDiscrete(sampler.Get1D(), &lightPdf);
-            if (lightPdf == 0) return Spectrum(0.f);
+            lightNum = lightDistrib->SampleLight(it, sampler.Get1D(), &lightPdf);
+            if (lightNum < 0 || lightPdf == 0) return Spectrum(0.f);
         }
         else {
             lightNum = std::min((int)(sampler.Get1D() * nLights), nLights - 1);
@@ -91,112 +113,112 @@ namespace RayTrace
             scene, sampler, arena, handleMedia) / lightPdf;
     }
 
-    Spectrum EstimateDirect(const Interaction& it, const Vector2f& uScattering, const Light& light,
-        const Vector2f& uLight, const Scene& scene, Sampler& sampler, MemoryArena& arena, bool handleMedia /*= false*/, bool specular /*= false*/)
+    Spectrum SampleLightDirect(const Interaction& it, const Light& light, const Vector2f& uLight,
+        eBxDFType bsdfFlags, VisibilityTester* visibility)
     {
-        eBxDFType bsdfFlags = specular ? BSDF_ALL : eBxDFType(BSDF_ALL & ~BSDF_SPECULAR);
-        Spectrum Ld(0.f);
-        // Sample light source with multiple importance sampling
         Vector3f wi;
         float lightPdf = 0,
             scatteringPdf = 0;
-        VisibilityTester visibility;
-        Spectrum Li = light.Sample_Li(it, uLight, &wi, &lightPdf, &visibility);
-
-        if (lightPdf > 0 && !Li.IsBlack()) {
-            // Compute BSDF or phase function's value for light sample
-            Spectrum f;
-            if (it.IsSurfaceInteraction()) {
-                // Evaluate BSDF for light sampling strategy
-                const SurfaceInteraction& isect = (const SurfaceInteraction&)it;
-                f = isect.m_bsdf->f(isect.m_wo, wi, bsdfFlags) * AbsDot(wi, isect.shading.m_n);
-                scatteringPdf = isect.m_bsdf->Pdf(isect.m_wo, wi, bsdfFlags);
-                // VLOG(2) << "  surf f*dot :" << f << ", scatteringPdf: " << scatteringPdf;
-            }
-            else {
-                // Evaluate phase function for light sampling strategy
-                const MediumInteraction& mi = (const MediumInteraction&)it;
-                float p = mi.phase->p(mi.m_wo, wi);
-                f = Spectrum(p);
-                scatteringPdf = p;
-            }
-            if (!f.IsBlack()) {
-                // Compute effect of visibility for light source sample
-                if (handleMedia) {
-                    Li *= visibility.Tr(scene, sampler);
-                }
-                else {
-                    if (!visibility.Unoccluded(scene)) {
-                        Li = Spectrum(0.f);
-                    }
-                    else {
+        Spectrum Li = light.Sample_Li(it, uLight, &wi, &lightPdf, visibility);
+        if (lightPdf == 0 || Li.IsBlack())
+            return Spectrum(0.f);
 
-                    }
+        // Compute BSDF or phase function's value for light sample
+        Spectrum f;
+        if (it.IsSurfaceInteraction()) {
+            // Evaluate BSDF for light sampling strategy
+            const SurfaceInteraction& isect = (const SurfaceInteraction&)it;
+            f = isect.m_bsdf->f(isect.m_wo, wi, bsdfFlags) * AbsDot(wi, isect.shading.m_n);
+            scatteringPdf = isect.m_bsdf->Pdf(isect.m_wo, wi, bsdfFlags);
+        }
+        else {
+            // Evaluate phase function for light sampling strategy
+            const MediumInteraction& mi = (const MediumInteraction&)it;
+            float p = mi.phase->p(mi.m_wo, wi);
+            f = Spectrum(p);
+            scatteringPdf = p;
+        }
+        if (f.IsBlack())
+            return Spectrum(0.f);
 
-                }
+        if (IsDeltaLight(light.m_flags))
+            return f * Li / lightPdf;
+        float weight = PowerHeuristic(1, lightPdf, 1, scatteringPdf);
+        return f * Li * weight / lightPdf;
+    }
 
-                // Add light's contribution to reflected radiance
-                if (!Li.IsBlack()) {
-                    if (IsDeltaLight(light.m_flags))
-                        Ld += f * Li / lightPdf;
-                    else {
-                        float weight = PowerHeuristic(1, lightPdf, 1, scatteringPdf);
-                        Ld += f * Li * weight / lightPdf;
-                    }
-                }
-            }
+    Spectrum SampleBSDFDirect(const Interaction& it, const Vector2f& uScattering, const Light& light,
+        const Scene& scene, Sampler& sampler, bool handleMedia, eBxDFType bsdfFlags)
+    {
+        Vector3f wi;
+        float scatteringPdf = 0;
+        Spectrum f;
+        bool sampledSpecular = false;
+        if (it.IsSurfaceInteraction()) {
+            // Sample scattered direction for surface interactions
+            eBxDFType sampledType;
+            const SurfaceInteraction& isect = (const SurfaceInteraction&)it;
+            f = isect.m_bsdf->sample_f(isect.m_wo, &wi, uScattering, &scatteringPdf, bsdfFlags, &sampledType);
+            f *= AbsDot(wi, isect.shading.m_n);
+            sampledSpecular = (sampledType & BSDF_SPECULAR) != 0;
         }
+        else {
+            // Sample scattered direction for medium interactions
+            const MediumInteraction& mi = (const MediumInteraction&)it;
+            float p = mi.phase->Sample_p(mi.m_wo, &wi, uScattering);
+            f = Spectrum(p);
+            scatteringPdf = p;
+        }
+        if (f.IsBlack() || scatteringPdf <= 0)
+            return Spectrum(0.f);
 
-        // Sample BSDF with multiple importance sampling
-        if (!IsDeltaLight(light.m_flags)) {
-            Spectrum f;
-            bool sampledSpecular = false;
-            if (it.IsSurfaceInteraction()) {
-                // Sample scattered direction for surface interactions
-                eBxDFType sampledType;
-                const SurfaceInteraction& isect = (const SurfaceInteraction&)it;
-                f = isect.m_bsdf->sample_f(isect.m_wo, &wi, uScattering, &scatteringPdf, bsdfFlags, &sampledType);
-                f *= AbsDot(wi, isect.shading.m_n);
-                sampledSpecular = (sampledType & BSDF_SPECULAR) != 0;
-            }
-            else {
-                // Sample scattered direction for medium interactions
-                const MediumInteraction& mi = (const MediumInteraction&)it;
-                float p = mi.phase->Sample_p(mi.m_wo, &wi, uScattering);
-                f = Spectrum(p);
-                scatteringPdf = p;
-            }
-            // VLOG(2) << "  BSDF / phase sampling f: " << f << ", scatteringPdf: " <<
-            //     scatteringPdf;
-            if (!f.IsBlack() && scatteringPdf > 0) {
-                // Account for light contributions along sampled direction _wi_
-                float weight = 1;
-                if (!sampledSpecular) {
-                    lightPdf = light.Pdf_Li(it, wi);
-                    if (lightPdf == 0) return Ld;
-                    weight = PowerHeuristic(1, scatteringPdf, 1, lightPdf);
-                }
+        // Account for light contributions along sampled direction _wi_
+        float weight = 1;
+        if (!sampledSpecular) {
+            float lightPdf = light.Pdf_Li(it, wi);
+            if (lightPdf == 0) return Spectrum(0.f);
+            weight = PowerHeuristic(1, scatteringPdf, 1, lightPdf);
+        }
 
-                // Find intersection and compute transmittance
-                SurfaceInteraction lightIsect;
-                Ray ray = it.SpawnRay(wi);
-                Spectrum Tr(1.f);
-                bool foundSurfaceInteraction =
-                    handleMedia ? scene.intersectTr(ray, sampler, &lightIsect, &Tr)
-                    : scene.intersect(ray, &lightIsect);
-
-                // Add light contribution from material sampling
-                Spectrum Li(0.f);
-                if (foundSurfaceInteraction) {
-                    if (lightIsect.m_primitive->getAreaLight() == &light)
-                        Li = lightIsect.Le(-wi);
-                }
-                else
-                    Li = light.Le(ray);
-                if (!Li.IsBlack())
-                    Ld += f * Li * Tr * weight / scatteringPdf;
-            }
+        // Find intersection and compute transmittance
+        SurfaceInteraction lightIsect;
+        Ray ray = it.SpawnRay(wi);
+        Spectrum Tr(1.f);
+        bool foundSurfaceInteraction =
+            handleMedia ? scene.intersectTr(ray, sampler, &lightIsect, &Tr)
+            : scene.intersect(ray, &lightIsect);
+
+        // Add light contribution from material sampling
+        Spectrum Li(0.f);
+        if (foundSurfaceInteraction) {
+            if (lightIsect.m_primitive->getAreaLight() == &light)
+                Li = lightIsect.Le(-wi);
         }
+        else
+            Li = light.Le(ray);
+        if (Li.IsBlack())
+            return Spectrum(0.f);
+        return f * Li * Tr * weight / scatteringPdf;
+    }
+
+    Spectrum EstimateDirect(const Interaction& it, const Vector2f& uScattering, const Light& light,
+        const Vector2f& uLight, const Scene& scene, Sampler& sampler, MemoryArena& arena, bool handleMedia /*= false*/, bool specular /*= false*/)
+    {
+        eBxDFType bsdfFlags = specular ? BSDF_ALL : eBxDFType(BSDF_ALL & ~BSDF_SPECULAR);
+        // Sample light source with multiple importance sampling
+        VisibilityTester visibility;
+        Spectrum Ld = SampleLightDirect(it, light, uLight, bsdfFlags, &visibility);
+        if (!Ld.IsBlack()) {
+            // Compute effect of visibility for light source sample
+            if (handleMedia)
+                Ld *= visibility.Tr(scene, sampler);
+            else if (!visibility.Unoccluded(scene))
+                Ld = Spectrum(0.f);
+        }
+
+        // Sample BSDF with multiple importance sampling
+        if (!IsDeltaLight(light.m_flags))
+            Ld += SampleBSDFDirect(it, uScattering, light, scene, sampler, handleMedia, bsdfFlags);
         if (Ld.HasNaNs()) {
             std::cout << "Estimate Direct nans\n";
         }
@@ -224,9 +246,102 @@ namespace RayTrace
 
     void SamplerIntegrator::Render(const Scene& scene)
     {
-       
-        
         Preprocess(scene, *m_sampler);
+
+        using Clock = std::chrono::steady_clock;
+        const int64_t samplesPerPixel = m_sampler->m_samplesPerPixel;
+        const bool    adaptive = m_adaptive.targetError > 0;
+        int           samplesPerPass = m_progressive.samplesPerPass;
+        if (samplesPerPass <= 0)
+            samplesPerPass = adaptive ? std::max(1, m_adaptive.minSamplesPerPixel) : PreferredSamplesPerPass();
+        int64_t samplesDone = samplesPerPixel;
+        m_activePixels.clear();
+        m_activeTiles.clear();
+        if (samplesPerPass <= 0)
+            renderPass(scene, 0, samplesPerPixel, Clock::time_point::max());
+        else {
+            const int64_t maxSamples = m_progressive.maxSamplesPerPixel > 0
+                ? std::min<int64_t>(m_progressive.maxSamplesPerPixel, samplesPerPixel) : samplesPerPixel;
+            const Clock::time_point deadline = m_progressive.timeBudgetSeconds > 0
+                ? Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(m_progressive.timeBudgetSeconds))
+                : Clock::time_point::max();
+            const BBox2i   sampleBounds = m_camera->m_film->GetSampleBounds();
+            const Vector2i sampleExtent = sampleBounds.diagonal();
+            const Vector2i nTiles((sampleExtent.x + TileSize - 1) / TileSize,
+                                  (sampleExtent.y + TileSize - 1) / TileSize);
+            // Pixels sampled by the next pass, all of them until adaptive sampling drops converged ones
+            int64_t nActive = int64_t(std::max(0, std::min(sampleBounds.m_max.x, m_pixelBounds.m_max.x) - std::max(sampleBounds.m_min.x, m_pixelBounds.m_min.x))) *
+                              std::max(0, std::min(sampleBounds.m_max.y, m_pixelBounds.m_max.y) - std::max(sampleBounds.m_min.y, m_pixelBounds.m_min.y));
+            // Total samples of an adaptive render, 0 when it has no budget
+            const int64_t budget = adaptive ? m_adaptive.averageSamplesPerPixel * nActive : 0;
+            int64_t spent = 0;
+            samplesDone = 0;
+            for (int pass = 0; samplesDone < maxSamples && (budget <= 0 || spent < budget); ++pass) {
+                int64_t passSamples = samplesPerPass;
+                // The last pass of a budget only takes what is left of it
+                if (budget > 0)
+                    passSamples = std::min(passSamples, (budget - spent + nActive - 1) / nActive);
+                const int64_t passEnd = std::min<int64_t>(samplesDone + passSamples, maxSamples);
+                // The first pass always covers every tile so there is a complete image to publish
+                const bool complete = renderPass(scene, samplesDone, passEnd, pass == 0 ? Clock::time_point::max() : deadline);
+                // Tiles skipped by the deadline lack this pass, so only whole passes are counted
+                if (complete) {
+                    spent += nActive * (passEnd - samplesDone);
+                    samplesDone = passEnd;
+                }
+                m_camera->m_film->PublishImage(1.0f / samplesDone);
+                PassCompleted(pass);
+                if (!complete || Clock::now() >= deadline)
+                    break;
+                // Samples converged pixels no longer take stay in the budget for the noisy ones
+                if (adaptive && samplesDone >= m_adaptive.minSamplesPerPixel &&
+                    (nActive = updateActivePixels(sampleBounds, nTiles)) == 0)
+                    break;
+            }
+        }
+        m_activePixels.clear();
+        m_activeTiles.clear();
+        // Save final image after rendering
+        m_camera->m_film->WriteImage(1.0f / samplesDone);
+    }
+
+    int64_t SamplerIntegrator::updateActivePixels(const BBox2i& sampleBounds, const Vector2i& nTiles)
+    {
+        const Film&    film = *m_camera->m_film;
+        const BBox2i&  filmBounds = film.m_croppedPixelBounds;
+        const Vector2i sampleExtent = sampleBounds.diagonal();
+        m_activePixels.assign(std::max(0, sampleBounds.area()), 0);
+        m_activeTiles.assign(nTiles.x * nTiles.y, 0);
+        std::atomic<int64_t> nActive(0);
+
+        // Sample pixels outside the cropped film follow the film pixel nearest to them
+        ParallelFor([&](int64_t y) {
+            int64_t nRowActive = 0;
+            for (int x = 0; x < sampleExtent.x; ++x) {
+                Vector2i pixel = sampleBounds.m_min + Vector2i(x, (int)y);
+                if (!m_pixelBounds.insideExclusive(pixel))
+                    continue;
+                Vector2i filmPixel(std::clamp(pixel.x, filmBounds.m_min.x, filmBounds.m_max.x - 1),
+                                   std::clamp(pixel.y, filmBounds.m_min.y, filmBounds.m_max.y - 1));
+                if (film.GetPixelError(filmPixel) < m_adaptive.targetError)
+                    continue;
+                m_activePixels[y * sampleExtent.x + x] = 1;
+                ++nRowActive;
+            }
+            nActive += nRowActive;
+        }, sampleExtent.y);
+
+        for (int y = 0; y < sampleExtent.y; ++y)
+            for (int x = 0; x < sampleExtent.x; ++x)
+                if (m_activePixels[y * sampleExtent.x + x])
+                    m_activeTiles[(y / TileSize) * nTiles.x + x / TileSize] = 1;
+        return nActive;
+    }
+
+    bool SamplerIntegrator::renderPass(const Scene& scene, int64_t firstSample, int64_t endSample,
+        std::chrono::steady_clock::time_point deadline)
+    {
         // Render image tiles in parallel
 
         // Compute number of tiles, _nTiles_, to use for parallel rendering
@@ -236,51 +351,84 @@ namespace RayTrace
         Vector2i nTiles((sampleExtent.x + TileSize - 1) / TileSize,
                         (sampleExtent.y + TileSize - 1) / TileSize);
 
-        struct TileTask
-        {
-            void operator()()
-            {
-                MemoryArena arena;
-                auto sampleBounds = m_camera->m_film->GetSampleBounds();
-                // Get sampler instance for tile
-                int seed = m_curTile.y * m_nTiles.x + m_curTile.x;
-                
-                std::unique_ptr<Sampler> tileSampler = m_integrator->GetSampler()->Clone(seed);
-
-                // Compute sample bounds for tile
-                int x0 = sampleBounds.m_min.x + m_curTile.x * TileSize;
-                int x1 = std::min(x0 + TileSize, sampleBounds.m_max.x);
-
-                int y0 = sampleBounds.m_min.x + m_curTile.y * TileSize;
-                int y1 = std::min(y0 + TileSize, sampleBounds.m_max.y);
-                BBox2i tileBounds(Vector2i(x0, y0), Vector2i(x1, y1));
-                // LOG(INFO) << "Starting image tile " << tileBounds;
-                std::unique_ptr<FilmTile> filmTile = m_camera->m_film->GetFilmTile(tileBounds);
-
-                for (int pixY = y0; pixY < y1; pixY++)
-                    for (int pixX = x0; pixX < x1; pixX++)
-                    {
-                        Vector2i pixel(pixX, pixY);
-                        if (!m_pixelBounds.insideExclusive(pixel))
-                            continue;
-                        tileSampler->StartPixel(pixel);
-
-                      
+        std::atomic<bool> complete(true);
+        ParallelFor2D([&](Vector2i tile) {
+            // Tiles of a pass that starts past the deadline are skipped, their pixels keep the earlier passes
+            if (std::chrono::steady_clock::now() >= deadline) {
+                complete = false;
+                return;
+            }
+            // Tiles whose pixels all converged are skipped by adaptive sampling
+            if (!m_activeTiles.empty() && !m_activeTiles[tile.y * nTiles.x + tile.x])
+                return;
+            MemoryArena arena;
+            // Get sampler instance for tile, the seed is the same in every pass and SetSampleNumber()
+            // continues the pixel's sequence where the previous pass stopped
+            int seed = tile.y * nTiles.x + tile.x;
+            std::unique_ptr<Sampler> tileSampler = m_sampler->Clone(seed);
+            // Compute sample bounds for tile
+            int x0 = sampleBounds.m_min.x + tile.x * TileSize;
+            int x1 = std::min(x0 + TileSize, sampleBounds.m_max.x);
+
+            int y0 = sampleBounds.m_min.y + tile.y * TileSize;
+            int y1 = std::min(y0 + TileSize, sampleBounds.m_max.y);
+            BBox2i tileBounds(Vector2i(x0, y0), Vector2i(x1, y1));
+            // LOG(INFO) << "Starting image tile " << tileBounds;
+            std::unique_ptr<FilmTile> filmTile = m_camera->m_film->GetFilmTile(tileBounds);
+
+            for (int pixY = y0; pixY < y1; pixY++)
+                for (int pixX = x0; pixX < x1; pixX++)
+                {
+                    Vector2i pixel(pixX, pixY);
+                    if (!m_pixelBounds.insideExclusive(pixel))
+                        continue;
+                    if (!m_activePixels.empty() &&
+                        !m_activePixels[(pixY - sampleBounds.m_min.y) * sampleExtent.x + pixX - sampleBounds.m_min.x])
+                        continue;
+                    tileSampler->StartPixel(pixel);
+                    if (firstSample > 0)
+                        tileSampler->SetSampleNumber(firstSample);
+
+                    bool moreSamples = true;
+                    while (moreSamples) {
+                        // Generate up to _RayPacketSize_ camera rays for the pixel
+                        CameraSample       cameraSamples[RayPacketSize];
+                        RayDifferential    rays[RayPacketSize];
+                        float              rayWeights[RayPacketSize];
+                        int64_t            sampleNumbers[RayPacketSize];
+                        uint32_t           activeMask = 0;
+                        int                nSamples = 0;
                         do {
-                           
-                            // Initialize _CameraSample_ for current sample
-                            CameraSample cameraSample = tileSampler->GetCameraSample(pixel);
-                            // Generate camera ray for current sample
-                            RayDifferential ray;
-                            float rayWeight = m_camera->GenerateRayDifferential(cameraSample, &ray);
-                            ray.scaleDifferentials(1 / std::sqrt((float)tileSampler->m_samplesPerPixel));
+                            sampleNumbers[nSamples] = tileSampler->CurrentSampleNumber();
+                            cameraSamples[nSamples] = tileSampler->GetCameraSample(pixel);
+                            rayWeights[nSamples] = m_camera->GenerateRayDifferential(cameraSamples[nSamples], &rays[nSamples]);
+                            rays[nSamples].scaleDifferentials(1 / std::sqrt((float)tileSampler->m_samplesPerPixel));
+                            if (rayWeights[nSamples] > 0)
+                                activeMask |= 1u << nSamples;
+                            ++nSamples;
+                            moreSamples = tileSampler->StartNextSample() &&
+                                tileSampler->CurrentSampleNumber() < endSample;
+                        } while (moreSamples && nSamples < RayPacketSize);
+
+                        // Trace the first hits as one packet
+                        Ray                packet[RayPacketSize];
+                        SurfaceInteraction primaryHits[RayPacketSize];
+                        for (int i = 0; i < nSamples; ++i)
+                            packet[i] = rays[i];
+                        scene.intersect8(packet, primaryHits, activeMask);
+
+                        for (int i = 0; i < nSamples; ++i) {
+                            // Rewind the sampler to this sample, past the camera sample dimensions
+                            tileSampler->SetSampleNumber(sampleNumbers[i]);
+                            tileSampler->GetCameraSample(pixel);
+                            rays[i].m_maxT = packet[i].m_maxT;
 
                             // Evaluate radiance along camera ray
                             Spectrum L(0.f);
-                            if (rayWeight > 0)
-                                L = m_integrator->Li(ray, *m_scene, *tileSampler, arena);
+                            if (rayWeights[i] > 0)
+                                L = Li(rays[i], scene, *tileSampler, arena, 0, &primaryHits[i]);
 
-                            // Issue warning if unexpected radiance value returned                           
+                            // Issue warning if unexpected radiance value returned
                             if (L.HasNaNs()) {
                                 L = Spectrum(0.f);
                             }
@@ -288,40 +436,23 @@ namespace RayTrace
                                 L = Spectrum(0.f);
                             }
                             else if (std::isinf(L.y())) {
-                                L = Spectrum(0.f);                               
+                                L = Spectrum(0.f);
                             }
-                        
 
-                            filmTile->AddSample(cameraSample.m_image, L, rayWeight);
+                            filmTile->AddSample(cameraSamples[i].m_image, L, rayWeights[i]);
                             arena.Reset();
-                        } while (tileSampler->StartNextSample());
+                        }
+                        if (moreSamples)
+                            tileSampler->SetSampleNumber(sampleNumbers[nSamples - 1] + 1);
                     }
-                m_camera->m_film->MergeFilmTile(std::move(filmTile));
-            }
-            
-            BBox2i              m_pixelBounds;
-            Vector2i            m_nTiles;
-            Vector2i            m_curTile;
-            SamplerIntegrator*  m_integrator;
-            const Camera*             m_camera;
-            const Scene*              m_scene;
-        };
-
-        TaskQueue<TileTask> renderQueue(NumSystemCores());
-        for (int y = 0; y < nTiles.y; ++y) 
-        {
-            for (int x = 0; x < nTiles.x; ++x)
-            {
-                TileTask t = { m_pixelBounds, nTiles, {x, y}, this, m_camera.get(), &scene };
-                renderQueue.Enqueue(t);                
-            }//for x tiles
-        }//for y tiles
-        // Save final image after rendering
-        renderQueue.Join();
-        m_camera->m_film->WriteImage( 1.0f / m_sampler->m_samplesPerPixel);
+                }
+            m_camera->m_film->MergeFilmTile(std::move(filmTile));
+        }, nTiles);
+        return complete;
     }
 
-    Spectrum SamplerIntegrator::Li(const RayDifferential& ray, const Scene& scene, Sampler& sampler, MemoryArena& arena, int depth /*= 0*/) const
+
+    Spectrum SamplerIntegrator::Li(const RayDifferential& ray, const Scene& scene, Sampler& sampler, MemoryArena& arena, int depth /*= 0*/, const SurfaceInteraction* primaryHit /*= nullptr*/) const
     {
         return 0.f;
     }
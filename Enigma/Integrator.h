@@ -1,4 +1,5 @@
 #pragma once
+#include <chrono>
 #include "Defines.h"
 #include "Spectrum.h"
 #include "Lights.h"
@@ -19,7 +20,7 @@ namespace RayTrace
     Spectrum UniformSampleOneLight(const Interaction& it, const Scene& scene,
         MemoryArena& arena, Sampler& sampler,
         bool handleMedia = false,
-        const Distribution1D* lightDistrib = nullptr);
+        const LightDistribution* lightDistrib = nullptr);
    
     Spectrum EstimateDirect(const Interaction& it, const Vector2f& uShading,
         const Light& light, const Vector2f& uLight,
@@ -27,6 +28,14 @@ namespace RayTrace
         MemoryArena& arena, bool handleMedia = false,
         bool specular = false);
 
+    // The two halves of EstimateDirect, for callers that trace the shadow rays themselves.
+    // SampleLightDirect returns the MIS weighted light sample before _visibility_ is tested,
+    // SampleBSDFDirect traces the BSDF sampled ray and is only meaningful for non delta lights
+    Spectrum SampleLightDirect(const Interaction& it, const Light& light, const Vector2f& uLight,
+        eBxDFType bsdfFlags, VisibilityTester* visibility);
+    Spectrum SampleBSDFDirect(const Interaction& it, const Vector2f& uScattering, const Light& light,
+        const Scene& scene, Sampler& sampler, bool handleMedia, eBxDFType bsdfFlags);
+
     std::unique_ptr<Distribution1D> ComputeLightPowerDistribution( const Scene& scene );
     
     
@@ -52,21 +61,65 @@ namespace RayTrace
 
         virtual void                Preprocess(const Scene& scene, Sampler& sampler);
         virtual void                Render(const Scene& scene);
-        virtual Spectrum            Li(const RayDifferential& ray, const Scene& scene,Sampler& sampler, MemoryArena& arena, int depth = 0) const = 0;
+        // _primaryHit_, when given, is the intersection of _ray_ already traced by a camera ray
+        // packet in Render(); a null m_primitive marks a miss
+        virtual Spectrum            Li(const RayDifferential& ray, const Scene& scene,Sampler& sampler, MemoryArena& arena, int depth = 0,
+                                       const SurfaceInteraction* primaryHit = nullptr) const = 0;
         Spectrum                    SpecularReflect(const RayDifferential& ray, const SurfaceInteraction& isect, const Scene& scene, Sampler& sampler, MemoryArena& arena, int depth) const;
         Spectrum                    SpecularTransmit(const RayDifferential& ray, const SurfaceInteraction& isect, const Scene& scene, Sampler& sampler, MemoryArena& arena, int depth) const;
         const BBox2i&               GetPixelBounds() const;
         const SamplerPtr&           GetSampler() const;
         const CameraPtr&            GetCamera() const override;
 
+        // Progressive mode renders passes of _samplesPerPass_ samples per pixel over all tiles and
+        // publishes the film after each one. It stops at _maxSamplesPerPixel_ or after the pass
+        // running when _timeBudgetSeconds_ expires, 0 disables either limit
+        struct ProgressiveSettings {
+            int    samplesPerPass     = 0;      // 0 renders all samples in a single pass
+            int    maxSamplesPerPixel = 0;
+            double timeBudgetSeconds  = 0.0;
+        };
+        void                        SetProgressiveSettings(const ProgressiveSettings& settings) { m_progressive = settings; }
+
+        // Adaptive mode renders in passes like progressive mode (of _minSamplesPerPixel_ samples when
+        // no pass size is set). Once a pixel has _minSamplesPerPixel_ samples it stops being sampled
+        // as soon as its relative error, see Film::GetPixelError, drops below _targetError_.
+        // With _averageSamplesPerPixel_ set the render spends that many samples per pixel in total,
+        // so the samples converged pixels leave go to the noisy ones. The sampler's samples per
+        // pixel (or the progressive maximum) remain the ceiling of every pixel
+        struct AdaptiveSettings {
+            float  targetError            = 0.f;    // 0 disables adaptive sampling
+            int    minSamplesPerPixel     = 16;
+            int    averageSamplesPerPixel = 0;      // 0 samples noisy pixels up to the ceiling without a budget
+        };
+        void                        SetAdaptiveSettings(const AdaptiveSettings& settings) { m_adaptive = settings; }
+
     protected:
+        // Pass size used when neither progressive nor adaptive mode sets one, 0 renders a single pass
+        virtual int                 PreferredSamplesPerPass() const { return 0; }
+        // Called after each pass of a multi pass render, before the next one starts
+        virtual void                PassCompleted(int pass) { UNUSED(pass) }
+
         // SamplerIntegrator Protected Data
         CameraPtr m_camera;
 
     private:
+        // Renders samples [_firstSample_, _endSample_) of every pixel, tiles not started by _deadline_ are
+        // skipped. Returns false when any tile was skipped
+        bool                        renderPass(const Scene& scene, int64_t firstSample, int64_t endSample,
+                                        std::chrono::steady_clock::time_point deadline);
+        // Marks the sample pixels and tiles whose film pixels are still above the target error,
+        // returns the number of pixels left to sample
+        int64_t                     updateActivePixels(const BBox2i& sampleBounds, const Vector2i& nTiles);
+
         // SamplerIntegrator Private Data
         std::shared_ptr<Sampler> m_sampler;
         const BBox2i       m_pixelBounds;
+        ProgressiveSettings m_progressive;
+        AdaptiveSettings    m_adaptive;
+        // Adaptive sampling masks over the sample bounds and the tiles, empty while every pixel is sampled
+        std::vector<uint8_t> m_activePixels,
+                             m_activeTiles;
     };
 
    
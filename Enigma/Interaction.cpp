@@ -112,6 +112,7 @@ namespace RayTrace
         , m_dndu(dndu)
         , m_dndv(dndv)
         , m_shape(shape)
+        , m_shapeId(shape ? shape->m_shapeId : 0)
         , m_faceIndex(faceIndex)
         {
         // Initialize shading geometry from true geometry
@@ -75,6 +75,8 @@ namespace RayTrace
         Vector3f m_dpdu, m_dpdv;
         Vector3f m_dndu, m_dndv;
         const Shape* m_shape = nullptr;
+        // Shape::m_shapeId of the hit, compact meshes number their faces the same way
+        uint32_t m_shapeId = 0;
         struct {
             Vector3f m_n;
             Vector3f m_dpdu, m_dpdv;
@@ -90,6 +92,10 @@ namespace RayTrace
         // index with an intersection point for use in Ptex texture lookups.
         // If Ptex isn't being used, then this value is ignored.
         int m_faceIndex = 0;
+
+        // Wavelengths of the path in spectral rendering, null otherwise. Materials with
+        // wavelength dependent scattering may terminate the secondary wavelengths
+        SampledWavelengths* m_wavelengths = nullptr;
     };
 
 }  // namespace pbrt
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "HWPass.h"
 #include "ResourceManager.h"
 #include "HWVertexBuffer.h"
+#include "SceneManager.h"
 
 #include "LayerBase.h"
 
@@ -29,6 +30,14 @@ namespace RayTrace
             if (pass->IsEnabled())
                 m_activePasses.push_back(pass);   
 
+        //cull against this layer's camera, the passes skip culled items
+        if (_pCamera) {
+            const Frustum frustum(_pCamera->GetWorldToView(), _pCamera->GetProj());
+            m_pContext->GetSceneManager().CullObjects(&frustum);
+        }
+        else
+            m_pContext->GetSceneManager().CullObjects(nullptr);
+
         for (auto& pass : m_activePasses)
             pass->Begin(m_layer, _viewport, _pCamera ); //fetch items for this layer
     }
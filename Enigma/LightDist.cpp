@@ -8,6 +8,7 @@
 #include "Integrator.h"
 #include "Sampler.h"
 #include "Lights.h"
+#include "Interaction.h"
 
 #include "LightDist.h"
 
@@ -28,6 +29,9 @@ namespace RayTrace
         else if (name == "spatial")
             return std::unique_ptr<LightDistribution>{
             new SpatialLightDistribution(scene)};
+        else if (name == "bvh")
+            return std::unique_ptr<LightDistribution>{
+            new BVHLightDistribution(scene)};
         else {
             Error(
                 "Light sample distribution type \"%s\" unknown. Using \"spatial\".",
@@ -42,6 +46,12 @@ namespace RayTrace
 
     }
 
+    int LightDistribution::SampleLight(const Interaction& it, float u, float* pdf) const
+    {
+        const int lightNum = Lookup(it.m_p)->SampleDiscrete(u, pdf);
+        return *pdf > 0 ? lightNum : -1;
+    }
+
     //////////////////////////////////////////////////////////////////////////
     //UniformLightDistribution
     //////////////////////////////////////////////////////////////////////////
@@ -266,5 +276,166 @@ namespace RayTrace
         return new Distribution1D(&lightContrib[0], int(lightContrib.size()));
     }
 
-}
 
+    //////////////////////////////////////////////////////////////////////////
+    //BVHLightDistribution
+    //////////////////////////////////////////////////////////////////////////
+    // Cost of a cluster for the split heuristic: its power times the measure of the directions it
+    // emits in, times its surface area stretched by how thin the node is along _dim_
+    static float EvaluateSplitCost(const LightBounds& b, const BBox3f& nodeBounds, int dim)
+    {
+        if (b.m_phi == 0)
+            return 0;
+        const float thetaO = std::acos(std::clamp(b.m_cosThetaO, -1.f, 1.f));
+        const float thetaE = std::acos(std::clamp(b.m_cosThetaE, -1.f, 1.f));
+        const float thetaW = std::min(thetaO + thetaE, PI);
+        const float sinThetaO = std::sqrt(std::max(0.f, 1 - b.m_cosThetaO * b.m_cosThetaO));
+        const float mOmega = TWO_PI * (1 - b.m_cosThetaO) +
+            PI / 2 * (2 * thetaW * sinThetaO - std::cos(thetaO - 2 * thetaW) - 2 * thetaO * sinThetaO + b.m_cosThetaO);
+        const Vector3f d = nodeBounds.diagonal();
+        const float    kr = d[dim] > 0 ? std::max(d.x, std::max(d.y, d.z)) / d[dim] : 1.f;
+        return b.m_phi * mOmega * kr * b.m_bounds.surfaceArea();
+    }
+
+    BVHLightDistribution::BVHLightDistribution(const Scene& scene)
+        : m_powerDistrib(ComputeLightPowerDistribution(scene))
+    {
+        std::vector<BuildLight> lights;
+        for (size_t i = 0; i < scene.getNumLights(); ++i) {
+            LightBounds bounds;
+            if (!scene.getLight(i)->Bounds(&bounds))
+                m_infiniteLights.push_back((int)i);
+            else if (bounds.m_phi > 0)
+                lights.push_back({ (int)i, bounds });
+        }
+        if (!lights.empty()) {
+            m_nodes.reserve(2 * lights.size() - 1);
+            buildRecursive(lights, 0, (int)lights.size());
+        }
+    }
+
+    int BVHLightDistribution::buildRecursive(std::vector<BuildLight>& lights, int start, int end)
+    {
+        const int nodeIndex = (int)m_nodes.size();
+        m_nodes.emplace_back();
+        if (end - start == 1) {
+            m_nodes[nodeIndex] = { lights[start].m_bounds, (uint32_t)lights[start].m_index, true };
+            return nodeIndex;
+        }
+
+        BBox3f bounds, centroidBounds;
+        for (int i = start; i < end; ++i) {
+            bounds.addBounds(lights[i].m_bounds.m_bounds);
+            centroidBounds.addPoint(lights[i].m_bounds.m_bounds.getCenter());
+        }
+
+        // Find the cheapest split between buckets of light centroids along any axis
+        constexpr int nBuckets = 12;
+        auto bucketIndex = [&](const BuildLight& light, int dim) {
+            const float offset = (light.m_bounds.m_bounds.getCenter()[dim] - centroidBounds.m_min[dim]) /
+                (centroidBounds.m_max[dim] - centroidBounds.m_min[dim]);
+            return std::clamp((int)(offset * nBuckets), 0, nBuckets - 1);
+        };
+        float minCost = InfinityF32;
+        int   minDim = -1,
+              minBucket = -1;
+        for (int dim = 0; dim < 3; ++dim) {
+            if (centroidBounds.m_max[dim] <= centroidBounds.m_min[dim])
+                continue;
+            LightBounds buckets[nBuckets];
+            for (int i = start; i < end; ++i) {
+                const int b = bucketIndex(lights[i], dim);
+                buckets[b] = Union(buckets[b], lights[i].m_bounds);
+            }
+            for (int split = 1; split < nBuckets; ++split) {
+                LightBounds below, above;
+                for (int b = 0; b < split; ++b)
+                    below = Union(below, buckets[b]);
+                for (int b = split; b < nBuckets; ++b)
+                    above = Union(above, buckets[b]);
+                const float cost = EvaluateSplitCost(below, bounds, dim) + EvaluateSplitCost(above, bounds, dim);
+                if (cost < minCost) {
+                    minCost = cost;
+                    minDim = dim;
+                    minBucket = split;
+                }
+            }
+        }
+
+        int mid = start;
+        if (minDim >= 0)
+            mid = (int)(std::partition(lights.begin() + start, lights.begin() + end, [&](const BuildLight& light) {
+                return bucketIndex(light, minDim) < minBucket;
+            }) - lights.begin());
+        // Coincident centroids or a one sided split fall back to halving the range
+        if (mid == start || mid == end) {
+            mid = (start + end) / 2;
+            const int dim = (int)centroidBounds.maximumExtent();
+            std::nth_element(lights.begin() + start, lights.begin() + mid, lights.begin() + end, [dim](const BuildLight& a, const BuildLight& b) {
+                return a.m_bounds.m_bounds.getCenter()[dim] < b.m_bounds.m_bounds.getCenter()[dim];
+            });
+        }
+
+        // The first child follows its parent
+        buildRecursive(lights, start, mid);
+        const int secondChild = buildRecursive(lights, mid, end);
+        m_nodes[nodeIndex].m_bounds = Union(m_nodes[nodeIndex + 1].m_bounds, m_nodes[secondChild].m_bounds);
+        m_nodes[nodeIndex].m_offset = (uint32_t)secondChild;
+        m_nodes[nodeIndex].m_isLeaf = false;
+        return nodeIndex;
+    }
+
+    const Distribution1D* BVHLightDistribution::Lookup(const Vector3f& _p) const
+    {
+        return m_powerDistrib.get();
+    }
+
+    int BVHLightDistribution::SampleLight(const Interaction& it, float u, float* pdf) const
+    {
+        *pdf = 0;
+        const size_t nInfinite = m_infiniteLights.size();
+        if (m_nodes.empty() && nInfinite == 0)
+            return -1;
+
+        // The unbounded lights share the same chance as the whole tree
+        const float pInfinite = float(nInfinite) / float(nInfinite + (m_nodes.empty() ? 0 : 1));
+        if (u < pInfinite) {
+            const size_t i = std::min((size_t)(u / pInfinite * nInfinite), nInfinite - 1);
+            *pdf = pInfinite / nInfinite;
+            return m_infiniteLights[i];
+        }
+        u = std::min((u - pInfinite) / (1 - pInfinite), OneMinusEpsilon);
+
+        const Vector3f& p = it.m_p;
+        const Vector3f  n = it.IsSurfaceInteraction() ? ((const SurfaceInteraction&)it).shading.m_n : Vector3f(0.f);
+        float    pmf = 1 - pInfinite;
+        uint32_t nodeIndex = 0;
+        for (;;) {
+            const Node& node = m_nodes[nodeIndex];
+            if (node.m_isLeaf) {
+                if (node.m_bounds.Importance(p, n) <= 0)
+                    return -1;
+                *pdf = pmf;
+                return (int)node.m_offset;
+            }
+
+            // Descend into a child in proportion to its importance, remapping _u_ for the next level
+            const float importance0 = m_nodes[nodeIndex + 1].m_bounds.Importance(p, n);
+            const float importance1 = m_nodes[node.m_offset].m_bounds.Importance(p, n);
+            if (importance0 == 0 && importance1 == 0)
+                return -1;
+            const float p0 = importance0 / (importance0 + importance1);
+            if (u < p0) {
+                nodeIndex = nodeIndex + 1;
+                u = std::min(u / p0, OneMinusEpsilon);
+                pmf *= p0;
+            }
+            else {
+                nodeIndex = node.m_offset;
+                u = std::min((u - p0) / (1 - p0), OneMinusEpsilon);
+                pmf *= 1 - p0;
+            }
+        }
+    }
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "Defines.h"
+#include "Lights.h"
 
 namespace RayTrace
 {
@@ -13,6 +14,10 @@ namespace RayTrace
         // Given a point |p| in space, this method returns a (hopefully
         // effective) sampling distribution for light sources at that point.
         virtual const Distribution1D* Lookup(const Vector3f& _p) const = 0;
+
+        // Chooses one light to sample for the shading point _it_ and returns its index with its
+        // probability in _pdf_, -1 when no light reaches _it_. The default draws from Lookup()
+        virtual int SampleLight(const Interaction& it, float u, float* pdf) const;
     };
 
 
@@ -82,6 +87,36 @@ namespace RayTrace
     };
 
 
+    // Many light sampling with a BVH over the light bounds, see "Importance Sampling of Many
+    // Lights With Adaptive Tree Splitting" (Conty Estevez and Kulla 2018). SampleLight() descends
+    // from the root choosing each child in proportion to its estimated contribution to the
+    // shading point, in O(log n). Lights without bounds (infinite, distant) are chosen uniformly
+    // next to the tree. Lookup() has no point specific distribution and returns the power one
+    class BVHLightDistribution : public LightDistribution {
+    public:
+        BVHLightDistribution(const Scene& scene);
+        const Distribution1D* Lookup(const Vector3f& _p) const override;
+        int SampleLight(const Interaction& it, float u, float* pdf) const override;
+
+    private:
+        struct Node {
+            LightBounds m_bounds;
+            uint32_t    m_offset;       // second child for interior nodes, light index for leaves
+            bool        m_isLeaf;
+        };
+        struct BuildLight {
+            int         m_index;
+            LightBounds m_bounds;
+        };
+        // Builds the subtree over _lights_[start, end) and returns its root
+        int buildRecursive(std::vector<BuildLight>& lights, int start, int end);
+
+        std::vector<Node>               m_nodes;
+        std::vector<int>                m_infiniteLights;
+        std::unique_ptr<Distribution1D> m_powerDistrib;
+    };
+
+
     std::unique_ptr<LightDistribution> CreateLightSampleDistribution(
         const std::string& name, const Scene& scene);
 
@@ -65,6 +65,108 @@ namespace RayTrace
         m_uComponent = _rng.randomFloat();
     }*/
 
+#pragma region LightBounds
+    static float SinFromCos(float cosTheta)
+    {
+        return std::sqrt(std::max(0.f, 1 - cosTheta * cosTheta));
+    }
+
+    float LightBounds::Importance(const Vector3f& p, const Vector3f& n) const
+    {
+        // cos and sin of the difference of two angles, clamped to the angle 0 once b exceeds a
+        auto cosSubClamped = [](float sinA, float cosA, float sinB, float cosB) {
+            return cosA > cosB ? 1.f : cosA * cosB + sinA * sinB;
+        };
+        auto sinSubClamped = [](float sinA, float cosA, float sinB, float cosB) {
+            return cosA > cosB ? 0.f : sinA * cosB - cosA * sinB;
+        };
+
+        const Vector3f pc = m_bounds.getCenter();
+        const float    d2 = std::max(DistanceSqr(p, pc), Length(m_bounds.diagonal()) / 2);
+        if (d2 <= 0)
+            return m_phi;
+
+        // Angle between the normal cone axis and the direction towards _p_
+        const Vector3f wi = LengthSqr(p - pc) > 0 ? Normalize(p - pc) : m_w;
+        float cosThetaW = Dot(m_w, wi);
+        if (m_twoSided)
+            cosThetaW = std::abs(cosThetaW);
+        const float sinThetaW = SinFromCos(cosThetaW);
+
+        // Half angle of the cone of directions from _p_ towards the bounds
+        float cosThetaB = -1;
+        if (!m_bounds.inside(p)) {
+            Vector3f center;
+            float    radius;
+            m_bounds.getBoundingSphere(center, radius);
+            const float sin2ThetaMax = radius * radius / DistanceSqr(p, center);
+            if (sin2ThetaMax < 1)
+                cosThetaB = std::sqrt(1 - sin2ThetaMax);
+        }
+        const float sinThetaB = SinFromCos(cosThetaB);
+
+        // Smallest angle between an emitted direction and a direction towards _p_
+        const float sinThetaO = SinFromCos(m_cosThetaO);
+        const float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, m_cosThetaO);
+        const float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, m_cosThetaO);
+        const float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+        if (cosThetaP < m_cosThetaE)
+            return 0;
+
+        float importance = m_phi * cosThetaP / d2;
+        // Surfaces also receive less at grazing angles
+        if (LengthSqr(n) > 0) {
+            const float cosThetaI = AbsDot(wi, n);
+            const float sinThetaI = SinFromCos(cosThetaI);
+            importance *= cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+        }
+        return std::max(importance, 0.f);
+    }
+
+    LightBounds Union(const LightBounds& a, const LightBounds& b)
+    {
+        if (a.m_phi == 0)
+            return b;
+        if (b.m_phi == 0)
+            return a;
+
+        LightBounds result;
+        result.m_bounds = Union(a.m_bounds, b.m_bounds);
+        result.m_phi = a.m_phi + b.m_phi;
+        result.m_cosThetaE = std::min(a.m_cosThetaE, b.m_cosThetaE);
+        result.m_twoSided = a.m_twoSided || b.m_twoSided;
+
+        // Smallest cone containing both normal cones
+        const float thetaA = std::acos(std::clamp(a.m_cosThetaO, -1.f, 1.f));
+        const float thetaB = std::acos(std::clamp(b.m_cosThetaO, -1.f, 1.f));
+        const float thetaD = std::acos(std::clamp(Dot(a.m_w, b.m_w), -1.f, 1.f));
+        if (std::min(thetaD + thetaB, PI) <= thetaA) {
+            result.m_w = a.m_w;
+            result.m_cosThetaO = a.m_cosThetaO;
+        }
+        else if (std::min(thetaD + thetaA, PI) <= thetaB) {
+            result.m_w = b.m_w;
+            result.m_cosThetaO = b.m_cosThetaO;
+        }
+        else {
+            const float    thetaO = (thetaA + thetaD + thetaB) / 2;
+            const Vector3f axis = Cross(a.m_w, b.m_w);
+            if (thetaO >= PI || LengthSqr(axis) == 0) {
+                result.m_w = a.m_w;
+                result.m_cosThetaO = -1;
+            }
+            else {
+                // Rotate a's axis towards b's, _axis_ is perpendicular to it
+                const float    thetaR = thetaO - thetaA;
+                const Vector3f k = Normalize(axis);
+                result.m_w = Normalize(a.m_w * std::cos(thetaR) + Cross(k, a.m_w) * std::sin(thetaR));
+                result.m_cosThetaO = std::cos(thetaO);
+            }
+        }
+        return result;
+    }
+#pragma endregion
+
 #pragma region Light
     Light::Light(int flags, const Transform& LightToWorld, const MediumInterface& mediumInterface, int nSamples /*= 1*/)
         : m_lightToWorld( LightToWorld )
@@ -128,6 +230,14 @@ namespace RayTrace
         return 4.0f * PI * m_intensity;
     }
 
+    bool PointLight::Bounds(LightBounds* bounds) const
+    {
+        *bounds = LightBounds();
+        bounds->m_bounds = BBox3f(m_pos);
+        bounds->m_phi = Power().MaxComponentValue();
+        return true;
+    }
+
 #pragma endregion
 #pragma region SpotLight
     SpotLight::SpotLight(const Transform& _light2world, const MediumInterface& _mi, const Spectrum& _intensity, float _width, float _fall)
@@ -177,6 +287,18 @@ namespace RayTrace
             (1.f - .5f * (m_cosFalloffStart + m_cosTotalWidth));
     }
 
+    bool SpotLight::Bounds(LightBounds* bounds) const
+    {
+        // The cone restricts the directions, so the power is bounded as if emitted everywhere
+        *bounds = LightBounds();
+        bounds->m_bounds = BBox3f(m_pos);
+        bounds->m_w = Normalize(m_lightToWorld.transformVector(Vector3f(0.f, 0.f, 1.f)));
+        bounds->m_phi = 4.f * PI * m_intensity.MaxComponentValue();
+        bounds->m_cosThetaO = m_cosFalloffStart;
+        bounds->m_cosThetaE = std::cos(std::acos(m_cosTotalWidth) - std::acos(m_cosFalloffStart));
+        return true;
+    }
+
     float SpotLight::Falloff(const Vector3f& w) const
     {
         Vector3f wl = Normalize(m_worldToLight.transformVector(w));
@@ -295,6 +417,18 @@ namespace RayTrace
             : Spectrum(1.f)) * m_intensity * 2.0f * PI * (1.f - m_cosTotalWidth);
     }
 
+    bool ProjectionLight::Bounds(LightBounds* bounds) const
+    {
+        // Every emitted direction lies in the projection cone
+        *bounds = LightBounds();
+        bounds->m_bounds = BBox3f(m_pos);
+        bounds->m_w = Normalize(m_lightToWorld.transformVector(Vector3f(0.f, 0.f, 1.f)));
+        bounds->m_phi = Power().MaxComponentValue();
+        bounds->m_cosThetaO = m_cosTotalWidth;
+        bounds->m_cosThetaE = 1.f;
+        return true;
+    }
+
 #pragma endregion
 
 #pragma region GonioPhotometricLight 
@@ -362,33 +496,18 @@ namespace RayTrace
             Spectrum(m_gonioMap ? m_gonioMap->lookup(Vector2f{ .5f, .5f }, .5f) : 1.f, SPECTRUM_ILLUMINANT);
     }
 
+    bool GonioPhotometricLight::Bounds(LightBounds* bounds) const
+    {
+        *bounds = LightBounds();
+        bounds->m_bounds = BBox3f(m_pos);
+        bounds->m_phi = Power().MaxComponentValue();
+        return true;
+    }
+
 #pragma endregion
 
 #pragma region IniniteAreaLight
 
-    struct Task
-    {
-
-        void operator()()
-        {
-
-            float filter = 0.5f / std::min(m_width, m_height);
-            float vp = (m_yStart+0.5f) / (float)m_height;
-            float sinTheta = sinf(PI * float(m_yStart + .5f) / float(m_height));
-
-            for (int u = 0; u < m_width; ++u) {
-                float up = float(u + .5f) / (float)m_width;
-                std::size_t idx = u + m_yStart * m_width;
-                (*m_img)[idx] = m_radiance->lookup(Vector2f(up, vp), filter).y();
-                (*m_img)[idx] *= sinTheta;
-            }
-        }
-        FloatVector* m_img;
-        ImageDataRGBPtr     m_radiance;
-        int                 m_yStart;
-        int                 m_width,
-            m_height;
-    };
 
 
 
@@ -426,15 +545,17 @@ namespace RayTrace
         //float filter = 1.f / std::max(width, height);
         std::vector<float> img( static_cast<std::size_t>(width) * static_cast<std::size_t>(height));       
 
-        TaskQueue<Task> worker( NumSystemCores() );
-
-        for (int v = 0; v < height; ++v) {
-
-            Task t = { &img, m_radianceMap, v, width, height };
-            worker.Enqueue(t);
-        }
-
-        worker.Join();
+        const float filter = 0.5f / std::min(width, height);
+        ParallelFor([&](int64_t v) {
+            float vp = (v + 0.5f) / (float)height;
+            float sinTheta = sinf(PI * float(v + .5f) / float(height));
+            for (int u = 0; u < width; ++u) {
+                float up = float(u + .5f) / (float)width;
+                std::size_t idx = u + v * width;
+                img[idx] = m_radianceMap->lookup(Vector2f(up, vp), filter).y();
+                img[idx] *= sinTheta;
+            }
+        }, height, 32);
 
         // Compute sampling distributions for rows and columns of image
         m_distribution = std::make_unique<Distribution2D>(img.data(), width, height);
@@ -649,6 +770,19 @@ namespace RayTrace
         float scale = m_twoSided ? 2.0f : 1.0f;
         return m_Lemission * (m_area * PI * scale);
     }
+
+    bool DiffuseAreaLight::Bounds(LightBounds* bounds) const
+    {
+        *bounds = LightBounds();
+        bounds->m_bounds = m_shape->worldBounds();
+        bounds->m_phi = Power().MaxComponentValue();
+        bounds->m_twoSided = m_twoSided;
+        if (!m_shape->normalBounds(&bounds->m_w, &bounds->m_cosThetaO)) {
+            bounds->m_w = Vector3f(0.f, 0.f, 1.f);
+            bounds->m_cosThetaO = -1.f;
+        }
+        return true;
+    }
    
 #pragma endregion
 
@@ -715,6 +849,16 @@ namespace RayTrace
         return !scene.intersectP(p0.SpawnRayTo(p1));
     }
 
+    uint32_t VisibilityTester::Unoccluded(const VisibilityTester* testers, int count, const Scene& scene)
+    {
+        assert(count <= RayPacketSize);
+        Ray rays[RayPacketSize];
+        for (int i = 0; i < count; ++i)
+            rays[i] = testers[i].p0.SpawnRayTo(testers[i].p1);
+        const uint32_t activeMask = (1u << count) - 1;
+        return activeMask & ~scene.intersectP8(rays, activeMask);
+    }
+
     Spectrum VisibilityTester::Tr(const Scene& scene, Sampler& sampler) const
     {
         Ray ray(p0.SpawnRayTo(p1));
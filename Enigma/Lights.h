@@ -6,6 +6,7 @@
 #include "Defines.h"
 #include "MipMap.h"
 #include "Interaction.h"
+#include "BBox.h"
 
 namespace RayTrace
 {
@@ -19,6 +20,23 @@ namespace RayTrace
     
     using ImageDataRGBPtr = std::shared_ptr<MipMap<RGBSpectrum>>;
 
+    // Conservative bounds on what a light emits, see BVHLightDistribution. The emitters lie in
+    // _m_bounds_ and their normals in the cone around _m_w_ of cosine _m_cosThetaO_, light
+    // leaves them at most _m_cosThetaE_ away from the normal. _m_phi_ estimates the total power
+    struct LightBounds {
+        BBox3f      m_bounds;
+        Vector3f    m_w = Vector3f(0.f, 0.f, 1.f);
+        float       m_phi = 0.f;
+        float       m_cosThetaO = -1.f;         // all normals
+        float       m_cosThetaE = 0.f;          // hemisphere around each normal
+        bool        m_twoSided = false;
+
+        // Estimates the light arriving at _p_ on a surface with normal _n_, never zero when
+        // some of it can. _n_ is zero for points in media
+        float       Importance(const Vector3f& p, const Vector3f& n) const;
+    };
+    LightBounds Union(const LightBounds& a, const LightBounds& b);
+
 	class Light
 	{
 	public:
@@ -37,6 +55,8 @@ namespace RayTrace
                                                       Vector3f* wi, float* pdf, VisibilityTester* vis) const = 0;
 
         virtual Spectrum            Power() const = 0;
+        // Lights at infinity have no bounds and return false
+        virtual bool                        Bounds(LightBounds* bounds) const { return false; }
 
         // Light Public Data
         const int m_flags;
@@ -62,6 +82,7 @@ namespace RayTrace
         virtual Spectrum            Sample_Li(const Interaction& ref, const Vector2f& u,
                                                       Vector3f* wi, float* pdf, VisibilityTester* vis) const override;
         virtual Spectrum            Power() const override;
+        virtual bool                        Bounds(LightBounds* bounds) const override;
 
 
 
@@ -81,6 +102,7 @@ namespace RayTrace
         virtual Spectrum            Sample_Li(const Interaction& ref, const Vector2f& u,
                                                       Vector3f* wi, float* pdf, VisibilityTester* vis) const override;
         virtual Spectrum            Power() const override;
+        virtual bool                        Bounds(LightBounds* bounds) const override;
 
 
         float                               Falloff(const Vector3f& w) const;
@@ -111,6 +133,7 @@ namespace RayTrace
         virtual Spectrum            Sample_Li(const Interaction& ref, const Vector2f& u,
                                                       Vector3f* wi, float* pdf, VisibilityTester* vis) const override;
         virtual Spectrum            Power() const override;
+        virtual bool                        Bounds(LightBounds* bounds) const override;
 
 
 		ImageDataRGBPtr		m_projMap;
@@ -139,6 +162,7 @@ namespace RayTrace
         virtual Spectrum            Sample_Li(const Interaction& ref, const Vector2f& u,
                                                       Vector3f* wi, float* pdf, VisibilityTester* vis) const override;
         virtual Spectrum            Power() const override;
+        virtual bool                        Bounds(LightBounds* bounds) const override;
 
 
         ImageDataRGBPtr		m_gonioMap;
@@ -233,6 +257,7 @@ namespace RayTrace
         virtual Spectrum            Sample_Li(const Interaction& ref, const Vector2f& u,
                                                       Vector3f* wi, float* pdf, VisibilityTester* vis) const override;
         virtual Spectrum            Power() const override;
+        virtual bool                        Bounds(LightBounds* bounds) const override;
      
 
     protected:
@@ -255,6 +280,9 @@ namespace RayTrace
         const Interaction& P0() const { return p0; }
         const Interaction& P1() const { return p1; }
         bool  Unoccluded(const Scene& scene) const;
+        // Traces the shadow rays of up to RayPacketSize testers as one packet,
+        // returns the mask of the unoccluded ones
+        static uint32_t Unoccluded(const VisibilityTester* testers, int count, const Scene& scene);
         Spectrum Tr(const Scene& scene, Sampler& sampler) const;
 
     private:
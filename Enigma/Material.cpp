@@ -162,13 +162,14 @@ namespace RayTrace
             si->m_bsdf->addBxDF(ARENA_ALLOC(arena, ScaledBxDF)(si2.m_bsdf->m_pBxDFS[i], s2));
     }
 
-    GlassMaterial::GlassMaterial(const SpectrumTexturePtr& Kr, const SpectrumTexturePtr& Kt, const FloatTexturePtr& uRoughness, const FloatTexturePtr& vRoughness, const FloatTexturePtr& index, const FloatTexturePtr& bumpMap, bool remapRoughness) : m_Kr(Kr)
+    GlassMaterial::GlassMaterial(const SpectrumTexturePtr& Kr, const SpectrumTexturePtr& Kt, const FloatTexturePtr& uRoughness, const FloatTexturePtr& vRoughness, const FloatTexturePtr& index, const FloatTexturePtr& bumpMap, bool remapRoughness, float cauchyB) : m_Kr(Kr)
         , m_Kt(Kt)
         , m_uRoughness(uRoughness)
         , m_vRoughness(vRoughness)
         , m_index(index)
         , m_bumpMap(bumpMap)
         , m_remapRoughness(remapRoughness)
+        , m_cauchyB(cauchyB)
     {
 
     }
@@ -178,6 +179,13 @@ namespace RayTrace
         // Perform bump mapping with _bumpMap_, if present
         if (m_bumpMap) Bump(m_bumpMap, si);
         float eta    = m_index->Evaluate(*si);
+        // Cauchy's equation with _index_ as its constant term. The refracted direction depends on
+        // the wavelength, so spectral paths continue with the hero wavelength only
+        if (m_cauchyB != 0 && si->m_wavelengths) {
+            float lambda = (*si->m_wavelengths)[0] * 1e-3f;
+            eta += m_cauchyB / (lambda * lambda);
+            si->m_wavelengths->TerminateSecondary();
+        }
         float urough = m_uRoughness->Evaluate(*si);
         float vrough = m_vRoughness->Evaluate(*si);
         Spectrum R   = m_Kr->Evaluate(*si).Clamp();
@@ -631,8 +639,9 @@ namespace RayTrace
        FloatTexturePtr roughv = mp.GetFloatTexture("vroughness", 0.f);
        FloatTexturePtr bumpMap = mp.GetFloatTextureOrNull("bumpmap");
        bool remapRoughness = mp.FindBool("remaproughness", true);
+       float cauchyB = mp.FindFloat("cauchyb", 0.f);
 
-       return new GlassMaterial(Kr, Kt, roughu, roughv, eta, bumpMap,remapRoughness);
+       return new GlassMaterial(Kr, Kt, roughu, roughv, eta, bumpMap,remapRoughness, cauchyB);
    }
 
    PlasticMaterial* CreatePlasticMaterial(const TextureParams& mp)
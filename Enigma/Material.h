@@ -90,7 +90,8 @@ namespace RayTrace
             const FloatTexturePtr& vRoughness,
             const FloatTexturePtr& index,
             const FloatTexturePtr& bumpMap,
-            bool remapRoughness);
+            bool remapRoughness,
+            float cauchyB = 0.f);
 
         void	computeScatteringFunctions(SurfaceInteraction* isect, MemoryArena& arena,
             eTransportMode mode, bool allowMultipleLobes) const override;
@@ -103,6 +104,7 @@ namespace RayTrace
         FloatTexturePtr     m_uRoughness;
         FloatTexturePtr     m_vRoughness;
         bool                m_remapRoughness;
+        float               m_cauchyB;          // dispersion, in square micrometers
     };
 
     // PlasticMaterial Declarations
@@ -32,10 +32,29 @@ namespace RayTrace
             Error(
                 "GridDensityMedium requires a spectrally uniform attenuation "
                 "coefficient!");
-        float maxDensity = 0;
-        for (int i = 0; i < nx * ny * nz; ++i)
-            maxDensity = std::max(maxDensity, m_density[i]);
-        m_invMaxDensity = 1.0f / maxDensity;
+
+        // Density() interpolates between the samples at (i + 0.5) / n, so a cell also takes the
+        // maximum over the samples just outside of it
+        const int res[3] = { nx, ny, nz };
+        for (int axis = 0; axis < 3; ++axis)
+            m_majorantRes[axis] = std::min(MajorantGridRes, res[axis]);
+        m_majorants.assign(m_majorantRes[0] * m_majorantRes[1] * m_majorantRes[2], 0.f);
+        for (int z = 0; z < m_majorantRes[2]; ++z)
+            for (int y = 0; y < m_majorantRes[1]; ++y)
+                for (int x = 0; x < m_majorantRes[0]; ++x) {
+                    const int cell[3] = { x, y, z };
+                    int lo[3], hi[3];
+                    for (int axis = 0; axis < 3; ++axis) {
+                        lo[axis] = std::max(0, (int)std::floor((float)cell[axis] / m_majorantRes[axis] * res[axis] - .5f));
+                        hi[axis] = std::min(res[axis] - 1, (int)std::floor((float)(cell[axis] + 1) / m_majorantRes[axis] * res[axis] - .5f) + 1);
+                    }
+                    float maxDensity = 0;
+                    for (int k = lo[2]; k <= hi[2]; ++k)
+                        for (int j = lo[1]; j <= hi[1]; ++j)
+                            for (int i = lo[0]; i <= hi[0]; ++i)
+                                maxDensity = std::max(maxDensity, m_density[(k * ny + j) * nx + i]);
+                    m_majorants[(z * m_majorantRes[1] + y) * m_majorantRes[0] + x] = maxDensity;
+                }
     }
 
     float GridDensityMedium::D(const Vector3i& p) const
@@ -44,23 +63,129 @@ namespace RayTrace
         if (!sampleBounds.insideExlusive(p))
             return 0.f;
 
-        int idx = (p.z * m_ny + p.y) + m_nx + p.x;
+        int idx = (p.z * m_ny + p.y) * m_nx + p.x;
         return m_density[idx];
     }
 
-    Spectrum GridDensityMedium::Tr(const Ray& ray, Sampler& sampler) const
+    template <typename Func>
+    void GridDensityMedium::track(const Ray& ray, float tMin, float tMax, Sampler& sampler, Func collision) const
+    {
+        // Set up the 3D DDA over the majorant grid
+        const Vector3f pGrid = ray.scale(tMin);
+        int   cell[3], step[3], cellLimit[3];
+        float nextCrossingT[3], deltaT[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            const int   res = m_majorantRes[axis];
+            const float dir = ray.m_dir[axis];
+            cell[axis] = std::clamp((int)(pGrid[axis] * res), 0, res - 1);
+            if (dir == 0) {
+                nextCrossingT[axis] = InfinityF32;
+                deltaT[axis] = InfinityF32;
+                step[axis] = 0;
+                cellLimit[axis] = -1;
+            }
+            else if (dir > 0) {
+                nextCrossingT[axis] = tMin + ((float)(cell[axis] + 1) / res - pGrid[axis]) / dir;
+                deltaT[axis] = 1 / (dir * res);
+                step[axis] = 1;
+                cellLimit[axis] = res;
+            }
+            else {
+                nextCrossingT[axis] = tMin + ((float)cell[axis] / res - pGrid[axis]) / dir;
+                deltaT[axis] = -1 / (dir * res);
+                step[axis] = -1;
+                cellLimit[axis] = -1;
+            }
+        }
+
+        float t = tMin;
+        for (;;) {
+            int exitAxis = 0;
+            if (nextCrossingT[1] < nextCrossingT[exitAxis]) exitAxis = 1;
+            if (nextCrossingT[2] < nextCrossingT[exitAxis]) exitAxis = 2;
+            const float tEnd = std::min(tMax, nextCrossingT[exitAxis]);
+
+            // Exponential steps against the cell's majorant, restarting at the cell boundary
+            // is valid since the distribution is memoryless
+            const float sigmaMaj = m_sigma_t * m_majorants[(cell[2] * m_majorantRes[1] + cell[1]) * m_majorantRes[0] + cell[0]];
+            if (sigmaMaj > 0) {
+                for (;;) {
+                    t -= std::log(1 - sampler.Get1D()) / sigmaMaj;
+                    if (t >= tEnd)
+                        break;
+                    if (!collision(t, sigmaMaj))
+                        return;
+                }
+            }
+
+            if (tEnd >= tMax)
+                return;
+            t = tEnd;
+            cell[exitAxis] += step[exitAxis];
+            if (cell[exitAxis] == cellLimit[exitAxis])
+                return;
+            nextCrossingT[exitAxis] += deltaT[exitAxis];
+        }
+    }
+
+    Spectrum GridDensityMedium::Tr(const Ray& rWorld, Sampler& sampler) const
     {
-        return {};
+        // Transform the ray to the medium's unit cube, _t_ then measures world distance
+        const float dirLength = rWorld.m_dir.length();
+        const Ray   ray = m_worldToMedium.transformRay(
+            Ray(rWorld.m_origin, rWorld.m_dir / dirLength, rWorld.m_maxT * dirLength));
+        const BBox3f b(Vector3f(0.f), Vector3f(1.f));
+        float tMin, tMax;
+        if (!b.intersectP(ray, &tMin, &tMax))
+            return Spectrum(1.f);
+
+        // Ratio tracking
+        float Tr = 1;
+        track(ray, tMin, tMax, sampler, [&](float t, float sigmaMaj) {
+            Tr *= 1 - std::max(0.f, m_sigma_t * Density(ray.scale(t)) / sigmaMaj);
+            return Tr > 0;
+        });
+        return Spectrum(Tr);
     }
 
-    Spectrum GridDensityMedium::Sample(const Ray& ray, Sampler& sampler, MemoryArena& arena, MediumInteraction* mi) const
+    Spectrum GridDensityMedium::Sample(const Ray& rWorld, Sampler& sampler, MemoryArena& arena, MediumInteraction* mi) const
     {
-        return {};
+        const float dirLength = rWorld.m_dir.length();
+        const Ray   ray = m_worldToMedium.transformRay(
+            Ray(rWorld.m_origin, rWorld.m_dir / dirLength, rWorld.m_maxT * dirLength));
+        const BBox3f b(Vector3f(0.f), Vector3f(1.f));
+        float tMin, tMax;
+        if (!b.intersectP(ray, &tMin, &tMax))
+            return Spectrum(1.f);
+
+        // Delta tracking, a real collision scatters with probability sigma_s / sigma_t
+        bool scattered = false;
+        track(ray, tMin, tMax, sampler, [&](float t, float sigmaMaj) {
+            if (m_sigma_t * Density(ray.scale(t)) / sigmaMaj <= sampler.Get1D())
+                return true;
+            *mi = MediumInteraction(rWorld.scale(t / dirLength), -rWorld.m_dir, rWorld.m_time, this,
+                ARENA_ALLOC(arena, HenyeyGreenstein)(m_g));
+            scattered = true;
+            return false;
+        });
+        return scattered ? m_sigma_s / m_sigma_t : Spectrum(1.f);
     }
 
     float GridDensityMedium::Density(const Vector3f& p) const
     {
-        return 0;
+        // Compute voxel coordinates and offsets for _p_
+        const Vector3f pSamples(p.x * m_nx - .5f, p.y * m_ny - .5f, p.z * m_nz - .5f);
+        const Vector3i pi((int)std::floor(pSamples.x), (int)std::floor(pSamples.y), (int)std::floor(pSamples.z));
+        const Vector3f d = pSamples - Vector3f((float)pi.x, (float)pi.y, (float)pi.z);
+
+        // Trilinearly interpolate density values to compute local density
+        const float d00 = Lerp(D(pi), D(pi + Vector3i(1, 0, 0)), d.x);
+        const float d10 = Lerp(D(pi + Vector3i(0, 1, 0)), D(pi + Vector3i(1, 1, 0)), d.x);
+        const float d01 = Lerp(D(pi + Vector3i(0, 0, 1)), D(pi + Vector3i(1, 0, 1)), d.x);
+        const float d11 = Lerp(D(pi + Vector3i(0, 1, 1)), D(pi + Vector3i(1, 1, 1)), d.x);
+        const float d0 = Lerp(d00, d10, d.y);
+        const float d1 = Lerp(d01, d11, d.y);
+        return Lerp(d0, d1, d.z);
     }
 
 
@@ -46,6 +46,13 @@ namespace RayTrace
 
 
     private:
+        // Visits the tentative collisions of delta tracking along the medium space _ray_ within
+        // [_tMin_, _tMax_]. A 3D DDA walks the majorant grid so each step is sampled against the
+        // majorant of its cell and empty cells are skipped. _collision_(t, sigmaMaj) returns
+        // false to stop
+        template <typename Func>
+        void        track(const Ray& ray, float tMin, float tMax, Sampler& sampler, Func collision) const;
+
         // GridDensityMedium Private Data
         const Spectrum m_sigma_a,
                                m_sigma_s;
@@ -54,7 +61,11 @@ namespace RayTrace
         const Transform m_worldToMedium;
         std::unique_ptr<float[]> m_density;
         float m_sigma_t;
-        float m_invMaxDensity;
+        // Coarse grid over the medium's unit cube, each cell holds the largest density the
+        // interpolated grid reaches inside it
+        static constexpr int MajorantGridRes = 16;
+        int                  m_majorantRes[3];
+        std::vector<float>   m_majorants;
     };
 
    
@@ -40,7 +40,8 @@ namespace RayTrace
         }
         void* Alloc(size_t nBytes) {
 
-            const int align = alignof(std::max_align_t);
+            // At least 16 so SSE aligned types like spectra can live in the arena
+            const int align = std::max<int>(16, alignof(std::max_align_t));
             static_assert(IsPowerOf2(align), "Minimum alignment not a power of two");
 
             nBytes = (nBytes + align - 1) & ~(align - 1);
@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <numeric>
+#include <immintrin.h>
+#include "BBox.h"
+#include "Ray.h"
+#include "Memory.h"
+#include "Material.h"
+#include "Interaction.h"
+#include "TriangleMesh.h"
+#include "Shape.h"
+#include "Misc.h"
+#include "Transform.h"
+#include "Concurrency.h"
+#include "MeshPrimitive.h"
+
+namespace RayTrace
+{
+    static constexpr int TrianglesPerBlock = 4;
+    static constexpr int nMeshSAHBuckets = 12;
+
+    struct MeshBVHNode {
+        BBox3f   bounds;
+        int32_t  offset;        // leaf: first triangle, then block index; interior: second child
+        uint16_t nTriangles;    // 0 -> interior node
+        uint8_t  axis;
+        uint8_t  pad[1];
+    };
+
+    // Vertices of 4 faces as [vertex][axis][lane], lanes past the leaf's face count are unused
+    struct alignas(16) TriangleBlock4 {
+        float    p[3][3][TrianglesPerBlock];
+        uint32_t triIndex[TrianglesPerBlock];
+    };
+
+    // Permutation and shear of the watertight test, set up once per ray
+    struct RayShear {
+        explicit RayShear(const Ray& ray) {
+            kz = (int)MaxDimension(Abs(ray.m_dir));
+            kx = kz + 1;
+            if (kx == 3) kx = 0;
+            ky = kx + 1;
+            if (ky == 3) ky = 0;
+            const Vector3f d = Permute(ray.m_dir, kx, ky, kz);
+            o = Permute(ray.m_origin, kx, ky, kz);
+            Sx = -d.x / d.z;
+            Sy = -d.y / d.z;
+            Sz = 1.f / d.z;
+        }
+        int      kx, ky, kz;
+        Vector3f o;
+        float    Sx, Sy, Sz;
+    };
+
+    static inline __m128 Abs4(__m128 x) { return _mm_andnot_ps(_mm_set1_ps(-0.f), x); }
+    static inline __m128 Max4(__m128 a, __m128 b, __m128 c) { return _mm_max_ps(_mm_max_ps(Abs4(a), Abs4(b)), Abs4(c)); }
+
+    // The watertight test of IntersectTriangle() on 4 faces at once, returns the mask of lanes
+    // that may be hit before _tMax_. Edge functions and t pass within twice the error bounds
+    // of IntersectTriangle(), so slivers and grazing hits always reach the scalar test
+    static inline int IntersectBlock4(const TriangleBlock4& b, int nTriangles, const RayShear& s, float tMax) {
+        const __m128 ox = _mm_set1_ps(s.o.x), oy = _mm_set1_ps(s.o.y), oz = _mm_set1_ps(s.o.z);
+        const __m128 sx = _mm_set1_ps(s.Sx), sy = _mm_set1_ps(s.Sy), sz = _mm_set1_ps(s.Sz);
+
+        // Translate to the ray origin, permute and shear, in the order IntersectTriangle() does
+        __m128 x[3], y[3], z[3];
+        for (int i = 0; i < 3; ++i) {
+            z[i] = _mm_sub_ps(_mm_load_ps(b.p[i][s.kz]), oz);
+            x[i] = _mm_add_ps(_mm_sub_ps(_mm_load_ps(b.p[i][s.kx]), ox), _mm_mul_ps(sx, z[i]));
+            y[i] = _mm_add_ps(_mm_sub_ps(_mm_load_ps(b.p[i][s.ky]), oy), _mm_mul_ps(sy, z[i]));
+        }
+        const __m128 e0 = _mm_sub_ps(_mm_mul_ps(x[1], y[2]), _mm_mul_ps(y[1], x[2]));
+        const __m128 e1 = _mm_sub_ps(_mm_mul_ps(x[2], y[0]), _mm_mul_ps(y[2], x[0]));
+        const __m128 e2 = _mm_sub_ps(_mm_mul_ps(x[0], y[1]), _mm_mul_ps(y[0], x[1]));
+
+        // |Sx|, |Sy| <= 1, so the unscaled z bounds the shear error
+        const __m128 maxXt = Max4(x[0], x[1], x[2]), maxYt = Max4(y[0], y[1], y[2]), maxZ = Max4(z[0], z[1], z[2]);
+        const __m128 deltaX = _mm_mul_ps(_mm_set1_ps(gamma(5)), _mm_add_ps(maxXt, maxZ));
+        const __m128 deltaY = _mm_mul_ps(_mm_set1_ps(gamma(5)), _mm_add_ps(maxYt, maxZ));
+        const __m128 deltaE = _mm_mul_ps(_mm_set1_ps(2.f), _mm_add_ps(
+            _mm_mul_ps(_mm_set1_ps(gamma(2)), _mm_mul_ps(maxXt, maxYt)),
+            _mm_add_ps(_mm_mul_ps(deltaY, maxXt), _mm_mul_ps(deltaX, maxYt))));
+        const __m128 slackE = _mm_add_ps(deltaE, deltaE), negSlackE = _mm_sub_ps(_mm_setzero_ps(), slackE);
+        const __m128 allPos = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, negSlackE), _mm_cmpge_ps(e1, negSlackE)), _mm_cmpge_ps(e2, negSlackE));
+        const __m128 allNeg = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(e0, slackE), _mm_cmple_ps(e1, slackE)), _mm_cmple_ps(e2, slackE));
+
+        // Scaled t with the sign of det folded in, compared against the t error bound scaled by det
+        const __m128 det = _mm_add_ps(_mm_add_ps(e0, e1), e2);
+        const __m128 detSign = _mm_and_ps(det, _mm_set1_ps(-0.f));
+        for (int i = 0; i < 3; ++i)
+            z[i] = _mm_mul_ps(z[i], sz);
+        const __m128 tScaled = _mm_xor_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, z[0]), _mm_mul_ps(e1, z[1])), _mm_mul_ps(e2, z[2])), detSign);
+        const __m128 maxZt = Max4(z[0], z[1], z[2]), maxE = Max4(e0, e1, e2);
+        const __m128 deltaZ = _mm_mul_ps(_mm_set1_ps(gamma(3)), maxZt);
+        const __m128 slackT = _mm_mul_ps(_mm_set1_ps(6.f), _mm_add_ps(
+            _mm_mul_ps(_mm_set1_ps(gamma(3)), _mm_mul_ps(maxE, maxZt)),
+            _mm_add_ps(_mm_mul_ps(deltaE, maxZt), _mm_mul_ps(deltaZ, maxE))));
+
+        __m128 mask = _mm_or_ps(allPos, allNeg);
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(tScaled, _mm_sub_ps(_mm_setzero_ps(), slackT)));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(tScaled, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tMax), Abs4(det)), slackT)));
+        return _mm_movemask_ps(mask) & ((1 << nTriangles) - 1);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // TriangleMeshPrimitive Implementation
+    //////////////////////////////////////////////////////////////////////////
+    TriangleMeshPrimitive::TriangleMeshPrimitive(const TriangleMeshPtr& mesh,
+        const Transform* objectToWorld, const Transform* worldToObject,
+        bool reverseOrientation, const MaterialPtr& material,
+        const MediumInterface& mi)
+        : m_mesh(mesh)
+        , m_objectToWorld(objectToWorld)
+        , m_worldToObject(worldToObject)
+        , m_reverseOrientation(reverseOrientation)
+        , m_transformSwapsHandedness(objectToWorld->swapsHandedness())
+        , m_material(material)
+        , m_mi(mi)
+        , m_firstShapeId(Shape::s_nextShapeId)
+    {
+        const int nTriangles = m_mesh->m_nTriangles;
+        Shape::s_nextShapeId += nTriangles;
+        if (nTriangles == 0)
+            return;
+
+        const uint32_t* indices = m_mesh->m_vertexIndices.data();
+        const Vector3f* p = m_mesh->m_p.get();
+        std::vector<BBox3f> triBounds(nTriangles);
+        ParallelFor([&](int64_t i) {
+            const uint32_t* v = &indices[3 * i];
+            BBox3f b;
+            b.addPoint(p[v[0]]);
+            b.addPoint(p[v[1]]);
+            b.addPoint(p[v[2]]);
+            triBounds[i] = b;
+        }, nTriangles, 1024);
+
+        std::vector<uint32_t> triIndices(nTriangles);
+        std::iota(triIndices.begin(), triIndices.end(), 0u);
+        std::vector<MeshBVHNode> nodes;
+        nodes.reserve(2 * (nTriangles / TrianglesPerBlock) + 1);
+        buildRecursive(nodes, triIndices, triBounds, 0, nTriangles);
+        m_bounds = nodes[0].bounds;
+
+        // One block of records per leaf, in leaf order
+        std::vector<int> leaves;
+        for (int i = 0; i < (int)nodes.size(); ++i)
+            if (nodes[i].nTriangles > 0)
+                leaves.push_back(i);
+        m_blocks = AllocAligned<TriangleBlock4>(leaves.size());
+        ParallelFor([&](int64_t leaf) {
+            MeshBVHNode& node = nodes[leaves[leaf]];
+            TriangleBlock4& block = m_blocks[leaf];
+            for (int lane = 0; lane < TrianglesPerBlock; ++lane) {
+                Vector3f pv[3] = { Vector3f(0.f), Vector3f(0.f), Vector3f(0.f) };
+                uint32_t tri = 0;
+                if (lane < node.nTriangles) {
+                    tri = triIndices[node.offset + lane];
+                    const uint32_t* v = &indices[3 * tri];
+                    for (int i = 0; i < 3; ++i)
+                        pv[i] = p[v[i]];
+                }
+                for (int i = 0; i < 3; ++i)
+                    for (int a = 0; a < 3; ++a)
+                        block.p[i][a][lane] = pv[i][a];
+                block.triIndex[lane] = tri;
+            }
+            node.offset = (int32_t)leaf;
+        }, (int64_t)leaves.size(), 256);
+
+        m_nodes = AllocAligned<MeshBVHNode>(nodes.size());
+        std::copy(nodes.begin(), nodes.end(), m_nodes);
+    }
+
+    TriangleMeshPrimitive::~TriangleMeshPrimitive()
+    {
+        FreeAligned(m_nodes);
+        FreeAligned(m_blocks);
+    }
+
+    int TriangleMeshPrimitive::buildRecursive(std::vector<MeshBVHNode>& nodes, std::vector<uint32_t>& triIndices,
+        const std::vector<BBox3f>& triBounds, int start, int end)
+    {
+        const int nodeIndex = (int)nodes.size();
+        nodes.emplace_back();
+
+        BBox3f bounds, centroidBounds;
+        for (int i = start; i < end; ++i) {
+            bounds = Union(bounds, triBounds[triIndices[i]]);
+            centroidBounds = Union(centroidBounds, triBounds[triIndices[i]].getCenter());
+        }
+        nodes[nodeIndex].bounds = bounds;
+
+        const int nTriangles = end - start;
+        if (nTriangles <= TrianglesPerBlock) {
+            nodes[nodeIndex].offset = start;
+            nodes[nodeIndex].nTriangles = (uint16_t)nTriangles;
+            return nodeIndex;
+        }
+
+        const int dim = centroidBounds.maximumExtent();
+        auto centroid = [&](uint32_t tri) { return triBounds[tri].getCenter()[dim]; };
+        int mid = start;
+        if (centroidBounds.m_max[dim] > centroidBounds.m_min[dim]) {
+            // Binned SAH, same cost sweep as BVHAccel
+            int    counts[nMeshSAHBuckets] = {};
+            BBox3f bucketBounds[nMeshSAHBuckets];
+            auto bucketOf = [&](uint32_t tri) {
+                int b = (int)(nMeshSAHBuckets * centroidBounds.offset(triBounds[tri].getCenter())[dim]);
+                return std::min(b, nMeshSAHBuckets - 1);
+            };
+            for (int i = start; i < end; ++i) {
+                int b = bucketOf(triIndices[i]);
+                counts[b]++;
+                bucketBounds[b] = Union(bucketBounds[b], triBounds[triIndices[i]]);
+            }
+
+            float  areaBelow[nMeshSAHBuckets - 1];
+            int    countBelow[nMeshSAHBuckets - 1];
+            BBox3f b0, b1;
+            int    count0 = 0, count1 = 0;
+            for (int i = 0; i < nMeshSAHBuckets - 1; ++i) {
+                b0 = Union(b0, bucketBounds[i]);
+                count0 += counts[i];
+                countBelow[i] = count0;
+                areaBelow[i] = b0.surfaceArea();
+            }
+            float minCost = InfinityF32;
+            int   minBucket = 0;
+            for (int i = nMeshSAHBuckets - 1; i > 0; --i) {
+                b1 = Union(b1, bucketBounds[i]);
+                count1 += counts[i];
+                float cost = countBelow[i - 1] * areaBelow[i - 1] + count1 * b1.surfaceArea();
+                if (countBelow[i - 1] > 0 && count1 > 0 && cost < minCost) {
+                    minCost = cost;
+                    minBucket = i - 1;
+                }
+            }
+            mid = (int)(std::partition(triIndices.begin() + start, triIndices.begin() + end,
+                [&](uint32_t tri) { return bucketOf(tri) <= minBucket; }) - triIndices.begin());
+        }
+        if (mid == start || mid == end) {
+            // Coincident centroids, split by count so leaves stay within one block
+            mid = (start + end) / 2;
+            std::nth_element(triIndices.begin() + start, triIndices.begin() + mid, triIndices.begin() + end,
+                [&](uint32_t a, uint32_t b) { return centroid(a) < centroid(b); });
+        }
+
+        buildRecursive(nodes, triIndices, triBounds, start, mid);
+        const int secondChild = buildRecursive(nodes, triIndices, triBounds, mid, end);
+        nodes[nodeIndex].offset = secondChild;
+        nodes[nodeIndex].nTriangles = 0;
+        nodes[nodeIndex].axis = (uint8_t)dim;
+        return nodeIndex;
+    }
+
+    template <typename Func>
+    bool TriangleMeshPrimitive::traverse(const Ray& r, Func func) const
+    {
+        if (!m_nodes) return false;
+        const RayShear shear(r);
+        Vector3f invDir = Inverted(r.m_dir);
+        int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+        int toVisitOffset = 0, currentNodeIndex = 0;
+        int nodesToVisit[64];
+        while (true) {
+            const MeshBVHNode* node = &m_nodes[currentNodeIndex];
+            if (node->bounds.intersectP(r, invDir, dirIsNeg)) {
+                if (node->nTriangles > 0) {
+                    const TriangleBlock4& block = m_blocks[node->offset];
+                    int mask = IntersectBlock4(block, node->nTriangles, shear, r.m_maxT);
+                    while (mask) {
+                        int lane = CountTrailingZeros(mask);
+                        mask &= mask - 1;
+                        if (func(block.triIndex[lane]))
+                            return true;
+                    }
+                    if (toVisitOffset == 0) break;
+                    currentNodeIndex = nodesToVisit[--toVisitOffset];
+                }
+                else if (dirIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->offset;
+                }
+                else {
+                    nodesToVisit[toVisitOffset++] = node->offset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+            else {
+                if (toVisitOffset == 0) break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            }
+        }
+        return false;
+    }
+
+    bool TriangleMeshPrimitive::intersect(const Ray& r, SurfaceInteraction* isect) const
+    {
+        const float tMax = r.m_maxT;
+        int hitTriangle = -1;
+        Vector3f b;
+        traverse(r, [&](uint32_t tri) {
+            const uint32_t* v = &m_mesh->m_vertexIndices[3 * tri];
+            float t;
+            if (IntersectTriangle(r, m_mesh->m_p[v[0]], m_mesh->m_p[v[1]], m_mesh->m_p[v[2]], &t, &b)) {
+                r.m_maxT = t;
+                hitTriangle = (int)tri;
+            }
+            return false;
+        });
+        if (hitTriangle < 0)
+            return false;
+
+        // Only the closest face pays for the full interaction
+        if (!ComputeTriangleInteraction(*m_mesh, hitTriangle, b, r, m_reverseOrientation,
+                m_transformSwapsHandedness, nullptr, false, isect)) {
+            r.m_maxT = tMax;
+            return false;
+        }
+        isect->m_primitive = this;
+        isect->m_shapeId = m_firstShapeId + hitTriangle;
+        if (m_mi.IsMediumTransition())
+            isect->m_mediumInterface = m_mi;
+        else
+            isect->m_mediumInterface = MediumInterface(r.m_medium);
+        return true;
+    }
+
+    bool TriangleMeshPrimitive::intersectP(const Ray& r) const
+    {
+        return traverse(r, [&](uint32_t tri) {
+            const uint32_t* v = &m_mesh->m_vertexIndices[3 * tri];
+            return IntersectTriangle(r, m_mesh->m_p[v[0]], m_mesh->m_p[v[1]], m_mesh->m_p[v[2]], nullptr, nullptr);
+        });
+    }
+
+    BBox3f TriangleMeshPrimitive::worldBound() const
+    {
+        return m_bounds;
+    }
+
+    const AreaLight* TriangleMeshPrimitive::getAreaLight() const
+    {
+        return nullptr;
+    }
+
+    const Material* TriangleMeshPrimitive::getMaterial() const
+    {
+        return m_material.get();
+    }
+
+    void TriangleMeshPrimitive::computeScatteringFunctions(SurfaceInteraction* isect, MemoryArena& arena, eTransportMode mode, bool allowMultipleLobes) const
+    {
+        if (m_material)
+            m_material->computeScatteringFunctions(isect, arena, mode, allowMultipleLobes);
+    }
+
+    bool TriangleMeshPrimitive::CanRepresent(const TriangleMesh& mesh)
+    {
+        return !mesh.m_alphaMask && !mesh.m_shadowAlphaMask;
+    }
+}
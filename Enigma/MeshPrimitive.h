@@ -0,0 +1,54 @@
+#pragma once
+#include "Defines.h"
+#include "Primitive.h"
+
+namespace RayTrace
+{
+    struct MeshBVHNode;
+    struct TriangleBlock4;
+
+    // TriangleMeshPrimitive Declarations
+    // Aggregate over all faces of one TriangleMesh. Its BVH leaves hold the vertices of
+    // 4 triangles in SoA layout, which replace the Triangle and GeometricPrimitive objects
+    // otherwise created per face. A conservative 4-wide watertight test filters candidates,
+    // hits are confirmed with the same scalar watertight test Triangle uses.
+    class TriangleMeshPrimitive : public Aggregate
+    {
+    public:
+        TriangleMeshPrimitive(const TriangleMeshPtr& mesh,
+            const Transform* objectToWorld, const Transform* worldToObject,
+            bool reverseOrientation, const MaterialPtr& material,
+            const MediumInterface& mi);
+        ~TriangleMeshPrimitive();
+
+        BBox3f              worldBound() const override;
+        bool                intersect(const Ray& r, SurfaceInteraction*) const override;
+        bool                intersectP(const Ray& r) const override;
+        const AreaLight*    getAreaLight() const override;
+        const Material*     getMaterial() const override;
+        void                computeScatteringFunctions(SurfaceInteraction* isect, MemoryArena& arena, eTransportMode mode, bool allowMultipleLobes) const override;
+
+        // Meshes with alpha textures still need the per face path
+        static bool         CanRepresent(const TriangleMesh& mesh);
+
+    private:
+        int                 buildRecursive(std::vector<MeshBVHNode>& nodes, std::vector<uint32_t>& triIndices,
+                                const std::vector<BBox3f>& triBounds, int start, int end);
+        // Calls _func_(triIndex) for every face whose record passes the filter, stops when it returns true
+        template <typename Func>
+        bool                traverse(const Ray& r, Func func) const;
+
+        // TriangleMeshPrimitive Private Data
+        TriangleMeshPtr     m_mesh;
+        const Transform*    m_objectToWorld;
+        const Transform*    m_worldToObject;
+        const bool          m_reverseOrientation;
+        const bool          m_transformSwapsHandedness;
+        MaterialPtr         m_material;
+        MediumInterface     m_mi;
+        BBox3f              m_bounds;
+        uint32_t            m_firstShapeId;     // faces are numbered like the per face Triangles
+        MeshBVHNode*        m_nodes = nullptr;
+        TriangleBlock4*     m_blocks = nullptr;
+    };
+}
@@ -2,12 +2,15 @@
 #include <vector>
 #include <assert.h>
 #include <memory>
+#include <mutex>
 #include "MathCommon.h"
 #include "Memory.h"
+#include "Error.h"
 
 #include "Spectrum.h"
 #include "IO.h"
 #include "TexInfo.h"
+#include "TextureCache.h"
 
 namespace RayTrace
 {
@@ -44,6 +47,9 @@ namespace RayTrace
       
         using PyramidData = BlockedArray<T, 2 >;
         using PyramidDataUPtr = std::unique_ptr<PyramidData>;
+
+        // Paged levels are cut into TileRes x TileRes texel tiles
+        static constexpr uint32_t TileRes = 64;
       
         MipMap()
             : m_doTrilinear(false)
@@ -61,19 +67,35 @@ namespace RayTrace
                 bool _doTri = false, float _maxAniso = 8.0f, eImageWrapMode _wrapMode = eImageWrapMode::TEXTURE_WRAP_REPEAT);
        
         ~MipMap() {
-
+            if (isPaged())
+                GetTextureCache().RemoveTexture(m_cacheTexture);
         }
 
         uint32_t    width() const { return  m_width; }
         uint32_t    height() const { return m_height; }
         uint32_t    levels() const { return m_nLevels; }
-        const T&    texel(uint32_t level, int s, int t) const;
+        bool        isPaged() const { return m_cacheTexture != TextureCache::InvalidTexture; }
+        T           texel(uint32_t level, int s, int t) const;
         T           lookup(const Vector2f& st, Vector2f dstdx,  Vector2f dstdy);
         T           lookup(const Vector2f& st, float width = 0.0f);
 
       
 
     private:
+        struct Level {
+            uint32_t    m_width;
+            uint32_t    m_height;
+            uint32_t    m_nTilesX;
+            uint32_t    m_firstTile;
+        };
+
+        // Pins the paged tiles a lookup touched; a filter footprint straddles at most four
+        struct TexelCursor {
+            TextureTilePtr  m_tiles[4];
+            uint32_t        m_index[4] = { ~0u, ~0u, ~0u, ~0u };
+            int             m_next = 0;
+        };
+
         static void     initLUT();
 
         float                       clamp(float v) { return std::clamp(v, 0.f, INFINITY); }
@@ -81,6 +103,9 @@ namespace RayTrace
         SampledSpectrum     clamp(const SampledSpectrum& v) { return v.Clamp(0.f, INFINITY); }
         T                           triangle(int level, const Vector2f& st) const;
         T                           EWA(int level, Vector2f st, Vector2f dst0, Vector2f dst1) const;
+        T                           texel(TexelCursor& cursor, uint32_t level, int s, int t) const;
+        bool                        wrap(int& s, int& t, uint32_t uSize, uint32_t vSize) const;
+        void                        buildPaged(std::vector<T> _imgData);
 
         std::vector<ResampleWeight> resampleWeights(int _oldWidth, int _newWidth) const;
         std::vector<T>              resizeImage(const std::vector<T>& _imgData, int _oldWidth, int _oldHeight, int& _newWidth, int& _newHeight);
@@ -96,7 +121,9 @@ namespace RayTrace
         eImageWrapMode  m_wrapMode;
         
 
-        std::vector<PyramidDataUPtr> m_pyramidData; 
+        std::vector<Level>              m_levels;
+        std::vector<PyramidDataUPtr>    m_pyramidData;      // empty while paged
+        uint32_t                        m_cacheTexture = TextureCache::InvalidTexture;
        
 #define WEIGHT_LUT_SIZE 128
         static float*     s_weightLut; 
@@ -128,16 +155,33 @@ namespace RayTrace
         
         // Initialize levels of MIPMap from image
         m_nLevels = 1 + Log2Int(float(std::max(m_width, m_height)));
-        m_pyramidData.resize(m_nLevels);
-        //pyramid = new BlockedArray<T> *[nLevels];
+        m_levels.resize(m_nLevels);
+        uint32_t nTiles = 0;
+        for (uint32_t i = 0; i < m_nLevels; ++i) {
+            Level& level = m_levels[i];
+            level.m_width  = std::max(1u, m_width >> i);
+            level.m_height = std::max(1u, m_height >> i);
+            level.m_nTilesX = (level.m_width + TileRes - 1) / TileRes;
+            level.m_firstTile = nTiles;
+            nTiles += level.m_nTilesX * ((level.m_height + TileRes - 1) / TileRes);
+        }
 
+        // Only page textures bigger than a few tiles, small ones cost less than their tile overhead
+        if (GetTextureCacheSize() > 0 && m_levels[0].m_nTilesX > 2 && m_levels[0].m_height > 2 * TileRes)
+            m_cacheTexture = GetTextureCache().AddTexture(TileRes * TileRes * sizeof(T), nTiles);
+        if (isPaged()) {
+            buildPaged(std::move(_imgData));
+            return;
+        }
+
+        m_pyramidData.resize(m_nLevels);
         // Initialize most detailed level of MIPMap
         m_pyramidData[0] =  std::make_unique<PyramidData>(m_width, m_height, _imgData.data() );
        
         for (uint32_t i = 1; i < m_nLevels; ++i) {
             // Initialize $i$th MIPMap level from $i-1$st level
-            uint32_t sRes = std::max(1u, m_pyramidData[i - 1]->uSize() / 2);
-            uint32_t tRes = std::max(1u, m_pyramidData[i - 1]->vSize() / 2);
+            uint32_t sRes = m_levels[i].m_width;
+            uint32_t tRes = m_levels[i].m_height;
 
             m_pyramidData[i] = std::make_unique<PyramidData>(sRes, tRes);
 
@@ -151,6 +195,46 @@ namespace RayTrace
        
     }
 
+    template<typename T>
+    void MipMap<T>::buildPaged(std::vector<T> _imgData)
+    {
+        // Only the level being filtered and its parent are ever in memory, every finished
+        // level goes straight to the tile file
+        static_assert(std::is_trivially_copyable<T>::value, "paged texels are copied as bytes");
+        std::vector<T> tile(TileRes * TileRes);
+        std::vector<T> coarser;
+        for (uint32_t i = 0; i < m_nLevels; ++i) {
+            const Level& level = m_levels[i];
+            const uint32_t nTilesY = (level.m_height + TileRes - 1) / TileRes;
+            for (uint32_t ty = 0; ty < nTilesY; ++ty)
+                for (uint32_t tx = 0; tx < level.m_nTilesX; ++tx) {
+                    std::fill(tile.begin(), tile.end(), T(0.f));
+                    const uint32_t s1 = std::min(level.m_width,  (tx + 1) * TileRes);
+                    const uint32_t t1 = std::min(level.m_height, (ty + 1) * TileRes);
+                    for (uint32_t t = ty * TileRes; t < t1; ++t)
+                        for (uint32_t s = tx * TileRes; s < s1; ++s)
+                            tile[(t % TileRes) * TileRes + s % TileRes] = _imgData[t * level.m_width + s];
+                    if (!GetTextureCache().WriteTile(m_cacheTexture, level.m_firstTile + ty * level.m_nTilesX + tx, tile.data()))
+                        Warning("Unable to write texture tile");
+                }
+
+            if (i + 1 == m_nLevels)
+                break;
+            // Filter four texels from finer level of pyramid
+            const Level& next = m_levels[i + 1];
+            auto fine = [&](int s, int t) {
+                return wrap(s, t, level.m_width, level.m_height) ? _imgData[t * level.m_width + s] : T(0.f);
+            };
+            coarser.resize(next.m_width * next.m_height);
+            for (uint32_t t = 0; t < next.m_height; ++t)
+                for (uint32_t s = 0; s < next.m_width; ++s)
+                    coarser[t * next.m_width + s] = .25f *
+                    (fine(2 * s, 2 * t) + fine(2 * s + 1, 2 * t) +
+                        fine(2 * s, 2 * t + 1) + fine(2 * s + 1, 2 * t + 1));
+            _imgData.swap(coarser);
+        }
+    }
+
     template<typename T>
     std::vector<ResampleWeight> MipMap<T>::resampleWeights(int _oldWidth, int _newWidth) const
     {
@@ -243,14 +327,17 @@ namespace RayTrace
     template<typename T>
     void MipMap<T>::initLUT()
     {
-        if (s_weightLut)
-            return;
-        s_weightLut = AllocAligned<float>(WEIGHT_LUT_SIZE);
-        for (int i = 0; i < WEIGHT_LUT_SIZE; ++i) {
-            float alpha = 2;
-            float r2 = float(i) / float(WEIGHT_LUT_SIZE - 1);
-            s_weightLut[i] = expf(-alpha * r2) - expf(-alpha);
-        }
+        // MIP maps are built concurrently by the texture loads
+        static std::once_flag initialized;
+        std::call_once(initialized, []() {
+            float* lut = AllocAligned<float>(WEIGHT_LUT_SIZE);
+            for (int i = 0; i < WEIGHT_LUT_SIZE; ++i) {
+                float alpha = 2;
+                float r2 = float(i) / float(WEIGHT_LUT_SIZE - 1);
+                lut[i] = expf(-alpha * r2) - expf(-alpha);
+            }
+            s_weightLut = lut;
+        });
     }
 
     
@@ -261,12 +348,12 @@ namespace RayTrace
         if (level >= (int)levels()) 
             return texel(levels() - 1, 0, 0);
         // Convert EWA coordinates to appropriate scale for level
-        st[0] = st[0] * m_pyramidData[level]->uSize() - 0.5f;
-        st[1] = st[1] * m_pyramidData[level]->vSize() - 0.5f;
-        dst0[0] *= m_pyramidData[level]->uSize();
-        dst0[1] *= m_pyramidData[level]->vSize();
-        dst1[0] *= m_pyramidData[level]->uSize();
-        dst1[1] *= m_pyramidData[level]->vSize();
+        st[0] = st[0] * m_levels[level].m_width - 0.5f;
+        st[1] = st[1] * m_levels[level].m_height - 0.5f;
+        dst0[0] *= m_levels[level].m_width;
+        dst0[1] *= m_levels[level].m_height;
+        dst1[0] *= m_levels[level].m_width;
+        dst1[1] *= m_levels[level].m_height;
 
         // Compute ellipse coefficients to bound EWA filter region
         float A = dst0[1] * dst0[1] + dst1[1] * dst1[1] + 1;
@@ -289,6 +376,7 @@ namespace RayTrace
         // Scan over ellipse bound and compute quadratic equation
         T sum(0.f);
         float sumWts = 0;
+        TexelCursor cursor;
         for (int it = t0; it <= t1; ++it) {
             float tt = it - st[1];
             for (int is = s0; is <= s1; ++is) {
@@ -298,7 +386,7 @@ namespace RayTrace
                 if (r2 < 1) {
                     int index = std::min((int)(r2 * WEIGHT_LUT_SIZE), WEIGHT_LUT_SIZE - 1);
                     float weight = s_weightLut[index];
-                    sum += texel(level, is, it) * weight;
+                    sum += texel(cursor, level, is, it) * weight;
                     sumWts += weight;
                 }
             }
@@ -310,45 +398,70 @@ namespace RayTrace
     T MipMap<T>::triangle(int level, const Vector2f& st) const
     {
         level = std::clamp(level, 0, (int)levels() - 1);
-        float s = st[0] * m_pyramidData[level]->uSize() - 0.5f;
-        float t = st[1] * m_pyramidData[level]->vSize() - 0.5f;
+        float s = st[0] * m_levels[level].m_width - 0.5f;
+        float t = st[1] * m_levels[level].m_height - 0.5f;
         int s0 = std::floor(s), 
             t0 = std::floor(t);
         float ds = s - s0, dt = t - t0;
-        return (1 - ds) * (1 - dt) * texel(level, s0, t0) +
-            (1 - ds) * dt * texel(level, s0, t0 + 1) +
-            ds * (1 - dt) * texel(level, s0 + 1, t0) +
-            ds * dt * texel(level, s0 + 1, t0 + 1);
+        TexelCursor cursor;
+        return (1 - ds) * (1 - dt) * texel(cursor, level, s0, t0) +
+            (1 - ds) * dt * texel(cursor, level, s0, t0 + 1) +
+            ds * (1 - dt) * texel(cursor, level, s0 + 1, t0) +
+            ds * dt * texel(cursor, level, s0 + 1, t0 + 1);
     }
 
    
 
 
     template<typename T>
-    const T& MipMap<T>::texel(uint32_t level, int s, int t) const
+    bool MipMap<T>::wrap(int& s, int& t, uint32_t uSize, uint32_t vSize) const
     {
-        assert(level < m_nLevels);
-        const PyramidData& l = *m_pyramidData[level];
         // Compute texel $(s,t)$ accounting for boundary conditions
         switch (m_wrapMode) 
         {
             case  TEXTURE_WRAP_REPEAT:
-                s = s % l.uSize(); //Mod(s, l.uSize());
-                t = t % l.vSize();//Mod(t, l.vSize());
+                s = Mod(s, (int)uSize);
+                t = Mod(t, (int)vSize);
                 break;
             case TEXTURE_WRAP_CLAMP:
-                s = std::clamp(s, 0, (int)l.uSize() - 1);
-                t = std::clamp(t, 0, (int)l.vSize() - 1);
+                s = std::clamp(s, 0, (int)uSize - 1);
+                t = std::clamp(t, 0, (int)vSize - 1);
                 break;
-            case TEXTURE_WRAP_BLACK: {
-                static const T black = 0.f;
-                if (s < 0 || s >= (int)l.uSize() ||
-                    t < 0 || t >= (int)l.vSize())
-                    return black;
-                break;
-            }
+            case TEXTURE_WRAP_BLACK:
+                return s >= 0 && s < (int)uSize && t >= 0 && t < (int)vSize;
+        }
+        return true;
+    }
+
+    template<typename T>
+    T MipMap<T>::texel(uint32_t level, int s, int t) const
+    {
+        TexelCursor cursor;
+        return texel(cursor, level, s, t);
+    }
+
+    template<typename T>
+    T MipMap<T>::texel(TexelCursor& cursor, uint32_t level, int s, int t) const
+    {
+        assert(level < m_nLevels);
+        const Level& l = m_levels[level];
+        if (!wrap(s, t, l.m_width, l.m_height))
+            return T(0.f);
+        if (!isPaged())
+            return (*m_pyramidData[level])(s, t);
+
+        const uint32_t tile = l.m_firstTile + (t / TileRes) * l.m_nTilesX + s / TileRes;
+        int slot = 0;
+        while (slot < 4 && cursor.m_index[slot] != tile)
+            ++slot;
+        if (slot == 4) {
+            slot = cursor.m_next;
+            cursor.m_next = (cursor.m_next + 1) & 3;
+            cursor.m_tiles[slot] = GetTextureCache().GetTile(m_cacheTexture, tile);
+            cursor.m_index[slot] = tile;
         }
-        return l(s, t);
+        const T* texels = reinterpret_cast<const T*>(cursor.m_tiles[slot]->m_data.get());
+        return texels[(t % TileRes) * TileRes + s % TileRes];
     }
 
     template<typename T>
@@ -25,6 +25,13 @@ namespace RayTrace
 #endif
     }
 
+    inline int PopCount(uint32_t v) {
+        int count = 0;
+        for (; v; v &= v - 1)
+            ++count;
+        return count;
+    }
+
     static constexpr int PrimeTableSize = 1000;
     extern const int PrimeSums[PrimeTableSize];
     extern const int Primes[PrimeTableSize];
@@ -48,6 +48,8 @@ namespace RayTrace
 
     void ModifierStack::Apply()
     {
+        //modifiers append to the geometry, start over from empty streams, their capacity is kept
+        m_object->Clear();
         for (auto& curMod : m_modifiers) {
             curMod->Apply();
         }
@@ -55,15 +57,8 @@ namespace RayTrace
 
     void ModifierStack::Updated(ModifierBase* _pModifier)
     {
-        bool apply = false;
-        for (auto& curMod : m_modifiers)
-        {
-            if (curMod.get() == _pModifier) {
-                apply = true;
-            }
-            if (apply)
-                curMod->Apply();
-        }
+        //the geometry holds the output of every modifier, nothing earlier in the stack can be reused
+        Apply();
     }
 
     ModifierStack* ModifierStack::AddModifier(std::unique_ptr<ModifierBase> _modifier)
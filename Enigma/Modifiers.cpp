@@ -8,45 +8,62 @@
 namespace RayTrace
 {
   
-    inline sUnprocessedFace FlipFace(sUnprocessedFace _face)
-    {
-        _face.Flip();
-        return _face;
-    }
+    /*
+        @brief: cos and sin of _segments_ + 1 evenly spaced angles over [0, _range_], computed once
+                per Apply instead of for every corner. Closed rings repeat the first entry at the
+                end so the corners of the seam weld
+    */
+    struct SinCosRing
+    {
+        SinCosRing(int _segments, float _range, bool _closed)
+            : m_cos(_segments + 1)
+            , m_sin(_segments + 1)
+        {
+            const float inc = _range / _segments;
+            for (int i = 0; i <= _segments; ++i) {
+                m_cos[i] = cosf(i * inc);
+                m_sin[i] = sinf(i * inc);
+            }
+            if (_closed) {
+                m_cos[_segments] = m_cos[0];
+                m_sin[_segments] = m_sin[0];
+            }
+        }
+
+        std::vector<float> m_cos,
+                           m_sin;
+    };
 
-    inline bool Triangulate(GeometryBase& _object)
+    // Concentric rings of quads in the plane y = _height_ over the ellipse of _dims.x_ by _dims.z_,
+    // stack 0 is the rim and the last stack ends in the center
+    static void AddDisk(GeometryBuilder& _builder, const SinCosRing& _ring, int _numSides, int _numStacks,
+                        const Vector3f& _dims, float _height, bool _flip)
     {
-        for (auto& face : _object.m_unprocessed)
+        auto Corner = [&](int _side, int _stack, Vector3f& _pos, Vector2f& _uv)
         {
-            auto e1 = face.m_verts[1] - face.m_verts[0];
-            auto e2 = face.m_verts[2] - face.m_verts[0];
-            
-            auto normal = Normalize(Cross(e1, e2));
-            for (int i = 0; i < face.m_verts.size(); i += 2) {
-
-                int next     = (i + 1) % face.m_verts.size();
-                int nextnext = (i + 2) % face.m_verts.size();
-
-                _object.m_verts.push_back(face.m_verts[i]);
-                _object.m_uvs.push_back(face.m_uvs[i]);
-                _object.m_normals.push_back(normal);
-
-                _object.m_verts.push_back(face.m_verts[next]);
-                _object.m_uvs.push_back(face.m_uvs[next]);
-                _object.m_normals.push_back(normal);
-
-                _object.m_verts.push_back(face.m_verts[nextnext]);
-                _object.m_uvs.push_back(face.m_uvs[nextnext]);
-                _object.m_normals.push_back(normal);
+            const float scale = 1.0f - (float)_stack / _numStacks;
+            const float x = _ring.m_cos[_side] * _dims.x * 0.5f * scale;
+            const float z = _ring.m_sin[_side] * _dims.z * 0.5f * scale;
+
+            _pos = Vector3f(x, _height, z);
+            _uv  = Vector2f(x / _dims.x + 0.5f, 0.5f - z / _dims.z);
+        };
+
+        for (int side = 0; side < _numSides; ++side) {
+            for (int stack = 0; stack < _numStacks; ++stack) {
+                Vector3f verts[4];
+                Vector2f uvs[4];
+                Corner(side,     stack + 1, verts[0], uvs[0]);
+                Corner(side,     stack,     verts[1], uvs[1]);
+                Corner(side + 1, stack,     verts[2], uvs[2]);
+                Corner(side + 1, stack + 1, verts[3], uvs[3]);
+                _builder.AddQuad(verts, uvs, _flip);
             }
         }
-        return true;
-        
     }
 
 
 
-   
     /// <summary>
     /// ModifierBase Implementation
     /// </summary>
@@ -118,58 +135,37 @@ namespace RayTrace
 
     void PlaneModifier::Apply()
     {
-        auto* pObject = GetGeometry();
-
+        GeometryBuilder builder(GetGeometry());
+        builder.Reserve(m_subDivs.x * m_subDivs.y);
 
         const float xInc = m_dimensions.x / m_subDivs.x;
         const float zInc = m_dimensions.z / m_subDivs.y;
-       
-
         const Vector2f uvwInc = Inverted(Vector2f(m_subDivs));
 
-
         const float xStart = -m_dimensions.x * 0.5f;
         const float zStart = -m_dimensions.z * 0.5f;
-      
-        const float xEnd = m_dimensions.x * 0.5f;
-        const float zEnd = m_dimensions.z * 0.5f;
-       
-
 
+        //corners come from the grid index, neighbouring quads share them bit for bit
         for (int x = 0; x < m_subDivs.x; ++x)
         {
-            float xCur = x * xInc + xStart;
-            float xNext = xCur + xInc;
-            float uCur = x * uvwInc.x;
-            float uNext = uCur + uvwInc.x;
-            { //bottom & top
-                
-
-                for (int z = 0; z < m_subDivs.y; z++) {
-                    sUnprocessedFace top;
-                    float zCur = z * zInc + zStart;
-                    float zNext = zCur + zInc;
-
-                    float vCur = z * uvwInc.y;
-                    float vNext = vCur + uvwInc.y;
-
-
-                    top.m_verts.emplace_back(xCur, 0.f,  zCur);
-                    top.m_verts.emplace_back(xCur, 0.f,  zNext);
-                    top.m_verts.emplace_back(xNext, 0.f, zNext);
-                    top.m_verts.emplace_back(xNext, 0.f,  zCur);
-
-                    top.m_uvs.emplace_back(uCur,  1.0f - vCur);
-                    top.m_uvs.emplace_back(uCur,  1.0f - vNext);
-                    top.m_uvs.emplace_back(uNext, 1.0f - vNext);
-                    top.m_uvs.emplace_back(uNext, 1.0f - vCur);
-
-                    pObject->m_unprocessed.push_back(top);
-                }
-              
+            const float xCur  = x * xInc + xStart;
+            const float xNext = (x + 1) * xInc + xStart;
+            const float uCur  = x * uvwInc.x;
+            const float uNext = (x + 1) * uvwInc.x;
+
+            for (int z = 0; z < m_subDivs.y; z++) {
+                const float zCur  = z * zInc + zStart;
+                const float zNext = (z + 1) * zInc + zStart;
+                const float vCur  = z * uvwInc.y;
+                const float vNext = (z + 1) * uvwInc.y;
+
+                const Vector3f verts[4] = { { xCur,  0.f, zCur  }, { xCur,  0.f, zNext },
+                                            { xNext, 0.f, zNext }, { xNext, 0.f, zCur  } };
+                const Vector2f uvs[4]   = { { uCur,  1.0f - vCur  }, { uCur,  1.0f - vNext },
+                                            { uNext, 1.0f - vNext }, { uNext, 1.0f - vCur  } };
+                builder.AddQuad(verts, uvs);
             }
         }
-        Triangulate(*pObject);
     }
 
     ObjPropVector PlaneModifier::GetProperties()
@@ -219,69 +215,11 @@ namespace RayTrace
 
     void DiskModifier::Apply()
     {
-       
-        auto* pObject = GetGeometry();
-
-
-        const Vector2f start = { m_dimensions.x * -0.5, m_dimensions.z * -0.5f };
-        const Vector2f end = { m_dimensions.x * 0.5, m_dimensions.z * 0.5f };
-        const float sideInc = ToRadians(360.0f) / m_numSides;
-
-        for (int side = 0; side < m_numSides; ++side) {
-            const float xCur  = cosf(side * sideInc) * m_dimensions.x * 0.5f;
-            const float zCur  = sinf(side * sideInc) * m_dimensions.z * 0.5f;
-            const float xNext = cosf(side * sideInc + sideInc) * m_dimensions.x * 0.5f;
-            const float zNext = sinf(side * sideInc + sideInc) * m_dimensions.z * 0.5f;
-
-            const auto sideCur  = Vector2f{ xCur, zCur };
-            const auto sideNext = Vector2f{ xNext, zNext };
-
-            const auto lengthCur  = Length(sideCur);
-            const auto lengthNext = Length(sideNext);
-
-            const Vector2f curDir     = -1.0f * sideCur / lengthCur;     
-            const Vector2f nextDir    = -1.0f * sideNext / lengthNext;
+        GeometryBuilder builder(GetGeometry());
+        builder.Reserve(m_numSides * m_numStacks);
 
-            const float    curLengthInc  = lengthCur / m_numStacks;
-            const float    nextLengthInc = lengthNext / m_numStacks;
-
-            auto NormalizedCoordinate = [](auto _input, auto _min, auto _max)
-            {
-                const auto range = _max - _min;
-                return (_input - _min) / range;
-            };
-
-
-            for (int stack = 0; stack < m_numStacks; ++stack)
-            {
-                const Vector2f a = sideCur + curDir * (curLengthInc * stack + curLengthInc);
-                const Vector2f b = sideCur + curDir * (curLengthInc * stack );
-                const Vector2f c = sideNext + nextDir * (nextLengthInc * stack);
-                const Vector2f d = sideNext + nextDir * (nextLengthInc * stack + nextLengthInc);
-
-
-
-                sUnprocessedFace face;
-                face.m_verts.emplace_back( a.x, 0.0f, a.y );
-                face.m_verts.emplace_back( b.x, 0.0f, b.y );
-                face.m_verts.emplace_back( c.x, 0.0f, c.y );
-                face.m_verts.emplace_back( d.x, 0.0f, d.y );
-                
-                const auto uvStackCur  = NormalizedCoordinate(a , start, end );
-                const auto uvSideCur   = NormalizedCoordinate(b , start, end );
-                const auto uvSideNext  = NormalizedCoordinate(c , start, end );
-                const auto uvStackNext = NormalizedCoordinate(d , start, end );
-
-                face.m_uvs.emplace_back( uvStackCur  .x , 1.0f - uvStackCur  .y);
-                face.m_uvs.emplace_back( uvSideCur   .x , 1.0f - uvSideCur   .y);
-                face.m_uvs.emplace_back( uvSideNext  .x , 1.0f - uvSideNext  .y);
-                face.m_uvs.emplace_back( uvStackNext .x , 1.0f - uvStackNext .y);
-                face.Flip();
-                pObject->m_unprocessed.push_back(face);
-            }
-
-        }
-        Triangulate(*pObject);
+        const SinCosRing ring(m_numSides, ToRadians(360.0f), true);
+        AddDisk(builder, ring, m_numSides, m_numStacks, m_dimensions, 0.0f, true);
     }
 
     ObjPropVector DiskModifier::GetProperties()
@@ -330,161 +268,95 @@ namespace RayTrace
     }
 
     void CubeModifier::Apply()
-{
-        auto* pObject = GetGeometry();
-        
-        
+    {
+        GeometryBuilder builder(GetGeometry());
+        builder.Reserve(2 * (m_subDivs.x * m_subDivs.z + m_subDivs.x * m_subDivs.y + m_subDivs.y * m_subDivs.z));
+
         const float xInc = m_dimensions.x / m_subDivs.x;
         const float yInc = m_dimensions.y / m_subDivs.y;
         const float zInc = m_dimensions.z / m_subDivs.z;
 
         const Vector3f uvwInc = Inverted( Vector3f(m_subDivs) );
-        
 
         const float xStart   = -m_dimensions.x * 0.5f;
         const float yStart   = -m_dimensions.y * 0.5f;
-        const float zStart   = -m_dimensions.z * 0.5f;    
+        const float zStart   = -m_dimensions.z * 0.5f;
 
         const float xEnd     = m_dimensions.x * 0.5f;
         const float yEnd     = m_dimensions.y * 0.5f;
         const float zEnd     = m_dimensions.z * 0.5f;
 
-
-
+        //corners come from the grid index, neighbouring quads of a side share them bit for bit
         for (int x = 0; x < m_subDivs.x; ++x)
         {
-            float xCur  = x * xInc + xStart;
-            float xNext = xCur + xInc;          
-            float uCur  = x * uvwInc.x;
-            float uNext = uCur + uvwInc.x;
-            { //bottom & top
-              
-               
-                for (int z = 0; z < m_subDivs.z; z++) {
-                    sUnprocessedFace top,
-                                     bottom;
-
-                    float zCur  = z * zInc + zStart;
-                    float zNext = zCur + zInc;
-                    float vCur  = z * uvwInc.z;
-                    float vNext = vCur + uvwInc.z;
-
-                    bottom.m_verts.emplace_back(xCur,  yStart, zCur);
-                    bottom.m_verts.emplace_back(xCur,  yStart, zNext);
-                    bottom.m_verts.emplace_back(xNext, yStart, zNext);
-                    bottom.m_verts.emplace_back(xNext, yStart, zCur);
-
-
-                    bottom.m_uvs.emplace_back(uCur,  1.0f - vCur);
-                    bottom.m_uvs.emplace_back(uCur,  1.0f - vNext);
-                    bottom.m_uvs.emplace_back(uNext, 1.0f - vNext);
-                    bottom.m_uvs.emplace_back(uNext, 1.0f - vCur);
-
-                    top.m_verts.emplace_back(xCur,  yEnd,  zCur);
-                    top.m_verts.emplace_back(xCur,  yEnd,  zNext);
-                    top.m_verts.emplace_back(xNext, yEnd,  zNext);
-                    top.m_verts.emplace_back(xNext, yEnd,  zCur);
-
-                    top.m_uvs.emplace_back( uCur,  1.0f - vCur);
-                    top.m_uvs.emplace_back( uCur,  1.0f - vNext);
-                    top.m_uvs.emplace_back( uNext, 1.0f - vNext);
-                    top.m_uvs.emplace_back( uNext, 1.0f - vCur);
-
-                    bottom.Flip();
-                    pObject->m_unprocessed.push_back(bottom);
-                    pObject->m_unprocessed.push_back(top);
-                   
-                }
-                
-              
-            }
-
-            {//front bback
-           
-
-
-                for (int y = 0; y < m_subDivs.y; y++) {
-                    float yCur = y * yInc + yStart;
-                    float yNext = yCur + yInc;
-                    float vCur = y * uvwInc.y;
-                    float vNext = vCur + uvwInc.y;
-
-                    sUnprocessedFace front,
-                        back;
-                    back.m_verts.emplace_back(xCur,  yCur,  zStart  );
-                    back.m_verts.emplace_back(xCur,  yNext, zStart  );
-                    back.m_verts.emplace_back(xNext, yNext, zStart  );
-                    back.m_verts.emplace_back(xNext, yCur , zStart  );
-
-                    back.m_uvs.emplace_back(1.0f - uCur, vCur);
-                    back.m_uvs.emplace_back(1.0f - uCur, vNext);
-                    back.m_uvs.emplace_back(1.0f - uNext, vNext);
-                    back.m_uvs.emplace_back(1.0f - uNext, vCur);
-
-                    front.m_verts.emplace_back(xCur,  yCur,   -zStart);
-                    front.m_verts.emplace_back(xCur,  yNext,  -zStart);
-                    front.m_verts.emplace_back(xNext, yNext, -zStart);
-                    front.m_verts.emplace_back(xNext, yCur,  -zStart);
-
-                    front.m_uvs.emplace_back(uCur, vCur);
-                    front.m_uvs.emplace_back(uCur, vNext);
-                    front.m_uvs.emplace_back(uNext, vNext);
-                    front.m_uvs.emplace_back(uNext, vCur);
+            const float xCur  = x * xInc + xStart;
+            const float xNext = (x + 1) * xInc + xStart;
+            const float uCur  = x * uvwInc.x;
+            const float uNext = (x + 1) * uvwInc.x;
 
-                    front.Flip();
-
-                    pObject->m_unprocessed.push_back(front);
-                    pObject->m_unprocessed.push_back(back);
-                }
-
-              //  front.Flip();
-            
+            //bottom & top
+            for (int z = 0; z < m_subDivs.z; z++) {
+                const float zCur  = z * zInc + zStart;
+                const float zNext = (z + 1) * zInc + zStart;
+                const float vCur  = z * uvwInc.z;
+                const float vNext = (z + 1) * uvwInc.z;
+
+                const Vector2f uvs[4] = { { uCur,  1.0f - vCur  }, { uCur,  1.0f - vNext },
+                                          { uNext, 1.0f - vNext }, { uNext, 1.0f - vCur  } };
+
+                const Vector3f bottom[4] = { { xCur,  yStart, zCur  }, { xCur,  yStart, zNext },
+                                             { xNext, yStart, zNext }, { xNext, yStart, zCur  } };
+                const Vector3f top[4]    = { { xCur,  yEnd,   zCur  }, { xCur,  yEnd,   zNext },
+                                             { xNext, yEnd,   zNext }, { xNext, yEnd,   zCur  } };
+                builder.AddQuad(bottom, uvs, true);
+                builder.AddQuad(top, uvs);
+            }
 
-            }           
+            //front & back
+            for (int y = 0; y < m_subDivs.y; y++) {
+                const float yCur  = y * yInc + yStart;
+                const float yNext = (y + 1) * yInc + yStart;
+                const float vCur  = y * uvwInc.y;
+                const float vNext = (y + 1) * uvwInc.y;
+
+                const Vector3f front[4]   = { { xCur,  yCur,  zEnd   }, { xCur,  yNext, zEnd   },
+                                              { xNext, yNext, zEnd   }, { xNext, yCur,  zEnd   } };
+                const Vector2f frontUvs[4] = { { uCur,  vCur  }, { uCur,  vNext },
+                                               { uNext, vNext }, { uNext, vCur  } };
+                const Vector3f back[4]    = { { xCur,  yCur,  zStart }, { xCur,  yNext, zStart },
+                                              { xNext, yNext, zStart }, { xNext, yCur,  zStart } };
+                const Vector2f backUvs[4] = { { 1.0f - uCur,  vCur  }, { 1.0f - uCur,  vNext },
+                                              { 1.0f - uNext, vNext }, { 1.0f - uNext, vCur  } };
+                builder.AddQuad(front, frontUvs, true);
+                builder.AddQuad(back, backUvs);
+            }
         }
-        
+
+        //left & right
         for (int y = 0; y < m_subDivs.y; y++) {
-            float yCur = y * yInc + yStart;
-            float yNext = yCur + yInc;
-            float vCur  = y * uvwInc.y;
-            float vNext = vCur + uvwInc.y;
+            const float yCur  = y * yInc + yStart;
+            const float yNext = (y + 1) * yInc + yStart;
+            const float vCur  = y * uvwInc.y;
+            const float vNext = (y + 1) * uvwInc.y;
 
             for (int z = 0; z < m_subDivs.z; z++) {
-                float zCur  = z * zInc + zStart;
-                float zNext = zCur + zInc;
-                float uCur  = z * uvwInc.z;
-                float uNext = uCur + uvwInc.z;
-
-
-                sUnprocessedFace left, right;
-
-                left.m_verts.emplace_back(xStart, yCur,  zCur   );
-                left.m_verts.emplace_back(xStart, yNext, zCur  );
-                left.m_verts.emplace_back(xStart, yNext, zNext );
-                left.m_verts.emplace_back(xStart, yCur,  zNext  );
-
-                left.m_uvs.emplace_back( uCur,   vCur);
-                left.m_uvs.emplace_back( uCur,   vNext);
-                left.m_uvs.emplace_back( uNext,  vNext);
-                left.m_uvs.emplace_back( uNext,  vCur);
-
-                right.m_verts.emplace_back(xEnd, yCur,  zCur  );
-                right.m_verts.emplace_back(xEnd, yNext, zCur  );
-                right.m_verts.emplace_back(xEnd, yNext, zNext );
-                right.m_verts.emplace_back(xEnd, yCur,  zNext );
-
-                right.m_uvs.emplace_back(1.0f - uCur, vCur);
-                right.m_uvs.emplace_back(1.0f - uCur, vNext);
-                right.m_uvs.emplace_back(1.0f - uNext, vNext);
-                right.m_uvs.emplace_back(1.0f - uNext, vCur);
-
-                left.Flip();
-                pObject->m_unprocessed.push_back(left);
-                pObject->m_unprocessed.push_back(right);
+                const float zCur  = z * zInc + zStart;
+                const float zNext = (z + 1) * zInc + zStart;
+                const float uCur  = z * uvwInc.z;
+                const float uNext = (z + 1) * uvwInc.z;
+
+                const Vector3f left[4]     = { { xStart, yCur,  zCur  }, { xStart, yNext, zCur  },
+                                               { xStart, yNext, zNext }, { xStart, yCur,  zNext } };
+                const Vector2f leftUvs[4]  = { { uCur,  vCur  }, { uCur,  vNext },
+                                               { uNext, vNext }, { uNext, vCur  } };
+                const Vector3f right[4]    = { { xEnd,   yCur,  zCur  }, { xEnd,   yNext, zCur  },
+                                               { xEnd,   yNext, zNext }, { xEnd,   yCur,  zNext } };
+                const Vector2f rightUvs[4] = { { 1.0f - uCur,  vCur  }, { 1.0f - uCur,  vNext },
+                                               { 1.0f - uNext, vNext }, { 1.0f - uNext, vCur  } };
+                builder.AddQuad(left, leftUvs, true);
+                builder.AddQuad(right, rightUvs);
             }
-          
         }
-        Triangulate(*pObject);
     }
 
     ObjPropVector CubeModifier::GetProperties()
@@ -531,67 +403,32 @@ namespace RayTrace
 
     void SphereModifier::Apply()
     {
-        auto ToCarthesian = [](float theta, float phi )
-        {
-            // return Vector3f(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
-            const auto sinPhi = sinf(phi);
-            const auto sinTheta = sinf(theta);
-            const auto cosPhi = cosf(phi);
-            const auto cosTheta = cosf(theta);
+        GeometryBuilder builder(GetGeometry());
+        builder.Reserve(m_numSides * m_numStacks);
 
-            return Vector3f(sinTheta * cosPhi, cosTheta, sinTheta * sinPhi);
-        };
-        
-        
-        
-        const auto thetaInc = ToRadians(180.0f) / m_numStacks;
-        const auto phiInc   = ToRadians(360.0) / m_numSides;
+        const SinCosRing phi(m_numSides, ToRadians(360.0f), true);
+        const SinCosRing theta(m_numStacks, ToRadians(180.0f), false);
         const auto dimsHalfs = m_dimensions * 0.5f;
 
-        auto* pObject = GetGeometry();
-
-
+        auto Corner = [&](int _side, int _stack, Vector3f& _pos, Vector2f& _uv)
+        {
+            const float sinTheta = theta.m_sin[_stack];
+            _pos = Vector3f(sinTheta * phi.m_cos[_side], theta.m_cos[_stack], sinTheta * phi.m_sin[_side]) * dimsHalfs;
+            _uv  = Vector2f(1.0f - (float)_side / m_numSides, 1.0f - (float)_stack / m_numStacks);
+        };
 
         for (int i = 0; i < m_numSides; ++i)
         {
-            const auto curPhi = phiInc * i;
-            const auto nextPhi = curPhi + phiInc;
-            
             for (int j = 0; j < m_numStacks; ++j) {
-
-                const auto curTheta = j * thetaInc;
-                const auto nextTheta = curTheta + thetaInc;
-
-                const auto a = ToCarthesian(nextTheta, curPhi) * dimsHalfs;
-                const auto b = ToCarthesian(curTheta, curPhi) * dimsHalfs;;
-                const auto c = ToCarthesian(curTheta, nextPhi) * dimsHalfs;
-                const auto d = ToCarthesian(nextTheta, nextPhi) * dimsHalfs;
-
-                const auto uv1 = Vector2f(1.0f -  curPhi  / ToRadians(360),1.0f -  nextTheta / ToRadians(180.0f) );
-                const auto uv2 = Vector2f(1.0f -  curPhi  / ToRadians(360),1.0f -  curTheta  / ToRadians(180.0f) );
-                const auto uv3 = Vector2f(1.0f -  nextPhi / ToRadians(360),1.0f -  curTheta  / ToRadians(180.0f) );
-                const auto uv4 = Vector2f(1.0f -  nextPhi / ToRadians(360),1.0f -  nextTheta / ToRadians(180.0f) );
-
-                sUnprocessedFace face;
-                face.m_verts.push_back(a);
-                face.m_verts.push_back(b);
-                face.m_verts.push_back(c);
-                face.m_verts.push_back(d);
-
-                face.m_uvs.push_back(uv1);
-                face.m_uvs.push_back(uv2);
-                face.m_uvs.push_back(uv3);
-                face.m_uvs.push_back(uv4);
-               // face.Flip();
-
-                pObject->m_unprocessed.push_back(face);
-
-
-                
+                Vector3f verts[4];
+                Vector2f uvs[4];
+                Corner(i,     j + 1, verts[0], uvs[0]);
+                Corner(i,     j,     verts[1], uvs[1]);
+                Corner(i + 1, j,     verts[2], uvs[2]);
+                Corner(i + 1, j + 1, verts[3], uvs[3]);
+                builder.AddQuad(verts, uvs);
             }
         }
-        Triangulate(*pObject);
-
     }
 
     ObjPropVector SphereModifier::GetProperties()
@@ -637,109 +474,41 @@ namespace RayTrace
 
     void ConeModifier::Apply()
     {
-       
-        const auto sideInc = ToRadians(360.0f) / m_numSides;
+        GeometryBuilder builder(GetGeometry());
+        builder.Reserve(m_numSides * (m_numStacks + (m_endCaps ? m_capStacks : 0)));
+
+        const SinCosRing ring(m_numSides, ToRadians(360.0f), true);
 
         const auto startHeight = m_dimensions.y * -0.5f;
-        const auto endHeight = m_dimensions.y * 0.5f;
-        const auto top = Vector3f(0.0f, endHeight, 0.0f);
+        const auto top = Vector3f(0.0f, m_dimensions.y * 0.5f, 0.0f);
 
-        auto* pObject = GetGeometry();
+        //corners on the line from the rim to the top
+        auto Corner = [&](int _side, int _stack, Vector3f& _pos, Vector2f& _uv)
+        {
+            const float t = (float)_stack / m_numStacks;
+            const auto  rim = Vector3f(ring.m_cos[_side] * m_dimensions.x * 0.5f, startHeight,
+                                       ring.m_sin[_side] * m_dimensions.z * 0.5f);
 
+            _pos = rim + (top - rim) * t;
+            _uv  = Vector2f(1.0f - (float)_side / m_numSides, t);
+        };
 
         for (int side = 0; side < m_numSides; ++side)
         {
-            const auto curSide = Vector3f(cosf(side * sideInc) * m_dimensions.x * 0.5f,
-                                         startHeight,
-                                          sinf(side * sideInc) * m_dimensions.z * 0.5f);
-            const auto nextSide = Vector3f(cosf(side * sideInc + sideInc) * m_dimensions.x * 0.5f,
-                                           startHeight,
-                                           sinf(side * sideInc + sideInc) * m_dimensions.z * 0.5f);
-
-            const auto lengthAbInc = Length(top - curSide) / m_numStacks;
-            const auto lengthCdINc = Length(top - nextSide) / m_numStacks;;
-
-            const auto dirAb = Normalize(top - curSide);
-            const auto dirCd = Normalize(top - nextSide);
-
             for (int stack = 0; stack < m_numStacks; ++stack)
             {
-                const auto a =  curSide + (dirAb * (stack * lengthAbInc + lengthAbInc));
-                const auto b =  curSide + (dirAb * (stack * lengthAbInc));
-                const auto c =  nextSide + (dirCd * (stack * lengthCdINc));
-                const auto d =  nextSide + (dirCd * (stack * lengthCdINc + lengthCdINc));
-
-                sUnprocessedFace face;
-                face.m_verts.emplace_back(a.x, a.y, a.z);
-                face.m_verts.emplace_back(b.x, b.y, b.z);
-                face.m_verts.emplace_back(c.x, c.y, c.z);
-                face.m_verts.emplace_back(d.x, d.y, d.z);
-
-                const auto aHeight = (startHeight - a.y) / ( startHeight - endHeight);
-                const auto bHeight = (startHeight - b.y) / ( startHeight - endHeight);
-
-                face.m_uvs.emplace_back(1.0f - (side * sideInc) / ToRadians(360.0f), aHeight);
-                face.m_uvs.emplace_back(1.0f - (side * sideInc) / ToRadians(360.0f), bHeight);
-                face.m_uvs.emplace_back(1.0f - (side * sideInc + sideInc) / ToRadians(360.0f), bHeight);
-                face.m_uvs.emplace_back(1.0f - (side * sideInc + sideInc) / ToRadians(360.0f), aHeight);
-                face.Flip();
-                pObject->m_unprocessed.push_back(face);
+                Vector3f verts[4];
+                Vector2f uvs[4];
+                Corner(side,     stack + 1, verts[0], uvs[0]);
+                Corner(side,     stack,     verts[1], uvs[1]);
+                Corner(side + 1, stack,     verts[2], uvs[2]);
+                Corner(side + 1, stack + 1, verts[3], uvs[3]);
+                builder.AddQuad(verts, uvs, true);
             }
-            //caps
-            if (m_endCaps) {
-            
-                Vector3f capCur  = Vector3f(curSide.x, 0.0f, curSide.z);
-                Vector3f capNext = Vector3f(nextSide.x, 0.0f, nextSide.z);
-
-                const auto lengthCur = Length(capCur);
-                const auto lengthNext = Length(capNext);
-
-                const auto curDir = -1.0f * capCur / lengthCur;
-                const auto nextDir = -1.0f * capNext / lengthNext;
-
-                const auto curLengthInc = lengthCur / m_capStacks;
-                const auto nextLengthInc = lengthNext / m_capStacks;
-
-                auto NormalizedCoordinate = [](auto _input, auto _min, auto _max)
-                {
-                    const auto range = _max - _min;
-                    return (_input - _min) / range;
-                };
-
-                const Vector3f start = m_dimensions * -0.5f;
-                const Vector3f end = m_dimensions * 0.5f;
-                const float sideInc = ToRadians(360.0f) / m_numSides;
-
-                for (int stack = 0; stack < m_capStacks; ++stack)
-                {
-                    const Vector3f a = curSide + curDir * (curLengthInc * stack + curLengthInc);
-                    const Vector3f b = curSide + curDir * (curLengthInc * stack);
-                    const Vector3f c = nextSide + nextDir * (nextLengthInc * stack);
-                    const Vector3f d = nextSide + nextDir * (nextLengthInc * stack + nextLengthInc);
-
-                    sUnprocessedFace cap;
-                    cap.m_verts.emplace_back(a.x, startHeight, a.z);
-                    cap.m_verts.emplace_back(b.x, startHeight, b.z);
-                    cap.m_verts.emplace_back(c.x, startHeight, c.z);
-                    cap.m_verts.emplace_back(d.x, startHeight, d.z);
-
-                    const auto uvStackCur = NormalizedCoordinate(a, start, end);
-                    const auto uvSideCur = NormalizedCoordinate(b, start, end);
-                    const auto uvSideNext = NormalizedCoordinate(c, start, end);
-                    const auto uvStackNext = NormalizedCoordinate(d, start, end);
-
-                    cap.m_uvs.emplace_back(uvStackCur.x, 1.0f - uvStackCur.z);
-                    cap.m_uvs.emplace_back(uvSideCur.x, 1.0f - uvSideCur.z);
-                    cap.m_uvs.emplace_back(uvSideNext.x, 1.0f - uvSideNext.z);
-                    cap.m_uvs.emplace_back(uvStackNext.x, 1.0f - uvStackNext.z);
-                    pObject->m_unprocessed.push_back(cap);
-                 
-                }
-            }
-
         }
 
-        Triangulate(*pObject);
+        if (m_endCaps)
+            AddDisk(builder, ring, m_numSides, m_capStacks, m_dimensions, startHeight, false);
     }
 
     ObjPropVector ConeModifier::GetProperties()
@@ -787,111 +556,41 @@ namespace RayTrace
 
     void CylinderModifier::Apply()
     {
-        const auto stackInc = m_dimensions.y / m_numStacks;
-        const auto sideInc = ToRadians(360.0f) / m_numSides;
+        GeometryBuilder builder(GetGeometry());
+        builder.Reserve(m_numSides * (m_numStacks + (m_endCaps ? 2 * m_capStacks : 0)));
+
+        const SinCosRing ring(m_numSides, ToRadians(360.0f), true);
 
+        const auto stackInc    = m_dimensions.y / m_numStacks;
         const auto startHeight = m_dimensions.y * -0.5f;
         const auto endHeight   = m_dimensions.y * 0.5f;
-        const auto dir         = Vector3f(0.0f, 1.0f, 0.0f);
-
-        auto* pObject = GetGeometry();
 
+        auto Corner = [&](int _side, int _stack, Vector3f& _pos, Vector2f& _uv)
+        {
+            _pos = Vector3f(ring.m_cos[_side] * m_dimensions.x * 0.5f,
+                            startHeight + _stack * stackInc,
+                            ring.m_sin[_side] * m_dimensions.z * 0.5f);
+            _uv  = Vector2f(1.0f - (float)_side / m_numSides, (float)_stack / m_numStacks);
+        };
 
         for (int side = 0; side < m_numSides; ++side)
         {
-            const auto curSide  = Vector3f( cosf( side * sideInc ) * m_dimensions.x * 0.5f,
-                                            0.0f,
-                                            sinf( side * sideInc ) * m_dimensions.z * 0.5f );
-            const auto nextSide = Vector3f( cosf( side * sideInc + sideInc ) * m_dimensions.x * 0.5f,
-                                            0.0f,
-                                            sinf( side * sideInc + sideInc ) * m_dimensions.z * 0.5f );
-
             for (int stack = 0; stack < m_numStacks; ++stack)
             {
-                const auto a = Vector3f( 0, startHeight, 0) + curSide + (dir *  (stack * stackInc + stackInc));
-                const auto b = Vector3f( 0, startHeight, 0) + curSide + (dir *  (stack * stackInc));
-                const auto c = Vector3f( 0, startHeight, 0) + nextSide + (dir * (stack * stackInc));
-                const auto d = Vector3f( 0, startHeight, 0) + nextSide + (dir * (stack * stackInc + stackInc));
-
-                sUnprocessedFace face;
-                face.m_verts.emplace_back(a.x, a.y, a.z);
-                face.m_verts.emplace_back(b.x, b.y, b.z);
-                face.m_verts.emplace_back(c.x, c.y, c.z);
-                face.m_verts.emplace_back(d.x, d.y, d.z);
-
-                const auto aHeight = (stack * stackInc + stackInc) / (endHeight - startHeight);
-                const auto bHeight = (stack * stackInc)  / (endHeight - startHeight);
-
-                face.m_uvs.emplace_back(1.0f - (side * sideInc) / ToRadians(360.0f), aHeight);
-                face.m_uvs.emplace_back(1.0f - (side * sideInc) / ToRadians(360.0f), bHeight);
-                face.m_uvs.emplace_back(1.0f - (side * sideInc + sideInc) / ToRadians(360.0f), bHeight);
-                face.m_uvs.emplace_back(1.0f - (side * sideInc + sideInc) / ToRadians(360.0f), aHeight);
-                face.Flip();
-                pObject->m_unprocessed.push_back(face);
-            }
-            //caps
-            if (m_endCaps) {
-                //const auto sideCur  = Vector2f{ xCur,  zCur };
-               // const auto sideNext = Vector2f{ xNext, zNext };
-
-                const auto lengthCur  = Length(curSide);
-                const auto lengthNext = Length(nextSide);
-
-                const auto curDir = -1.0f * curSide / lengthCur;
-                const auto nextDir = -1.0f * nextSide / lengthNext;
-
-                const auto curLengthInc = lengthCur / m_capStacks;
-                const auto nextLengthInc = lengthNext / m_capStacks;
-
-                auto NormalizedCoordinate = [](auto _input, auto _min, auto _max)
-                {
-                    const auto range = _max - _min;
-                    return (_input - _min) / range;
-                };
-
-                const Vector3f start = m_dimensions * -0.5f;
-                const Vector3f end = m_dimensions * 0.5f;
-                const float sideInc  = ToRadians(360.0f) / m_numSides;
-
-                for (int stack = 0; stack < m_capStacks; ++stack)
-                {
-                    const Vector3f a = curSide + curDir *   (curLengthInc * stack + curLengthInc);
-                    const Vector3f b = curSide + curDir *   (curLengthInc * stack);
-                    const Vector3f c = nextSide + nextDir * (nextLengthInc * stack);
-                    const Vector3f d = nextSide + nextDir * (nextLengthInc * stack + nextLengthInc);
-
-                    sUnprocessedFace topCap, bottomCap;
-                    topCap.m_verts.emplace_back(a.x,startHeight, a.z);
-                    topCap.m_verts.emplace_back(b.x,startHeight, b.z);
-                    topCap.m_verts.emplace_back(c.x,startHeight, c.z);
-                    topCap.m_verts.emplace_back(d.x,startHeight, d.z);
-
-                    const auto uvStackCur  = NormalizedCoordinate(a, start, end);
-                    const auto uvSideCur   = NormalizedCoordinate(b, start, end);
-                    const auto uvSideNext  = NormalizedCoordinate(c, start, end);
-                    const auto uvStackNext = NormalizedCoordinate(d, start, end);
-
-                    topCap.m_uvs.emplace_back(uvStackCur.x,  1.0f - uvStackCur.z);
-                    topCap.m_uvs.emplace_back(uvSideCur.x,   1.0f - uvSideCur.z);
-                    topCap.m_uvs.emplace_back(uvSideNext.x,  1.0f - uvSideNext.z);
-                    topCap.m_uvs.emplace_back(uvStackNext.x, 1.0f - uvStackNext.z);
-                    bottomCap = topCap;
-
-                    for (auto& v : bottomCap.m_verts)
-                        v.y = endHeight;
-                    bottomCap.Flip();
-                   
-
-                    pObject->m_unprocessed.push_back(topCap);
-                    pObject->m_unprocessed.push_back(bottomCap);
-                }
+                Vector3f verts[4];
+                Vector2f uvs[4];
+                Corner(side,     stack + 1, verts[0], uvs[0]);
+                Corner(side,     stack,     verts[1], uvs[1]);
+                Corner(side + 1, stack,     verts[2], uvs[2]);
+                Corner(side + 1, stack + 1, verts[3], uvs[3]);
+                builder.AddQuad(verts, uvs, true);
             }
-
         }
 
-        Triangulate(*pObject);
-
-
+        if (m_endCaps) {
+            AddDisk(builder, ring, m_numSides, m_capStacks, m_dimensions, startHeight, false);
+            AddDisk(builder, ring, m_numSides, m_capStacks, m_dimensions, endHeight, true);
+        }
     }
 
     ObjPropVector CylinderModifier::GetProperties()
@@ -83,7 +83,10 @@ namespace RayTrace
 
     void ObjectBase::SetObjectFlags(const ObjectFlags& _flags)
     {
+        const bool visibilityChanged = m_flags.m_field.m_visible != _flags.m_field.m_visible;
         m_flags = _flags;
+        if (visibilityChanged)
+            ObjectModified();
     }
 
     uint32_t ObjectBase::GetLayerFlags() const
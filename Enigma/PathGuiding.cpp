@@ -0,0 +1,322 @@
+#include <assert.h>
+#include <algorithm>
+#include "MathCommon.h"
+#include "Concurrency.h"
+#include "PathGuiding.h"
+
+namespace RayTrace
+{
+    static void AtomicAdd(std::atomic<float>& value, float increment)
+    {
+        float oldValue = value.load(std::memory_order_relaxed);
+        while (!value.compare_exchange_weak(oldValue, oldValue + increment, std::memory_order_relaxed))
+            ;
+    }
+
+    // Selects the quadrant of the unit square containing _p_ and remaps _p_ to that quadrant
+    static int ChildQuadrant(Vector2f& p)
+    {
+        int ix = p.x >= 0.5f ? 1 : 0;
+        int iy = p.y >= 0.5f ? 1 : 0;
+        p.x = std::min(2 * p.x - ix, OneMinusEpsilon);
+        p.y = std::min(2 * p.y - iy, OneMinusEpsilon);
+        return ix + 2 * iy;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // DirectionalQuadTree
+    //////////////////////////////////////////////////////////////////////////
+    DirectionalQuadTree::Node::Node()
+    {
+        for (int i = 0; i < 4; ++i) {
+            m_sum[i].store(0.f, std::memory_order_relaxed);
+            m_child[i] = 0;
+        }
+    }
+
+    DirectionalQuadTree::Node::Node(const Node& other)
+    {
+        *this = other;
+    }
+
+    DirectionalQuadTree::Node& DirectionalQuadTree::Node::operator=(const Node& other)
+    {
+        for (int i = 0; i < 4; ++i) {
+            m_sum[i].store(other.m_sum[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            m_child[i] = other.m_child[i];
+        }
+        return *this;
+    }
+
+    float DirectionalQuadTree::Node::Sum() const
+    {
+        float sum = 0;
+        for (int i = 0; i < 4; ++i)
+            sum += m_sum[i].load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    DirectionalQuadTree::DirectionalQuadTree()
+        : m_nodes(1)
+        , m_nSamples(0)
+    {
+
+    }
+
+    DirectionalQuadTree::DirectionalQuadTree(const DirectionalQuadTree& other)
+        : m_nodes(other.m_nodes)
+        , m_nSamples(other.m_nSamples.load())
+    {
+
+    }
+
+    DirectionalQuadTree& DirectionalQuadTree::operator=(const DirectionalQuadTree& other)
+    {
+        m_nodes = other.m_nodes;
+        m_nSamples = other.m_nSamples.load();
+        return *this;
+    }
+
+    void DirectionalQuadTree::Record(const Vector2f& _p, float weight)
+    {
+        Vector2f p = _p;
+        uint32_t node = 0;
+        for (;;) {
+            int q = ChildQuadrant(p);
+            AtomicAdd(m_nodes[node].m_sum[q], weight);
+            if (!m_nodes[node].m_child[q])
+                break;
+            node = m_nodes[node].m_child[q];
+        }
+        ++m_nSamples;
+    }
+
+    Vector2f DirectionalQuadTree::Sample(Vector2f u, float* pdf) const
+    {
+        Vector2f origin(0.f, 0.f);
+        float    size = 1;
+        float    density = 1;
+        uint32_t node = 0;
+        for (;;) {
+            const Node& n = m_nodes[node];
+            float s[4];
+            for (int i = 0; i < 4; ++i)
+                s[i] = n.m_sum[i].load(std::memory_order_relaxed);
+            const float total = s[0] + s[1] + s[2] + s[3];
+            // Quadrants without energy below this node are sampled uniformly
+            if (total <= 0)
+                break;
+
+            // Pick the column, then the quadrant within it, reusing the sample for the rest
+            const float fracLeft = (s[0] + s[2]) / total;
+            int ix;
+            if (u.x < fracLeft) {
+                ix = 0;
+                u.x /= fracLeft;
+            }
+            else {
+                ix = 1;
+                u.x = (u.x - fracLeft) / (1 - fracLeft);
+            }
+            const float column = s[ix] + s[ix + 2];
+            const float fracBottom = column > 0 ? s[ix] / column : 0.5f;
+            int iy;
+            if (u.y < fracBottom) {
+                iy = 0;
+                u.y /= fracBottom;
+            }
+            else {
+                iy = 1;
+                u.y = (u.y - fracBottom) / (1 - fracBottom);
+            }
+            u.x = std::clamp(u.x, 0.f, OneMinusEpsilon);
+            u.y = std::clamp(u.y, 0.f, OneMinusEpsilon);
+
+            const int q = ix + 2 * iy;
+            density *= 4 * s[q] / total;
+            size *= 0.5f;
+            origin += Vector2f((float)ix, (float)iy) * size;
+            if (!n.m_child[q])
+                break;
+            node = n.m_child[q];
+        }
+        *pdf = density;
+        return origin + u * size;
+    }
+
+    float DirectionalQuadTree::Pdf(Vector2f p) const
+    {
+        float    density = 1;
+        uint32_t node = 0;
+        for (;;) {
+            const Node& n = m_nodes[node];
+            const float total = n.Sum();
+            if (total <= 0)
+                break;
+            const int q = ChildQuadrant(p);
+            density *= 4 * n.m_sum[q].load(std::memory_order_relaxed) / total;
+            if (!n.m_child[q])
+                break;
+            node = n.m_child[q];
+        }
+        return density;
+    }
+
+    float DirectionalQuadTree::Total() const
+    {
+        return m_nodes[0].Sum();
+    }
+
+    void DirectionalQuadTree::SetSampleCount(uint64_t count)
+    {
+        m_nSamples = count;
+    }
+
+    void DirectionalQuadTree::Refine(const DirectionalQuadTree& from, int maxDepth, float subdivideThreshold)
+    {
+        static constexpr uint32_t NoSource = ~0u;
+        struct Entry {
+            uint32_t    node;
+            uint32_t    source;     // node of _from_ covering the same quadrants, if any
+            float       energy[4];
+            int         depth;
+        };
+
+        m_nodes.assign(1, Node());
+        m_nSamples = 0;
+        const float total = from.Total();
+        if (total <= 0)
+            return;
+
+        std::vector<Entry> stack;
+        Entry root = { 0, 0, {}, 1 };
+        for (int i = 0; i < 4; ++i)
+            root.energy[i] = from.m_nodes[0].m_sum[i].load(std::memory_order_relaxed);
+        stack.push_back(root);
+        while (!stack.empty()) {
+            Entry entry = stack.back();
+            stack.pop_back();
+            if (entry.depth >= maxDepth)
+                continue;
+            for (int q = 0; q < 4; ++q) {
+                if (entry.energy[q] <= subdivideThreshold * total)
+                    continue;
+                // Quadrants subdivided past the recorded tree split their energy evenly
+                Entry child = { (uint32_t)m_nodes.size(), NoSource, {}, entry.depth + 1 };
+                const uint32_t sourceChild = entry.source != NoSource ? from.m_nodes[entry.source].m_child[q] : 0;
+                if (sourceChild) {
+                    child.source = sourceChild;
+                    for (int i = 0; i < 4; ++i)
+                        child.energy[i] = from.m_nodes[sourceChild].m_sum[i].load(std::memory_order_relaxed);
+                }
+                else {
+                    for (int i = 0; i < 4; ++i)
+                        child.energy[i] = entry.energy[q] / 4;
+                }
+                m_nodes.emplace_back();
+                m_nodes[entry.node].m_child[q] = child.node;
+                stack.push_back(child);
+            }
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // GuidingField
+    //////////////////////////////////////////////////////////////////////////
+    GuidingField::GuidingField(const BBox3f& bounds, int spatialThreshold /*= 4000*/,
+        int maxDirectionalDepth /*= 20*/, float directionalThreshold /*= 0.01f*/)
+        : m_nodes(1)
+        , m_leaves(1)
+        , m_spatialThreshold(spatialThreshold)
+        , m_maxDirectionalDepth(maxDirectionalDepth)
+        , m_directionalThreshold(directionalThreshold)
+    {
+        // Halving a cube keeps the regions close to cubes
+        const Vector3f center = (bounds.m_min + bounds.m_max) * 0.5f;
+        const Vector3f extent = bounds.m_max - bounds.m_min;
+        const float    halfSize = 0.5f * 1.01f * std::max(extent.x, std::max(extent.y, extent.z)) + 1e-4f;
+        m_bounds = BBox3f(center - Vector3f(halfSize), center + Vector3f(halfSize));
+    }
+
+    uint32_t GuidingField::leafIndex(const Vector3f& _p) const
+    {
+        const Vector3f extent = m_bounds.m_max - m_bounds.m_min;
+        float p[3];
+        for (int a = 0; a < 3; ++a)
+            p[a] = std::clamp((_p[a] - m_bounds.m_min[a]) / extent[a], 0.f, OneMinusEpsilon);
+        uint32_t node = 0;
+        while (m_nodes[node].m_child[0]) {
+            const SpatialNode& n = m_nodes[node];
+            const int i = p[n.m_axis] >= 0.5f ? 1 : 0;
+            p[n.m_axis] = std::min(2 * p[n.m_axis] - i, OneMinusEpsilon);
+            node = n.m_child[i];
+        }
+        return m_nodes[node].m_leaf;
+    }
+
+    const DirectionalQuadTree* GuidingField::Lookup(const Vector3f& p) const
+    {
+        const DirectionalQuadTree& tree = m_leaves[leafIndex(p)].m_sampling;
+        return tree.Total() > 0 ? &tree : nullptr;
+    }
+
+    void GuidingField::Record(const Vector3f& p, const Vector3f& wi, float Li, float pdf)
+    {
+        if (!(pdf > 0) || !(Li > 0))
+            return;
+        const float weight = Li / pdf;
+        if (std::isinf(weight))
+            return;
+        m_leaves[leafIndex(p)].m_building.Record(DirectionToSquare(wi), weight);
+    }
+
+    void GuidingField::Refine()
+    {
+        // Split the regions that received too many samples, the halves start from the parent's trees
+        for (size_t i = 0; i < m_nodes.size(); ++i) {
+            if (m_nodes[i].m_child[0])
+                continue;
+            const uint32_t leaf = m_nodes[i].m_leaf;
+            const uint64_t nSamples = m_leaves[leaf].m_building.SampleCount();
+            if (nSamples <= (uint64_t)m_spatialThreshold)
+                continue;
+            m_leaves[leaf].m_building.SetSampleCount(nSamples / 2);
+            Leaf copy = m_leaves[leaf];
+            const uint32_t otherLeaf = (uint32_t)m_leaves.size();
+            m_leaves.push_back(copy);
+
+            const uint32_t firstChild = (uint32_t)m_nodes.size();
+            const int      childAxis = (m_nodes[i].m_axis + 1) % 3;
+            m_nodes.resize(m_nodes.size() + 2);
+            m_nodes[firstChild].m_axis = m_nodes[firstChild + 1].m_axis = childAxis;
+            m_nodes[firstChild].m_leaf = leaf;
+            m_nodes[firstChild + 1].m_leaf = otherLeaf;
+            m_nodes[i].m_child[0] = firstChild;
+            m_nodes[i].m_child[1] = firstChild + 1;
+        }
+
+        ParallelFor([&](int64_t i) {
+            Leaf& leaf = m_leaves[i];
+            leaf.m_sampling = leaf.m_building;
+            leaf.m_building.Refine(leaf.m_sampling, m_maxDirectionalDepth, m_directionalThreshold);
+        }, (int64_t)m_leaves.size());
+    }
+
+    Vector2f GuidingField::DirectionToSquare(const Vector3f& w)
+    {
+        const float cosTheta = std::clamp(w.z, -1.f, 1.f);
+        float phi = std::atan2(w.y, w.x);
+        if (phi < 0)
+            phi += TWO_PI;
+        return Vector2f(std::clamp((cosTheta + 1) * 0.5f, 0.f, OneMinusEpsilon),
+                        std::clamp(phi * INV_TWO_PI, 0.f, OneMinusEpsilon));
+    }
+
+    Vector3f GuidingField::SquareToDirection(const Vector2f& p)
+    {
+        const float cosTheta = 2 * p.x - 1;
+        const float sinTheta = std::sqrt(std::max(0.f, 1 - cosTheta * cosTheta));
+        const float phi = TWO_PI * p.y;
+        return Vector3f(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+    }
+}
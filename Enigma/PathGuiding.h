@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "Defines.h"
+#include "BBox.h"
+
+namespace RayTrace
+{
+    // Path guiding in the spirit of "Practical Path Guiding" (Mueller et al. 2017): a binary
+    // spatial tree over the scene whose leaves hold quadtrees over the sphere of directions.
+    // Paths record the radiance they carried into the building trees during a pass; between
+    // passes the recorded trees become the sampling trees and the building trees are refined
+    // where most energy arrived.
+
+    // DirectionalQuadTree Declarations
+    // Directions are mapped to the unit square by (cos theta, phi), which preserves area, so the
+    // density over the square divided by 4 pi is the density over solid angle
+    class DirectionalQuadTree {
+    public:
+        DirectionalQuadTree();
+
+        // Adds _weight_ to the quadrants containing _p_, safe to call concurrently
+        void        Record(const Vector2f& p, float weight);
+        // Samples the square proportional to the recorded energy, _pdf_ is the density over the square
+        Vector2f    Sample(Vector2f u, float* pdf) const;
+        float       Pdf(Vector2f p) const;
+        float       Total() const;
+        uint64_t    SampleCount() const { return m_nSamples; }
+        void        SetSampleCount(uint64_t count);
+
+        // Rebuilds the topology from the energy recorded in _from_: quadrants holding more than
+        // _subdivideThreshold_ of the total are subdivided up to _maxDepth_, the others are
+        // merged. The sums start over at 0
+        void        Refine(const DirectionalQuadTree& from, int maxDepth, float subdivideThreshold);
+
+        DirectionalQuadTree(const DirectionalQuadTree& other);
+        DirectionalQuadTree& operator=(const DirectionalQuadTree& other);
+
+    private:
+        struct Node {
+            Node();
+            Node(const Node& other);
+            Node& operator=(const Node& other);
+            float Sum() const;
+
+            std::atomic<float>  m_sum[4];       // energy of each quadrant, indexed x + 2 y
+            uint32_t            m_child[4];     // 0 marks a leaf quadrant, node 0 is the root
+        };
+
+        std::vector<Node>       m_nodes;
+        std::atomic<uint64_t>   m_nSamples;
+    };
+
+    // GuidingField Declarations
+    class GuidingField {
+    public:
+        GuidingField(const BBox3f& bounds, int spatialThreshold = 4000,
+            int maxDirectionalDepth = 20, float directionalThreshold = 0.01f);
+
+        // Sampling tree of the region containing _p_, null while it has not learned anything
+        const DirectionalQuadTree*  Lookup(const Vector3f& p) const;
+        // Records the radiance _Li_ arriving at _p_ from _wi_, sampled with density _pdf_
+        void                        Record(const Vector3f& p, const Vector3f& wi, float Li, float pdf);
+        // Promotes the recorded trees to sampling trees and refines both trees. Must not run
+        // concurrently with Lookup or Record
+        void                        Refine();
+
+        static Vector2f             DirectionToSquare(const Vector3f& w);
+        static Vector3f             SquareToDirection(const Vector2f& p);
+
+    private:
+        struct SpatialNode {
+            int         m_axis = 0;
+            uint32_t    m_child[2] = { 0, 0 };  // both 0 for leaves
+            uint32_t    m_leaf = 0;             // index of the leaf's trees
+        };
+        struct Leaf {
+            DirectionalQuadTree m_sampling,
+                                m_building;
+        };
+
+        uint32_t                    leafIndex(const Vector3f& p) const;
+
+        BBox3f                      m_bounds;
+        std::vector<SpatialNode>    m_nodes;
+        std::vector<Leaf>           m_leaves;
+        const int                   m_spatialThreshold;
+        const int                   m_maxDirectionalDepth;
+        const float                 m_directionalThreshold;
+    };
+}
@@ -29,11 +29,17 @@ namespace RayTrace
     //////////////////////////////////////////////////////////////////////////
     PathIntegrator::PathIntegrator(int maxDepth, std::shared_ptr<Camera> camera,
         std::shared_ptr<Sampler> sampler, const BBox2i& pixelBounds,
-        float rrThreshold /*= 1*/, const std::string& lightSampleStrategy /*= "spatial"*/)
+        float rrThreshold /*= 1*/, const std::string& lightSampleStrategy /*= "spatial"*/,
+        bool spectral /*= false*/, bool guiding /*= false*/,
+        float guidingFraction /*= 0.5f*/, int guidingSamplesPerPass /*= 4*/)
         : SamplerIntegrator(camera, sampler, pixelBounds)
         , m_maxDepth(maxDepth)
         , m_rrThreshold(rrThreshold)
         , m_lightSampleStrategy(lightSampleStrategy)
+        , m_spectral(spectral)
+        , m_guidingEnabled(guiding)
+        , m_guidingFraction(std::clamp(guidingFraction, 0.f, 1.f))
+        , m_guidingSamplesPerPass(std::max(1, guidingSamplesPerPass))
     {
 
     }
@@ -41,10 +47,24 @@ namespace RayTrace
     void PathIntegrator::Preprocess(const Scene& scene, Sampler& sampler)
     {
         m_lightDistribution = CreateLightSampleDistribution(m_lightSampleStrategy, scene);
+        // The spectral estimator does not guide
+        m_guiding.reset();
+        if (m_guidingEnabled && !m_spectral)
+            m_guiding = std::make_unique<GuidingField>(scene.worldBound());
     }
 
-    Spectrum PathIntegrator::Li(const RayDifferential& _ray, const Scene& scene, Sampler& sampler, MemoryArena& arena, int depth) const
+    void PathIntegrator::PassCompleted(int pass)
     {
+        UNUSED(pass)
+        if (m_guiding)
+            m_guiding->Refine();
+    }
+
+    Spectrum PathIntegrator::Li(const RayDifferential& _ray, const Scene& scene, Sampler& sampler, MemoryArena& arena, int depth, const SurfaceInteraction* primaryHit) const
+    {
+        if (m_spectral)
+            return spectralLi(_ray, scene, sampler, arena, primaryHit);
+
         Spectrum L(0.f), beta(1.f);
         RayDifferential ray(_ray);
         bool specularBounce = false;
@@ -58,6 +78,22 @@ namespace RayTrace
         // out of a medium and thus have their beta value increased.
         float etaScale = 1;
 
+        // Path vertices whose incident radiance is recorded into the guiding field. _beta_ is the
+        // throughput right after the vertex, so a contribution c to L arrived there as c / beta
+        struct GuidingVertex {
+            Vector3f p, wi;
+            Spectrum beta, radiance;
+            float    pdf;
+        };
+        GuidingVertex* vertices = m_guiding ? arena.Alloc<GuidingVertex>(std::max(1, m_maxDepth)) : nullptr;
+        int nVertices = 0;
+        auto addToVertices = [&](const Spectrum& contribution) {
+            for (int i = 0; i < nVertices; ++i)
+                for (int c = 0; c < Spectrum::nSamples; ++c)
+                    if (vertices[i].beta[c] > 0)
+                        vertices[i].radiance[c] += contribution[c] / vertices[i].beta[c];
+        };
+
         for (bounces = 0;; ++bounces) {
             // Find next path vertex and accumulate contribution
         //    VLOG(2) << "Path tracer bounce " << bounces << ", current L = " << L
@@ -66,20 +102,41 @@ namespace RayTrace
            
             // Intersect _ray_ with scene and store intersection in _isect_
             SurfaceInteraction isect;
-            bool foundIntersection = scene.intersect(ray, &isect);
+            bool foundIntersection;
+            if (bounces == 0 && primaryHit) {
+                isect = *primaryHit;
+                foundIntersection = primaryHit->m_primitive != nullptr;
+            }
+            else
+                foundIntersection = scene.intersect(ray, &isect);
 
             // Possibly add emitted light at intersection
             if (bounces == 0 || specularBounce) {
                 // Add emitted light at path vertex or from the environment
+                Spectrum Le(0.f);
                 if (foundIntersection) {
-                    L += beta * isect.Le(-ray.m_dir);
+                    Le = beta * isect.Le(-ray.m_dir);
                     //  VLOG(2) << "Added Le -> L = " << L;
                 }
                 else {
                     for (const auto& light : scene.m_infiniteLights)
-                        L += beta * light->Le(ray);
+                        Le += beta * light->Le(ray);
                     // VLOG(2) << "Added infinite area lights -> L = " << L;
-                }               
+                }
+                L += Le;
+                if (nVertices)
+                    addToVertices(Le);
+            }
+            else if (nVertices) {
+                // Light sampling already accounted for this emission in L, but the guiding field
+                // still has to learn where it comes from
+                Spectrum Le(0.f);
+                if (foundIntersection)
+                    Le = beta * isect.Le(-ray.m_dir);
+                else
+                    for (const auto& light : scene.m_infiniteLights)
+                        Le += beta * light->Le(ray);
+                addToVertices(Le);
             }
 
             // Terminate path if ray escaped or _maxDepth_ was reached00
@@ -94,32 +151,57 @@ namespace RayTrace
                 continue;
             }
 
-            const Distribution1D* distrib = m_lightDistribution->Lookup(isect.m_p);
-
             // Sample illumination from lights to find path contribution.
             // (But skip this for perfectly specular BSDFs.)
             if (isect.m_bsdf->numComponents(eBxDFType(BSDF_ALL & ~BSDF_SPECULAR)) >
                 0) {
                 //++totalPaths;
                 Spectrum Ld = beta * UniformSampleOneLight(isect, scene, arena,
-                    sampler, false, distrib);
+                    sampler, false, m_lightDistribution.get());
                 //   VLOG(2) << "Sampled direct lighting Ld = " << Ld;
                 if (Ld.IsBlack()) {
                     //++zeroRadiancePaths;
                 }               
                 //  CHECK_GE(Ld.y(), 0.f);
                 L += Ld;
+                if (nVertices)
+                    addToVertices(Ld);
             }
 
             // Sample BSDF to get new path direction
             Vector3f wo = -ray.m_dir, wi;
             float pdf;
             eBxDFType flags;
-            Spectrum f = isect.m_bsdf->sample_f(wo, &wi, sampler.Get2D(), &pdf, BSDF_ALL, &flags);
+            Spectrum f;
+            // Only vertices without specular lobes are guided and recorded
+            const bool guidable = m_guiding &&
+                isect.m_bsdf->numComponents(eBxDFType(BSDF_ALL & ~BSDF_SPECULAR)) == isect.m_bsdf->numComponents();
+            const DirectionalQuadTree* guide = guidable ? m_guiding->Lookup(isect.m_p) : nullptr;
+            if (guide) {
+                // One sample MIS between the BSDF and the learned incident radiance
+                const Vector2f u = sampler.Get2D();
+                float guidePdf, bsdfPdf;
+                if (sampler.Get1D() < m_guidingFraction) {
+                    wi = GuidingField::SquareToDirection(guide->Sample(u, &guidePdf));
+                    guidePdf *= INV_FOUR_PI;
+                    f = isect.m_bsdf->f(wo, wi);
+                    bsdfPdf = isect.m_bsdf->Pdf(wo, wi);
+                    flags = Dot(wo, isect.m_n) * Dot(wi, isect.m_n) > 0 ? BSDF_REFLECTION : BSDF_TRANSMISSION;
+                }
+                else {
+                    f = isect.m_bsdf->sample_f(wo, &wi, u, &bsdfPdf, BSDF_ALL, &flags);
+                    guidePdf = guide->Pdf(GuidingField::DirectionToSquare(wi)) * INV_FOUR_PI;
+                }
+                pdf = m_guidingFraction * guidePdf + (1 - m_guidingFraction) * bsdfPdf;
+            }
+            else
+                f = isect.m_bsdf->sample_f(wo, &wi, sampler.Get2D(), &pdf, BSDF_ALL, &flags);
             // VLOG(2) << "Sampled BSDF, f = " << f << ", pdf = " << pdf;
             if (f.IsBlack() || pdf == 0.f)
                 break;
             beta *= f * AbsDot(wi, isect.shading.m_n) / pdf;
+            if (guidable)
+                vertices[nVertices++] = { isect.m_p, wi, beta, Spectrum(0.f), pdf };
             
             //VLOG(2) << "Updated beta = " << beta;
            // CHECK_GE(beta.y(), 0.f);
@@ -136,6 +218,10 @@ namespace RayTrace
 
             // Account for subsurface scattering, if applicable
             if (isect.m_bssrdf && (flags & BSDF_TRANSMISSION)) {
+                // The light leaves elsewhere, so _wi_ does not describe where it arrived from
+                if (guidable)
+                    --nVertices;
+
                 // Importance sample the BSSRDF
                 SurfaceInteraction pi;
                 Spectrum S = isect.m_bssrdf->Sample_S(
@@ -145,7 +231,10 @@ namespace RayTrace
                 beta *= S / pdf;
                
                 // Account for the direct subsurface scattering component
-                L += beta * UniformSampleOneLight(pi, scene, arena, sampler, false, m_lightDistribution->Lookup(pi.m_p));
+                Spectrum Ld = beta * UniformSampleOneLight(pi, scene, arena, sampler, false, m_lightDistribution.get());
+                L += Ld;
+                if (nVertices)
+                    addToVertices(Ld);
 
                 // Account for the indirect subsurface scattering component
                 Spectrum f = pi.m_bsdf->sample_f(pi.m_wo, &wi, sampler.Get2D(), &pdf, BSDF_ALL, &flags);
@@ -175,9 +264,99 @@ namespace RayTrace
             }
         }
         // ReportValue(pathLength, bounces);
+        for (int i = 0; i < nVertices; ++i)
+            m_guiding->Record(vertices[i].p, vertices[i].wi, vertices[i].radiance.y(), vertices[i].pdf);
         return L;
     }
 
+    Spectrum PathIntegrator::spectralLi(const RayDifferential& _ray, const Scene& scene, Sampler& sampler, MemoryArena& arena, const SurfaceInteraction* primaryHit) const
+    {
+        SampledWavelengths lambda = SampledWavelengths::SampleVisible(sampler.Get1D());
+        HeroSpectrum L(0.f), beta(1.f);
+        RayDifferential ray(_ray);
+        bool specularBounce = false;
+        float etaScale = 1;
+
+        for (int bounces = 0;; ++bounces) {
+            SurfaceInteraction isect;
+            bool foundIntersection;
+            if (bounces == 0 && primaryHit) {
+                isect = *primaryHit;
+                foundIntersection = primaryHit->m_primitive != nullptr;
+            }
+            else
+                foundIntersection = scene.intersect(ray, &isect);
+
+            // Possibly add emitted light at intersection
+            if (bounces == 0 || specularBounce) {
+                if (foundIntersection)
+                    L += beta * HeroSpectrum::FromRGB(isect.Le(-ray.m_dir), lambda, eSpectrumType::SPECTRUM_ILLUMINANT);
+                else
+                    for (const auto& light : scene.m_infiniteLights)
+                        L += beta * HeroSpectrum::FromRGB(light->Le(ray), lambda, eSpectrumType::SPECTRUM_ILLUMINANT);
+            }
+            if (!foundIntersection || bounces >= m_maxDepth) break;
+
+            // Compute scattering functions and skip over medium boundaries
+            isect.m_wavelengths = &lambda;
+            isect.ComputeScatteringFunctions(ray, arena, true);
+            if (!isect.m_bsdf) {
+                ray = isect.SpawnRay(ray.m_dir);
+                bounces--;
+                continue;
+            }
+
+            // Direct lighting is estimated in RGB, then upsampled as light arriving at the path
+            if (isect.m_bsdf->numComponents(eBxDFType(BSDF_ALL & ~BSDF_SPECULAR)) > 0) {
+                Spectrum Ld = UniformSampleOneLight(isect, scene, arena, sampler, false, m_lightDistribution.get());
+                L += beta * HeroSpectrum::FromRGB(Ld, lambda, eSpectrumType::SPECTRUM_ILLUMINANT);
+            }
+
+            // Sample BSDF to get new path direction, its weight is upsampled as a reflectance
+            Vector3f wo = -ray.m_dir, wi;
+            float pdf;
+            eBxDFType flags;
+            Spectrum f = isect.m_bsdf->sample_f(wo, &wi, sampler.Get2D(), &pdf, BSDF_ALL, &flags);
+            if (f.IsBlack() || pdf == 0.f)
+                break;
+            beta *= HeroSpectrum::FromRGB(f * AbsDot(wi, isect.shading.m_n) / pdf, lambda);
+            specularBounce = (flags & BSDF_SPECULAR) != 0;
+            if ((flags & BSDF_SPECULAR) && (flags & BSDF_TRANSMISSION)) {
+                float eta = isect.m_bsdf->m_eta;
+                etaScale *= (Dot(wo, isect.m_n) > 0) ? (eta * eta) : 1 / (eta * eta);
+            }
+            ray = isect.SpawnRay(wi);
+
+            // Account for subsurface scattering, if applicable
+            if (isect.m_bssrdf && (flags & BSDF_TRANSMISSION)) {
+                SurfaceInteraction pi;
+                Spectrum S = isect.m_bssrdf->Sample_S(
+                    scene, sampler.Get1D(), sampler.Get2D(), arena, &pi, &pdf);
+                if (S.IsBlack() || pdf == 0) break;
+                beta *= HeroSpectrum::FromRGB(S / pdf, lambda);
+
+                Spectrum Ld = UniformSampleOneLight(pi, scene, arena, sampler, false, m_lightDistribution.get());
+                L += beta * HeroSpectrum::FromRGB(Ld, lambda, eSpectrumType::SPECTRUM_ILLUMINANT);
+
+                Spectrum f = pi.m_bsdf->sample_f(pi.m_wo, &wi, sampler.Get2D(), &pdf, BSDF_ALL, &flags);
+                if (f.IsBlack() || pdf == 0) break;
+                beta *= HeroSpectrum::FromRGB(f * AbsDot(wi, pi.shading.m_n) / pdf, lambda);
+                specularBounce = (flags & BSDF_SPECULAR) != 0;
+                ray = pi.SpawnRay(wi);
+            }
+
+            // Possibly terminate the path with Russian roulette
+            HeroSpectrum rrBeta = beta * etaScale;
+            if (rrBeta.MaxComponentValue() < m_rrThreshold && bounces > 3) {
+                float q = std::max((float).05f, 1.0f - rrBeta.MaxComponentValue());
+                if (sampler.Get1D() < q)
+                    break;
+                beta /= 1 - q;
+            }
+        }
+        return L.ToRGBSpectrum(lambda);
+    }
+
  
     Integrator* CreatePathIntegrator(const ParamSet& _param, const CameraPtr& _cam, const SamplerPtr& _sampler)
     {
@@ -197,7 +376,12 @@ namespace RayTrace
         }
         float rrThreshold = _param.FindOneFloat("rrthreshold", 1.);
         std::string lightStrategy = _param.FindOneString("lightsamplestrategy", "spatial");
-        return new PathIntegrator(maxDepth, _cam, _sampler, pixelBounds, rrThreshold, lightStrategy);
+        bool spectral = _param.FindOneBool("spectral", false);
+        bool guiding = _param.FindOneBool("guiding", false);
+        float guidingFraction = _param.FindOneFloat("guidingfraction", 0.5f);
+        int guidingSamplesPerPass = _param.FindOneInt("guidingspp", 4);
+        return new PathIntegrator(maxDepth, _cam, _sampler, pixelBounds, rrThreshold, lightStrategy, spectral,
+            guiding, guidingFraction, guidingSamplesPerPass);
     }
 }
 
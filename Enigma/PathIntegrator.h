@@ -2,6 +2,7 @@
 
 
 #include "Integrator.h"
+#include "PathGuiding.h"
 
 namespace RayTrace
 {
@@ -12,18 +13,39 @@ namespace RayTrace
         PathIntegrator(int maxDepth, std::shared_ptr<Camera> camera,
             std::shared_ptr<Sampler> sampler,
             const  BBox2i& pixelBounds, float rrThreshold = 1,
-            const std::string& lightSampleStrategy = "spatial");
+            const std::string& lightSampleStrategy = "spatial",
+            bool spectral = false, bool guiding = false,
+            float guidingFraction = 0.5f, int guidingSamplesPerPass = 4);
 
         void Preprocess(const Scene& scene, Sampler& sampler);
         Spectrum Li(const RayDifferential& ray, const Scene& scene,
-            Sampler& sampler, MemoryArena& arena, int depth) const;
+            Sampler& sampler, MemoryArena& arena, int depth,
+            const SurfaceInteraction* primaryHit = nullptr) const;
+
+    protected:
+        // Guiding learns between passes, so a guided render is always split in passes
+        int  PreferredSamplesPerPass() const override { return m_guiding ? m_guidingSamplesPerPass : 0; }
+        void PassCompleted(int pass) override;
 
     private:
+        // Hero wavelength variant of Li(): the path carries nHeroWavelengths sampled wavelengths,
+        // RGB reflectances and emission are upsampled at each vertex and the radiance estimate
+        // is converted to XYZ before it goes to the film
+        Spectrum spectralLi(const RayDifferential& ray, const Scene& scene,
+            Sampler& sampler, MemoryArena& arena, const SurfaceInteraction* primaryHit) const;
+
         // PathIntegrator Private Data
         const int           m_maxDepth;
         const float         m_rrThreshold;
         const std::string   m_lightSampleStrategy;
+        const bool          m_spectral;
+        // Path guiding: with probability _m_guidingFraction_ the direction is drawn from the
+        // learned incident radiance instead of the BSDF, both densities are combined with MIS
+        const bool          m_guidingEnabled;
+        const float         m_guidingFraction;
+        const int           m_guidingSamplesPerPass;
         std::unique_ptr<LightDistribution> m_lightDistribution;
+        std::unique_ptr<GuidingField>      m_guiding;
     };
 
     Integrator* CreatePathIntegrator(const ParamSet& _param, const CameraPtr& _cam, const SamplerPtr& _sampler);
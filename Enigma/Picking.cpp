@@ -0,0 +1,415 @@
+#include <assert.h>
+#include <algorithm>
+#include <numeric>
+#include "Context.h"
+#include "SceneManager.h"
+#include "WrappedEntity.h"
+#include "HWCamera.h"
+#include "HWRenderer.h"
+#include "ModifierStack.h"
+#include "Geometry.h"
+#include "Picking.h"
+
+namespace RayTrace
+{
+    static constexpr uint32_t MaxTrisInLeaf = 4;
+    static constexpr uint32_t MaxDepth      = 64;  //size of the traversal stacks
+
+    // Two sided Moller-Trumbore test, shortens _ray.m_maxT_ on a hit
+    static bool IntersectTriangle(const Ray& _ray, const Vector3f& _p0, const Vector3f& _p1, const Vector3f& _p2)
+    {
+        const Vector3f e1  = _p1 - _p0;
+        const Vector3f e2  = _p2 - _p0;
+        const Vector3f p   = Cross(_ray.m_dir, e2);
+        const float    det = Dot(e1, p);
+        if (det == 0.0f)
+            return false;
+
+        const float    invDet = 1.0f / det;
+        const Vector3f s = _ray.m_origin - _p0;
+        const float    u = Dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+
+        const Vector3f q = Cross(s, e1);
+        const float    v = Dot(_ray.m_dir, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+
+        const float t = Dot(e2, q) * invDet;
+        if (t <= 0.0f || t >= _ray.m_maxT)
+            return false;
+        _ray.m_maxT = t;
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    //TriangleBVH
+    //////////////////////////////////////////////////////////////////////////
+    TriangleBVH::TriangleBVH(const Vector3f* _pVerts, uint32_t _numVerts, const uint32_t* _pIndices, uint32_t _numIndices)
+        : m_verts(_pVerts, _pVerts + _numVerts)
+    {
+        if (_pIndices) {
+            m_indices.assign(_pIndices, _pIndices + (_numIndices - _numIndices % 3));
+        }
+        else {
+            m_indices.resize(_numVerts - _numVerts % 3);
+            std::iota(m_indices.begin(), m_indices.end(), 0u);
+        }
+        m_bounds = Union(m_bounds, m_verts.data(), (uint32_t)m_verts.size());
+    }
+
+    bool TriangleBVH::Intersect(const Ray& _ray) const
+    {
+        if (m_nodes.empty())
+            build();
+        if (m_nodes.empty())
+            return false;
+
+        const Vector3f invDir(1.0f / _ray.m_dir.x, 1.0f / _ray.m_dir.y, 1.0f / _ray.m_dir.z);
+        const int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+        // Front to back traversal, the far child waits on the stack
+        uint32_t stack[MaxDepth];
+        int      stackSize = 0;
+        uint32_t current   = 0;
+        bool     hit       = false;
+        while (true) {
+            const Node& node = m_nodes[current];
+            if (node.m_bounds.intersectP(_ray, invDir, dirIsNeg)) {
+                if (node.m_numTris > 0) {
+                    for (uint32_t i = node.m_offset; i < node.m_offset + node.m_numTris; ++i) {
+                        const uint32_t* tri = &m_indices[3 * i];
+                        hit |= IntersectTriangle(_ray, m_verts[tri[0]], m_verts[tri[1]], m_verts[tri[2]]);
+                    }
+                    if (stackSize == 0)
+                        break;
+                    current = stack[--stackSize];
+                }
+                else if (dirIsNeg[node.m_axis]) {
+                    stack[stackSize++] = current + 1;
+                    current = node.m_offset;
+                }
+                else {
+                    stack[stackSize++] = node.m_offset;
+                    current = current + 1;
+                }
+            }
+            else {
+                if (stackSize == 0)
+                    break;
+                current = stack[--stackSize];
+            }
+        }
+        return hit;
+    }
+
+    bool TriangleBVH::Overlaps(const FrustumCuller& _culler) const
+    {
+        if (m_nodes.empty())
+            build();
+        if (m_nodes.empty())
+            return false;
+
+        uint32_t stack[MaxDepth];
+        int      stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0) {
+            const uint32_t nodeIndex = stack[--stackSize];
+            const Node&    node      = m_nodes[nodeIndex];
+            const auto     result    = _culler.Classify(node.m_bounds);
+            if (result == eCullResult::CULL_RESULT_OUTSIDE)
+                continue;
+            if (result == eCullResult::CULL_RESULT_INSIDE)
+                return true; //nodes are never empty
+
+            if (node.m_numTris > 0) {
+                for (uint32_t i = node.m_offset; i < node.m_offset + node.m_numTris; ++i) {
+                    if (_culler.IsVisible(triangleBounds(i)))
+                        return true;
+                }
+            }
+            else {
+                stack[stackSize++] = nodeIndex + 1;
+                stack[stackSize++] = node.m_offset;
+            }
+        }
+        return false;
+    }
+
+    BBox3f TriangleBVH::triangleBounds(uint32_t _tri) const
+    {
+        return Union(BBox3f(m_verts[m_indices[3 * _tri]], m_verts[m_indices[3 * _tri + 1]]), m_verts[m_indices[3 * _tri + 2]]);
+    }
+
+    void TriangleBVH::build() const
+    {
+        const uint32_t numTris = GetTriangleCount();
+        if (numTris == 0)
+            return;
+
+        std::vector<BBox3f>   triBounds(numTris);
+        std::vector<uint32_t> tris(numTris);
+        for (uint32_t i = 0; i < numTris; ++i) {
+            triBounds[i] = triangleBounds(i);
+            tris[i] = i;
+        }
+        m_nodes.reserve(2 * numTris);
+        buildRecursive(triBounds, tris, 0, numTris, 0);
+
+        // Store the triangles in leaf order so that leaves address a contiguous range
+        std::vector<uint32_t> ordered(m_indices.size());
+        for (uint32_t i = 0; i < numTris; ++i)
+            std::copy_n(&m_indices[3 * tris[i]], 3, &ordered[3 * i]);
+        m_indices.swap(ordered);
+    }
+
+    uint32_t TriangleBVH::buildRecursive(const std::vector<BBox3f>& _triBounds, std::vector<uint32_t>& _tris,
+                                         uint32_t _first, uint32_t _last, uint32_t _depth) const
+    {
+        const uint32_t nodeIndex = (uint32_t)m_nodes.size();
+        m_nodes.emplace_back();
+
+        BBox3f bounds, centroidBounds;
+        for (uint32_t i = _first; i < _last; ++i) {
+            bounds         = Union(bounds, _triBounds[_tris[i]]);
+            centroidBounds = Union(centroidBounds, _triBounds[_tris[i]].getCenter());
+        }
+
+        const uint32_t count = _last - _first;
+        const int      axis  = centroidBounds.maximumExtent();
+        const float    axisMin    = centroidBounds.m_min[axis];
+        const float    axisExtent = centroidBounds.m_max[axis] - axisMin;
+        // Small ranges, coincident centroids and the stack limit end in a leaf
+        if (count <= MaxTrisInLeaf || axisExtent <= 0.0f || _depth + 1 >= MaxDepth) {
+            Node& leaf = m_nodes[nodeIndex];
+            leaf.m_bounds  = bounds;
+            leaf.m_offset  = _first;
+            leaf.m_numTris = count;
+            return nodeIndex;
+        }
+
+        // Bin the centroids and split where the surface area heuristic is lowest
+        constexpr int NumBuckets = 12;
+        struct BucketInfo {
+            uint32_t m_count = 0;
+            BBox3f   m_bounds;
+        };
+        BucketInfo buckets[NumBuckets];
+        auto BucketOf = [&](uint32_t _tri) {
+            const int b = (int)(NumBuckets * (_triBounds[_tri].getCenter()[axis] - axisMin) / axisExtent);
+            return std::min(b, NumBuckets - 1);
+        };
+        for (uint32_t i = _first; i < _last; ++i) {
+            auto& bucket = buckets[BucketOf(_tris[i])];
+            ++bucket.m_count;
+            bucket.m_bounds = Union(bucket.m_bounds, _triBounds[_tris[i]]);
+        }
+
+        // The first and the last bucket are never empty, so both sides of every split are populated
+        float minCost   = InfinityF32;
+        int   minBucket = 0;
+        for (int split = 0; split < NumBuckets - 1; ++split) {
+            BBox3f   b0, b1;
+            uint32_t c0 = 0, c1 = 0;
+            for (int i = 0; i <= split; ++i) {
+                if (buckets[i].m_count == 0)
+                    continue;
+                b0 = Union(b0, buckets[i].m_bounds);
+                c0 += buckets[i].m_count;
+            }
+            for (int i = split + 1; i < NumBuckets; ++i) {
+                if (buckets[i].m_count == 0)
+                    continue;
+                b1 = Union(b1, buckets[i].m_bounds);
+                c1 += buckets[i].m_count;
+            }
+            const float cost = c0 * b0.surfaceArea() + c1 * b1.surfaceArea();
+            if (cost < minCost) {
+                minCost   = cost;
+                minBucket = split;
+            }
+        }
+
+        const auto midIt = std::partition(_tris.begin() + _first, _tris.begin() + _last,
+            [&](uint32_t _tri) { return BucketOf(_tri) <= minBucket; });
+        const uint32_t mid = (uint32_t)(midIt - _tris.begin());
+        assert(mid > _first && mid < _last);
+
+        buildRecursive(_triBounds, _tris, _first, mid, _depth + 1);
+        const uint32_t secondChild = buildRecursive(_triBounds, _tris, mid, _last, _depth + 1);
+
+        Node& node = m_nodes[nodeIndex];
+        node.m_bounds  = bounds;
+        node.m_offset  = secondChild;
+        node.m_numTris = 0;
+        node.m_axis    = axis;
+        return nodeIndex;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    //ScenePicker
+    //////////////////////////////////////////////////////////////////////////
+
+    // Objects that are drawn with an object id: meshes and editor sprites
+    static bool IsPickable(WrappedEntity* _pEnt)
+    {
+        return _pEnt->HasComponent<MeshComponent>() ||
+               (_pEnt->HasComponent<IndexedMeshComponent>() && _pEnt->GetObjectFlags().m_field.m_visible) ||
+               (_pEnt->HasComponent<EditorSpriteComponent>() && _pEnt->HasComponent<Position3fComponent>());
+    }
+
+    // Indexed triangles built by a modifier stack, nullptr for other objects
+    static const GeometryBase* GetEditorGeometry(WrappedEntity* _pEnt)
+    {
+        auto geoComp = _pEnt->GetComponent<EditorGeometricComponent>();
+        if (!geoComp || !geoComp->m_pModStack)
+            return nullptr;
+        return geoComp->m_pModStack->GetGeometry();
+    }
+
+    // Sprites face the camera, their quad is rebuilt for the camera that picks
+    static bool GetSpriteQuad(WrappedEntity* _pEnt, const HWCamera* _pCamera, Vector3f _quad[4])
+    {
+        auto spriteComp = _pEnt->GetComponent<EditorSpriteComponent>();
+        return CreateViewportAllignedQuad(_pCamera, _pEnt->GetPosition(), spriteComp->m_scale, _quad);
+    }
+
+    // Shortens _ray.m_maxT_ if _pEnt_ is hit before it
+    static bool IntersectObject(WrappedEntity* _pEnt, const HWCamera* _pCamera, const Ray& _ray)
+    {
+        if (!IsPickable(_pEnt))
+            return false;
+
+        if (_pEnt->HasComponent<EditorSpriteComponent>()) {
+            Vector3f quad[4];
+            if (!GetSpriteQuad(_pEnt, _pCamera, quad))
+                return false;
+            //triangle strip order
+            const bool hitA = IntersectTriangle(_ray, quad[0], quad[1], quad[2]);
+            const bool hitB = IntersectTriangle(_ray, quad[1], quad[3], quad[2]);
+            return hitA || hitB;
+        }
+
+        // Object space ray, an affine transform keeps the ray parameter
+        const Matrix4x4 toLocal = Inverse4x4(_pEnt->GetWorldTransform());
+        const Ray localRay(ToVector3(toLocal * Vector4f(_ray.m_origin, 1.0f)),
+                           ToVector3(toLocal * Vector4f(_ray.m_dir, 0.0f)), _ray.m_maxT);
+
+        bool hit = false;
+        auto meshComp = _pEnt->GetComponent<IndexedMeshComponent>();
+        if (meshComp && meshComp->m_pPickMesh) {
+            hit = meshComp->m_pPickMesh->Intersect(localRay);
+        }
+        else if (auto pGeometry = GetEditorGeometry(_pEnt)) {
+            const Vector3f* verts   = pGeometry->GetVertices();
+            const uint32_t* indices = pGeometry->GetIndices();
+            for (uint32_t i = 0; i + 2 < pGeometry->GetIndicesCount(); i += 3)
+                hit |= IntersectTriangle(localRay, verts[indices[i]], verts[indices[i + 1]], verts[indices[i + 2]]);
+        }
+        else {
+            //no triangles on the CPU, pick the bounds
+            float t0, t1;
+            hit = _pEnt->GetBoundingBox().intersectP(localRay, &t0, &t1) && t0 > 0.0f;
+            if (hit)
+                localRay.m_maxT = t0;
+        }
+
+        if (hit)
+            _ray.m_maxT = localRay.m_maxT;
+        return hit;
+    }
+
+    // True if geometry of _pEnt_ is not outside the frustum of _view_ and _proj_
+    static bool OverlapsObject(WrappedEntity* _pEnt, const HWCamera* _pCamera, const FrustumCuller& _worldCuller,
+                               const Matrix4x4& _view, const Matrix4x4& _proj)
+    {
+        if (!IsPickable(_pEnt))
+            return false;
+
+        if (_pEnt->HasComponent<EditorSpriteComponent>()) {
+            Vector3f quad[4];
+            return GetSpriteQuad(_pEnt, _pCamera, quad) && _worldCuller.IsVisible(Union(BBox3f(), quad, 4));
+        }
+
+        // Planes of the frustum in object space
+        const FrustumCuller localCuller(Frustum(_view * _pEnt->GetWorldTransform(), _proj));
+        auto meshComp = _pEnt->GetComponent<IndexedMeshComponent>();
+        if (meshComp && meshComp->m_pPickMesh)
+            return meshComp->m_pPickMesh->Overlaps(localCuller);
+
+        if (auto pGeometry = GetEditorGeometry(_pEnt)) {
+            const Vector3f* verts   = pGeometry->GetVertices();
+            const uint32_t* indices = pGeometry->GetIndices();
+            for (uint32_t i = 0; i + 2 < pGeometry->GetIndicesCount(); i += 3) {
+                const Vector3f tri[3] = { verts[indices[i]], verts[indices[i + 1]], verts[indices[i + 2]] };
+                if (localCuller.IsVisible(Union(BBox3f(), tri, 3)))
+                    return true;
+            }
+            return false;
+        }
+        return localCuller.IsVisible(_pEnt->GetBoundingBox());
+    }
+
+    ScenePicker::ScenePicker(Context* _pContext)
+        : m_pContext(_pContext)
+    {
+
+    }
+
+    PickResult ScenePicker::Pick(const HWCamera* _pCamera, const Vector2i& _xy) const
+    {
+        // From the near to the far plane, t runs from 0 to 1
+        const Vector3f nearPos = _pCamera->ScreenToWorld((float)_xy.x, (float)_xy.y, 0.0f);
+        const Vector3f farPos  = _pCamera->ScreenToWorld((float)_xy.x, (float)_xy.y, 1.0f);
+        const Ray ray(nearPos, farPos - nearPos, 1.0f);
+
+        PickResult result;
+        auto TestObject = [&](void* _pUserData) {
+            auto pEnt = static_cast<WrappedEntity*>(_pUserData);
+            if (IntersectObject(pEnt, _pCamera, ray))
+                result.m_pEntity = pEnt;
+        };
+        m_pContext->GetSceneManager().GetSpatialTree().Query(ray, TestObject);
+        for (auto pEnt : getUnbounded())
+            TestObject(pEnt);
+
+        if (result.m_pEntity)
+            result.m_worldPos = ray.scale(ray.m_maxT);
+        return result;
+    }
+
+    EntityVector ScenePicker::PickRect(const HWCamera* _pCamera, const Vector2i& _min, const Vector2i& _max) const
+    {
+        // Narrow the camera's projection to the rectangle, window y points up
+        const Vector4f  viewport(0.f, 0.f, (float)_pCamera->GetWidth(), (float)_pCamera->GetHeight());
+        const Vector2f  center = Vector2f(_min + _max) * 0.5f;
+        const Vector2f  size   = Vector2f(_max - _min);
+        const Matrix4x4 proj   = PickMatrix4x4(Vector2f(center.x, viewport.w - center.y), size, viewport) * _pCamera->GetProj();
+        const Matrix4x4& view  = _pCamera->GetWorldToView();
+        const FrustumCuller culler(Frustum(view, proj));
+
+        EntityVector result;
+        auto TestObject = [&](void* _pUserData) {
+            auto pEnt = static_cast<WrappedEntity*>(_pUserData);
+            if (OverlapsObject(pEnt, _pCamera, culler, view, proj))
+                result.push_back(pEnt);
+        };
+        m_pContext->GetSceneManager().GetSpatialTree().Query(culler, TestObject);
+        for (auto pEnt : getUnbounded())
+            TestObject(pEnt);
+        return result;
+    }
+
+    const EntityVector& ScenePicker::getUnbounded() const
+    {
+        auto& scene = m_pContext->GetSceneManager();
+        if (m_unboundedRevision != scene.GetRevision()) {
+            m_unbounded = scene.GetObjects([&](WrappedEntity* _pEnt) {
+                return IsPickable(_pEnt) && scene.GetSpatialProxy(_pEnt) == DynamicAABBTree::NullNode;
+            });
+            m_unboundedRevision = scene.GetRevision();
+        }
+        return m_unbounded;
+    }
+}
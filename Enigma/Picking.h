@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include "FrontEndDef.h"
+#include "BBox.h"
+#include "Ray.h"
+#include "Frustum.h"
+
+namespace RayTrace
+{
+    /*
+        @brief: Object space triangles of a mesh kept on the CPU for picking. The hierarchy is a
+                lightweight BVHAccel: SAH buckets, at most 4 triangles per leaf and nodes in depth
+                first order. It is built by the first query, meshes that are never picked only cost
+                the copy of their positions and indices
+    */
+    class TriangleBVH
+    {
+    public:
+        // _pIndices_ may be nullptr for non indexed triangle lists
+        TriangleBVH(const Vector3f* _pVerts, uint32_t _numVerts, const uint32_t* _pIndices, uint32_t _numIndices);
+
+        // Closest triangle hit before _ray.m_maxT_, which is shortened to the hit
+        bool            Intersect(const Ray& _ray) const;
+        // True if the bounds of a triangle are not outside _culler_
+        bool            Overlaps(const FrustumCuller& _culler) const;
+
+        const BBox3f&   GetBounds() const { return m_bounds; }
+        uint32_t        GetTriangleCount() const { return (uint32_t)m_indices.size() / 3; }
+
+    private:
+        struct Node
+        {
+            BBox3f   m_bounds;
+            uint32_t m_offset  = 0; //first triangle for leaves, second child for interior nodes
+            uint32_t m_numTris = 0; //0 for interior nodes
+            uint32_t m_axis    = 0; //split axis of interior nodes
+        };
+
+        void            build() const;
+        uint32_t        buildRecursive(const std::vector<BBox3f>& _triBounds, std::vector<uint32_t>& _tris,
+                                       uint32_t _first, uint32_t _last, uint32_t _depth) const;
+        BBox3f          triangleBounds(uint32_t _tri) const;
+
+        std::vector<Vector3f>           m_verts;
+        mutable std::vector<uint32_t>   m_indices; //3 per triangle, reordered by build()
+        mutable std::vector<Node>       m_nodes;   //empty until the first query
+        BBox3f                          m_bounds;
+    };
+
+    struct PickResult
+    {
+        WrappedEntity*  m_pEntity  = nullptr;
+        Vector3f        m_worldPos = Vector3f(InfinityF32);
+    };
+
+    /*
+        @brief: Answers pick and marquee queries on demand. Candidates come from the scene's spatial
+                tree, objects that are not in the tree (sprites, editor geometry) are tested one by one
+    */
+    class ScenePicker
+    {
+    public:
+        ScenePicker(Context* _pContext);
+
+        // Closest object under the viewport pixel _xy_
+        PickResult      Pick(const HWCamera* _pCamera, const Vector2i& _xy) const;
+        // Objects with geometry inside the viewport rectangle [_min_, _max_), occluded objects included
+        EntityVector    PickRect(const HWCamera* _pCamera, const Vector2i& _min, const Vector2i& _max) const;
+
+    private:
+        const EntityVector& getUnbounded() const;
+
+        Context*                m_pContext = nullptr;
+        mutable EntityVector    m_unbounded;                //pickable objects without a spatial tree proxy
+        mutable uint64_t        m_unboundedRevision = 0;    //scene revision m_unbounded was gathered at
+    };
+}
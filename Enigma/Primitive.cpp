@@ -30,6 +30,24 @@ namespace RayTrace
 
     }
 
+    uint32_t Primitive::intersect8(const Ray* rays, SurfaceInteraction* isects, uint32_t activeMask) const
+    {
+        uint32_t hitMask = 0;
+        for (int i = 0; i < RayPacketSize; ++i)
+            if ((activeMask & (1u << i)) && intersect(rays[i], &isects[i]))
+                hitMask |= 1u << i;
+        return hitMask;
+    }
+
+    uint32_t Primitive::intersectP8(const Ray* rays, uint32_t activeMask) const
+    {
+        uint32_t hitMask = 0;
+        for (int i = 0; i < RayPacketSize; ++i)
+            if ((activeMask & (1u << i)) && intersectP(rays[i]))
+                hitMask |= 1u << i;
+        return hitMask;
+    }
+
    /* BSDF* Primitive::getBSDF(const DifferentialGeometry& _dg, const Transform& _objectToWorld, MemoryArena& _ma) const
 	{
 		throw std::exception("Not Implemented");
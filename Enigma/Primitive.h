@@ -12,6 +12,8 @@ namespace RayTrace
 {
 	
 #pragma region Primitive
+    static constexpr int RayPacketSize = 8;
+
 	class Primitive: std::enable_shared_from_this<Primitive> {
 	public:
 		Primitive();
@@ -25,6 +27,11 @@ namespace RayTrace
         virtual const Material*  getMaterial() const = 0;
         virtual void						computeScatteringFunctions(SurfaceInteraction* isect,MemoryArena& arena, eTransportMode mode, bool allowMultipleLobes) const = 0;
 
+        // Packet queries, bit i of activeMask selects rays[i]. Both return the mask
+        // of rays that hit something, the default traces each active ray on its own.
+        virtual uint32_t         intersect8(const Ray* rays, SurfaceInteraction* isects, uint32_t activeMask) const;
+        virtual uint32_t         intersectP8(const Ray* rays, uint32_t activeMask) const;
+
 
 		// Primitive Public Data
 		const uint32_t m_primitiveId;
@@ -506,6 +506,7 @@ namespace RayTrace
                                 }
                                 assert(texPtr);
                                 pMat->m_textures[i] = texPtr;
+                                GetContext().GetSceneManager().MarkModified(); //alpha masking may have changed
 
                                 AddLogMessage(&GetContext(), (const char*)payLoad->Data, eLogLevel::LOG_LEVEL_INFO);
 
@@ -23,6 +23,7 @@ namespace RayTrace
     {
         m_currentPixel = p;
         m_currentPixelSampleIndex = 0;
+        m_samplesStarted = 1;
         // Reset array offsets for next pixel sample
         m_array1DOffset = m_array2DOffset = 0;
     }
@@ -71,6 +72,7 @@ namespace RayTrace
     bool Sampler::StartNextSample()
     {
         m_array1DOffset = m_array2DOffset = 0;
+        m_samplesStarted = std::max(m_samplesStarted, m_currentPixelSampleIndex + 2);
         return ++m_currentPixelSampleIndex < m_samplesPerPixel;
     }
 
@@ -79,9 +81,26 @@ namespace RayTrace
         // Reset array offsets for next pixel sample
         m_array1DOffset = m_array2DOffset = 0;
         m_currentPixelSampleIndex = sampleNum;
+        if (sampleNum >= m_samplesStarted) {
+            m_samplesStarted = sampleNum + 1;
+            startSampleStream(sampleNum);
+        }
         return m_currentPixelSampleIndex < m_samplesPerPixel;
     }
 
+    // Seed of the RNG stream of a pixel's samples from _sampleNum_ on, _seed_ is the one of Clone()
+    static uint32_t SampleStreamSeed(uint32_t seed, const Vector2i& p, int64_t sampleNum)
+    {
+        uint64_t v = ((uint64_t)(uint32_t)p.x << 32 | (uint32_t)p.y) ^ ((uint64_t)seed * 0x9E3779B97F4A7C15ull);
+        v ^= (uint64_t)sampleNum * 0xC2B2AE3D27D4EB4Full;
+        v ^= v >> 31;
+        v *= 0x7fb5d329728ea185ull;
+        v ^= v >> 27;
+        v *= 0x81dadef4bc2dd44dull;
+        v ^= v >> 33;
+        return (uint32_t)v;
+    }
+
 
     //////////////////////////////////////////////////////////////////////////
     //PixelSampler
@@ -116,6 +135,11 @@ namespace RayTrace
         return Sampler::SetSampleNumber(_num);
     }
 
+    void PixelSampler::startSampleStream(int64_t sampleNum)
+    {
+        m_rng.setSeed(SampleStreamSeed(m_seed, m_currentPixel, sampleNum));
+    }
+
     float PixelSampler::Get1D()
     {
         if (m_current1DDimension < m_samples1D.size())
@@ -294,6 +318,7 @@ namespace RayTrace
     std::unique_ptr<Sampler> StratifiedSampler::Clone(int seed) const
     {
         auto s = std::make_unique<StratifiedSampler>(*this);
+        s->m_seed = seed;
         s->m_rng.setSeed(seed);
         return s;
     }
@@ -398,6 +423,11 @@ namespace RayTrace
         Sampler::StartPixel(p);
     }
 
+    void RandomSampler::startSampleStream(int64_t sampleNum)
+    {
+        m_rng.setSeed(SampleStreamSeed(m_seed, m_currentPixel, sampleNum));
+    }
+
     float RandomSampler::Get1D()
     {
         return m_rng.uniformFloat();
@@ -411,6 +441,7 @@ namespace RayTrace
     std::unique_ptr<Sampler> RandomSampler::Clone(int seed) const
     {
         auto s = std::make_unique<RandomSampler>(*this);
+        s->m_seed = seed;
         s->m_rng.setSeed(seed);
         return s;
     }
@@ -441,6 +472,7 @@ namespace RayTrace
     std::unique_ptr<Sampler> ZeroTwoSequenceSampler::Clone(int seed) const
     {
         auto s = std::make_unique<ZeroTwoSequenceSampler>(*this);
+        s->m_seed = seed;
         s->m_rng.setSeed(seed);
         return s;
     }
@@ -488,6 +520,7 @@ namespace RayTrace
     std::unique_ptr<Sampler> MaxMinDistSampler::Clone(int seed) const
     {
         auto s = std::make_unique < MaxMinDistSampler>(*this);
+        s->m_seed = seed;
         s->m_rng.setSeed(seed);
         return s;
 
@@ -36,9 +36,15 @@ namespace RayTrace
         const int64_t m_samplesPerPixel;
 
     protected:
+        // Called by SetSampleNumber() for a sample past every one started since StartPixel(),
+        // samplers drawing from an RNG reseed it there so a later pass never repeats its values
+        virtual void     startSampleStream(int64_t sampleNum) { UNUSED(sampleNum) }
+
         // Sampler Protected Data
         Vector2i   m_currentPixel;
         int64_t          m_currentPixelSampleIndex;
+        int64_t          m_samplesStarted = 0;
+        uint32_t         m_seed = 0;         // of Clone()
         std::vector<int> m_samples1DArraySizes, 
                          m_samples2DArraySizes;
         std::vector<std::vector<float>>          m_sampleArray1D;
@@ -66,6 +72,8 @@ namespace RayTrace
         int                                         m_current1DDimension = 0, 
                                                     m_current2DDimension = 0;
         RNG                                         m_rng;
+
+        void startSampleStream(int64_t sampleNum) override;
     };
 
     class GlobalSampler : public Sampler {
@@ -167,6 +175,9 @@ namespace RayTrace
         Vector2f                     Get2D() override;
         std::unique_ptr<Sampler>     Clone(int seed) const override;
 
+    protected:
+        void                         startSampleStream(int64_t sampleNum) override;
+
     private:
         RNG m_rng;
     };
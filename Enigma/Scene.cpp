@@ -3,6 +3,7 @@
 #include "Lights.h"
 #include "Primitive.h"
 #include "BVH.h"
+#include "InstanceAccel.h"
 #include "Scene.h"
 
 
@@ -30,6 +31,24 @@ namespace RayTrace
     }
 
 
+    void Scene::Refit(const std::vector<const Primitive*>& _changed)
+    {
+        if (BVHAccel* bvh = dynamic_cast<BVHAccel*>(m_accel.get()))
+            bvh->Refit(_changed);
+        else if (InstanceAccel* instances = dynamic_cast<InstanceAccel*>(m_accel.get()))
+            instances->Refit(_changed);
+        m_bounds = m_accel->worldBound();
+        // Infinite and distant lights depend on the scene bounds
+        for (const auto& light : m_lights)
+            light->Preprocess(*this);
+    }
+
+    void Scene::SetInstanceTransform(int _instance, const AnimatedTransform& _instanceToWorld)
+    {
+        if (InstanceAccel* instances = dynamic_cast<InstanceAccel*>(m_accel.get()))
+            instances->SetInstanceTransform(_instance, _instanceToWorld);
+    }
+
     bool Scene::intersect(const Ray& _ray, SurfaceInteraction* _isect) const
     {
         assert(LengthSqr(_ray.m_dir ) > 0.f);
@@ -43,6 +62,16 @@ namespace RayTrace
         return  m_accel->intersectP(_ray);       
     }
 
+    uint32_t Scene::intersect8(const Ray* _rays, SurfaceInteraction* _isects, uint32_t _activeMask) const
+    {
+        return m_accel->intersect8(_rays, _isects, _activeMask);
+    }
+
+    uint32_t Scene::intersectP8(const Ray* _rays, uint32_t _activeMask) const
+    {
+        return m_accel->intersectP8(_rays, _activeMask);
+    }
+
     bool Scene::intersectTr(Ray _ray, Sampler& sampler, SurfaceInteraction* _isect, Spectrum* _transmittance) const
     {
         *_transmittance = Spectrum(1.f);
@@ -20,6 +20,15 @@ namespace RayTrace
         bool						intersect(const Ray& ray, SurfaceInteraction* isect) const;
         bool						intersectP(const Ray& ray) const;
         bool						intersectTr(Ray ray, Sampler& sampler, SurfaceInteraction* isect, Spectrum* transmittance) const;
+        // Packets of RayPacketSize rays, return the mask of active rays that hit
+        uint32_t					intersect8(const Ray* rays, SurfaceInteraction* isects, uint32_t activeMask) const;
+        uint32_t					intersectP8(const Ray* rays, uint32_t activeMask) const;
+
+		// Updates the acceleration structure after _changed_ primitives moved, e.g. for
+		// editor driven re-renders, instead of building a new Scene
+		void						Refit(const std::vector<const Primitive*>& changed);
+		// Moves an instance of an InstanceAccel scene, applied by the next Refit()
+		void						SetInstanceTransform(int instance, const AnimatedTransform& instanceToWorld);
 
 		const BBox3f&			worldBound() const;
 		int							getNumLights() const;
@@ -0,0 +1,237 @@
+#include "Defines.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#elif defined(IS_WINDOWS)
+#define  NOMINMAX
+#include <windows.h>  // Windows file mapping API
+#endif
+#include "Error.h"
+#include "SceneCache.h"
+
+namespace RayTrace
+{
+    static std::string sceneCacheDirectory;
+
+    static constexpr uint32_t SceneCacheMagic   = 0x48435345;   // "ESCH"
+    static constexpr uint32_t SceneCacheVersion = 1;
+    static constexpr int      MaxSceneCacheChunks = 8;
+    static constexpr size_t   SceneCacheAlignment = 64;
+
+    struct SceneCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t numChunks;
+        uint32_t pad;
+        uint64_t chunkOffset[MaxSceneCacheChunks];
+        uint64_t chunkSize[MaxSceneCacheChunks];
+    };
+
+    void SetSceneCacheDirectory(const std::string& dir)
+    {
+        sceneCacheDirectory = dir;
+    }
+
+    const std::string& GetSceneCacheDirectory()
+    {
+        return sceneCacheDirectory;
+    }
+
+    uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+    {
+        const uint64_t m = 0xc6a4a7935bd1e995ull;
+        const int r = 47;
+        uint64_t h = seed ^ (size * m);
+
+        const uint8_t* bytes = (const uint8_t*)data;
+        const size_t nBlocks = size / 8;
+        for (size_t i = 0; i < nBlocks; ++i) {
+            uint64_t k;
+            memcpy(&k, bytes + 8 * i, sizeof(k));
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+
+        const uint8_t* tail = bytes + 8 * nBlocks;
+        switch (size & 7) {
+        case 7: h ^= uint64_t(tail[6]) << 48;
+        case 6: h ^= uint64_t(tail[5]) << 40;
+        case 5: h ^= uint64_t(tail[4]) << 32;
+        case 4: h ^= uint64_t(tail[3]) << 24;
+        case 3: h ^= uint64_t(tail[2]) << 16;
+        case 2: h ^= uint64_t(tail[1]) << 8;
+        case 1: h ^= uint64_t(tail[0]);
+            h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // MappedFile Implementation
+    //////////////////////////////////////////////////////////////////////////
+    std::unique_ptr<MappedFile> MappedFile::Open(const std::string& filename)
+    {
+        std::unique_ptr<MappedFile> file(new MappedFile());
+#ifdef PBRT_HAVE_MMAP
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1)
+            return nullptr;
+        struct stat stat;
+        if (fstat(fd, &stat) != 0 || stat.st_size == 0) {
+            close(fd);
+            return nullptr;
+        }
+        void* ptr = mmap(0, stat.st_size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+        close(fd);
+        if (ptr == MAP_FAILED)
+            return nullptr;
+        file->m_data = (const uint8_t*)ptr;
+        file->m_size = stat.st_size;
+#elif defined(IS_WINDOWS)
+        HANDLE fileHandle =
+            CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return nullptr;
+        LARGE_INTEGER liLen;
+        if (!GetFileSizeEx(fileHandle, &liLen) || liLen.QuadPart == 0) {
+            CloseHandle(fileHandle);
+            return nullptr;
+        }
+        HANDLE mapping = CreateFileMapping(fileHandle, 0, PAGE_READONLY, 0, 0, 0);
+        CloseHandle(fileHandle);
+        if (mapping == 0)
+            return nullptr;
+        LPVOID ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (ptr == nullptr)
+            return nullptr;
+        file->m_data = (const uint8_t*)ptr;
+        file->m_size = liLen.QuadPart;
+#else
+        std::ifstream in(filename, std::ios::binary | std::ios::ate);
+        if (!in)
+            return nullptr;
+        file->m_contents.resize((size_t)in.tellg());
+        in.seekg(0);
+        if (file->m_contents.empty() || !in.read((char*)file->m_contents.data(), file->m_contents.size()))
+            return nullptr;
+        file->m_data = file->m_contents.data();
+        file->m_size = file->m_contents.size();
+#endif
+        return file;
+    }
+
+    MappedFile::~MappedFile()
+    {
+#ifdef PBRT_HAVE_MMAP
+        if (m_data)
+            munmap((void*)m_data, m_size);
+#elif defined(IS_WINDOWS)
+        if (m_data)
+            UnmapViewOfFile(m_data);
+#endif
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // Cache files
+    //////////////////////////////////////////////////////////////////////////
+    static std::string SceneCachePath(const char* kind, uint64_t key)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "%s-%016llx.cache", kind, (unsigned long long)key);
+        return (std::filesystem::path(sceneCacheDirectory) / name).string();
+    }
+
+    bool WriteSceneCache(const char* kind, uint64_t key, const std::vector<SceneCacheChunk>& chunks)
+    {
+        if (sceneCacheDirectory.empty() || chunks.size() > MaxSceneCacheChunks)
+            return false;
+
+        SceneCacheHeader header = {};
+        header.magic = SceneCacheMagic;
+        header.version = SceneCacheVersion;
+        header.key = key;
+        header.numChunks = (uint32_t)chunks.size();
+        uint64_t offset = sizeof(SceneCacheHeader);
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            offset = (offset + SceneCacheAlignment - 1) & ~(uint64_t)(SceneCacheAlignment - 1);
+            header.chunkOffset[i] = offset;
+            header.chunkSize[i] = chunks[i].size;
+            offset += chunks[i].size;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(sceneCacheDirectory, ec);
+        const std::string path = SceneCachePath(kind, key);
+        static std::atomic<uint32_t> tempCounter(0);
+        const std::string tempPath = path + "." +
+            std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." +
+            std::to_string(tempCounter++) + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary);
+            if (!out) {
+                Warning("Unable to write scene cache file \"%s\"", tempPath.c_str());
+                return false;
+            }
+            out.write((const char*)&header, sizeof(header));
+            const char zeros[SceneCacheAlignment] = {};
+            uint64_t written = sizeof(header);
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                out.write(zeros, header.chunkOffset[i] - written);
+                out.write((const char*)chunks[i].data, chunks[i].size);
+                written = header.chunkOffset[i] + chunks[i].size;
+            }
+            if (!out) {
+                out.close();
+                std::filesystem::remove(tempPath, ec);
+                return false;
+            }
+        }
+        // Another process may have written the same file meanwhile, either copy is valid
+        std::filesystem::rename(tempPath, path, ec);
+        if (ec)
+            std::filesystem::remove(tempPath, ec);
+        return true;
+    }
+
+    std::unique_ptr<MappedFile> ReadSceneCache(const char* kind, uint64_t key, std::vector<SceneCacheChunk>* chunks)
+    {
+        if (sceneCacheDirectory.empty())
+            return nullptr;
+        std::unique_ptr<MappedFile> file = MappedFile::Open(SceneCachePath(kind, key));
+        if (!file || file->size() < sizeof(SceneCacheHeader))
+            return nullptr;
+
+        const SceneCacheHeader* header = (const SceneCacheHeader*)file->data();
+        if (header->magic != SceneCacheMagic || header->version != SceneCacheVersion ||
+            header->key != key || header->numChunks > MaxSceneCacheChunks)
+            return nullptr;
+        chunks->resize(header->numChunks);
+        for (uint32_t i = 0; i < header->numChunks; ++i) {
+            if (header->chunkOffset[i] + header->chunkSize[i] > file->size())
+                return nullptr;
+            (*chunks)[i] = { file->data() + header->chunkOffset[i], (size_t)header->chunkSize[i] };
+        }
+        return file;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "Defines.h"
+
+namespace RayTrace
+{
+    // SceneCache Declarations
+    // Binary files holding build results (flattened BVHs, parsed PLY meshes) keyed by a hash
+    // of their inputs, so an unchanged scene is mapped from disk instead of rebuilt.
+    // Caching is disabled while the cache directory is empty.
+    void                SetSceneCacheDirectory(const std::string& dir);
+    const std::string&  GetSceneCacheDirectory();
+
+    // MurmurHash64A
+    uint64_t            HashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+    // Read only view of a whole file, memory mapped where the platform supports it
+    class MappedFile
+    {
+    public:
+        static std::unique_ptr<MappedFile> Open(const std::string& filename);
+        ~MappedFile();
+
+        const uint8_t*      data() const { return m_data; }
+        size_t              size() const { return m_size; }
+
+    private:
+        MappedFile() = default;
+
+        const uint8_t*          m_data = nullptr;
+        size_t                  m_size = 0;
+        std::vector<uint8_t>    m_contents;     // when the file couldn't be mapped
+    };
+
+    struct SceneCacheChunk
+    {
+        const void*         data;
+        size_t              size;
+    };
+
+    // Writes _chunks_ to the cache file of _kind_ and _key_. The file is written under a
+    // temporary name and renamed, so concurrent renders never read a partial file.
+    bool                WriteSceneCache(const char* kind, uint64_t key, const std::vector<SceneCacheChunk>& chunks);
+    // Maps the cache file of _kind_ and _key_ and returns its chunks in the order they were
+    // written, pointing into the mapping. Returns nullptr if there is no valid file.
+    std::unique_ptr<MappedFile> ReadSceneCache(const char* kind, uint64_t key, std::vector<SceneCacheChunk>* chunks);
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "SceneManager.h"
 #include "WrappedEntity.h"
 #include "HWMesh.h"
@@ -12,19 +13,40 @@ namespace RayTrace
     } 
    
 
-    FilteredSceneItemCollector::FilteredSceneItemCollector(EntityFilter _pFilter /*= nullptr*/, bool _fetchDrawFunc /*= true*/) : m_pEntFilter(_pFilter)
+    FilteredSceneItemCollector::FilteredSceneItemCollector(EntityFilter _pFilter /*= nullptr*/, bool _fetchDrawFunc /*= true*/,
+        std::vector<SceneGather> _gathers /*= {}*/) : m_pEntFilter(_pFilter)
         , m_fetchDrawFunc(_fetchDrawFunc)
+        , m_gathers(std::move(_gathers))
     {
 
     }
 
-    std::vector<SceneItem> FilteredSceneItemCollector::GetItems(SceneManager* _pScene) const
+    const SceneItemVector& FilteredSceneItemCollector::GetItems(SceneManager* _pScene) const
     {
-        auto* pRenderer = &_pScene->GetContext().GetRenderer();
-        const auto entities = _pScene->GetObjects(m_pEntFilter);
+        if (m_pScene == _pScene && m_sceneRevision == _pScene->GetRevision())
+            return m_items;
+        m_pScene        = _pScene;
+        m_sceneRevision = _pScene->GetRevision();
+        ++m_revision;
 
-        std::vector<SceneItem> retVal;
-        retVal.reserve(entities.size());
+        std::vector<WrappedEntity*> entities;
+        if (m_gathers.empty())
+            entities = _pScene->GetObjects(m_pEntFilter);
+        else {
+            for (const auto& gather : m_gathers)
+                gather(_pScene, entities);
+            // An object can own the components of several gathers, keep it once and in creation order
+            std::sort(entities.begin(), entities.end(), [](const WrappedEntity* _a, const WrappedEntity* _b) {
+                return _a->GetEntity().GetId() < _b->GetEntity().GetId();
+            });
+            entities.erase(std::unique(entities.begin(), entities.end()), entities.end());
+            if (m_pEntFilter)
+                entities.erase(std::remove_if(entities.begin(), entities.end(),
+                    [this](WrappedEntity* _pEnt) { return !m_pEntFilter(_pEnt); }), entities.end());
+        }
+
+        m_items.clear();
+        m_items.reserve(entities.size());
         for (auto ent : entities) {
             SceneItem item = { ent };
             if (m_fetchDrawFunc) { 
@@ -35,9 +57,14 @@ namespace RayTrace
                 }
                 
             }
-            retVal.push_back(item);            
+            m_items.push_back(item);            
         }
-        return retVal;
+        return m_items;
+    }
+
+    uint64_t FilteredSceneItemCollector::GetRevision() const
+    {
+        return m_revision;
     }
 
    
@@ -1,16 +1,41 @@
 #pragma once
 #include "FrontEndDef.h"
 #include "SceneItem.h"
+#include "SceneManager.h"
+#include "WrappedEntity.h"
 
 namespace RayTrace
 {
-    
-    
+    // Appends the objects of _pScene_ owning all of _Ts_. Walks a component view, so only the
+    // entities with those components are visited instead of every object in the scene
+    template<typename... Ts>
+    void CollectObjectsWith(SceneManager* _pScene, std::vector<WrappedEntity*>& _objects)
+    {
+        _pScene->GetContext().GetComponentSystem().View<Ts...>().Each([&](Entity _ent, Ts&...) {
+            if (auto pObj = _pScene->GetEntityObject(_ent))
+                _objects.push_back(pObj);
+        });
+    }
+
+    // Candidate objects a collector filters
+    using SceneGather = std::function<void(SceneManager* _pScene, std::vector<WrappedEntity*>& _objects)>;
+
+    template<typename... Ts>
+    SceneGather GatherObjectsWith()
+    {
+        return [](SceneManager* _pScene, std::vector<WrappedEntity*>& _objects) {
+            CollectObjectsWith<Ts...>(_pScene, _objects);
+        };
+    }
+
     class SceneItemCollector
     {
     public:
         virtual ~SceneItemCollector();
-        virtual std::vector<SceneItem> GetItems( SceneManager* _pScene ) const = 0;
+        // Items of _pScene_ for this collector, the reference stays valid until the next call
+        virtual const SceneItemVector& GetItems( SceneManager* _pScene ) const = 0;
+        // Changes whenever GetItems() returned a different list, passes re-bin their items on change
+        virtual uint64_t               GetRevision() const = 0;
     };
 
    
@@ -19,8 +44,11 @@ namespace RayTrace
     class FilteredSceneItemCollector : public SceneItemCollector 
     {
     public:
-        FilteredSceneItemCollector(EntityFilter _pFilter = nullptr, bool _fetchDrawFunc = true);
-        std::vector<SceneItem> GetItems(SceneManager* _pScene) const override;
+        // Without _gathers_ every scene object is filtered, otherwise only the objects they collect
+        FilteredSceneItemCollector(EntityFilter _pFilter = nullptr, bool _fetchDrawFunc = true,
+            std::vector<SceneGather> _gathers = {});
+        const SceneItemVector& GetItems(SceneManager* _pScene) const override;
+        uint64_t               GetRevision() const override;
 
 
 
@@ -28,5 +56,12 @@ namespace RayTrace
 
         EntityFilter m_pEntFilter = nullptr;
         bool         m_fetchDrawFunc = true;      
+        std::vector<SceneGather> m_gathers;
+
+        //items are only collected again once the scene revision changes
+        mutable SceneItemVector m_items;
+        mutable SceneManager*   m_pScene        = nullptr;
+        mutable uint64_t        m_sceneRevision = 0;
+        mutable uint64_t        m_revision      = 0;
     };
 }
\ No newline at end of file
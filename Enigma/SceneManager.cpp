@@ -8,6 +8,8 @@
 #include "InputHandler.h"
 #include "Controller.h"
 #include "SceneManager.h"
+#include "Api.h"
+#include "Scene.h"
 
 namespace RayTrace
 {
@@ -65,6 +67,12 @@ namespace RayTrace
         m_pActiveView = nullptr;
         m_objectMap.clear();
         m_objectVector.clear();
+        m_spatialTree.Clear();
+        m_proxies.clear();
+        m_entityObjects.clear();
+        m_visibleStamp.clear();
+        m_cullStamp = 0;
+        MarkModified();
         return true;
     }
 
@@ -86,6 +94,12 @@ namespace RayTrace
         return m_objectVector[objIdx].get();
     }
 
+    WrappedEntity* SceneManager::GetEntityObject(Entity _ent) const
+    {
+        const auto id = _ent.GetId();
+        return id < m_entityObjects.size() ? m_entityObjects[id] : nullptr;
+    }
+
     bool SceneManager::AddObject(const std::string& _name, WrappedEntityUPtr _object)
     {
         if (ContainsObject(_name))
@@ -93,6 +107,12 @@ namespace RayTrace
         const auto objCount = GetObjectCount();        
         m_objectVector.push_back(std::move(_object));
         m_objectMap[_name] = objCount;
+        const auto id = m_objectVector.back()->GetEntity().GetId();
+        if (id >= m_entityObjects.size())
+            m_entityObjects.resize(id + 1, nullptr);
+        m_entityObjects[id] = m_objectVector.back().get();
+        insertProxy(m_objectVector.back().get());
+        MarkModified();
         return true;
     }
 
@@ -114,10 +134,13 @@ namespace RayTrace
         m_objectMap[uuid] = objIdx;
         //move entity
         auto pEntity = std::move(m_objectVector.back());
+        removeProxy(pEntity.get());
+        m_entityObjects[pEntity->GetEntity().GetId()] = nullptr;
         //erase
         m_objectVector.pop_back();
         m_objectMap.erase(_name);
         assert(m_objectVector.size() == m_objectMap.size());
+        MarkModified();
         return pEntity;
     }
 
@@ -159,6 +182,142 @@ namespace RayTrace
     void SceneManager::EndModification()
     {
         m_modEndSize = m_objectVector.size();
+        MarkModified();
+    }
+
+    uint64_t SceneManager::GetRevision() const
+    {
+        return m_revision;
+    }
+
+    void SceneManager::MarkModified()
+    {
+        ++m_revision;
+    }
+
+    //world bounds of objects that can be culled, meshes carry a BBox3fComponent
+    static bool GetCullBounds(const WrappedEntity* _pObj, BBox3f* _pBounds)
+    {
+        const auto bbComp = _pObj->GetComponent<BBox3fComponent>();
+        if (!bbComp)
+            return false;
+        const auto& bounds = bbComp->m_bounds;
+        if (bounds.m_min.x > bounds.m_max.x || bounds.m_min.y > bounds.m_max.y || bounds.m_min.z > bounds.m_max.z)
+            return false;
+        *_pBounds = _pObj->GetWorldBoundingBox();
+        return true;
+    }
+
+    int32_t& SceneManager::proxyOf(const WrappedEntity* _pObj)
+    {
+        const auto id = _pObj->GetEntity().GetId();
+        if (id >= m_proxies.size())
+            m_proxies.resize(id + 1, NotInScene);
+        return m_proxies[id];
+    }
+
+    void SceneManager::insertProxy(WrappedEntity* _pObj)
+    {
+        auto& proxy = proxyOf(_pObj);
+        assert(proxy == NotInScene);
+        BBox3f bounds;
+        proxy = GetCullBounds(_pObj, &bounds) ? m_spatialTree.Insert(bounds, _pObj) : Unbounded;
+    }
+
+    void SceneManager::removeProxy(WrappedEntity* _pObj)
+    {
+        auto& proxy = proxyOf(_pObj);
+        if (proxy >= 0)
+            m_spatialTree.Remove(proxy);
+        proxy = NotInScene;
+    }
+
+    void SceneManager::UpdateBounds(WrappedEntity* _pObj)
+    {
+        auto& proxy = proxyOf(_pObj);
+        if (proxy == NotInScene)
+            return;
+
+        BBox3f bounds;
+        const bool bounded = GetCullBounds(_pObj, &bounds);
+        if (proxy >= 0 && bounded)
+            m_spatialTree.Move(proxy, bounds);
+        else if (proxy >= 0) {
+            m_spatialTree.Remove(proxy);
+            proxy = Unbounded;
+        }
+        else if (bounded)
+            proxy = m_spatialTree.Insert(bounds, _pObj);
+    }
+
+    void SceneManager::SyncRenderScene(const std::vector<WrappedEntity*>& _objects)
+    {
+        Scene* pScene = renderOptions ? renderOptions->m_scene.get() : nullptr;
+        if (!pScene)
+            return;
+
+        std::vector<const Primitive*> changed;
+        bool moved = false;
+        for (auto pObj : _objects) {
+            auto pLink  = pObj->GetComponent<RenderSceneComponent>();
+            auto pTrans = pObj->GetComponent<TransformComponent>();
+            if (!pLink || !pTrans || !pLink->m_objectToWorld)
+                continue;
+            //the shapes and the instance reference these, overwrite them in place
+            *pLink->m_objectToWorld = Transform(pTrans->m_transform);
+            *pLink->m_worldToObject = pLink->m_objectToWorld->inverted();
+            if (pLink->m_instance >= 0)
+                pScene->SetInstanceTransform(pLink->m_instance, AnimatedTransform(
+                    pLink->m_objectToWorld.get(), renderOptions->transformStartTime,
+                    pLink->m_objectToWorld.get(), renderOptions->transformEndTime));
+            changed.insert(changed.end(), pLink->m_primitives.begin(), pLink->m_primitives.end());
+            moved = true;
+        }
+        if (moved)
+            pScene->Refit(changed);
+    }
+
+    void SceneManager::CullObjects(const Frustum* _pFrustum)
+    {
+        if (!_pFrustum) {
+            m_cullStamp = 0;
+            return;
+        }
+        if (++m_cullStamp == 0) { //wrapped around, old stamps could match again
+            std::fill(m_visibleStamp.begin(), m_visibleStamp.end(), 0);
+            m_cullStamp = 1;
+        }
+        if (m_visibleStamp.size() < m_proxies.size())
+            m_visibleStamp.resize(m_proxies.size(), 0);
+
+        const FrustumCuller culler(*_pFrustum);
+        m_spatialTree.Query(culler, [&](void* _pUserData) {
+            const auto pObj = static_cast<const WrappedEntity*>(_pUserData);
+            m_visibleStamp[pObj->GetEntity().GetId()] = m_cullStamp;
+        });
+    }
+
+    bool SceneManager::IsCulled(const WrappedEntity* _pObj) const
+    {
+        if (m_cullStamp == 0)
+            return false;
+        const auto id = _pObj->GetEntity().GetId();
+        if (id >= m_proxies.size() || m_proxies[id] < 0 || id >= m_visibleStamp.size())
+            return false; //added after the last cull pass
+        return m_visibleStamp[id] != m_cullStamp;
+    }
+
+    const DynamicAABBTree& SceneManager::GetSpatialTree() const
+    {
+        return m_spatialTree;
+    }
+
+    int32_t SceneManager::GetSpatialProxy(const WrappedEntity* _pObj) const
+    {
+        const auto id = _pObj->GetEntity().GetId();
+        if (id >= m_proxies.size() || m_proxies[id] < 0)
+            return DynamicAABBTree::NullNode;
+        return m_proxies[id];
     }
 
     BBox3f SceneManager::GetSceneBounds() const
@@ -2,6 +2,7 @@
 #include <unordered_map>
 #include "SystemBase.h"
 #include "Entity.h"
+#include "DynamicAABBTree.h"
 
 namespace RayTrace
 {
@@ -41,6 +42,8 @@ namespace RayTrace
 
         EntityVector                GetEntities(const UUIDVector& _names) const;
         WrappedEntity*              GetObject(const std::string& _name) const;
+        // Object wrapping _ent_, nullptr for entities that are not in this scene
+        WrappedEntity*              GetEntityObject(Entity _ent) const;
 
         bool                        AddObject(const std::string&_name, WrappedEntityUPtr _object);
         
@@ -61,6 +64,24 @@ namespace RayTrace
 
         BBox3f                      GetSceneBounds() const;
 
+        // Bumped whenever objects are added, removed or changed in a way that affects what gets
+        // drawn, render lists built from the scene are rebuilt when it changes
+        uint64_t                    GetRevision() const;
+        void                        MarkModified();
+
+        // Refreshes the world bounds of _pObj_ in the spatial tree, call after its transform changed
+        void                        UpdateBounds(WrappedEntity* _pObj);
+        // Moves the ray traced primitives of _objects_ with a RenderSceneComponent to their
+        // current transform and refits the render scene, call after their transforms changed
+        void                        SyncRenderScene(const std::vector<WrappedEntity*>& _objects);
+        // Objects outside _pFrustum_ are culled until the next call, nothing is culled for nullptr
+        void                        CullObjects(const Frustum* _pFrustum);
+        // Only objects with a BBox3fComponent are ever culled
+        bool                        IsCulled(const WrappedEntity* _pObj) const;
+        const DynamicAABBTree&      GetSpatialTree() const;
+        // DynamicAABBTree::NullNode for objects that are not in the spatial tree
+        int32_t                     GetSpatialProxy(const WrappedEntity* _pObj) const;
+
         SceneView*                  GetActiveSceneView() const;
         void                        SetActiveSceneView(SceneView* _pView);
 
@@ -73,6 +94,20 @@ namespace RayTrace
         uint32_t                            m_modBeginSize = 0;
         uint32_t                            m_modEndSize   = 0;      
         SceneView*                          m_pActiveView = nullptr;
+        uint64_t                            m_revision    = 1;
+
+        static constexpr int32_t NotInScene = -2; //m_proxies entry of objects that are not in this scene
+        static constexpr int32_t Unbounded  = -1; //m_proxies entry of scene objects that are never culled
+
+        void                                insertProxy(WrappedEntity* _pObj);
+        void                                removeProxy(WrappedEntity* _pObj);
+        int32_t&                            proxyOf(const WrappedEntity* _pObj);
+
+        DynamicAABBTree                     m_spatialTree;
+        std::vector<int32_t>                m_proxies;      //by EntityId, spatial tree proxy or NotInScene/Unbounded
+        std::vector<WrappedEntity*>         m_entityObjects;//by EntityId, null for entities not in this scene
+        std::vector<uint32_t>               m_visibleStamp; //by EntityId, cull pass that last found the object visible
+        uint32_t                            m_cullStamp   = 0; //0 while nothing is culled
       
     };
 
@@ -1,7 +1,6 @@
 
 #include "UiHelperFuncs.h"
 #include "ImGuizmo.h" 
-#include <set>
 #include <backends\imgui_impl_sdl.h>
 #include <backends\imgui_impl_opengl3.h>
 #include "SDL_keyboard.h"
@@ -167,28 +166,16 @@ namespace RayTrace
         if (bounds.area() <= 0)
             return false;
 
-        std::set<uint32_t> selectedObjectsSet;
-
-        auto SelectObjectByIdFilter = [&](ObjectBase* _pObject) {
-            for (auto id : selectedObjectsSet) {
-                if (id == _pObject->GetObjectId())
-                    return true;
-            }
-            return false;
-        };
-
-
-        for (int y = bounds.m_min.y; y < bounds.m_max.y; ++y)
-        for (int x = bounds.m_min.x; x < bounds.m_max.x; ++x)
-        {
-            const auto [ID, WORLDPOS] = m_pEditLayer->GetObjectUnderCursor(Vector2i(x, y));
-            if (ID != INVALID_ID) {
-                selectedObjectsSet.insert(ID);
-            }
+        //a click takes the closest object, a rectangle everything that overlaps it
+        if (bounds.area() == 1) {
+            const auto objId = m_pEditLayer->GetObjectUnderCursor(bounds.m_min).first;
+            auto SelectObjectByIdFilter = [&](ObjectBase* _pObject) {
+                return objId != INVALID_ID && objId == _pObject->GetObjectId();
+            };
+            return HandleSelectionGeneric(GetContext().GetSceneManager().GetObjects(SelectObjectByIdFilter));
         }
 
-        auto selectedObject = GetContext().GetSceneManager().GetObjects(SelectObjectByIdFilter);
-        return HandleSelectionGeneric(selectedObject);
+        return HandleSelectionGeneric(m_pEditLayer->GetObjectsInRect(bounds.m_min, bounds.m_max));
 
         return false;
     }
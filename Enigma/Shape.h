@@ -49,6 +49,11 @@ namespace RayTrace
         // used in this case.
         virtual float solidAngle(const Vector3f& p, int nSamples) const;
 
+        // Bounds the geometric normals reported by intersect() and sample() by the cone around
+        // _axis_ with cosine _cosTheta_. Returns false when the shape has no bound tighter than
+        // the whole sphere
+        virtual bool normalBounds(Vector3f* axis, float* cosTheta) const { return false; }
+
 
 
 
@@ -1510,5 +1510,171 @@ namespace RayTrace
         return FromXYZ(xyz);
     }
 
-}
+    //////////////////////////////////////////////////////////////////////////
+    // Hero wavelength sampling
+    //////////////////////////////////////////////////////////////////////////
+    static float SampleVisibleWavelength(float u)
+    {
+        return 538 - 138.888889f * std::atanh(0.85691062f - 1.82750197f * u);
+    }
+
+    static float VisibleWavelengthPdf(float lambda)
+    {
+        if (lambda < heroLambdaMin || lambda > heroLambdaMax)
+            return 0;
+        float c = std::cosh(0.0072f * (lambda - 538));
+        return 0.0039398042f / (c * c);
+    }
+
+    SampledWavelengths SampledWavelengths::SampleVisible(float u)
+    {
+        SampledWavelengths wavelengths;
+        for (int i = 0; i < nHeroWavelengths; ++i) {
+            float up = u + float(i) / nHeroWavelengths;
+            if (up > 1)
+                up -= 1;
+            wavelengths.m_lambda[i] = SampleVisibleWavelength(up);
+            wavelengths.m_pdf[i] = VisibleWavelengthPdf(wavelengths.m_lambda[i]);
+        }
+        return wavelengths;
+    }
+
+    void SampledWavelengths::TerminateSecondary()
+    {
+        if (SecondaryTerminated())
+            return;
+        for (int i = 1; i < nHeroWavelengths; ++i)
+            m_pdf[i] = 0;
+        m_pdf[0] /= nHeroWavelengths;
+    }
+
+    bool SampledWavelengths::SecondaryTerminated() const
+    {
+        for (int i = 1; i < nHeroWavelengths; ++i)
+            if (m_pdf[i] != 0)
+                return false;
+        return true;
+    }
 
+    HeroSpectrum::HeroSpectrum(float v /*= 0.f*/)
+        : CoefficientSpectrum(v)
+    {
+
+    }
+
+    HeroSpectrum::HeroSpectrum(const CoefficientSpectrum<nHeroWavelengths>& v)
+        : CoefficientSpectrum<nHeroWavelengths>(v)
+    {
+
+    }
+
+    // The RGB basis spectra are sampled evenly from RGB2SpectLambda[0] to RGB2SpectLambda[n - 1]
+    static float EvalRGB2SpectBasis(const float* basis, float lambda)
+    {
+        float x = (lambda - RGB2SpectLambda[0]) * (nRGB2SpectSamples - 1) /
+            (RGB2SpectLambda[nRGB2SpectSamples - 1] - RGB2SpectLambda[0]);
+        if (x <= 0)
+            return basis[0];
+        if (x >= nRGB2SpectSamples - 1)
+            return basis[nRGB2SpectSamples - 1];
+        int i = (int)x;
+        return Lerp(basis[i], basis[i + 1], x - i);
+    }
+
+    HeroSpectrum HeroSpectrum::FromRGB(const float rgb[3], const SampledWavelengths& lambda, eSpectrumType type)
+    {
+        const bool reflectance = type == eSpectrumType::SPECTRUM_REFLECTANCE;
+        const float* white = reflectance ? RGBRefl2SpectWhite : RGBIllum2SpectWhite;
+        // Indexed by the channel left out of the secondary color and by the primary channel
+        const float* secondaries[3] = {
+            reflectance ? RGBRefl2SpectCyan : RGBIllum2SpectCyan,
+            reflectance ? RGBRefl2SpectMagenta : RGBIllum2SpectMagenta,
+            reflectance ? RGBRefl2SpectYellow : RGBIllum2SpectYellow };
+        const float* primaries[3] = {
+            reflectance ? RGBRefl2SpectRed : RGBIllum2SpectRed,
+            reflectance ? RGBRefl2SpectGreen : RGBIllum2SpectGreen,
+            reflectance ? RGBRefl2SpectBlue : RGBIllum2SpectBlue };
+
+        // Same decomposition as SampledSpectrum::FromRGB: white up to the smallest channel,
+        // the secondary of the two others up to the middle one and the primary for the rest
+        int iMin = 0;
+        if (rgb[1] < rgb[iMin]) iMin = 1;
+        if (rgb[2] < rgb[iMin]) iMin = 2;
+        int iMid = (iMin + 1) % 3,
+            iMax = (iMin + 2) % 3;
+        if (rgb[iMid] > rgb[iMax])
+            std::swap(iMid, iMax);
+
+        const float scale = reflectance ? .94f : .86445f;
+        HeroSpectrum r;
+        for (int i = 0; i < nHeroWavelengths; ++i) {
+            r.c[i] = scale * (rgb[iMin] * EvalRGB2SpectBasis(white, lambda[i]) +
+                (rgb[iMid] - rgb[iMin]) * EvalRGB2SpectBasis(secondaries[iMin], lambda[i]) +
+                (rgb[iMax] - rgb[iMid]) * EvalRGB2SpectBasis(primaries[iMax], lambda[i]));
+        }
+        return r.Clamp();
+    }
+
+    HeroSpectrum HeroSpectrum::FromRGB(const RGBSpectrum& rgb, const SampledWavelengths& lambda, eSpectrumType type)
+    {
+        float c[3];
+        rgb.ToRGB(c);
+        return FromRGB(c, lambda, type);
+    }
+
+    HeroSpectrum HeroSpectrum::FromSampled(const float* lambda, const float* v, int n, const SampledWavelengths& wavelengths)
+    {
+        if (!SpectrumSamplesSorted(lambda, v, n)) {
+            std::vector<float> slambda(&lambda[0], &lambda[n]);
+            std::vector<float> sv(&v[0], &v[n]);
+            SortSpectrumSamples(&slambda[0], &sv[0], n);
+            return FromSampled(&slambda[0], &sv[0], n, wavelengths);
+        }
+        HeroSpectrum r;
+        for (int i = 0; i < nHeroWavelengths; ++i)
+            r.c[i] = InterpolateSpectrumSamples(lambda, v, n, wavelengths[i]);
+        return r;
+    }
+
+    // CIE tables are sampled every nanometer from CIE_lambda[0]
+    static float EvalCIE(const float* table, float lambda)
+    {
+        float x = lambda - CIE_lambda[0];
+        if (x <= 0 || x >= nCIESamples - 1)
+            return 0;
+        int i = (int)x;
+        return Lerp(table[i], table[i + 1], x - i);
+    }
+
+    void HeroSpectrum::ToXYZ(const SampledWavelengths& lambda, float xyz[3]) const
+    {
+        xyz[0] = xyz[1] = xyz[2] = 0.f;
+        for (int i = 0; i < nHeroWavelengths; ++i) {
+            if (lambda.Pdf(i) == 0)
+                continue;
+            float w = c[i] / lambda.Pdf(i);
+            xyz[0] += w * EvalCIE(CIE_X, lambda[i]);
+            xyz[1] += w * EvalCIE(CIE_Y, lambda[i]);
+            xyz[2] += w * EvalCIE(CIE_Z, lambda[i]);
+        }
+        const float scale = 1.f / (nHeroWavelengths * CIE_Y_integral);
+        xyz[0] *= scale;
+        xyz[1] *= scale;
+        xyz[2] *= scale;
+    }
+
+    float HeroSpectrum::y(const SampledWavelengths& lambda) const
+    {
+        float xyz[3];
+        ToXYZ(lambda, xyz);
+        return xyz[1];
+    }
+
+    RGBSpectrum HeroSpectrum::ToRGBSpectrum(const SampledWavelengths& lambda) const
+    {
+        float xyz[3];
+        ToXYZ(lambda, xyz);
+        return RGBSpectrum::FromXYZ(xyz);
+    }
+
+}
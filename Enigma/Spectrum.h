@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <limits>
 #include <algorithm>
+#include <immintrin.h>
 #include "Defines.h"
 #include "MathCommon.h"
 
@@ -61,24 +62,95 @@ namespace RayTrace
     extern const float RGBIllum2SpectGreen[nRGB2SpectSamples];
     extern const float RGBIllum2SpectBlue[nRGB2SpectSamples];
 
+    // Spectrum SIMD Helpers
+    // Coefficients are stored padded to whole SIMD registers: one SSE register for spectra of up
+    // to 4 coefficients, 8 lane chunks for longer ones (one AVX register, or two SSE registers
+    // without AVX). Padding lanes hold unspecified values, reductions and comparisons mask them out
+    template <int nSpectrumSamples>
+    struct SpectrumLanes {
+        static constexpr int chunk = nSpectrumSamples <= 4 ? 4 : 8;
+        static constexpr int count = (nSpectrumSamples + chunk - 1) / chunk * chunk;
+    };
+
+    namespace SpectrumSimd
+    {
+        inline __m128 Add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+        inline __m128 Sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+        inline __m128 Mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+        inline __m128 Div(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+        inline __m128 Min(__m128 a, __m128 b) { return _mm_min_ps(a, b); }
+        inline __m128 Max(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+        inline __m128 Sqrt(__m128 a) { return _mm_sqrt_ps(a); }
+        inline __m128 Splat(float v, __m128) { return _mm_set1_ps(v); }
+#if defined(__AVX__)
+        inline __m256 Add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+        inline __m256 Sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+        inline __m256 Mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+        inline __m256 Div(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+        inline __m256 Min(__m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+        inline __m256 Max(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+        inline __m256 Sqrt(__m256 a) { return _mm256_sqrt_ps(a); }
+        inline __m256 Splat(float v, __m256) { return _mm256_set1_ps(v); }
+#endif
+
+        // r = op(a, b) over _nLanes_ floats, 8 lanes at a time with AVX and 4 otherwise.
+        // _op_ is generic over the register type
+        template <int nLanes, typename Op>
+        inline void Map(float* r, const float* a, const float* b, Op op) {
+            int i = 0;
+#if defined(__AVX__)
+            for (; i + 8 <= nLanes; i += 8)
+                _mm256_storeu_ps(r + i, op(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+#endif
+            for (; i < nLanes; i += 4)
+                _mm_storeu_ps(r + i, op(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        }
+
+        template <int nLanes, typename Op>
+        inline void Map(float* r, const float* a, Op op) {
+            int i = 0;
+#if defined(__AVX__)
+            for (; i + 8 <= nLanes; i += 8)
+                _mm256_storeu_ps(r + i, op(_mm256_loadu_ps(a + i)));
+#endif
+            for (; i < nLanes; i += 4)
+                _mm_storeu_ps(r + i, op(_mm_loadu_ps(a + i)));
+        }
+
+        // True if _pred_, returning a comparison mask, holds for any of the first _nSamples_ lanes
+        template <int nSamples, int nLanes, typename Pred>
+        inline bool Any(const float* a, const float* b, Pred pred) {
+            for (int i = 0; i < nLanes; i += 4) {
+                int mask = _mm_movemask_ps(pred(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+                if (i + 4 > nSamples)
+                    mask &= (1 << (nSamples - i)) - 1;
+                if (mask)
+                    return true;
+            }
+            return false;
+        }
+    }
+
     // Spectrum Declarations
     template <int nSpectrumSamples>
     class CoefficientSpectrum {
+        static constexpr int nLanes = SpectrumLanes<nSpectrumSamples>::count;
+
     public:
         // CoefficientSpectrum Public Methods
         CoefficientSpectrum(float v = 0.f) {
-            for (int i = 0; i < nSpectrumSamples; ++i) c[i] = v;
+            for (int i = 0; i < nLanes; ++i) c[i] = v;
             assert(!HasNaNs());
         }
 #ifdef DEBUG
         CoefficientSpectrum(const CoefficientSpectrum& s) {
             DCHECK(!s.HasNaNs());
-            for (int i = 0; i < nSpectrumSamples; ++i) c[i] = s.c[i];
+            for (int i = 0; i < nLanes; ++i) c[i] = s.c[i];
         }
 
         CoefficientSpectrum& operator=(const CoefficientSpectrum& s) {
             DCHECK(!s.HasNaNs());
-            for (int i = 0; i < nSpectrumSamples; ++i) c[i] = s.c[i];
+            for (int i = 0; i < nLanes; ++i) c[i] = s.c[i];
             return *this;
         }
 #endif  // DEBUG
@@ -92,49 +164,48 @@ namespace RayTrace
         }
         CoefficientSpectrum& operator+=(const CoefficientSpectrum& s2) {
             assert(!s2.HasNaNs());
-            for (int i = 0; i < nSpectrumSamples; ++i) c[i] += s2.c[i];
+            SpectrumSimd::Map<nLanes>(c, c, s2.c, [](auto a, auto b) { return SpectrumSimd::Add(a, b); });
             return *this;
         }
         CoefficientSpectrum operator+(const CoefficientSpectrum& s2) const {
             assert(!s2.HasNaNs());
-            CoefficientSpectrum ret = *this;
-            for (int i = 0; i < nSpectrumSamples; ++i) ret.c[i] += s2.c[i];
+            CoefficientSpectrum ret;
+            SpectrumSimd::Map<nLanes>(ret.c, c, s2.c, [](auto a, auto b) { return SpectrumSimd::Add(a, b); });
             return ret;
         }
         CoefficientSpectrum operator-(const CoefficientSpectrum& s2) const {
             assert(!s2.HasNaNs());
-            CoefficientSpectrum ret = *this;
-            for (int i = 0; i < nSpectrumSamples; ++i) ret.c[i] -= s2.c[i];
+            CoefficientSpectrum ret;
+            SpectrumSimd::Map<nLanes>(ret.c, c, s2.c, [](auto a, auto b) { return SpectrumSimd::Sub(a, b); });
             return ret;
         }
         CoefficientSpectrum operator/(const CoefficientSpectrum& s2) const {
             assert(!s2.HasNaNs());
-            CoefficientSpectrum ret = *this;
-            for (int i = 0; i < nSpectrumSamples; ++i) {
+            for (int i = 0; i < nSpectrumSamples; ++i)
                 assert(s2.c[i] != 0);
-                ret.c[i] /= s2.c[i];
-            }
+            CoefficientSpectrum ret;
+            SpectrumSimd::Map<nLanes>(ret.c, c, s2.c, [](auto a, auto b) { return SpectrumSimd::Div(a, b); });
             return ret;
         }
         CoefficientSpectrum operator*(const CoefficientSpectrum& sp) const {
             assert(!sp.HasNaNs());
-            CoefficientSpectrum ret = *this;
-            for (int i = 0; i < nSpectrumSamples; ++i) ret.c[i] *= sp.c[i];
+            CoefficientSpectrum ret;
+            SpectrumSimd::Map<nLanes>(ret.c, c, sp.c, [](auto a, auto b) { return SpectrumSimd::Mul(a, b); });
             return ret;
         }
         CoefficientSpectrum& operator*=(const CoefficientSpectrum& sp) {
             assert(!sp.HasNaNs());
-            for (int i = 0; i < nSpectrumSamples; ++i) c[i] *= sp.c[i];
+            SpectrumSimd::Map<nLanes>(c, c, sp.c, [](auto a, auto b) { return SpectrumSimd::Mul(a, b); });
             return *this;
         }
         CoefficientSpectrum operator*(float a) const {
-            CoefficientSpectrum ret = *this;
-            for (int i = 0; i < nSpectrumSamples; ++i) ret.c[i] *= a;
+            CoefficientSpectrum ret;
+            SpectrumSimd::Map<nLanes>(ret.c, c, [a](auto v) { return SpectrumSimd::Mul(v, SpectrumSimd::Splat(a, v)); });
             assert(!ret.HasNaNs());
             return ret;
         }
         CoefficientSpectrum& operator*=(float a) {
-            for (int i = 0; i < nSpectrumSamples; ++i) c[i] *= a;
+            SpectrumSimd::Map<nLanes>(c, c, [a](auto v) { return SpectrumSimd::Mul(v, SpectrumSimd::Splat(a, v)); });
             assert(!HasNaNs());
             return *this;
         }
@@ -146,33 +217,29 @@ namespace RayTrace
         CoefficientSpectrum operator/(float a) const {
             assert(a != 0);
             assert(!std::isnan(a));
-            CoefficientSpectrum ret = *this;
-            for (int i = 0; i < nSpectrumSamples; ++i) ret.c[i] /= a;
+            CoefficientSpectrum ret;
+            SpectrumSimd::Map<nLanes>(ret.c, c, [a](auto v) { return SpectrumSimd::Div(v, SpectrumSimd::Splat(a, v)); });
             assert(!ret.HasNaNs());
             return ret;
         }
         CoefficientSpectrum& operator/=(float a) {
             assert(a != 0);
             assert(!std::isnan(a));
-            for (int i = 0; i < nSpectrumSamples; ++i) c[i] /= a;
+            SpectrumSimd::Map<nLanes>(c, c, [a](auto v) { return SpectrumSimd::Div(v, SpectrumSimd::Splat(a, v)); });
             return *this;
         }
         bool operator==(const CoefficientSpectrum& sp) const {
-            for (int i = 0; i < nSpectrumSamples; ++i)
-                if (c[i] != sp.c[i]) return false;
-            return true;
+            return !SpectrumSimd::Any<nSpectrumSamples, nLanes>(c, sp.c, [](__m128 a, __m128 b) { return _mm_cmpneq_ps(a, b); });
         }
         bool operator!=(const CoefficientSpectrum& sp) const {
             return !(*this == sp);
         }
         bool IsBlack() const {
-            for (int i = 0; i < nSpectrumSamples; ++i)
-                if (c[i] != 0.) return false;
-            return true;
+            return !SpectrumSimd::Any<nSpectrumSamples, nLanes>(c, c, [](__m128 a, __m128) { return _mm_cmpneq_ps(a, _mm_setzero_ps()); });
         }
         friend CoefficientSpectrum Sqrt(const CoefficientSpectrum& s) {
             CoefficientSpectrum ret;
-            for (int i = 0; i < nSpectrumSamples; ++i) ret.c[i] = std::sqrt(s.c[i]);
+            SpectrumSimd::Map<nLanes>(ret.c, s.c, [](auto v) { return SpectrumSimd::Sqrt(v); });
             assert(!ret.HasNaNs());
             return ret;
         }
@@ -181,7 +248,7 @@ namespace RayTrace
             float e);
         CoefficientSpectrum operator-() const {
             CoefficientSpectrum ret;
-            for (int i = 0; i < nSpectrumSamples; ++i) ret.c[i] = -c[i];
+            SpectrumSimd::Map<nLanes>(ret.c, c, [](auto v) { return SpectrumSimd::Sub(SpectrumSimd::Splat(0.f, v), v); });
             return ret;
         }
         friend CoefficientSpectrum Exp(const CoefficientSpectrum& s) {
@@ -205,17 +272,19 @@ namespace RayTrace
         }
         CoefficientSpectrum Clamp(float low = 0, float high = InfinityF32) const {
             CoefficientSpectrum ret;
-            for (int i = 0; i < nSpectrumSamples; ++i)
-                ret.c[i] = std::clamp(c[i], low, high);
+            SpectrumSimd::Map<nLanes>(ret.c, c, [low, high](auto v) {
+                return SpectrumSimd::Max(SpectrumSimd::Min(v, SpectrumSimd::Splat(high, v)), SpectrumSimd::Splat(low, v));
+            });
             assert(!ret.HasNaNs());
             return ret;
         }
         
-        bool HasInfs()
+        bool HasInfs() const
         {
-            for (int i = 0; i < nSpectrumSamples; ++i)
-                if (std::isinf(c[i])) return true;
-            return false;
+            return SpectrumSimd::Any<nSpectrumSamples, nLanes>(c, c, [](__m128 a, __m128) {
+                const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+                return _mm_cmpeq_ps(_mm_and_ps(a, absMask), _mm_set1_ps(InfinityF32));
+            });
         }
 
 
@@ -226,9 +295,7 @@ namespace RayTrace
             return m;
         }
         bool HasNaNs() const {
-            for (int i = 0; i < nSpectrumSamples; ++i)
-                if (std::isnan(c[i])) return true;
-            return false;
+            return SpectrumSimd::Any<nSpectrumSamples, nLanes>(c, c, [](__m128 a, __m128) { return _mm_cmpunord_ps(a, a); });
         }
         bool Write(FILE* f) const {
             for (int i = 0; i < nSpectrumSamples; ++i)
@@ -257,7 +324,7 @@ namespace RayTrace
 
     protected:
         // CoefficientSpectrum Protected Data
-        float c[nSpectrumSamples];
+        alignas(16) float c[nLanes];
     };
 
     class SampledSpectrum : public CoefficientSpectrum<nSpectralSamples> {
@@ -312,6 +379,47 @@ namespace RayTrace
         static RGBSpectrum FromSampled(const float* lambda, const float* v, int n);
     };
 
+    // Hero wavelength sampling
+    // A spectral path carries nHeroWavelengths wavelengths: the hero wavelength, importance sampled
+    // over the visible range, and the others rotated from it evenly through the sampling domain
+    static const int   nHeroWavelengths = 4;
+    static const float heroLambdaMin = 360.f;
+    static const float heroLambdaMax = 830.f;
+
+    class SampledWavelengths {
+    public:
+        static SampledWavelengths SampleVisible(float u);
+
+        float   operator[](int i) const { return m_lambda[i]; }
+        float   Pdf(int i) const { return m_pdf[i]; }
+        // Keeps only the hero wavelength, for scattering that separates wavelengths like dispersion
+        void    TerminateSecondary();
+        bool    SecondaryTerminated() const;
+
+    private:
+        float   m_lambda[nHeroWavelengths];
+        float   m_pdf[nHeroWavelengths];
+    };
+
+    // Values of a spectrum at the wavelengths of a SampledWavelengths
+    class alignas(16) HeroSpectrum : public CoefficientSpectrum<nHeroWavelengths> {
+    public:
+        // HeroSpectrum Public Methods
+        HeroSpectrum(float v = 0.f);
+        HeroSpectrum(const CoefficientSpectrum<nHeroWavelengths>& v);
+        // Upsamples _rgb_ with the same basis spectra as SampledSpectrum::FromRGB
+        static HeroSpectrum FromRGB(const float rgb[3], const SampledWavelengths& lambda,
+            eSpectrumType type = eSpectrumType::SPECTRUM_REFLECTANCE);
+        static HeroSpectrum FromRGB(const RGBSpectrum& rgb, const SampledWavelengths& lambda,
+            eSpectrumType type = eSpectrumType::SPECTRUM_REFLECTANCE);
+        static HeroSpectrum FromSampled(const float* lambda, const float* v, int n,
+            const SampledWavelengths& wavelengths);
+        // Monte Carlo estimate of the XYZ of the spectrum over the sampled wavelengths
+        void ToXYZ(const SampledWavelengths& lambda, float xyz[3]) const;
+        float y(const SampledWavelengths& lambda) const;
+        RGBSpectrum ToRGBSpectrum(const SampledWavelengths& lambda) const;
+    };
+
     // Spectrum Inline Functions
     template <int nSpectrumSamples>
     inline CoefficientSpectrum<nSpectrumSamples> Pow(
@@ -0,0 +1,107 @@
+// Checks that editor style edits of the ray traced scene are picked up by Refit():
+// a moved sphere is hit at its new position and missed at its old one, without a
+// full rebuild of the BVH. Built as its own console application against the Enigma
+// sources, returns non zero on failure.
+#include <cstdio>
+#include "../Includes.h"
+
+using namespace RayTrace;
+
+namespace
+{
+    struct MovableSphere
+    {
+        std::shared_ptr<Transform> m_objectToWorld;
+        std::shared_ptr<Transform> m_worldToObject;
+        PrimitivePtr               m_primitive;
+    };
+
+    MovableSphere MakeSphere(const Vector3f& _pos)
+    {
+        MovableSphere sphere;
+        sphere.m_objectToWorld = std::make_shared<Transform>(Translate(_pos));
+        sphere.m_worldToObject = std::make_shared<Transform>(sphere.m_objectToWorld->inverted());
+        auto shape = std::make_shared<Sphere>(sphere.m_objectToWorld.get(), sphere.m_worldToObject.get(),
+            false, 0.5f, -0.5f, 0.5f, 360.0f);
+        sphere.m_primitive = std::make_shared<GeometricPrimitive>(shape, nullptr, nullptr, MediumInterface());
+        return sphere;
+    }
+
+    void Move(MovableSphere& _sphere, const Vector3f& _pos)
+    {
+        *_sphere.m_objectToWorld = Translate(_pos);
+        *_sphere.m_worldToObject = _sphere.m_objectToWorld->inverted();
+    }
+
+    // Shoots down -z onto the xy position of _pos_ and returns the primitive that was hit
+    const Primitive* Trace(const Primitive& _accel, const Vector3f& _pos)
+    {
+        Ray ray(Vector3f(_pos.x, _pos.y, 10.0f), Vector3f(0.0f, 0.0f, -1.0f));
+        SurfaceInteraction isect;
+        return _accel.intersect(ray, &isect) ? isect.m_primitive : nullptr;
+    }
+
+    int s_failures = 0;
+
+    void Check(bool _condition, const char* _what)
+    {
+        if (!_condition) {
+            std::printf("FAILED: %s\n", _what);
+            ++s_failures;
+        }
+    }
+
+    void TestBVHRefit()
+    {
+        std::vector<MovableSphere> spheres;
+        PrimitiveVector prims;
+        for (int y = 0; y < 8; ++y)
+            for (int x = 0; x < 8; ++x) {
+                spheres.push_back(MakeSphere(Vector3f(x * 2.0f, y * 2.0f, 0.0f)));
+                prims.push_back(spheres.back().m_primitive);
+            }
+        BVHAccel bvh(prims, 1, BVHAccel::SplitMethod::SAH, 4);
+
+        MovableSphere& moved = spheres[9];
+        const Vector3f from(2.0f, 2.0f, 0.0f), to(1.0f, 21.0f, 0.0f);
+        Check(Trace(bvh, from) == moved.m_primitive.get(), "sphere hit before the move");
+
+        Move(moved, to);
+        // A high threshold keeps every subtree, the tree is only refit
+        bvh.Refit({ moved.m_primitive.get() }, InfinityF32);
+        Check(Trace(bvh, to) == moved.m_primitive.get(), "BVHAccel: moved sphere hit at its new position");
+        Check(Trace(bvh, from) == nullptr, "BVHAccel: moved sphere missed at its old position");
+        Check(bvh.GetBuildStats().refits == 1, "BVHAccel: refit without a full rebuild");
+        Check(bvh.GetBuildStats().subtreesRebuilt == 0, "BVHAccel: no subtree rebuilt");
+        Check(bvh.worldBound().m_max.y >= to.y + 0.5f, "BVHAccel: world bounds grew");
+    }
+
+    void TestInstanceRefit()
+    {
+        MovableSphere sphere = MakeSphere(Vector3f(0.0f));
+        auto instances = std::make_shared<InstanceAccel>();
+        const int blas = instances->AddBLAS(std::make_shared<BVHAccel>(PrimitiveVector{ sphere.m_primitive }));
+
+        auto instanceToWorld = std::make_shared<Transform>(Translate(Vector3f(0.0f)));
+        const int instance = instances->AddInstance(blas,
+            AnimatedTransform(instanceToWorld.get(), 0.0f, instanceToWorld.get(), 1.0f));
+        instances->Commit();
+        Scene scene(instances, {});
+
+        const Vector3f to(5.0f, -3.0f, 0.0f);
+        *instanceToWorld = Translate(to);
+        scene.SetInstanceTransform(instance, AnimatedTransform(instanceToWorld.get(), 0.0f, instanceToWorld.get(), 1.0f));
+        scene.Refit({});
+        Check(Trace(*scene.m_accel, to) == sphere.m_primitive.get(), "InstanceAccel: moved instance hit at its new position");
+        Check(Trace(*scene.m_accel, Vector3f(0.0f)) == nullptr, "InstanceAccel: moved instance missed at its old position");
+        Check(scene.worldBound().m_min.x >= to.x - 0.5f - 1e-3f, "Scene: bounds follow the instance");
+    }
+}
+
+int main()
+{
+    TestBVHRefit();
+    TestInstanceRefit();
+    std::printf(s_failures ? "%d check(s) failed\n" : "all checks passed\n", s_failures);
+    return s_failures ? 1 : 0;
+}
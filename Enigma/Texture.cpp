@@ -1,5 +1,7 @@
+#include <Ptexture.h>
 #include "ParameterSet.h"
 #include "Error.h"
+#include "Api.h"
 #include "Texture.h"
 
 
@@ -357,7 +359,9 @@ namespace RayTrace
 
     FloatTexture* CreatePtexFloatTexture(const Transform& _texToWorld, const TextureParams& tp)
     {
-        return nullptr;
+        std::string filename = tp.FindFilename("filename");
+        float gamma = tp.FindFloat("gamma", 2.2f);
+        return new PtexTexture<float>(filename, gamma);
     }
 
 
@@ -541,9 +545,92 @@ namespace RayTrace
 
     SpectrumTexture* CreatePtexSpectrumTexture(const Transform& _texToWorld, const TextureParams& tp)
     {
-        return nullptr;
+        std::string filename = tp.FindFilename("filename");
+        float gamma = tp.FindFloat("gamma", 2.2f);
+        return new PtexTexture<Spectrum>(filename, gamma);
+    }
+
+#pragma endregion
+
+#pragma region PtexTexture
+
+    struct PtexErrorReporter : public Ptex::PtexErrorHandler {
+        void reportError(const char* error) override { Error(error); }
+    };
+
+    static Ptex::PtexCache* GetPtexCache()
+    {
+        // Created on first use so the options of pbrtInit() are in place
+        static PtexErrorReporter errorReporter;
+        static Ptex::PtexCache* cache = Ptex::PtexCache::create(std::max(PbrtOptions.ptexMaxFiles, 1),
+            size_t(std::max(PbrtOptions.ptexCacheMB, 1)) << 20, true, nullptr, &errorReporter);
+        return cache;
+    }
+
+    static void ConvertPtex(const float* result, int nc, float* to)
+    {
+        *to = nc == 1 ? result[0] : (result[0] + result[1] + result[2]) / 3;
+    }
+
+    static void ConvertPtex(const float* result, int nc, Spectrum* to)
+    {
+        if (nc == 1)
+            *to = Spectrum(result[0]);
+        else
+            *to = Spectrum::FromRGB(result);
     }
 
+    template <typename T>
+    PtexTexture<T>::PtexTexture(const std::string& _filename, float _gamma)
+        : m_filename(_filename)
+        , m_gamma(_gamma)
+    {
+        Ptex::String error;
+        Ptex::PtexTexture* texture = GetPtexCache()->get(m_filename.c_str(), error);
+        if (!texture) {
+            Error(error.c_str());
+            return;
+        }
+        if (texture->numChannels() != 1 && texture->numChannels() != 3)
+            Error("Ptex file must have 1 or 3 channels");
+        else
+            m_valid = true;
+        texture->release();
+    }
+
+    template <typename T>
+    T PtexTexture<T>::Evaluate(const SurfaceInteraction& si) const
+    {
+        if (!m_valid)
+            return T(0.f);
+
+        // The handle only pins the file while filtering, the cache may close it in between
+        Ptex::String error;
+        Ptex::PtexTexture* texture = GetPtexCache()->get(m_filename.c_str(), error);
+        if (!texture)
+            return T(0.f);
+        Ptex::PtexFilter::Options opts(Ptex::PtexFilter::FilterType::f_bspline);
+        Ptex::PtexFilter* filter = Ptex::PtexFilter::getFilter(texture, opts);
+        const int nc = texture->numChannels();
+
+        float result[3] = { 0.f, 0.f, 0.f };
+        filter->eval(result, 0, nc, si.m_faceIndex, si.m_uv[0], si.m_uv[1],
+            si.m_dudx, si.m_dvdx, si.m_dudy, si.m_dvdy);
+        filter->release();
+        texture->release();
+
+        if (m_gamma != 1)
+            for (int i = 0; i < nc; ++i)
+                if (result[i] >= 0 && result[i] <= 1)
+                    result[i] = std::pow(result[i], m_gamma);
+        T ret;
+        ConvertPtex(result, nc, &ret);
+        return ret;
+    }
+
+    template class PtexTexture<float>;
+    template class PtexTexture<Spectrum>;
+
 #pragma endregion
 
   
@@ -1,12 +1,16 @@
 #pragma once
+#include <atomic>
+#include <future>
 #include <memory>
 #include <map>
+#include <mutex>
 #include "Transform.h"
 #include "MipMap.h"
 #include "MathCommon.h"
 #include "IO.h"
 #include "TexInfo.h"
 #include "Interaction.h"
+#include "Concurrency.h"
 #include "Defines.h"
 
 
@@ -314,13 +318,12 @@ namespace RayTrace
     {
     public:    
         using TextureDataPtr = std::shared_ptr<MipMap<TMemory>>;
+        using TextureFuture  = std::shared_future<TextureDataPtr>;
         ImageTexture(const TextureMapping2DPtr& _m, const TexInfo& _tInfo)
             : m_map(_m)
+            , m_texture(getTexture(_tInfo))
             , m_texInfo(_tInfo)
         {
-            auto result = getTexture(_tInfo);
-            assert(result != nullptr);
-            m_mipMap = result;
         }
 
         TReturn Evaluate(const SurfaceInteraction& si) const override;
@@ -328,11 +331,34 @@ namespace RayTrace
 
 
     private:
-        TextureDataPtr  getTexture(const TexInfo& _info)
+        // Images are decoded on the async queue while parsing goes on; textures sharing a
+        // TexInfo share one load. The first Evaluate waits for it if it hasn't finished.
+        static TextureFuture getTexture(const TexInfo& _info)
         {
-            if (s_textureCache.find(_info) != std::end(s_textureCache))
-                return s_textureCache[_info];
+            std::shared_ptr<std::promise<TextureDataPtr>> promise;
+            TextureFuture result;
+            {
+                std::lock_guard<std::mutex> lock(s_textureCacheMutex);
+                auto it = s_textureCache.find(_info);
+                if (it != std::end(s_textureCache))
+                    return it->second;
+                promise = std::make_shared<std::promise<TextureDataPtr>>();
+                result = promise->get_future().share();
+                s_textureCache.emplace(_info, result);
+            }
+            RunAsync([promise, _info]() {
+                try {
+                    promise->set_value(loadTexture(_info));
+                }
+                catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+            return result;
+        }
 
+        static TextureDataPtr loadTexture(const TexInfo& _info)
+        {
             TextureDataPtr retVal = nullptr;
             int width = 0;
             int height = 0;
@@ -366,8 +392,6 @@ namespace RayTrace
                 std::vector<TMemory> val(1, oneVal);
                 retVal = std::make_shared< MipMap<TMemory>>(1, 1, val, _info.m_doTrilinear, _info.m_maxAniso, _info.m_wrapMode);
             }
-           
-            s_textureCache[_info] = retVal;
             return retVal;
         }
 
@@ -394,10 +418,12 @@ namespace RayTrace
             *_to = _from;
         }
 
-        static std::map<TexInfo, TextureDataPtr> s_textureCache;
+        static std::map<TexInfo, TextureFuture> s_textureCache;
+        static std::mutex                       s_textureCacheMutex;
 
         TextureMapping2DPtr m_map = nullptr;
-        TextureDataPtr      m_mipMap = nullptr;
+        TextureFuture       m_texture;
+        mutable std::atomic<MipMap<TMemory>*> m_mipMap = { nullptr };  // m_texture once it is ready
         TexInfo             m_texInfo;      
     };
 
@@ -408,14 +434,38 @@ namespace RayTrace
         Vector2f dstdx, dstdy;
         Vector2f st = m_map->map(si, &dstdx, &dstdy);
 
-        TMemory mem = m_mipMap->lookup( st, dstdx, dstdy);
+        MipMap<TMemory>* mipMap = m_mipMap.load(std::memory_order_acquire);
+        if (!mipMap) {
+            mipMap = m_texture.get().get();
+            m_mipMap.store(mipMap, std::memory_order_release);
+        }
+        TMemory mem = mipMap->lookup( st, dstdx, dstdy);
         TReturn ret;
         ConvertOut(mem, &ret);
         return ret;
     }
 
     template <typename TMemory, typename TReturn>
-    std::map<TexInfo, typename ImageTexture<TMemory, TReturn>::TextureDataPtr> ImageTexture<TMemory, TReturn>::s_textureCache;
+    std::map<TexInfo, typename ImageTexture<TMemory, TReturn>::TextureFuture> ImageTexture<TMemory, TReturn>::s_textureCache;
+
+    template <typename TMemory, typename TReturn>
+    std::mutex ImageTexture<TMemory, TReturn>::s_textureCacheMutex;
+
+    // Ptex lookups go through one PtexCache shared by every PtexTexture. It bounds the open
+    // files and resident face data and is shared by all render threads.
+    template <typename T>
+    class PtexTexture : public Texture<T>
+    {
+    public:
+        PtexTexture(const std::string& _filename, float _gamma);
+
+        T Evaluate(const SurfaceInteraction& si) const override;
+
+    private:
+        bool        m_valid = false;
+        std::string m_filename;
+        float       m_gamma;
+    };
 
 #pragma endregion	
 
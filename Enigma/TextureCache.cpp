@@ -0,0 +1,270 @@
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include "Error.h"
+#include "SceneCache.h"
+#include "TextureCache.h"
+
+#ifdef IS_WINDOWS
+#define  NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace RayTrace
+{
+    void SetTextureCacheSize(size_t bytes)
+    {
+        GetTextureCache().SetMaxBytes(bytes);
+    }
+
+    size_t GetTextureCacheSize()
+    {
+        return GetTextureCache().GetMaxBytes();
+    }
+
+    TextureCache& GetTextureCache()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // TextureCache Implementation
+    //////////////////////////////////////////////////////////////////////////
+    TextureCache::~TextureCache()
+    {
+        if (m_file != -1) {
+#ifdef IS_WINDOWS
+            CloseHandle((HANDLE)m_file);
+#else
+            close((int)m_file);
+#endif
+            std::error_code ec;
+            std::filesystem::remove(m_filename, ec);
+        }
+    }
+
+    bool TextureCache::openBackingFile()
+    {
+        if (m_file != -1)
+            return true;
+        // Tiles go next to the scene cache if there is one, the file only lives as long as the process
+        std::error_code ec;
+        std::filesystem::path dir = GetSceneCacheDirectory();
+        if (dir.empty())
+            dir = std::filesystem::temp_directory_path(ec);
+        std::filesystem::create_directories(dir, ec);
+        const std::string name = "textures-" +
+            std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "-" +
+            std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tiles";
+        m_filename = (dir / name).string();
+#ifdef IS_WINDOWS
+        m_file = (intptr_t)CreateFileA(m_filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, 0,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, 0);
+#else
+        m_file = open(m_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+#endif
+        if (m_file == -1) {
+            Warning("Unable to create texture tile file \"%s\"", m_filename.c_str());
+            return false;
+        }
+        m_textures.reset(new TextureRange[MaxTextures]);
+        return true;
+    }
+
+    bool TextureCache::resizeBackingFile(uint64_t size)
+    {
+#ifdef IS_WINDOWS
+        LARGE_INTEGER newSize;
+        newSize.QuadPart = (LONGLONG)size;
+        return SetFilePointerEx((HANDLE)m_file, newSize, nullptr, FILE_BEGIN) && SetEndOfFile((HANDLE)m_file);
+#else
+        return ftruncate((int)m_file, (off_t)size) == 0;
+#endif
+    }
+
+    bool TextureCache::readAt(uint64_t offset, void* data, size_t size) const
+    {
+        uint8_t* dst = (uint8_t*)data;
+        while (size > 0) {
+#ifdef IS_WINDOWS
+            // A synchronous handle still reads at the OVERLAPPED offset
+            OVERLAPPED overlapped = {};
+            overlapped.Offset     = (DWORD)offset;
+            overlapped.OffsetHigh = (DWORD)(offset >> 32);
+            DWORD read = 0;
+            const DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+            if (!ReadFile((HANDLE)m_file, dst, chunk, &read, &overlapped) || read == 0)
+                return false;
+#else
+            const ssize_t read = pread((int)m_file, dst, size, (off_t)offset);
+            if (read <= 0)
+                return false;
+#endif
+            dst += read;
+            offset += read;
+            size -= read;
+        }
+        return true;
+    }
+
+    bool TextureCache::writeAt(uint64_t offset, const void* data, size_t size) const
+    {
+        const uint8_t* src = (const uint8_t*)data;
+        while (size > 0) {
+#ifdef IS_WINDOWS
+            OVERLAPPED overlapped = {};
+            overlapped.Offset     = (DWORD)offset;
+            overlapped.OffsetHigh = (DWORD)(offset >> 32);
+            DWORD written = 0;
+            const DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+            if (!WriteFile((HANDLE)m_file, src, chunk, &written, &overlapped) || written == 0)
+                return false;
+#else
+            const ssize_t written = pwrite((int)m_file, src, size, (off_t)offset);
+            if (written <= 0)
+                return false;
+#endif
+            src += written;
+            offset += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    uint32_t TextureCache::AddTexture(size_t tileBytes, uint32_t nTiles)
+    {
+        std::lock_guard<std::mutex> lock(m_fileMutex);
+        if (!openBackingFile())
+            return InvalidTexture;
+        if (m_numTextures == MaxTextures) {
+            Warning("Texture tile file is full, keeping the texture resident");
+            return InvalidTexture;
+        }
+        const uint64_t size = m_fileSize + uint64_t(tileBytes) * nTiles;
+        if (!resizeBackingFile(size)) {
+            Warning("Unable to grow texture tile file \"%s\"", m_filename.c_str());
+            return InvalidTexture;
+        }
+        // The id reaches other threads through the caller, which orders this write before their reads
+        m_textures[m_numTextures] = { m_fileSize, tileBytes, nTiles };
+        m_fileSize = size;
+        return m_numTextures++;
+    }
+
+    void TextureCache::RemoveTexture(uint32_t texture)
+    {
+        for (Shard& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.m_mutex);
+            for (auto it = shard.m_tiles.begin(); it != shard.m_tiles.end();) {
+                if ((it->first >> 32) == texture) {
+                    shard.m_bytes -= it->second.m_tile->m_size;
+                    m_bytesResident -= it->second.m_tile->m_size;
+                    shard.m_lru.erase(it->second.m_lruPos);
+                    it = shard.m_tiles.erase(it);
+                }
+                else
+                    ++it;
+            }
+        }
+    }
+
+    bool TextureCache::WriteTile(uint32_t texture, uint32_t tile, const void* data)
+    {
+        const TextureRange& range = m_textures[texture];
+        assert(tile < range.m_nTiles);
+        return writeAt(range.m_offset + uint64_t(tile) * range.m_tileBytes, data, range.m_tileBytes);
+    }
+
+    TextureTilePtr TextureCache::GetTile(uint32_t texture, uint32_t tile)
+    {
+        const uint64_t key = tileKey(texture, tile);
+        Shard& shard = shardOf(key);
+        {
+            std::lock_guard<std::mutex> lock(shard.m_mutex);
+            auto it = shard.m_tiles.find(key);
+            if (it != shard.m_tiles.end()) {
+                shard.m_lru.splice(shard.m_lru.begin(), shard.m_lru, it->second.m_lruPos);
+                ++m_hits;
+                return it->second.m_tile;
+            }
+        }
+
+        // Read outside the shard lock; two threads missing on the same tile both read it
+        // and the second insert below keeps the first copy
+        ++m_misses;
+        std::shared_ptr<TextureTile> loaded = std::make_shared<TextureTile>();
+        const TextureRange& range = m_textures[texture];
+        loaded->m_size = range.m_tileBytes;
+        loaded->m_data.reset(new uint8_t[range.m_tileBytes]);
+        if (!readAt(range.m_offset + uint64_t(tile) * range.m_tileBytes, loaded->m_data.get(), range.m_tileBytes)) {
+            Warning("Unable to read texture tile from \"%s\"", m_filename.c_str());
+            std::fill(loaded->m_data.get(), loaded->m_data.get() + range.m_tileBytes, uint8_t(0));
+        }
+        m_bytesRead += loaded->m_size;
+
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+        auto inserted = shard.m_tiles.emplace(key, CachedTile());
+        CachedTile& cached = inserted.first->second;
+        if (!inserted.second) {
+            shard.m_lru.splice(shard.m_lru.begin(), shard.m_lru, cached.m_lruPos);
+            return cached.m_tile;
+        }
+        cached.m_tile = std::move(loaded);
+        shard.m_lru.push_front(key);
+        cached.m_lruPos = shard.m_lru.begin();
+        shard.m_bytes += cached.m_tile->m_size;
+        const size_t resident = (m_bytesResident += cached.m_tile->m_size);
+        size_t peak = m_peakBytesResident;
+        while (resident > peak && !m_peakBytesResident.compare_exchange_weak(peak, resident))
+            ;
+        TextureTilePtr result = cached.m_tile;
+        evict(shard, m_maxBytes / NumShards);
+        return result;
+    }
+
+    void TextureCache::evict(Shard& shard, size_t maxShardBytes)
+    {
+        // The most recently used tile always stays, whatever the budget
+        while (shard.m_bytes > maxShardBytes && shard.m_lru.size() > 1) {
+            auto it = shard.m_tiles.find(shard.m_lru.back());
+            shard.m_bytes -= it->second.m_tile->m_size;
+            m_bytesResident -= it->second.m_tile->m_size;
+            shard.m_tiles.erase(it);
+            shard.m_lru.pop_back();
+            ++m_evictions;
+        }
+    }
+
+    void TextureCache::SetMaxBytes(size_t bytes)
+    {
+        m_maxBytes = bytes;
+        for (Shard& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.m_mutex);
+            evict(shard, bytes / NumShards);
+        }
+    }
+
+    TextureCacheStats TextureCache::GetStats() const
+    {
+        TextureCacheStats stats;
+        stats.m_hits = m_hits;
+        stats.m_misses = m_misses;
+        stats.m_evictions = m_evictions;
+        stats.m_bytesRead = m_bytesRead;
+        stats.m_bytesResident = m_bytesResident;
+        stats.m_peakBytesResident = m_peakBytesResident;
+        return stats;
+    }
+
+    void TextureCache::ResetStats()
+    {
+        m_hits = m_misses = m_evictions = m_bytesRead = 0;
+        m_peakBytesResident = m_bytesResident.load();
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Defines.h"
+
+namespace RayTrace
+{
+    // TextureCache Declarations
+    // MIP levels of large image textures are cut into tiles and written to a backing file
+    // once; lookups page tiles back in on demand and the least recently used tiles are
+    // evicted once the resident tiles exceed the memory ceiling.
+    // Paging is disabled while the ceiling is 0, every MIP level then stays resident.
+    void                SetTextureCacheSize(size_t bytes);
+    size_t              GetTextureCacheSize();
+
+    struct TextureTile
+    {
+        std::unique_ptr<uint8_t[]>  m_data;
+        size_t                      m_size = 0;
+    };
+    using TextureTilePtr = std::shared_ptr<const TextureTile>;
+
+    struct TextureCacheStats
+    {
+        uint64_t    m_hits = 0;
+        uint64_t    m_misses = 0;
+        uint64_t    m_evictions = 0;
+        uint64_t    m_bytesRead = 0;
+        size_t      m_bytesResident = 0;
+        size_t      m_peakBytesResident = 0;
+    };
+
+    class TextureCache
+    {
+    public:
+        static constexpr uint32_t InvalidTexture = ~0u;
+
+        ~TextureCache();
+
+        // Reserves _nTiles_ tiles of _tileBytes_ each in the backing file
+        uint32_t            AddTexture(size_t tileBytes, uint32_t nTiles);
+        // Drops the resident tiles of _texture_, its range in the backing file is not reused
+        void                RemoveTexture(uint32_t texture);
+        bool                WriteTile(uint32_t texture, uint32_t tile, const void* data);
+        // Returns the tile, reading it from the backing file on a miss. Safe to call from
+        // any thread; the returned tile stays valid while referenced even if evicted.
+        TextureTilePtr      GetTile(uint32_t texture, uint32_t tile);
+
+        void                SetMaxBytes(size_t bytes);
+        size_t              GetMaxBytes() const { return m_maxBytes; }
+        TextureCacheStats   GetStats() const;
+        void                ResetStats();
+
+    private:
+        static constexpr int NumShards = 16;
+
+        struct CachedTile
+        {
+            TextureTilePtr                  m_tile;
+            std::list<uint64_t>::iterator   m_lruPos;
+        };
+
+        // Each shard is an independent LRU so threads missing on different tiles rarely contend
+        struct Shard
+        {
+            std::mutex                              m_mutex;
+            std::list<uint64_t>                     m_lru;      // front is most recently used
+            std::unordered_map<uint64_t, CachedTile> m_tiles;
+            size_t                                  m_bytes = 0;
+        };
+
+        struct TextureRange
+        {
+            uint64_t    m_offset;
+            size_t      m_tileBytes;
+            uint32_t    m_nTiles;
+        };
+
+        // Ranges never move once added, lookups read them without taking m_fileMutex
+        static constexpr uint32_t MaxTextures = 1 << 16;
+
+        static uint64_t     tileKey(uint32_t texture, uint32_t tile) { return (uint64_t(texture) << 32) | tile; }
+        Shard&              shardOf(uint64_t key) { return m_shards[(key * 0x9e3779b97f4a7c15ull) >> 60]; }
+        bool                openBackingFile();
+        bool                resizeBackingFile(uint64_t size);
+        bool                readAt(uint64_t offset, void* data, size_t size) const;
+        bool                writeAt(uint64_t offset, const void* data, size_t size) const;
+        void                evict(Shard& shard, size_t maxShardBytes);
+
+        Shard                       m_shards[NumShards];
+        std::atomic<size_t>         m_maxBytes = { 0 };
+
+        // Backing file shared by every paged texture. Tiles are read and written at their
+        // offset without moving a shared file position, so misses on different threads run
+        // in parallel; m_fileMutex only guards adding textures and growing the file
+        std::mutex                  m_fileMutex;
+        intptr_t                    m_file = -1;    // file descriptor, or HANDLE on Windows
+        std::string                 m_filename;
+        uint64_t                    m_fileSize = 0;
+        std::unique_ptr<TextureRange[]> m_textures;
+        uint32_t                    m_numTextures = 0;
+
+        std::atomic<uint64_t>       m_hits = { 0 };
+        std::atomic<uint64_t>       m_misses = { 0 };
+        std::atomic<uint64_t>       m_evictions = { 0 };
+        std::atomic<uint64_t>       m_bytesRead = { 0 };
+        std::atomic<size_t>         m_bytesResident = { 0 };
+        std::atomic<size_t>         m_peakBytesResident = { 0 };
+    };
+
+    TextureCache&       GetTextureCache();
+}
@@ -385,12 +385,16 @@ namespace RayTrace
             (ImGuizmo::MODE)m_transformType, glm::value_ptr(m_selectionTransform), glm::value_ptr( m_deltaTransform ), GetSnapValue(), nullptr, nullptr))
         {
             m_transformActive = true;            
+            std::vector<WrappedEntity*> moved;
             for (auto& trans : m_transformables) {
                 
                 auto pTransComp         = trans.m_pEntity->GetComponent<TransformComponent>();  
                 const auto& lastTrans   = pTransComp->m_transform;
                 pTransComp->m_transform = m_deltaTransform * lastTrans;                
+                GetContext().GetSceneManager().UpdateBounds(trans.m_pEntity);
+                moved.push_back(trans.m_pEntity);
             }           
+            GetContext().GetSceneManager().SyncRenderScene(moved);
         }     
     }
 
@@ -292,6 +292,11 @@ namespace RayTrace {
 		return glm::ortho(_left, _right, _bottom, _top, _near, _far);
     }
 
+    Matrix4x4 PickMatrix4x4(const Vector2f& _center, const Vector2f& _size, const Vector4f& _viewport)
+    {
+		return glm::pickMatrix(_center, _size, _viewport);
+    }
+
     Transform Transform::operator*(const Transform& _rhs) const noexcept
 	{
 		Matrix4x4 m1 = m_mat *_rhs.m_mat; 
@@ -332,6 +337,7 @@ namespace RayTrace {
         ret.m_mediumInterface = si.m_mediumInterface;
         ret.m_uv = si.m_uv;
         ret.m_shape = si.m_shape;
+        ret.m_shapeId = si.m_shapeId;
         ret.m_dpdu = transformVector(si.m_dpdu);
         ret.m_dpdv = transformVector(si.m_dpdv);
         ret.m_dndu = transformNormal(si.m_dndu);
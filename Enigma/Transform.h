@@ -183,7 +183,7 @@ namespace RayTrace
 
 		const Transform* m_start = nullptr, 
 			            *m_end = nullptr;
-		const float      m_startTime = 0.0f, m_endTime = 1.0f;
+		float            m_startTime = 0.0f, m_endTime = 1.0f;
 		bool			 m_isAnimated = false;
 
 		Vector3f		 m_trans[2];
@@ -363,6 +363,8 @@ namespace RayTrace
     Matrix4x4 Perspective4x4(float fov, float aspect, float znear, float zfar);
 	Matrix4x4 Orthographic4x4(float _left, float _right, float _top, float _bottom, float _near, float _far);
 	Matrix4x4 Orthographic4x4( const Vector2i& _screenDims );
+	// Maps the window rectangle of _size_ around _center_ (y up) onto the whole clip space
+	Matrix4x4 PickMatrix4x4(const Vector2f& _center, const Vector2f& _size, const Vector4f& _viewport);
 
 	Matrix4x4 GetIdentity();
 
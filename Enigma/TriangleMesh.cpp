@@ -4,6 +4,7 @@
 #include "Texture.h"
 #include "Error.h"
 #include "ParameterSet.h"
+#include "SceneCache.h"
 
 
 #include "ext/rply.h"
@@ -215,17 +216,16 @@ namespace RayTrace
 	}
 	
 
-    bool Triangle::intersect(const Ray& ray, float* tHit, SurfaceInteraction* isect, bool testAlphaTexture) const
-    {        
-       
-        Vector3f b;
-        float t;
-        if( !intersects( ray, &t, &b))
-            return false;
+    bool ComputeTriangleInteraction(const TriangleMesh& mesh, int triNumber, const Vector3f& b, const Ray& ray,
+        bool reverseOrientation, bool transformSwapsHandedness, const Shape* shape, bool testAlphaTexture,
+        SurfaceInteraction* isect)
+    {
+        const uint32_t* v = &mesh.m_vertexIndices[3 * triNumber];
+        const int faceIndex = mesh.m_faceIndices.size() ? mesh.m_faceIndices[triNumber] : 0;
 
-        const Vector3f& p0 = m_pMesh->m_p[m_startIndex[0]];
-        const Vector3f& p1 = m_pMesh->m_p[m_startIndex[1]];
-        const Vector3f& p2 = m_pMesh->m_p[m_startIndex[2]];
+        const Vector3f& p0 = mesh.m_p[v[0]];
+        const Vector3f& p1 = mesh.m_p[v[1]];
+        const Vector3f& p2 = mesh.m_p[v[2]];
 
         float b0 = b[0];
         float b1 = b[1];
@@ -234,7 +234,16 @@ namespace RayTrace
         // Compute triangle partial derivatives
         Vector3f dpdu, dpdv;
         Vector2f uv[3];
-        getUVs(uv);
+        if (mesh.m_uv) {
+            uv[0] = mesh.m_uv[v[0]];
+            uv[1] = mesh.m_uv[v[1]];
+            uv[2] = mesh.m_uv[v[2]];
+        }
+        else {
+            uv[0] = Vector2f(0, 0);
+            uv[1] = Vector2f(1, 0);
+            uv[2] = Vector2f(1, 1);
+        }
 
         // Compute deltas for triangle partial derivatives
         Vector2f duv02 = uv[0] - uv[2], duv12 = uv[1] - uv[2];
@@ -271,31 +280,30 @@ namespace RayTrace
         Vector2f uvHit = b0 * uv[0] + b1 * uv[1] + b2 * uv[2];
 
         // Test intersection against alpha texture, if present
-        if (testAlphaTexture && m_pMesh->m_alphaMask) {
+        if (testAlphaTexture && mesh.m_alphaMask) {
             SurfaceInteraction isectLocal(pHit, Vector3f(0, 0, 0), uvHit, -ray.m_dir,
                 dpdu, dpdv, Vector3f(0, 0, 0),
-                Vector3f(0, 0, 0), ray.m_time, this);
-            if (m_pMesh->m_alphaMask->Evaluate(isectLocal) == 0) return false;
+                Vector3f(0, 0, 0), ray.m_time, shape);
+            if (mesh.m_alphaMask->Evaluate(isectLocal) == 0) return false;
         }
 
         // Fill in _SurfaceInteraction_ from triangle hit
         *isect = SurfaceInteraction(pHit, pError, uvHit, -ray.m_dir, dpdu, dpdv,
             Vector3f(0, 0, 0), Vector3f(0, 0, 0), ray.m_time,
-            this, m_faceIndex);
+            shape, faceIndex);
 
         // Override surface normal in _isect_ for triangle
         isect->m_n = isect->shading.m_n = Normalize(Cross(dp02, dp12));
-        if (m_reverseOrientation ^ m_transformSwapsHandedness)
+        if (reverseOrientation ^ transformSwapsHandedness)
             isect->m_n = isect->shading.m_n = -isect->m_n;
 
-        if (m_pMesh->m_n || m_pMesh->m_s) {
+        if (mesh.m_n || mesh.m_s) {
             // Initialize _Triangle_ shading geometry
 
             // Compute shading normal _ns_ for triangle
             Vector3f ns;
-            if (m_pMesh->m_n) {
-                Vector3f normals[3];
-                getNormals(normals);
+            if (mesh.m_n) {
+                const Vector3f normals[3] = { mesh.m_n[v[0]], mesh.m_n[v[1]], mesh.m_n[v[2]] };
                 ns = (b0 * normals[0] + b1 * normals[1] + b2 * normals[2]);
                 if (LengthSqr(ns) > 0)
                     ns = Normalize(ns);
@@ -307,9 +315,8 @@ namespace RayTrace
 
             // Compute shading tangent _ss_ for triangle
             Vector3f ss;
-            if (m_pMesh->m_s) {
-                Vector3f tang[3];
-                getTangents(tang);
+            if (mesh.m_s) {
+                const Vector3f tang[3] = { mesh.m_s[v[0]], mesh.m_s[v[1]], mesh.m_s[v[2]] };
 
                 ss = (b0 * tang[0] + b1 * tang[1] + b2 * tang[2]);
                 if (LengthSqr(ss) > 0)
@@ -331,10 +338,9 @@ namespace RayTrace
 
             // Compute $\dndu$ and $\dndv$ for triangle shading geometry
             Vector3f dndu, dndv;
-            if (m_pMesh->m_n)
+            if (mesh.m_n)
             {
-                Vector3f normals[3];
-                getNormals(normals);
+                const Vector3f normals[3] = { mesh.m_n[v[0]], mesh.m_n[v[1]], mesh.m_n[v[2]] };
                 
                 // Compute deltas for triangle partial derivatives of normal
                 Vector2f duv02 = uv[0] - uv[2];
@@ -366,9 +372,24 @@ namespace RayTrace
             }
             else
                 dndu = dndv = Vec3fZero;
-            if (m_reverseOrientation) ts = -ts;
+            if (reverseOrientation) ts = -ts;
             isect->SetShadingGeometry(ss, ts, dndu, dndv, true);
         }
+        return true;
+    }
+
+    bool Triangle::intersect(const Ray& ray, float* tHit, SurfaceInteraction* isect, bool testAlphaTexture) const
+    {        
+       
+        Vector3f b;
+        float t;
+        if( !intersects( ray, &t, &b))
+            return false;
+
+        const int triNumber = (int)(m_startIndex - m_pMesh->m_vertexIndices.data()) / 3;
+        if (!ComputeTriangleInteraction(*m_pMesh, triNumber, b, ray, m_reverseOrientation,
+                m_transformSwapsHandedness, this, testAlphaTexture, isect))
+            return false;
 
         *tHit = t;      
         return true;
@@ -490,10 +511,13 @@ namespace RayTrace
 
     bool Triangle::intersects(const Ray& ray, float* tHit, Vector3f* bOut) const
     {
-        const Vector3f& p0 = m_pMesh->m_p[m_startIndex[0]];
-        const Vector3f& p1 = m_pMesh->m_p[m_startIndex[1]];
-        const Vector3f& p2 = m_pMesh->m_p[m_startIndex[2]];
+        return IntersectTriangle(ray, m_pMesh->m_p[m_startIndex[0]], m_pMesh->m_p[m_startIndex[1]],
+            m_pMesh->m_p[m_startIndex[2]], tHit, bOut);
+    }
 
+    bool IntersectTriangle(const Ray& ray, const Vector3f& p0, const Vector3f& p1, const Vector3f& p2,
+        float* tHit, Vector3f* bOut)
+    {
         // Perform ray--triangle intersection test
 
         // Transform triangle vertices to ray coordinate space
@@ -631,6 +655,35 @@ namespace RayTrace
         return it;
     }
 
+    bool Triangle::normalBounds(Vector3f* axis, float* cosTheta) const
+    {
+        const Vector3f& p0 = m_pMesh->m_p[m_startIndex[0]];
+        const Vector3f& p1 = m_pMesh->m_p[m_startIndex[1]];
+        const Vector3f& p2 = m_pMesh->m_p[m_startIndex[2]];
+        Vector3f n = Cross(p1 - p0, p2 - p0);
+        if (LengthSqr(n) == 0)
+            return false;
+        n = Normalize(n);
+        // Same orientation as sample(), which faces the normal towards the interpolated shading
+        // normal. That only stays constant over the face when the vertex normals agree
+        if (m_pMesh->m_n) {
+            Vector3f normals[3];
+            getNormals(normals);
+            const float d0 = Dot(n, normals[0]);
+            const float d1 = Dot(n, normals[1]);
+            const float d2 = Dot(n, normals[2]);
+            if (d0 < 0 && d1 < 0 && d2 < 0)
+                n *= -1;
+            else if (!(d0 >= 0 && d1 >= 0 && d2 >= 0))
+                return false;
+        }
+        else if (m_reverseOrientation ^ m_transformSwapsHandedness)
+            n *= -1;
+        *axis = n;
+        *cosTheta = 1;
+        return true;
+    }
+
     float Triangle::solidAngle(const Vector3f& p, int nSamples) const
     {
         Vector3f pSphere[3] = {
@@ -665,19 +718,27 @@ namespace RayTrace
         int nVertices, const Vector3f* p, const Vector3f* s, const Vector3f* n,
         const Vector2f* uv, const std::shared_ptr<Texture<float>>& alphaMask,
         const std::shared_ptr<Texture<float>>& shadowAlphaMask,
-        const int* faceIndices, TriangleMeshPtr* _resultOut
+        const int* faceIndices, TriangleMeshPtr* _resultOut,
+        bool _createShapes
         ) {
         std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>(
             *ObjectToWorld, nTriangles, vertexIndices, nVertices, p, s, n, uv,
             alphaMask, shadowAlphaMask, faceIndices);
         if (_resultOut)
             *_resultOut = mesh;
+        if (!_createShapes)
+            return {};
+        return CreateTriangleShapes(ObjectToWorld, WorldToObject, reverseOrientation, mesh);
+    }
 
+    ShapesVector CreateTriangleShapes(const Transform* _o2w, const Transform* _w2o,
+        bool _reverseOrientation, const TriangleMeshPtr& _mesh)
+    {
         std::vector<std::shared_ptr<Shape>> tris;
-        tris.reserve(nTriangles);
-        for (int i = 0; i < nTriangles; ++i)
-            tris.push_back(std::make_shared<Triangle>(ObjectToWorld, WorldToObject,
-                reverseOrientation, mesh, i));
+        tris.reserve(_mesh->m_nTriangles);
+        for (int i = 0; i < _mesh->m_nTriangles; ++i)
+            tris.push_back(std::make_shared<Triangle>(_o2w, _w2o,
+                _reverseOrientation, _mesh, i));
         return tris;
     }
 #pragma endregion
@@ -685,7 +746,7 @@ namespace RayTrace
     ShapesVector CreateTriangleMeshShape(
 		const Transform* _o2w, const Transform* _w2o, 
 		bool _reverseOrientation, const ParamSet& _params, 
-		FloatTextureMap* _floatTextures, TriangleMeshPtr* _resultOut )
+		FloatTextureMap* _floatTextures, TriangleMeshPtr* _resultOut, bool _createShapes )
     {
         int nvi, npi, nuvi, nsi, nni;
         const int* vi = _params.FindInt("indices", &nvi);
@@ -783,29 +844,22 @@ namespace RayTrace
             shadowAlphaTex.reset(new ConstantTexture<float>(0.f));
 
         return CreateTriangleMesh(_o2w, _w2o, _reverseOrientation, nvi / 3, vi, npi, P,
-            S, N, uvs, alphaTex, shadowAlphaTex, faceIndices, _resultOut );
+            S, N, uvs, alphaTex, shadowAlphaTex, faceIndices, _resultOut, _createShapes );
     }
 
 
 
-    std::vector<std::shared_ptr<Shape>> CreatePLYMesh(
-        const Transform* o2w,
-        const Transform* w2o,
-        bool reverseOrientation,
-        const ParamSet& params,
-        FloatTextureMap* floatTextures,
-        TriangleMeshPtr* _resultOut 
-        ) {
-        const std::string filename = params.FindOneFilename("filename", "");
+    // Reads _filename_ into the arrays of _context_
+    static bool ReadPLYFile(const std::string& filename, CallbackContext* context) {
         p_ply ply = ply_open(filename.c_str(), rply_message_callback, 0, nullptr);
         if (!ply) {
             Error("Couldn't open PLY file \"%s\"", filename.c_str());
-            return std::vector<std::shared_ptr<Shape>>();
+            return false;
         }
 
         if (!ply_read_header(ply)) {
             Error("Unable to read the header of PLY file \"%s\"", filename.c_str());
-            return std::vector<std::shared_ptr<Shape>>();
+            return false;
         }
 
         p_ply_element element = nullptr;
@@ -826,74 +880,145 @@ namespace RayTrace
         if (vertexCount == 0 || faceCount == 0) {
             Error("%s: PLY file is invalid! No face/vertex elements found!",
                 filename.c_str());
-            return std::vector<std::shared_ptr<Shape>>();
+            return false;
         }
 
-        CallbackContext context;
-
-        if (ply_set_read_cb(ply, "vertex", "x", rply_vertex_callback, &context,
+        if (ply_set_read_cb(ply, "vertex", "x", rply_vertex_callback, context,
             0x030) &&
-            ply_set_read_cb(ply, "vertex", "y", rply_vertex_callback, &context,
+            ply_set_read_cb(ply, "vertex", "y", rply_vertex_callback, context,
                 0x031) &&
-            ply_set_read_cb(ply, "vertex", "z", rply_vertex_callback, &context,
+            ply_set_read_cb(ply, "vertex", "z", rply_vertex_callback, context,
                 0x032)) {
-            context.p = new Vector3f[vertexCount];
+            context->p = new Vector3f[vertexCount];
         }
         else {
             Error("%s: Vertex coordinate property not found!",
                 filename.c_str());
-            return std::vector<std::shared_ptr<Shape>>();
+            return false;
         }
 
-        if (ply_set_read_cb(ply, "vertex", "nx", rply_vertex_callback, &context,
+        if (ply_set_read_cb(ply, "vertex", "nx", rply_vertex_callback, context,
             0x130) &&
-            ply_set_read_cb(ply, "vertex", "ny", rply_vertex_callback, &context,
+            ply_set_read_cb(ply, "vertex", "ny", rply_vertex_callback, context,
                 0x131) &&
-            ply_set_read_cb(ply, "vertex", "nz", rply_vertex_callback, &context,
+            ply_set_read_cb(ply, "vertex", "nz", rply_vertex_callback, context,
                 0x132))
-            context.n = new Vector3f[vertexCount];
+            context->n = new Vector3f[vertexCount];
 
         /* There seem to be lots of different conventions regarding UV coordinate
          * names */
-        if ((ply_set_read_cb(ply, "vertex", "u", rply_vertex_callback, &context,
+        if ((ply_set_read_cb(ply, "vertex", "u", rply_vertex_callback, context,
             0x220) &&
-            ply_set_read_cb(ply, "vertex", "v", rply_vertex_callback, &context,
+            ply_set_read_cb(ply, "vertex", "v", rply_vertex_callback, context,
                 0x221)) ||
-            (ply_set_read_cb(ply, "vertex", "s", rply_vertex_callback, &context,
+            (ply_set_read_cb(ply, "vertex", "s", rply_vertex_callback, context,
                 0x220) &&
-                ply_set_read_cb(ply, "vertex", "t", rply_vertex_callback, &context,
+                ply_set_read_cb(ply, "vertex", "t", rply_vertex_callback, context,
                     0x221)) ||
             (ply_set_read_cb(ply, "vertex", "texture_u", rply_vertex_callback,
-                &context, 0x220) &&
+                context, 0x220) &&
                 ply_set_read_cb(ply, "vertex", "texture_v", rply_vertex_callback,
-                    &context, 0x221)) ||
+                    context, 0x221)) ||
             (ply_set_read_cb(ply, "vertex", "texture_s", rply_vertex_callback,
-                &context, 0x220) &&
+                context, 0x220) &&
                 ply_set_read_cb(ply, "vertex", "texture_t", rply_vertex_callback,
-                    &context, 0x221)))
-            context.uv = new Vector2f[vertexCount];
+                    context, 0x221)))
+            context->uv = new Vector2f[vertexCount];
 
         /* Allocate enough space in case all faces are quads */
-        context.indices = new int[faceCount * 6];
-        context.vertexCount = vertexCount;
+        context->indices = new int[faceCount * 6];
+        context->vertexCount = vertexCount;
 
-        ply_set_read_cb(ply, "face", "vertex_indices", rply_face_callback, &context,
+        ply_set_read_cb(ply, "face", "vertex_indices", rply_face_callback, context,
             0);
-        if (ply_set_read_cb(ply, "face", "face_indices", rply_face_callback, &context,
+        if (ply_set_read_cb(ply, "face", "face_indices", rply_face_callback, context,
             1))
             // Extra space in case they're quads
-            context.faceIndices = new int[faceCount];
+            context->faceIndices = new int[faceCount];
 
         if (!ply_read(ply)) {
             Error("%s: unable to read the contents of PLY file",
                 filename.c_str());
             ply_close(ply);
-            return std::vector<std::shared_ptr<Shape>>();
+            return false;
         }
 
         ply_close(ply);
 
-        if (context.error) return std::vector<std::shared_ptr<Shape>>();
+        return !context->error;
+    }
+
+    std::vector<std::shared_ptr<Shape>> CreatePLYMesh(
+        const Transform* o2w,
+        const Transform* w2o,
+        bool reverseOrientation,
+        const ParamSet& params,
+        FloatTextureMap* floatTextures,
+        TriangleMeshPtr* _resultOut,
+        bool _createShapes
+        ) {
+        const std::string filename = params.FindOneFilename("filename", "");
+
+        // Parsed meshes are cached keyed by the PLY file contents, see SceneCache.h
+        // Chunks: vertex indices, P, N, uv, face indices, the optional ones may be empty
+        bool cacheable = false;
+        uint64_t cacheKey = 0;
+        std::unique_ptr<MappedFile> cacheFile;
+        std::vector<SceneCacheChunk> chunks;
+        if (!GetSceneCacheDirectory().empty()) {
+            if (std::unique_ptr<MappedFile> plyFile = MappedFile::Open(filename)) {
+                cacheable = true;
+                cacheKey = HashBytes(plyFile->data(), plyFile->size());
+                cacheFile = ReadSceneCache("ply", cacheKey, &chunks);
+            }
+        }
+        if (cacheFile) {
+            const size_t nVertices = chunks.size() == 5 ? chunks[1].size / sizeof(Vector3f) : 0;
+            const size_t nTriangles = chunks.size() == 5 ? chunks[0].size / (3 * sizeof(int)) : 0;
+            if (nVertices == 0 || nTriangles == 0 ||
+                chunks[0].size != nTriangles * 3 * sizeof(int) ||
+                chunks[1].size != nVertices * sizeof(Vector3f) ||
+                (chunks[2].size != 0 && chunks[2].size != nVertices * sizeof(Vector3f)) ||
+                (chunks[3].size != 0 && chunks[3].size != nVertices * sizeof(Vector2f)) ||
+                (chunks[4].size != 0 && chunks[4].size != nTriangles * sizeof(int)))
+                cacheFile.reset();
+        }
+
+        CallbackContext context;
+        const int* indices;
+        const Vector3f *p, *n;
+        const Vector2f* uv;
+        const int* faceIndices;
+        int nTriangles, nVertices;
+        if (cacheFile) {
+            auto chunkData = [&](int i) { return chunks[i].size > 0 ? chunks[i].data : nullptr; };
+            indices = (const int*)chunkData(0);
+            p = (const Vector3f*)chunkData(1);
+            n = (const Vector3f*)chunkData(2);
+            uv = (const Vector2f*)chunkData(3);
+            faceIndices = (const int*)chunkData(4);
+            nTriangles = int(chunks[0].size / (3 * sizeof(int)));
+            nVertices = int(chunks[1].size / sizeof(Vector3f));
+        }
+        else {
+            if (!ReadPLYFile(filename, &context))
+                return std::vector<std::shared_ptr<Shape>>();
+            indices = context.indices;
+            p = context.p;
+            n = context.n;
+            uv = context.uv;
+            faceIndices = context.faceIndices;
+            nTriangles = context.indexCtr / 3;
+            nVertices = context.vertexCount;
+            if (cacheable && (!faceIndices || context.faceIndexCtr >= nTriangles)) {
+                WriteSceneCache("ply", cacheKey, {
+                    { indices, size_t(nTriangles) * 3 * sizeof(int) },
+                    { p, size_t(nVertices) * sizeof(Vector3f) },
+                    { n, n ? size_t(nVertices) * sizeof(Vector3f) : 0 },
+                    { uv, uv ? size_t(nVertices) * sizeof(Vector2f) : 0 },
+                    { faceIndices, faceIndices ? size_t(nTriangles) * sizeof(int) : 0 } });
+            }
+        }
 
         // Look up an alpha texture, if applicable
         std::shared_ptr<Texture<float>> alphaTex;
@@ -924,10 +1049,10 @@ namespace RayTrace
             shadowAlphaTex.reset(new ConstantTexture<float>(0.f));
 
         return CreateTriangleMesh(o2w, w2o, reverseOrientation,
-            context.indexCtr / 3, context.indices,
-            vertexCount, context.p, nullptr, context.n,
-            context.uv, alphaTex, shadowAlphaTex,
-            context.faceIndices, _resultOut);
+            nTriangles, indices,
+            nVertices, p, nullptr, n,
+            uv, alphaTex, shadowAlphaTex,
+            faceIndices, _resultOut, _createShapes);
     }
 
 
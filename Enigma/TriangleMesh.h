@@ -60,6 +60,7 @@ namespace RayTrace
         // Returns the solid angle subtended by the triangle w.r.t. the given
         // reference point p.
         float                       solidAngle(const Vector3f& p, int nSamples) const;
+        bool                        normalBounds(Vector3f* axis, float* cosTheta) const;
 
     private:
         // Triangle Private Methods
@@ -76,14 +77,28 @@ namespace RayTrace
         int             m_faceIndex;
     };
  
+    // Watertight ray-triangle test, _tHit_ and _bOut_ (barycentrics) are optional
+    bool IntersectTriangle(const Ray& ray, const Vector3f& p0, const Vector3f& p1, const Vector3f& p2,
+        float* tHit, Vector3f* bOut);
+
+    // Interaction at barycentrics _b_ of face _triNumber_, false for degenerate faces and, with
+    // _testAlphaTexture_, for hits cut away by the alpha mask. _shape_ may be nullptr
+    bool ComputeTriangleInteraction(const TriangleMesh& mesh, int triNumber, const Vector3f& b, const Ray& ray,
+        bool reverseOrientation, bool transformSwapsHandedness, const Shape* shape, bool testAlphaTexture,
+        SurfaceInteraction* isect);
+
+    // With _createShapes_ false only the mesh is created and returned through _resultOut_
     ShapesVector CreatePLYMesh(
         const Transform* o2w, const Transform* w2o, bool reverseOrientation,
         const ParamSet& params, FloatTextureMap* _textureMap = nullptr, 
-        TriangleMeshPtr* _resultOut = nullptr);
+        TriangleMeshPtr* _resultOut = nullptr, bool _createShapes = true);
        
 	
 	ShapesVector  CreateTriangleMeshShape(const Transform* _o2w, const Transform* _w2o,
 			bool _reverseOrientation, const ParamSet& _param, FloatTextureMap* _textureMap, 
-            TriangleMeshPtr* _resultOut = nullptr );
+            TriangleMeshPtr* _resultOut = nullptr, bool _createShapes = true );
+
+    ShapesVector  CreateTriangleShapes(const Transform* _o2w, const Transform* _w2o,
+            bool _reverseOrientation, const TriangleMeshPtr& _mesh);
 
 }
\ No newline at end of file
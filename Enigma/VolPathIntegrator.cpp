@@ -42,7 +42,7 @@ namespace RayTrace
         UNUSED(sampler)
     }
 
-    Spectrum VolPathIntegrator::Li(const RayDifferential& _ray, const Scene& _scene, Sampler& _sampler, MemoryArena& _arena, int _depth) const
+    Spectrum VolPathIntegrator::Li(const RayDifferential& _ray, const Scene& _scene, Sampler& _sampler, MemoryArena& _arena, int _depth, const SurfaceInteraction* _primaryHit) const
     {
         UNUSED(_depth)
         
@@ -63,7 +63,13 @@ namespace RayTrace
         for (bounces = 0;; ++bounces) {
             // Intersect _ray_ with scene and store intersection in _isect_
             SurfaceInteraction isect;
-            bool foundIntersection = _scene.intersect(ray, &isect);
+            bool foundIntersection;
+            if (bounces == 0 && _primaryHit) {
+                isect = *_primaryHit;
+                foundIntersection = _primaryHit->m_primitive != nullptr;
+            }
+            else
+                foundIntersection = _scene.intersect(ray, &isect);
 
             // Sample the participating medium, if present
             MediumInteraction mi;
@@ -76,9 +82,8 @@ namespace RayTrace
                 if (bounces >= m_maxDepth) break;
                
                 // Handle scattering at point in medium for volumetric path tracer
-                const Distribution1D* lightDistrib = m_lightDistribution->Lookup(mi.m_p);
                 L += beta * UniformSampleOneLight(mi, _scene, _arena, _sampler, true,
-                    lightDistrib);
+                    m_lightDistribution.get());
 
                 Vector3f wo = -ray.m_dir, wi;
                 mi.phase->Sample_p(wo, &wi, _sampler.Get2D());
@@ -112,10 +117,8 @@ namespace RayTrace
 
                 // Sample illumination from lights to find attenuated path
                 // contribution
-                const Distribution1D* lightDistrib =
-                    m_lightDistribution->Lookup(isect.m_p);
                 L += beta * UniformSampleOneLight(isect, _scene, _arena, _sampler,
-                    true, lightDistrib);
+                    true, m_lightDistribution.get());
 
                 // Sample BSDF to get new path direction
                 Vector3f wo = -ray.m_dir, wi;
@@ -149,7 +152,7 @@ namespace RayTrace
                     // component
                     L += beta *
                         UniformSampleOneLight(pi, _scene, _arena, _sampler, true,
-                            m_lightDistribution->Lookup(pi.m_p));
+                            m_lightDistribution.get());
 
                     // Account for the indirect subsurface scattering component
                     Spectrum f2 = pi.m_bsdf->sample_f(pi.m_wo, &wi, _sampler.Get2D(),
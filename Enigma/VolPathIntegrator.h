@@ -15,7 +15,8 @@ namespace RayTrace
 
         void        Preprocess(const Scene& _scene, Sampler& _sampler) override;
         Spectrum    Li(const RayDifferential& _ray, const Scene& _scene,
-            Sampler& _sampler, MemoryArena& _arena, int _depth) const override;
+            Sampler& _sampler, MemoryArena& _arena, int _depth,
+            const SurfaceInteraction* _primaryHit = nullptr) const override;
 
     private:
         // VolPathIntegrator Private Data
@@ -0,0 +1,424 @@
+#include <algorithm>
+#include "Ray.h"
+#include "Camera.h"
+#include "Scene.h"
+#include "Sample.h"
+#include "Sampler.h"
+#include "MonteCarlo.h"
+#include "Primitive.h"
+#include "BxDF.h"
+#include "Interaction.h"
+#include "Film.h"
+#include "LightDist.h"
+#include "Error.h"
+#include "ParameterSet.h"
+#include "Spectrum.h"
+#include "Concurrency.h"
+
+#include "WavefrontPathIntegrator.h"
+
+namespace RayTrace
+{
+    static constexpr int WavefrontBatchSize = 4096;
+
+    // Sample dimensions recorded per path when it is generated. Each bounce draws at most
+    // 4 1D and 7 2D samples (light choice, light, MIS, BSDF, roulette and the BSSRDF probe with
+    // its own light and BSDF samples); bounces past SampledBounces use a per path hash instead
+    static constexpr int SampledBounces = 4;
+    static constexpr int Samples1DPerPath = 4 * SampledBounces;
+    static constexpr int Samples2DPerPath = 7 * SampledBounces;
+
+    struct WavefrontPath
+    {
+        RayDifferential     m_ray;
+        SurfaceInteraction  m_isect;
+        Spectrum            m_L;
+        Spectrum            m_beta;
+        Vector2f            m_pFilm;
+        float               m_rayWeight;
+        float               m_etaScale;
+        int                 m_bounces;
+        bool                m_specularBounce;
+        int                 m_next1D,
+                            m_next2D;
+        uint64_t            m_hashState;
+    };
+
+    // Shadow ray of a light sample, _m_Ld_ is added to the path if it is unoccluded
+    struct WavefrontShadowRay
+    {
+        VisibilityTester    m_tester;
+        Spectrum            m_Ld;
+        int                 m_path;
+    };
+
+    struct PathWavefront
+    {
+        std::vector<WavefrontPath>      m_paths;
+        std::vector<float>              m_samples1D;
+        std::vector<Vector2f>           m_samples2D;
+        std::vector<int>                m_active;       // paths with a ray to trace
+        std::vector<int>                m_shade;        // paths with a hit to shade
+        std::vector<WavefrontShadowRay> m_shadowRays;
+        MemoryArena                     m_arena;
+
+        PathWavefront()
+            : m_paths(WavefrontBatchSize)
+            , m_samples1D(WavefrontBatchSize * Samples1DPerPath)
+            , m_samples2D(WavefrontBatchSize * Samples2DPerPath)
+        {
+            m_active.reserve(WavefrontBatchSize);
+            m_shade.reserve(WavefrontBatchSize);
+            m_shadowRays.reserve(WavefrontBatchSize);
+        }
+    };
+
+    // Hands a path the samples recorded for it from the tile sampler, in the order it asks for
+    // them, so paths can be advanced in any order. Only valid while the path is being shaded
+    class PathSampleReplay : public Sampler
+    {
+    public:
+        PathSampleReplay(WavefrontPath& path, const float* samples1D, const Vector2f* samples2D)
+            : Sampler(1)
+            , m_path(path)
+            , m_samples1D(samples1D)
+            , m_samples2D(samples2D)
+        {
+        }
+
+        float Get1D() override
+        {
+            if (m_path.m_next1D < Samples1DPerPath)
+                return m_samples1D[m_path.m_next1D++];
+            return hashedFloat();
+        }
+
+        Vector2f Get2D() override
+        {
+            if (m_path.m_next2D < Samples2DPerPath)
+                return m_samples2D[m_path.m_next2D++];
+            float u = hashedFloat();
+            return Vector2f(u, hashedFloat());
+        }
+
+        std::unique_ptr<Sampler> Clone(int seed) const override
+        {
+            return std::unique_ptr<Sampler>(new PathSampleReplay(m_path, m_samples1D, m_samples2D));
+        }
+
+    private:
+        float hashedFloat()
+        {
+            // SplitMix64
+            uint64_t z = (m_path.m_hashState += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            z ^= z >> 31;
+            return std::min(OneMinusEpsilon, float(z >> 40) * 0x1p-24f);
+        }
+
+        WavefrontPath&      m_path;
+        const float*        m_samples1D;
+        const Vector2f*     m_samples2D;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // WavefrontPathIntegrator
+    //////////////////////////////////////////////////////////////////////////
+    WavefrontPathIntegrator::WavefrontPathIntegrator(int maxDepth, std::shared_ptr<Camera> camera,
+        std::shared_ptr<Sampler> sampler, const BBox2i& pixelBounds,
+        float rrThreshold /*= 1*/, const std::string& lightSampleStrategy /*= "spatial"*/)
+        : m_camera(camera)
+        , m_sampler(sampler)
+        , m_pixelBounds(pixelBounds)
+        , m_maxDepth(maxDepth)
+        , m_rrThreshold(rrThreshold)
+        , m_lightSampleStrategy(lightSampleStrategy)
+    {
+
+    }
+
+    WavefrontPathIntegrator::~WavefrontPathIntegrator()
+    {
+
+    }
+
+    void WavefrontPathIntegrator::Render(const Scene& scene)
+    {
+        m_lightDistribution = CreateLightSampleDistribution(m_lightSampleStrategy, scene);
+
+        BBox2i   sampleBounds = m_camera->m_film->GetSampleBounds();
+        Vector2i sampleExtent = sampleBounds.diagonal();
+        Vector2i nTiles((sampleExtent.x + TileSize - 1) / TileSize,
+                        (sampleExtent.y + TileSize - 1) / TileSize);
+
+        // The path buffers are a few MB, every thread keeps its own for all of its tiles
+        std::vector<std::unique_ptr<PathWavefront>> wavefronts(MaxThreadIndex());
+
+        ParallelFor2D([&](Vector2i tile) {
+            std::unique_ptr<PathWavefront>& wavefront = wavefronts[ThreadIndex()];
+            if (!wavefront)
+                wavefront.reset(new PathWavefront);
+
+            int seed = tile.y * nTiles.x + tile.x;
+            std::unique_ptr<Sampler> tileSampler = m_sampler->Clone(seed);
+            int x0 = sampleBounds.m_min.x + tile.x * TileSize;
+            int x1 = std::min(x0 + TileSize, sampleBounds.m_max.x);
+            int y0 = sampleBounds.m_min.y + tile.y * TileSize;
+            int y1 = std::min(y0 + TileSize, sampleBounds.m_max.y);
+            BBox2i tileBounds(Vector2i(x0, y0), Vector2i(x1, y1));
+            std::unique_ptr<FilmTile> filmTile = m_camera->m_film->GetFilmTile(tileBounds);
+
+            int     pixelIndex = 0;
+            int64_t sampleNumber = 0;
+            while (generatePaths(*wavefront, *tileSampler, tileBounds, pixelIndex, sampleNumber) > 0)
+                tracePaths(*wavefront, scene, *filmTile);
+            m_camera->m_film->MergeFilmTile(std::move(filmTile));
+        }, nTiles);
+
+        // Save final image after rendering
+        m_camera->m_film->WriteImage(1.0f / m_sampler->m_samplesPerPixel);
+    }
+
+    int WavefrontPathIntegrator::generatePaths(PathWavefront& wavefront, Sampler& sampler, const BBox2i& tileBounds,
+        int& pixelIndex, int64_t& sampleNumber) const
+    {
+        const int tileWidth = tileBounds.m_max.x - tileBounds.m_min.x;
+        const int nPixels = tileWidth * (tileBounds.m_max.y - tileBounds.m_min.y);
+        wavefront.m_active.clear();
+        int nPaths = 0;
+        while (nPaths < WavefrontBatchSize && pixelIndex < nPixels) {
+            Vector2i pixel(tileBounds.m_min.x + pixelIndex % tileWidth, tileBounds.m_min.y + pixelIndex / tileWidth);
+            if (!m_pixelBounds.insideExclusive(pixel)) {
+                ++pixelIndex;
+                continue;
+            }
+            // A pixel split between two batches resumes at its next sample
+            sampler.StartPixel(pixel);
+            if (sampleNumber > 0)
+                sampler.SetSampleNumber(sampleNumber);
+
+            bool moreSamples = true;
+            while (moreSamples && nPaths < WavefrontBatchSize) {
+                WavefrontPath& path = wavefront.m_paths[nPaths];
+                CameraSample cameraSample = sampler.GetCameraSample(pixel);
+                path.m_rayWeight = m_camera->GenerateRayDifferential(cameraSample, &path.m_ray);
+                path.m_ray.scaleDifferentials(1 / std::sqrt((float)sampler.m_samplesPerPixel));
+                path.m_pFilm = cameraSample.m_image;
+                path.m_L = Spectrum(0.f);
+                path.m_beta = Spectrum(1.f);
+                path.m_etaScale = 1;
+                path.m_bounces = 0;
+                path.m_specularBounce = false;
+                path.m_next1D = path.m_next2D = 0;
+                path.m_hashState = ((uint64_t)(pixel.y * 65536 + pixel.x) << 32) ^ (uint64_t)sampler.CurrentSampleNumber();
+                for (int i = 0; i < Samples1DPerPath; ++i)
+                    wavefront.m_samples1D[nPaths * Samples1DPerPath + i] = sampler.Get1D();
+                for (int i = 0; i < Samples2DPerPath; ++i)
+                    wavefront.m_samples2D[nPaths * Samples2DPerPath + i] = sampler.Get2D();
+                wavefront.m_active.push_back(nPaths);
+                ++nPaths;
+                moreSamples = sampler.StartNextSample();
+            }
+            if (moreSamples)
+                sampleNumber = sampler.CurrentSampleNumber();
+            else {
+                sampleNumber = 0;
+                ++pixelIndex;
+            }
+        }
+        return nPaths;
+    }
+
+    void WavefrontPathIntegrator::tracePaths(PathWavefront& wavefront, const Scene& scene, FilmTile& filmTile) const
+    {
+        std::vector<int>& active = wavefront.m_active;
+        const size_t nPaths = active.size();
+
+        // Paths the camera couldn't generate a ray for only contribute their weight
+        active.erase(std::remove_if(active.begin(), active.end(),
+            [&](int p) { return wavefront.m_paths[p].m_rayWeight <= 0; }), active.end());
+
+        while (!active.empty()) {
+            // Intersect all rays of the wavefront as packets
+            for (size_t k0 = 0; k0 < active.size(); k0 += RayPacketSize) {
+                const int          nRays = (int)std::min<size_t>(RayPacketSize, active.size() - k0);
+                Ray                packet[RayPacketSize];
+                SurfaceInteraction hits[RayPacketSize];
+                for (int i = 0; i < nRays; ++i)
+                    packet[i] = wavefront.m_paths[active[k0 + i]].m_ray;
+                uint32_t hitMask = scene.intersect8(packet, hits, (1u << nRays) - 1);
+                for (int i = 0; i < nRays; ++i) {
+                    WavefrontPath& path = wavefront.m_paths[active[k0 + i]];
+                    path.m_ray.m_maxT = packet[i].m_maxT;
+                    path.m_isect = (hitMask & (1u << i)) ? hits[i] : SurfaceInteraction();
+                }
+            }
+
+            // Add emitted light and retire the paths that escaped or reached _maxDepth_
+            std::vector<int>& shade = wavefront.m_shade;
+            shade.clear();
+            for (int p : active) {
+                WavefrontPath& path = wavefront.m_paths[p];
+                const bool foundIntersection = path.m_isect.m_primitive != nullptr;
+                if (path.m_bounces == 0 || path.m_specularBounce) {
+                    if (foundIntersection)
+                        path.m_L += path.m_beta * path.m_isect.Le(-path.m_ray.m_dir);
+                    else
+                        for (const auto& light : scene.m_infiniteLights)
+                            path.m_L += path.m_beta * light->Le(path.m_ray);
+                }
+                if (foundIntersection && path.m_bounces < m_maxDepth)
+                    shade.push_back(p);
+            }
+
+            // Group the hits by material so each one's BSDF and texture code runs back to back
+            std::sort(shade.begin(), shade.end(), [&](int a, int b) {
+                const Material* ma = wavefront.m_paths[a].m_isect.m_primitive->getMaterial();
+                const Material* mb = wavefront.m_paths[b].m_isect.m_primitive->getMaterial();
+                return ma != mb ? ma < mb : a < b;
+            });
+            shadePaths(wavefront, scene);
+            wavefront.m_arena.Reset();
+        }
+
+        for (size_t i = 0; i < nPaths; ++i) {
+            const WavefrontPath& path = wavefront.m_paths[i];
+            Spectrum L = path.m_L;
+            if (L.HasNaNs() || L.y() < -1e-5 || std::isinf(L.y()))
+                L = Spectrum(0.f);
+            filmTile.AddSample(path.m_pFilm, L, path.m_rayWeight);
+        }
+    }
+
+    void WavefrontPathIntegrator::shadePaths(PathWavefront& wavefront, const Scene& scene) const
+    {
+        MemoryArena& arena = wavefront.m_arena;
+        std::vector<int>& active = wavefront.m_active;
+        std::vector<WavefrontShadowRay>& shadowRays = wavefront.m_shadowRays;
+        const eBxDFType nonSpecular = eBxDFType(BSDF_ALL & ~BSDF_SPECULAR);
+        const int nLights = scene.getNumLights();
+
+        // Compute scattering functions and sample one light per path, the shadow rays are queued
+        active.clear();
+        shadowRays.clear();
+        for (int p : wavefront.m_shade) {
+            WavefrontPath& path = wavefront.m_paths[p];
+            SurfaceInteraction& isect = path.m_isect;
+            isect.ComputeScatteringFunctions(path.m_ray, arena, true);
+            if (!isect.m_bsdf) {
+                // Skip over medium boundaries without counting a bounce
+                path.m_ray = isect.SpawnRay(path.m_ray.m_dir);
+                active.push_back(p);
+                continue;
+            }
+            if (nLights == 0 || isect.m_bsdf->numComponents(nonSpecular) == 0)
+                continue;
+
+            PathSampleReplay sampler(path, &wavefront.m_samples1D[p * Samples1DPerPath], &wavefront.m_samples2D[p * Samples2DPerPath]);
+            float lightPdf;
+            int lightNum = m_lightDistribution->SampleLight(isect, sampler.Get1D(), &lightPdf);
+            Vector2f uLight = sampler.Get2D();
+            Vector2f uScattering = sampler.Get2D();
+            if (lightNum < 0 || lightPdf == 0)
+                continue;
+            const Light& light = *scene.getLight(lightNum);
+
+            WavefrontShadowRay shadowRay;
+            shadowRay.m_Ld = SampleLightDirect(isect, light, uLight, nonSpecular, &shadowRay.m_tester);
+            if (!shadowRay.m_Ld.IsBlack()) {
+                shadowRay.m_Ld *= path.m_beta / lightPdf;
+                shadowRay.m_path = p;
+                shadowRays.push_back(shadowRay);
+            }
+            if (!IsDeltaLight(light.m_flags))
+                path.m_L += path.m_beta * SampleBSDFDirect(isect, uScattering, light, scene, sampler, false, nonSpecular) / lightPdf;
+        }
+
+        // Trace the queued shadow rays as packets
+        for (size_t k0 = 0; k0 < shadowRays.size(); k0 += RayPacketSize) {
+            VisibilityTester testers[RayPacketSize];
+            const int nTests = (int)std::min<size_t>(RayPacketSize, shadowRays.size() - k0);
+            for (int i = 0; i < nTests; ++i)
+                testers[i] = shadowRays[k0 + i].m_tester;
+            uint32_t visible = VisibilityTester::Unoccluded(testers, nTests, scene);
+            for (int i = 0; i < nTests; ++i)
+                if (visible & (1u << i))
+                    wavefront.m_paths[shadowRays[k0 + i].m_path].m_L += shadowRays[k0 + i].m_Ld;
+        }
+
+        // Sample the BSDFs to continue the paths
+        for (int p : wavefront.m_shade) {
+            WavefrontPath& path = wavefront.m_paths[p];
+            SurfaceInteraction& isect = path.m_isect;
+            if (!isect.m_bsdf)
+                continue;
+            PathSampleReplay sampler(path, &wavefront.m_samples1D[p * Samples1DPerPath], &wavefront.m_samples2D[p * Samples2DPerPath]);
+            // Keep the light sample dimensions of this bounce reserved whether or not they were used
+            path.m_next1D = std::max(path.m_next1D, std::min(Samples1DPerPath, 4 * path.m_bounces + 1));
+            path.m_next2D = std::max(path.m_next2D, std::min(Samples2DPerPath, 7 * path.m_bounces + 2));
+
+            Vector3f wo = -path.m_ray.m_dir, wi;
+            float pdf;
+            eBxDFType flags;
+            Spectrum f = isect.m_bsdf->sample_f(wo, &wi, sampler.Get2D(), &pdf, BSDF_ALL, &flags);
+            if (f.IsBlack() || pdf == 0.f)
+                continue;
+            path.m_beta *= f * AbsDot(wi, isect.shading.m_n) / pdf;
+            path.m_specularBounce = (flags & BSDF_SPECULAR) != 0;
+            if ((flags & BSDF_SPECULAR) && (flags & BSDF_TRANSMISSION)) {
+                float eta = isect.m_bsdf->m_eta;
+                path.m_etaScale *= (Dot(wo, isect.m_n) > 0) ? (eta * eta) : 1 / (eta * eta);
+            }
+            path.m_ray = isect.SpawnRay(wi);
+
+            // Account for subsurface scattering, if applicable
+            if (isect.m_bssrdf && (flags & BSDF_TRANSMISSION)) {
+                SurfaceInteraction pi;
+                Spectrum S = isect.m_bssrdf->Sample_S(
+                    scene, sampler.Get1D(), sampler.Get2D(), arena, &pi, &pdf);
+                if (S.IsBlack() || pdf == 0)
+                    continue;
+                path.m_beta *= S / pdf;
+
+                // The probe's direct lighting is rare enough to trace its shadow ray right away
+                path.m_L += path.m_beta * UniformSampleOneLight(pi, scene, arena, sampler, false, m_lightDistribution.get());
+
+                Spectrum f = pi.m_bsdf->sample_f(pi.m_wo, &wi, sampler.Get2D(), &pdf, BSDF_ALL, &flags);
+                if (f.IsBlack() || pdf == 0)
+                    continue;
+                path.m_beta *= f * AbsDot(wi, pi.shading.m_n) / pdf;
+                path.m_specularBounce = (flags & BSDF_SPECULAR) != 0;
+                path.m_ray = pi.SpawnRay(wi);
+            }
+
+            // Possibly terminate the path with Russian roulette.
+            // Factor out radiance scaling due to refraction in rrBeta.
+            Spectrum rrBeta = path.m_beta * path.m_etaScale;
+            if (rrBeta.MaxComponentValue() < m_rrThreshold && path.m_bounces > 3) {
+                float q = std::max((float).05f, 1.0f - rrBeta.MaxComponentValue());
+                if (sampler.Get1D() < q)
+                    continue;
+                path.m_beta /= 1 - q;
+            }
+            ++path.m_bounces;
+            path.m_next1D = std::max(path.m_next1D, std::min(Samples1DPerPath, 4 * path.m_bounces));
+            path.m_next2D = std::max(path.m_next2D, std::min(Samples2DPerPath, 7 * path.m_bounces));
+            active.push_back(p);
+        }
+    }
+
+
+    Integrator* CreateWavefrontPathIntegrator(const ParamSet& _param, const CameraPtr& _cam, const SamplerPtr& _sampler)
+    {
+        int maxDepth = _param.FindOneInt("maxdepth", 5);
+        int np;
+        const int* pb = _param.FindInt("pixelbounds", &np);
+        BBox2i pixelBounds = _cam->GetFilm().GetSampleBounds();
+        if (pb && np == 4)
+            pixelBounds = Intersection(pixelBounds, BBox2i{ {pb[0], pb[2]}, {pb[1], pb[3]} });
+        float rrThreshold = _param.FindOneFloat("rrthreshold", 1.);
+        std::string lightStrategy = _param.FindOneString("lightsamplestrategy", "spatial");
+        return new WavefrontPathIntegrator(maxDepth, _cam, _sampler, pixelBounds, rrThreshold, lightStrategy);
+    }
+}
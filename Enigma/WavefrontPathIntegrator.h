@@ -0,0 +1,46 @@
+#pragma once
+
+
+#include "Integrator.h"
+
+namespace RayTrace
+{
+    struct PathWavefront;
+
+    // WavefrontPathIntegrator Declarations
+    // Same estimator as PathIntegrator, but each tile advances a batch of paths one stage at a
+    // time: intersect all rays as packets, add emission, shade the hits sorted by material, sample
+    // the lights, trace the shadow rays as packets and finally sample the BSDFs. Consecutive
+    // paths then run the same material and texture code and touch the same BVH nodes.
+    class WavefrontPathIntegrator : public Integrator {
+    public:
+        // WavefrontPathIntegrator Public Methods
+        WavefrontPathIntegrator(int maxDepth, std::shared_ptr<Camera> camera,
+            std::shared_ptr<Sampler> sampler,
+            const  BBox2i& pixelBounds, float rrThreshold = 1,
+            const std::string& lightSampleStrategy = "spatial");
+        ~WavefrontPathIntegrator();
+
+        void                Render(const Scene& scene) override;
+        const CameraPtr&    GetCamera() const override { return m_camera; }
+
+    private:
+        // Fills _wavefront_ with up to WavefrontBatchSize camera paths of _tileBounds_, resuming
+        // at _pixelIndex_/_sampleNumber_. Returns the number of paths generated
+        int                 generatePaths(PathWavefront& wavefront, Sampler& sampler, const BBox2i& tileBounds,
+                                int& pixelIndex, int64_t& sampleNumber) const;
+        void                tracePaths(PathWavefront& wavefront, const Scene& scene, FilmTile& filmTile) const;
+        void                shadePaths(PathWavefront& wavefront, const Scene& scene) const;
+
+        // WavefrontPathIntegrator Private Data
+        CameraPtr           m_camera;
+        SamplerPtr          m_sampler;
+        const BBox2i        m_pixelBounds;
+        const int           m_maxDepth;
+        const float         m_rrThreshold;
+        const std::string   m_lightSampleStrategy;
+        std::unique_ptr<LightDistribution> m_lightDistribution;
+    };
+
+    Integrator* CreateWavefrontPathIntegrator(const ParamSet& _param, const CameraPtr& _cam, const SamplerPtr& _sampler);
+}
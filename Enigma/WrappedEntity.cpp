@@ -4,6 +4,7 @@
 #include "Modifiers.h"
 #include "Geometry.h"
 #include "ResourceManager.h"
+#include "SceneManager.h"
 #include "WrappedEntity.h"
 
 namespace RayTrace
@@ -79,6 +80,15 @@ namespace RayTrace
         return pEntity;
     }
 
+    void WrappedEntity::ObjectModified()
+    {
+        ObjectBase::ObjectModified();
+        //components, visibility or material may have changed, render lists have to be rebuilt
+        GetContext().GetSceneManager().MarkModified();
+        GetContext().GetSceneManager().UpdateBounds(this);
+        GetContext().GetSceneManager().SyncRenderScene({ this });
+    }
+
     const Entity& WrappedEntity::GetEntity() const
     {
         return m_entity;
@@ -101,6 +111,24 @@ namespace RayTrace
         return BBox3f( Vector3f(0.0f), Vector3f(0.0f));        
     }
 
+    BBox3f WrappedEntity::GetWorldBoundingBox() const
+    {
+        const auto bounds = GetBoundingBox();
+        const auto transComp = GetComponent<TransformComponent>();
+        if (!transComp)
+            return bounds;
+
+        //transform center and extent, the extent along each world axis sums the absolute matrix entries
+        const auto& m = transComp->m_transform;
+        const Vector3f center = bounds.getCenter();
+        const Vector3f extent = bounds.diagonal() * 0.5f;
+        const Vector3f worldCenter = ToVector3(m * Vector4f(center, 1.0f));
+        Vector3f worldExtent;
+        for (int i = 0; i < 3; ++i)
+            worldExtent[i] = std::abs(m[0][i]) * extent.x + std::abs(m[1][i]) * extent.y + std::abs(m[2][i]) * extent.z;
+        return BBox3f(worldCenter - worldExtent, worldCenter + worldExtent);
+    }
+
     Vector3f WrappedEntity::GetPosition() const
     {
         if (auto transComp = GetComponent<TransformComponent>())
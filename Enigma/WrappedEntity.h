@@ -20,6 +20,8 @@ namespace RayTrace
 
         WrappedEntity*          Clone() const override;
 
+        void                    ObjectModified() override;
+
         const Entity&           GetEntity() const;
 
         const Matrix4x4&        GetWorldTransform() const;
@@ -28,6 +30,8 @@ namespace RayTrace
 
         BBox3f                  GetBoundingBox() const;
 
+        BBox3f                  GetWorldBoundingBox() const;
+
         Vector3f                GetPosition() const;
 
         Vector3f                GetIconColor() const;
@@ -97,8 +101,10 @@ namespace RayTrace
 	bool WrappedEntity::RemoveComponent()
 	{
 		auto retval = GetContext().GetComponentSystem().RemoveComponent<T>(m_entity);
-		if (retval)
+		if (retval) {
 			Initialize();
+			ObjectModified();
+		}
 		return retval;
 	}
 
@@ -113,6 +119,7 @@ namespace RayTrace
 	{
 		auto retval = GetContext().GetComponentSystem().CreateComponent<T>(m_entity);
 		Initialize();
+		ObjectModified();
 		return retval;
 	}
 
@@ -121,6 +128,7 @@ namespace RayTrace
 	{
 		auto retval = GetContext().GetComponentSystem().CreateComponents<Targs...>(m_entity);
 		Initialize();
+		ObjectModified();
 		return retval;
 	}
 